@@ -30,13 +30,40 @@ cbuffer SceneData : register(b0)
     matrix viewMatrix, projectionMatrix; // viewing info
 };
 
+// one slot of the level's per frame constant ring per draw
 cbuffer MeshData : register(b1)
 {
     matrix worldMatrix;
-    ATTRIBUTES materials;
-    
+    uint materialIndex;
 };
 
+// every material of the level, uploaded once
+StructuredBuffer<ATTRIBUTES> materialTable : register(t0);
+
+// the level's point and spot lights (clustered_lights.h)
+struct LIGHT
+{
+    float3 position;
+    float range;
+    float3 direction;
+    float spotScale;
+    float3 color;
+    float spotOffset;
+};
+
+// froxel grid the lights were binned into this frame, lightCount 0 without lights
+cbuffer ClusterData : register(b2)
+{
+    uint3 clusterCount;
+    uint lightCount;
+    float sliceScale, sliceBias;
+};
+
+StructuredBuffer<LIGHT> lights : register(t2);
+// per cluster: where its lights start in clusterLights and how many there are
+StructuredBuffer<uint2> clusterRanges : register(t3);
+StructuredBuffer<uint> clusterLights : register(t4);
+
 struct OutputToRasterizer
 {
     float4 posH : SV_POSITION; // position in homogenous projection space
@@ -44,13 +71,43 @@ struct OutputToRasterizer
     float3 normW : NORMAL;     // normal in world space (for lighting)
 };
 
+// screen tile and exponential depth slice of a world space position
+uint ClusterOf(float3 posW)
+{
+    float4 view = mul(float4(posW, 1), viewMatrix);
+    float4 clip = mul(view, projectionMatrix);
+    float2 tile = (clip.xy / clip.w * 0.5f + 0.5f) * float2(clusterCount.xy);
+    uint x = (uint)clamp(tile.x, 0, clusterCount.x - 1);
+    uint y = (uint)clamp(tile.y, 0, clusterCount.y - 1);
+    uint z = (uint)clamp(log(view.z) * sliceScale + sliceBias, 0, clusterCount.z - 1);
+    return x + clusterCount.x * (y + clusterCount.y * z);
+}
+
 float4 main(OutputToRasterizer output) : SV_TARGET
 {
+    ATTRIBUTES materials = materialTable[materialIndex];
+
     // normalize the normal and store in a variable
     float3 norm = normalize(output.normW);
     
     // direct light energy based on light type and surface normal/position
     float3 direct = saturate(dot(norm, -lightDirc.xyz)) * lightColor.xyz;
+
+    // plus the point and spot lights binned into this pixel's cluster
+    if (lightCount > 0)
+    {
+        uint2 range = clusterRanges[ClusterOf(output.posW)];
+        for (uint i = 0; i < range.y; ++i)
+        {
+            LIGHT light = lights[clusterLights[range.x + i]];
+            float3 toLight = light.position - output.posW;
+            float distanceSquared = dot(toLight, toLight);
+            float3 lightDir = toLight * rsqrt(max(distanceSquared, 0.000001f));
+            float falloff = saturate(1 - distanceSquared / (light.range * light.range));
+            float spot = saturate(dot(-lightDir, light.direction) * light.spotScale + light.spotOffset);
+            direct += saturate(dot(norm, lightDir)) * falloff * falloff * spot * spot * light.color;
+        }
+    }
    
     // indirect light from ambient light attribute (attenuated if point/spot)
     float3 indirect = saturate(materials.Ka * sunAmbient.xyz);
@@ -3,10 +3,23 @@
 
 struct My_Vert
 {
+#ifdef USE_COMPACT_VERTICES
+    // unorm16 steps across the asset's bounds, half uv, octahedral normal
+    float4 position : POSITION;
+    float2 uv : LOCATION;
+    float2 normal : NORMAL;
+#else
     float3 position : POSITION; 
     float3 uv : LOCATION; 
     float3 normal : NORMAL;
-
+#endif
+#ifdef USE_INSTANCING
+    // per instance world matrix rows (input slot 1)
+    float4 world0 : INSTANCE_WORLD0;
+    float4 world1 : INSTANCE_WORLD1;
+    float4 world2 : INSTANCE_WORLD2;
+    float4 world3 : INSTANCE_WORLD3;
+#endif
 };
 
 struct ATTRIBUTES {
@@ -29,12 +42,35 @@ cbuffer SceneData : register(b0)
     matrix viewMatrix, projectionMatrix; // viewing info
 };
 
+// one slot of the level's per frame constant ring per draw
 cbuffer MeshData : register(b1)
 {
     matrix worldMatrix;
-    ATTRIBUTES materials;
-    
+    uint materialIndex;
+    uint boundsIndex;
+};
+
+// every material of the level, uploaded once
+StructuredBuffer<ATTRIBUTES> materialTable : register(t0);
+
+#ifdef USE_COMPACT_VERTICES
+// per asset quantization of the compact positions
+struct POSITION_BOUNDS {
+    float3 scale;
+    float padding0;
+    float3 offset;
+    float padding1;
 };
+StructuredBuffer<POSITION_BOUNDS> positionBounds : register(t1);
+
+float3 OctahedralDecode(float2 encoded)
+{
+    float3 normal = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float t = saturate(-normal.z);
+    normal.xy += (normal.xy >= 0.0f) ? -t : t;
+    return normalize(normal);
+}
+#endif
 
 struct OutputToRasterizer
 {
@@ -48,8 +84,24 @@ OutputToRasterizer main(My_Vert inputVertex)
 {
 
     OutputToRasterizer _output = { float4(0.0f, 0.0f, 0.0f, 0.0f), float3(0.0f, 0.0f, 0.0f), float3(0.0f, 0.0f, 0.0f) };
+
+#ifdef USE_INSTANCING
+    // instanced draws stream the world matrix, MeshData only supplies the material
+    float4x4 world = float4x4(inputVertex.world0, inputVertex.world1, inputVertex.world2, inputVertex.world3);
+#else
+    float4x4 world = worldMatrix;
+#endif
    
-    float4 worldOut = mul(float4(inputVertex.position, 1.0f), worldMatrix); 
+#ifdef USE_COMPACT_VERTICES
+    POSITION_BOUNDS bounds = positionBounds[boundsIndex];
+    float3 position = bounds.offset + inputVertex.position.xyz * bounds.scale;
+    float3 normal = OctahedralDecode(inputVertex.normal);
+#else
+    float3 position = inputVertex.position;
+    float3 normal = inputVertex.normal;
+#endif
+
+    float4 worldOut = mul(float4(position, 1.0f), world); 
     float4 viewOut = mul(worldOut, viewMatrix);
     float4 projectionOut = mul(viewOut, projectionMatrix);
    
@@ -57,7 +109,7 @@ OutputToRasterizer main(My_Vert inputVertex)
     
     _output.posH = projectionOut;
     
-    float3 normalVal = mul(inputVertex.normal, (float3x3)worldMatrix);
+    float3 normalVal = mul(normal, (float3x3)world);
    
     _output.normW = normalize(normalVal);
 
@@ -0,0 +1,259 @@
+#ifndef _ASSET_CACHE_H_
+#define _ASSET_CACHE_H_
+// Reference counted cache of parsed .h2b files keyed by their resolved path.
+// Every placed copy of "Wall_Modular" shares one parsed asset (and one range
+// of the level's shared GPU geometry), instances only keep the handle plus
+// their world matrix. Simplified levels of detail are appended to the asset's
+// own vertices/indices, so they share its range of the GPU geometry too.
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "h2bParser.h"
+#include "job_system.h"
+#include "level_of_detail.h"
+#include "profiler.h"
+
+namespace Level {
+
+	typedef unsigned AssetHandle;
+	static const AssetHandle INVALID_ASSET = 0xFFFFFFFF;
+
+	struct ASSET_STATS {
+		unsigned uniqueAssets;	// assets currently cached
+		unsigned instances;		// live references to those assets
+		unsigned parses;		// .h2b files parsed since creation, failed opens not included
+		unsigned failedParses;	// .h2b files that could not be loaded, each remembered as missing
+		unsigned uploads;		// assets uploaded to the GPU since creation
+		unsigned lodAssets;		// cached assets with simplified levels
+		size_t residentBytes;	// vertex/index bytes held once per asset
+		size_t bytesSaved;		// bytes a copy per instance would have cost on top
+	};
+
+	class AssetCache
+	{
+		struct Entry {
+			std::string path;
+			H2B::Parser cpuModel;
+			ASSET_LODS lods;
+			unsigned refCount = 0;
+			bool uploaded = false;
+			bool lodsBuilt = false;
+			size_t bytes = 0;
+		};
+		// index is the handle, freed slots are nullptr until reused
+		std::vector<std::unique_ptr<Entry>> entries;
+		std::vector<AssetHandle> freeSlots;
+		std::unordered_map<std::string, AssetHandle> lookup;
+		// paths that failed to load, so 100 copies of a missing mesh only hit the disk once
+		std::set<std::string> missing;
+		unsigned parses = 0;
+		unsigned failedParses = 0;
+		unsigned uploads = 0;
+	public:
+		// cache key for a .h2b path ("../Models/./x.h2b" and "../Models/x.h2b" match)
+		static std::string ResolvePath(const std::string& h2bPath)
+		{
+			std::error_code error;
+			std::filesystem::path resolved = std::filesystem::weakly_canonical(h2bPath, error);
+			if (error)
+				resolved = std::filesystem::path(h2bPath).lexically_normal();
+			return resolved.generic_string();
+		}
+
+		// Returns the cached asset for this file (loading it on first use)
+		// and adds a reference, INVALID_ASSET if it can not be loaded.
+		AssetHandle Acquire(const std::string& h2bPath)
+		{
+			std::string key = ResolvePath(h2bPath);
+			auto found = lookup.find(key);
+			if (found != lookup.end()) {
+				++entries[found->second]->refCount;
+				return found->second;
+			}
+			if (missing.count(key) != 0)
+				return INVALID_ASSET;
+
+			std::unique_ptr<Entry> entry(new Entry);
+			bool parsed;
+			{
+				LEVEL_PROFILE_SCOPE("Parse h2b");
+				parsed = entry->cpuModel.Parse(h2bPath.c_str());
+			}
+			return Insert(key, std::move(entry), parsed);
+		}
+
+		// Acquire for many files at once, the path resolution and parsing of the files
+		// that are not cached yet is spread over jobs (if given). handles[i] belongs to
+		// h2bPaths[i] and holds a reference like Acquire's.
+		std::vector<AssetHandle> AcquireAll(const std::vector<std::string>& h2bPaths, JobSystem* jobs = nullptr)
+		{
+			const unsigned count = static_cast<unsigned>(h2bPaths.size());
+			std::vector<std::string> keys(count);
+			ParallelFor(jobs, count, 4, [&](unsigned begin, unsigned end) {
+				for (unsigned i = begin; i < end; ++i)
+					keys[i] = ResolvePath(h2bPaths[i]);
+			});
+			// first path of every new key gets parsed, later duplicates just reference it
+			std::unordered_map<std::string, unsigned> firstUse;
+			std::vector<unsigned> toParse;
+			for (unsigned i = 0; i < count; ++i)
+				if (lookup.count(keys[i]) == 0 && missing.count(keys[i]) == 0 && firstUse.emplace(keys[i], i).second)
+					toParse.push_back(i);
+			std::vector<std::unique_ptr<Entry>> loaded(count);
+			std::vector<char> parsed(count, 0);
+			ParallelFor(jobs, static_cast<unsigned>(toParse.size()), 1, [&](unsigned begin, unsigned end) {
+				for (unsigned j = begin; j < end; ++j) {
+					unsigned i = toParse[j];
+					LEVEL_PROFILE_SCOPE("Parse h2b");
+					loaded[i].reset(new Entry);
+					parsed[i] = loaded[i]->cpuModel.Parse(h2bPaths[i].c_str());
+				}
+			});
+
+			std::vector<AssetHandle> handles(count, INVALID_ASSET);
+			for (unsigned i = 0; i < count; ++i) {
+				if (loaded[i] != nullptr)
+					handles[i] = Insert(keys[i], std::move(loaded[i]), parsed[i] != 0);
+				else if (lookup.count(keys[i]) != 0)
+					handles[i] = AddReference(lookup[keys[i]]);
+			}
+			return handles;
+		}
+
+		// one more reference to an asset that is already held
+		AssetHandle AddReference(AssetHandle handle)
+		{
+			if (IsValid(handle))
+				++entries[handle]->refCount;
+			return handle;
+		}
+
+	private:
+		// adds a freshly parsed file with one reference (or remembers it failed)
+		AssetHandle Insert(const std::string& key, std::unique_ptr<Entry> entry, bool parsed)
+		{
+			LEVEL_PROFILE_COUNT("models loaded", parsed ? 1 : 0);
+			if (parsed == false) {
+				++failedParses;
+				missing.insert(key);
+				return INVALID_ASSET;
+			}
+			++parses;
+			entry->path = key;
+			entry->refCount = 1;
+			BaseLods(entry->cpuModel, entry->lods);
+			entry->bytes = sizeof(H2B::VERTEX) * entry->cpuModel.vertices.size() +
+				sizeof(unsigned) * entry->cpuModel.indices.size();
+
+			AssetHandle handle;
+			if (freeSlots.empty()) {
+				handle = static_cast<AssetHandle>(entries.size());
+				entries.push_back(std::move(entry));
+			}
+			else {
+				handle = freeSlots.back();
+				freeSlots.pop_back();
+				entries[handle] = std::move(entry);
+			}
+			lookup[key] = handle;
+			return handle;
+		}
+
+	public:
+
+		// Simplified levels for the given assets that have none yet. Assets already
+		// uploaded keep what they have, their geometry is on the GPU. jobs (optional)
+		// simplifies several assets at once.
+		void BuildLods(const std::vector<AssetHandle>& handles, const LOD_OPTIONS& options = LOD_OPTIONS(),
+			JobSystem* jobs = nullptr)
+		{
+			LEVEL_PROFILE_SCOPE("Build LODs");
+			std::vector<Entry*> toBuild;
+			for (AssetHandle handle : handles)
+				if (IsValid(handle) && !entries[handle]->uploaded && !entries[handle]->lodsBuilt) {
+					entries[handle]->lodsBuilt = true;
+					toBuild.push_back(entries[handle].get());
+				}
+			ParallelFor(jobs, static_cast<unsigned>(toBuild.size()), 1, [&](unsigned begin, unsigned end) {
+				for (unsigned i = begin; i < end; ++i) {
+					GenerateLods(toBuild[i]->cpuModel, toBuild[i]->lods, options);
+					toBuild[i]->bytes = sizeof(H2B::VERTEX) * toBuild[i]->cpuModel.vertices.size() +
+						sizeof(unsigned) * toBuild[i]->cpuModel.indices.size();
+				}
+			});
+		}
+
+		// Drops one reference, returns true if that destroyed the asset
+		// (the caller should then free any GPU copy it made of it).
+		bool Release(AssetHandle handle)
+		{
+			if (IsValid(handle) == false)
+				return false;
+			if (--entries[handle]->refCount > 0)
+				return false;
+			lookup.erase(entries[handle]->path);
+			entries[handle].reset();
+			freeSlots.push_back(handle);
+			return true;
+		}
+
+		// forget failed loads so the next level retries them
+		void ForgetMissing() {
+			missing.clear();
+		}
+
+		bool IsValid(AssetHandle handle) const {
+			return handle < entries.size() && entries[handle] != nullptr;
+		}
+		const H2B::Parser& Get(AssetHandle handle) const {
+			return entries[handle]->cpuModel;
+		}
+		// level 0 is the asset's meshes, see BuildLods for the rest
+		const ASSET_LODS& Lods(AssetHandle handle) const {
+			return entries[handle]->lods;
+		}
+		const std::string& Path(AssetHandle handle) const {
+			return entries[handle]->path;
+		}
+		unsigned RefCount(AssetHandle handle) const {
+			return IsValid(handle) ? entries[handle]->refCount : 0;
+		}
+		// every valid handle is below this
+		size_t Capacity() const {
+			return entries.size();
+		}
+
+		// GPU buffers are made once per asset, not once per instance
+		bool NeedsUpload(AssetHandle handle) const {
+			return IsValid(handle) && entries[handle]->uploaded == false;
+		}
+		void MarkUploaded(AssetHandle handle) {
+			if (IsValid(handle) && entries[handle]->uploaded == false) {
+				entries[handle]->uploaded = true;
+				++uploads;
+			}
+		}
+
+		ASSET_STATS GetStats() const
+		{
+			ASSET_STATS stats = {};
+			stats.parses = parses;
+			stats.failedParses = failedParses;
+			stats.uploads = uploads;
+			for (const auto& entry : entries) {
+				if (entry == nullptr)
+					continue;
+				++stats.uniqueAssets;
+				stats.instances += entry->refCount;
+				stats.lodAssets += entry->lods.count > 1 ? 1 : 0;
+				stats.residentBytes += entry->bytes;
+				stats.bytesSaved += entry->bytes * (entry->refCount - 1);
+			}
+			return stats;
+		}
+	};
+}
+#endif
@@ -0,0 +1,161 @@
+#ifndef _BATCH_MATH_H_
+#define _BATCH_MATH_H_
+// Per instance math over many instances at once. World matrices and boxes are
+// kept as structure of arrays (one array per component) so simd.h can run
+// Simd::LANES instances per instruction: boxes to world space, the 6 plane
+// frustum test and view space depth. Every lane does the same operations in
+// the same order as the scalar functions in culling.h (no fused multiply-add),
+// so the results are bit for bit the scalar ones; the instances after the last
+// full vector go through those scalar functions.
+#include <vector>
+#include "culling.h"
+#include "level_file.h"
+#include "simd.h"
+
+namespace Level {
+
+	// boxes as 6 arrays
+	struct BOUNDS_SOA {
+		std::vector<float> min[3], max[3];
+
+		unsigned Size() const {
+			return static_cast<unsigned>(min[0].size());
+		}
+		void Resize(unsigned count) {
+			for (int a = 0; a < 3; ++a) {
+				min[a].resize(count);
+				max[a].resize(count);
+			}
+		}
+		void Set(unsigned i, const AABB& bounds) {
+			for (int a = 0; a < 3; ++a) {
+				min[a][i] = bounds.min[a];
+				max[a][i] = bounds.max[a];
+			}
+		}
+		AABB Get(unsigned i) const {
+			return { { min[0][i], min[1][i], min[2][i] }, { max[0][i], max[1][i], max[2][i] } };
+		}
+	};
+
+	// affine row vector matrices as 12 arrays, row[r][c] is data[r * 4 + c] (row 3 is the translation)
+	struct MATRICES_SOA {
+		std::vector<float> row[4][3];
+
+		unsigned Size() const {
+			return static_cast<unsigned>(row[0][0].size());
+		}
+		void Resize(unsigned count) {
+			for (auto& r : row)
+				for (std::vector<float>& column : r)
+					column.resize(count);
+		}
+		void Set(unsigned i, const MATRIX& matrix) {
+			for (int r = 0; r < 4; ++r)
+				for (int c = 0; c < 3; ++c)
+					row[r][c][i] = matrix.data[r * 4 + c];
+		}
+		MATRIX Get(unsigned i) const {
+			MATRIX matrix = IdentityMatrix();
+			for (int r = 0; r < 4; ++r)
+				for (int c = 0; c < 3; ++c)
+					matrix.data[r * 4 + c] = row[r][c][i];
+			return matrix;
+		}
+	};
+
+	// depth of the box's center along the view's z axis (scalar reference)
+	inline float ViewDepth(const AABB& bounds, const MATRIX& view)
+	{
+		float depth = view.data[14];
+		for (int i = 0; i < 3; ++i)
+			depth += (bounds.min[i] + bounds.max[i]) * 0.5f * view.data[i * 4 + 2];
+		return depth;
+	}
+
+	// out[i] = TransformBounds(local[i], world[i]) for i in [begin, end), out must be sized already
+	inline void TransformBounds(const BOUNDS_SOA& local, const MATRICES_SOA& world, BOUNDS_SOA& out, unsigned begin, unsigned end)
+	{
+		using namespace Simd;
+		const FLOATS half = Set(0.5f);
+		unsigned i = begin;
+		for (; i + LANES <= end; i += LANES) {
+			FLOATS center[3], extent[3];
+			for (int a = 0; a < 3; ++a) {
+				FLOATS low = Load(&local.min[a][i]), high = Load(&local.max[a][i]);
+				center[a] = (low + high) * half;
+				extent[a] = (high - low) * half;
+			}
+			for (int c = 0; c < 3; ++c) {
+				FLOATS worldCenter = Load(&world.row[3][c][i]), worldExtent = Set(0.0f);
+				for (int r = 0; r < 3; ++r) {
+					FLOATS m = Load(&world.row[r][c][i]);
+					worldCenter = worldCenter + center[r] * m;
+					worldExtent = worldExtent + extent[r] * Abs(m);
+				}
+				Store(&out.min[c][i], worldCenter - worldExtent);
+				Store(&out.max[c][i], worldCenter + worldExtent);
+			}
+		}
+		for (; i < end; ++i)
+			out.Set(i, TransformBounds(local.Get(i), world.Get(i)));
+	}
+
+	// results[i] = TestBounds(frustum, bounds[i], all planes) for i in [begin, end), returns how many are not outside
+	inline unsigned CullBounds(const FRUSTUM& frustum, const BOUNDS_SOA& bounds, unsigned char* results, unsigned begin, unsigned end)
+	{
+		using namespace Simd;
+		const FLOATS zero = Set(0.0f);
+		unsigned visible = 0, i = begin;
+		for (; i + LANES <= end; i += LANES) {
+			FLOATS low[3], high[3];
+			for (int a = 0; a < 3; ++a) {
+				low[a] = Load(&bounds.min[a][i]);
+				high[a] = Load(&bounds.max[a][i]);
+			}
+			MASK outside = All(false), inside = All(true);
+			for (const float* plane : frustum.planes) {
+				// the corners only depend on the plane, one select per axis for the whole vector
+				FLOATS furthest = Set(plane[3]), nearest = furthest;
+				for (int a = 0; a < 3; ++a) {
+					FLOATS normal = Set(plane[a]);
+					furthest = furthest + normal * (plane[a] > 0 ? high[a] : low[a]);
+					nearest = nearest + normal * (plane[a] > 0 ? low[a] : high[a]);
+				}
+				outside = Or(outside, Less(furthest, zero));
+				inside = And(inside, GreaterEqual(nearest, zero));
+			}
+			const int outsideBits = Bits(outside), insideBits = Bits(inside);
+			for (int lane = 0; lane < LANES; ++lane) {
+				CULL_RESULT result = (outsideBits >> lane) & 1 ? CULL_OUTSIDE : (insideBits >> lane) & 1 ? CULL_INSIDE : CULL_INTERSECTS;
+				results[i + lane] = static_cast<unsigned char>(result);
+				visible += result != CULL_OUTSIDE;
+			}
+		}
+		for (; i < end; ++i) {
+			unsigned planeMask = 0x3F;
+			CULL_RESULT result = TestBounds(frustum, bounds.Get(i), planeMask);
+			results[i] = static_cast<unsigned char>(result);
+			visible += result != CULL_OUTSIDE;
+		}
+		return visible;
+	}
+
+	// depths[i] = ViewDepth(bounds[i], view) for i in [begin, end)
+	inline void ViewDepths(const MATRIX& view, const BOUNDS_SOA& bounds, float* depths, unsigned begin, unsigned end)
+	{
+		using namespace Simd;
+		const FLOATS half = Set(0.5f), origin = Set(view.data[14]);
+		const FLOATS axis[3] = { Set(view.data[2]), Set(view.data[6]), Set(view.data[10]) };
+		unsigned i = begin;
+		for (; i + LANES <= end; i += LANES) {
+			FLOATS depth = origin;
+			for (int a = 0; a < 3; ++a)
+				depth = depth + (Load(&bounds.min[a][i]) + Load(&bounds.max[a][i])) * half * axis[a];
+			Store(depths + i, depth);
+		}
+		for (; i < end; ++i)
+			depths[i] = ViewDepth(bounds.Get(i), view);
+	}
+}
+#endif
@@ -0,0 +1,449 @@
+#ifndef _CLUSTERED_LIGHTS_H_
+#define _CLUSTERED_LIGHTS_H_
+// Clustered forward lighting for the level's point and spot lights. The view
+// frustum is cut into a grid of froxels: tiles across the screen times
+// exponential depth slices between the projection's near and far planes.
+// Every frame the lights are moved to view space and binned, one job per depth
+// slice: a slice walks the lights in order, keeps the columns and rows of
+// clusters the light's bounding sphere reaches along that axis alone and tests
+// the light against each of those clusters' boxes (spot cones also against the
+// cluster's bounding sphere). After a prefix sum over the per cluster counts
+// every slice writes its lists into place, so each cluster's list is in light
+// order, the lists testing every light against every cluster gives
+// (BinBruteForce, the reference). PixelShader.hlsl finds its pixel's cluster
+// (ClusterOf) and only loops over that cluster's lights.
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "culling.h"
+#include "job_system.h"
+#include "level_math.h"
+#include "scene_constants.h"
+
+namespace Level {
+
+	enum class LIGHT_TYPE { POINT, SPOT };
+
+	// one of the level's lights, world space
+	struct LIGHT {
+		LIGHT_TYPE type;
+		FLOAT3 position;
+		FLOAT3 direction;	// spot only, unit length
+		FLOAT3 color;
+		float range;		// nothing past this distance is lit
+		float innerAngle;	// spot only, half angles in radians, full light inside inner,
+		float outerAngle;	// fading out to none at outer
+	};
+
+	// the exporter only writes a LIGHT's name and transform, the rest comes from here
+	struct LIGHT_DEFAULTS {
+		FLOAT3 color = { 1.0f, 0.9f, 0.75f };
+		float range = 10.0f;
+		float spotAngle = 0.3927f;	// half angle, Blender's default spot is 45 degrees wide
+		float spotBlend = 0.15f;	// part of the cone that fades out
+	};
+
+	// a LIGHT record: a spot if "spot" is in its name (any case), a point light otherwise.
+	// row 2 of the exported transform is the direction Blender's light points in (its -z axis)
+	inline LIGHT LightFromRecord(const std::string& name, const MATRIX& transform, const LIGHT_DEFAULTS& defaults = LIGHT_DEFAULTS())
+	{
+		std::string lower = name;
+		for (char& c : lower)
+			c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		LIGHT light;
+		light.type = lower.find("spot") != std::string::npos ? LIGHT_TYPE::SPOT : LIGHT_TYPE::POINT;
+		light.position = { transform.data[12], transform.data[13], transform.data[14] };
+		light.direction = Normalize({ transform.data[8], transform.data[9], transform.data[10] });
+		light.color = defaults.color;
+		light.range = defaults.range;
+		light.outerAngle = defaults.spotAngle;
+		light.innerAngle = defaults.spotAngle * (1.0f - defaults.spotBlend);
+		return light;
+	}
+
+	// what the pixel shader reads for a light
+	inline LIGHT_CONSTANTS LightConstants(const LIGHT& light)
+	{
+		LIGHT_CONSTANTS constants = {};
+		const float* position = &light.position.x;
+		const float* direction = &light.direction.x;
+		const float* color = &light.color.x;
+		for (int i = 0; i < 3; ++i) {
+			constants.position[i] = position[i];
+			constants.direction[i] = direction[i];
+			constants.color[i] = color[i];
+		}
+		constants.range = light.range;
+		constants.spotScale = 0.0f;
+		constants.spotOffset = 1.0f;
+		if (light.type == LIGHT_TYPE::SPOT) {
+			const float cosOuter = std::cos(light.outerAngle), cosInner = std::cos(light.innerAngle);
+			constants.spotScale = 1.0f / std::max(cosInner - cosOuter, 0.0001f);
+			constants.spotOffset = -cosOuter * constants.spotScale;
+		}
+		return constants;
+	}
+
+	// cluster of a world space position, PixelShader.hlsl's ClusterOf
+	inline unsigned ClusterOf(const CLUSTER_CONSTANTS& clusters, const float world[3], const MATRIX& view, const MATRIX& projection)
+	{
+		float viewPosition[4], clip[4];
+		TransformPoint(world, view, viewPosition);
+		for (int c = 0; c < 4; ++c)
+			clip[c] = viewPosition[0] * projection.data[c] + viewPosition[1] * projection.data[4 + c] +
+				viewPosition[2] * projection.data[8 + c] + viewPosition[3] * projection.data[12 + c];
+		auto cell = [](float value, unsigned count) {
+			return value > 0.0f ? static_cast<unsigned>(std::min(value, static_cast<float>(count - 1))) : 0u;
+		};
+		const unsigned x = cell((clip[0] / clip[3] * 0.5f + 0.5f) * clusters.clusterCount[0], clusters.clusterCount[0]);
+		const unsigned y = cell((clip[1] / clip[3] * 0.5f + 0.5f) * clusters.clusterCount[1], clusters.clusterCount[1]);
+		const unsigned z = cell(std::log(viewPosition[2]) * clusters.sliceScale + clusters.sliceBias, clusters.clusterCount[2]);
+		return x + clusters.clusterCount[0] * (y + clusters.clusterCount[1] * z);
+	}
+
+	struct CLUSTER_OPTIONS {
+		unsigned tilesX = 16;	// clusters across the screen
+		unsigned tilesY = 9;	// and up it
+		unsigned slices = 24;	// exponential depth slices between the near and far planes
+	};
+
+	struct CLUSTER_STATS {
+		unsigned lights;		// binned
+		unsigned clusters;		// in the grid
+		unsigned occupied;		// clusters with at least one light
+		unsigned entries;		// light list entries over all clusters
+		unsigned maxPerCluster;
+		unsigned long long tests;	// light against cluster tests
+		double binMs;
+	};
+
+	class LightClusters
+	{
+		// a light in view space: the sphere around everything it lights and, for spots, the cone
+		struct VIEW_LIGHT {
+			float center[3], radius;
+			float apex[3], axis[3];
+			float range, cosAngle, sinAngle;
+			bool spot;
+		};
+		// a cluster's view space box and the sphere around it
+		struct CLUSTER_BOUNDS {
+			AABB box;
+			float center[3], radius;
+		};
+		// clusters (index within the slice) and lights a slice found, in light order
+		struct SLICE {
+			std::vector<unsigned> clusters, lights;
+			std::vector<unsigned> counts;	// per cluster of the slice, then where its next light goes
+			unsigned long long tests = 0;
+		};
+
+		CLUSTER_OPTIONS options;
+		// the grid, rebuilt when the projection changes
+		bool gridValid = false;
+		MATRIX gridProjection = IdentityMatrix();
+		float nearPlane = 0.0f, farPlane = 0.0f;
+		std::vector<float> sliceDepth;				// slices + 1 planes
+		std::vector<float> columnMin, columnMax;	// view space x per slice and column, [slice * tilesX + column]
+		std::vector<float> rowMin, rowMax;			// y per slice and row
+		std::vector<CLUSTER_BOUNDS> bounds;			// x + tilesX * (y + tilesY * slice)
+		// this frame
+		std::vector<VIEW_LIGHT> viewLights;
+		std::vector<SLICE> sliceResults;
+		std::vector<CLUSTER_RANGE> ranges;
+		std::vector<unsigned> indices;
+		CLUSTER_STATS stats = {};
+
+		static float AxisDistance(float low, float high, float at) {
+			return std::max(std::max(low - at, at - high), 0.0f);
+		}
+
+		// does the light reach into the cluster, the one test both ways of binning use
+		static bool Touches(const VIEW_LIGHT& light, const CLUSTER_BOUNDS& cluster)
+		{
+			float distance = 0.0f;
+			for (int a = 0; a < 3; ++a) {
+				const float d = AxisDistance(cluster.box.min[a], cluster.box.max[a], light.center[a]);
+				distance += d * d;
+			}
+			if (distance > light.radius * light.radius)
+				return false;
+			if (!light.spot)
+				return true;
+			// the cone against the cluster's sphere: in front of the apex, not past the range, not outside the side
+			float v[3], lengthSquared = 0.0f, along = 0.0f;
+			for (int a = 0; a < 3; ++a) {
+				v[a] = cluster.center[a] - light.apex[a];
+				lengthSquared += v[a] * v[a];
+				along += v[a] * light.axis[a];
+			}
+			const float side = light.cosAngle * std::sqrt(std::max(lengthSquared - along * along, 0.0f)) - along * light.sinAngle;
+			return !(side > cluster.radius || along > cluster.radius + light.range || along < -cluster.radius);
+		}
+
+		static VIEW_LIGHT ToView(const LIGHT& light, const MATRIX& view)
+		{
+			VIEW_LIGHT result;
+			float position[4];
+			TransformPoint(&light.position.x, view, position);
+			const float* direction = &light.direction.x;
+			for (int c = 0; c < 3; ++c) {
+				result.apex[c] = result.center[c] = position[c];
+				result.axis[c] = direction[0] * view.data[c] + direction[1] * view.data[4 + c] + direction[2] * view.data[8 + c];
+			}
+			result.range = result.radius = light.range;
+			// a cone 180 degrees wide or more lights the whole sphere
+			result.spot = light.type == LIGHT_TYPE::SPOT && light.outerAngle < 1.5f;
+			result.cosAngle = std::cos(light.outerAngle);
+			result.sinAngle = std::sin(light.outerAngle);
+			if (result.spot) {
+				// smallest sphere around the cone: its cap's circle for wide cones, through the apex and that circle otherwise
+				float offset;
+				if (light.outerAngle > 0.7853982f) {
+					offset = light.range * result.cosAngle;
+					result.radius = light.range * result.sinAngle;
+				}
+				else
+					offset = result.radius = light.range / (2.0f * result.cosAngle);
+				for (int c = 0; c < 3; ++c)
+					result.center[c] += result.axis[c] * offset;
+			}
+			return result;
+		}
+
+		// the cluster boxes for a projection, false if it is not a (centered) perspective one
+		bool BuildGrid(const MATRIX& projection)
+		{
+			if (gridValid && std::memcmp(projection.data, gridProjection.data, sizeof(projection.data)) == 0)
+				return true;
+			gridValid = false;
+			gridProjection = projection;
+			const float* p = projection.data;
+			// PerspectiveLH: w = z, z' = z * p[10] + p[14]
+			if (p[11] != 1.0f || p[0] <= 0.0f || p[5] <= 0.0f || p[10] == 1.0f || p[10] == 0.0f)
+				return false;
+			nearPlane = -p[14] / p[10];
+			farPlane = p[14] / (1.0f - p[10]);
+			if (!(nearPlane > 0.0f && farPlane > nearPlane))
+				return false;
+			const unsigned X = options.tilesX, Y = options.tilesY, Z = options.slices;
+			sliceDepth.resize(Z + 1);
+			for (unsigned k = 0; k < Z; ++k)
+				sliceDepth[k] = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(k) / Z);
+			sliceDepth[Z] = farPlane;
+			// a tile's sides are planes through the eye, x / z is constant along them
+			columnMin.resize(Z * X);
+			columnMax.resize(Z * X);
+			rowMin.resize(Z * Y);
+			rowMax.resize(Z * Y);
+			for (unsigned k = 0; k < Z; ++k) {
+				const float z0 = sliceDepth[k], z1 = sliceDepth[k + 1];
+				for (unsigned i = 0; i < X; ++i) {
+					const float left = -1.0f + 2.0f * i / X, right = -1.0f + 2.0f * (i + 1) / X;
+					columnMin[k * X + i] = std::min(left * z0, left * z1) / p[0];
+					columnMax[k * X + i] = std::max(right * z0, right * z1) / p[0];
+				}
+				for (unsigned j = 0; j < Y; ++j) {
+					const float bottom = -1.0f + 2.0f * j / Y, top = -1.0f + 2.0f * (j + 1) / Y;
+					rowMin[k * Y + j] = std::min(bottom * z0, bottom * z1) / p[5];
+					rowMax[k * Y + j] = std::max(top * z0, top * z1) / p[5];
+				}
+			}
+			bounds.resize(static_cast<size_t>(X) * Y * Z);
+			for (unsigned k = 0; k < Z; ++k)
+				for (unsigned j = 0; j < Y; ++j)
+					for (unsigned i = 0; i < X; ++i) {
+						CLUSTER_BOUNDS& cluster = bounds[i + X * (j + Y * k)];
+						cluster.box = { { columnMin[k * X + i], rowMin[k * Y + j], sliceDepth[k] },
+							{ columnMax[k * X + i], rowMax[k * Y + j], sliceDepth[k + 1] } };
+						float extent = 0.0f;
+						for (int a = 0; a < 3; ++a) {
+							cluster.center[a] = (cluster.box.min[a] + cluster.box.max[a]) * 0.5f;
+							const float half = (cluster.box.max[a] - cluster.box.min[a]) * 0.5f;
+							extent += half * half;
+						}
+						cluster.radius = std::sqrt(extent);
+					}
+			gridValid = true;
+			return true;
+		}
+
+		// the grid and the view space lights, false if there is nothing to bin into
+		bool Prepare(const std::vector<LIGHT>& lights, const MATRIX& view, const MATRIX& projection)
+		{
+			stats = CLUSTER_STATS();
+			stats.lights = static_cast<unsigned>(lights.size());
+			stats.clusters = options.tilesX * options.tilesY * options.slices;
+			ranges.assign(stats.clusters, CLUSTER_RANGE());
+			indices.clear();
+			if (!BuildGrid(projection))
+				return false;
+			viewLights.resize(lights.size());
+			for (size_t l = 0; l < lights.size(); ++l)
+				viewLights[l] = ToView(lights[l], view);
+			return true;
+		}
+
+		void BinSlice(unsigned slice)
+		{
+			const unsigned X = options.tilesX, Y = options.tilesY;
+			SLICE& out = sliceResults[slice];
+			out.clusters.clear();
+			out.lights.clear();
+			out.counts.assign(X * Y, 0);
+			out.tests = 0;
+			const float* xMin = &columnMin[slice * X];
+			const float* xMax = &columnMax[slice * X];
+			const float* yMin = &rowMin[slice * Y];
+			const float* yMax = &rowMax[slice * Y];
+			const CLUSTER_BOUNDS* sliceBounds = &bounds[static_cast<size_t>(slice) * X * Y];
+			for (unsigned l = 0; l < viewLights.size(); ++l) {
+				const VIEW_LIGHT& light = viewLights[l];
+				// a cluster is out when one axis alone is already too far, Touches' sum can only be bigger
+				const float reach = light.radius * light.radius;
+				const float dz = AxisDistance(sliceDepth[slice], sliceDepth[slice + 1], light.center[2]);
+				if (dz * dz > reach)
+					continue;
+				unsigned firstColumn = 0, lastColumn = X, firstRow = 0, lastRow = Y;
+				auto out1D = [&](const float* low, const float* high, unsigned i, float at) {
+					const float d = AxisDistance(low[i], high[i], at);
+					return d * d > reach;
+				};
+				while (firstColumn < X && out1D(xMin, xMax, firstColumn, light.center[0]))
+					++firstColumn;
+				while (lastColumn > firstColumn && out1D(xMin, xMax, lastColumn - 1, light.center[0]))
+					--lastColumn;
+				while (firstRow < Y && out1D(yMin, yMax, firstRow, light.center[1]))
+					++firstRow;
+				while (lastRow > firstRow && out1D(yMin, yMax, lastRow - 1, light.center[1]))
+					--lastRow;
+				for (unsigned j = firstRow; j < lastRow; ++j)
+					for (unsigned i = firstColumn; i < lastColumn; ++i) {
+						++out.tests;
+						const unsigned cluster = i + X * j;
+						if (Touches(light, sliceBounds[cluster])) {
+							out.clusters.push_back(cluster);
+							out.lights.push_back(l);
+							++out.counts[cluster];
+						}
+					}
+			}
+		}
+
+		void Finish(std::chrono::high_resolution_clock::time_point start)
+		{
+			for (const CLUSTER_RANGE& range : ranges) {
+				stats.occupied += range.count > 0;
+				stats.maxPerCluster = std::max(stats.maxPerCluster, range.count);
+			}
+			stats.entries = static_cast<unsigned>(indices.size());
+			stats.binMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+	public:
+		// a new grid size takes effect at the next Bin
+		void SetOptions(const CLUSTER_OPTIONS& clusterOptions)
+		{
+			options.tilesX = std::max(1u, clusterOptions.tilesX);
+			options.tilesY = std::max(1u, clusterOptions.tilesY);
+			options.slices = std::max(1u, clusterOptions.slices);
+			gridValid = false;
+		}
+		const CLUSTER_OPTIONS& Options() const {
+			return options;
+		}
+
+		// every cluster's lights (indices into lights) for this camera, view and projection as
+		// given to Level_Objects::SetViewProjection. Nothing is lit without a perspective projection
+		void Bin(const std::vector<LIGHT>& lights, const MATRIX& view, const MATRIX& projection, JobSystem* jobs = nullptr)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			if (!Prepare(lights, view, projection)) {
+				Finish(start);
+				return;
+			}
+			const unsigned XY = options.tilesX * options.tilesY;
+			sliceResults.resize(options.slices);
+			ParallelFor(jobs, options.slices, 1, [&](unsigned begin, unsigned end) {
+				for (unsigned k = begin; k < end; ++k)
+					BinSlice(k);
+			});
+			// every slice's lists go after the slices before it
+			unsigned total = 0;
+			for (unsigned k = 0; k < options.slices; ++k) {
+				SLICE& slice = sliceResults[k];
+				stats.tests += slice.tests;
+				for (unsigned c = 0; c < XY; ++c) {
+					ranges[k * XY + c] = { total, slice.counts[c] };
+					slice.counts[c] = total;
+					total += ranges[k * XY + c].count;
+				}
+			}
+			indices.resize(total);
+			ParallelFor(jobs, options.slices, 1, [&](unsigned begin, unsigned end) {
+				for (unsigned k = begin; k < end; ++k) {
+					SLICE& slice = sliceResults[k];
+					for (size_t e = 0; e < slice.lights.size(); ++e)
+						indices[slice.counts[slice.clusters[e]]++] = slice.lights[e];
+				}
+			});
+			Finish(start);
+		}
+		// the same lists from testing every light against every cluster
+		void BinBruteForce(const std::vector<LIGHT>& lights, const MATRIX& view, const MATRIX& projection)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			if (!Prepare(lights, view, projection)) {
+				Finish(start);
+				return;
+			}
+			for (unsigned c = 0; c < bounds.size(); ++c) {
+				ranges[c].offset = static_cast<unsigned>(indices.size());
+				for (unsigned l = 0; l < viewLights.size(); ++l)
+					if (Touches(viewLights[l], bounds[c]))
+						indices.push_back(l);
+				ranges[c].count = static_cast<unsigned>(indices.size()) - ranges[c].offset;
+			}
+			stats.tests = static_cast<unsigned long long>(bounds.size()) * viewLights.size();
+			Finish(start);
+		}
+		void Clear()
+		{
+			viewLights.clear();
+			sliceResults.clear();
+			ranges.clear();
+			indices.clear();
+			stats = CLUSTER_STATS();
+		}
+
+		// what the pixel shader needs to find a pixel's cluster, lightCount 0 if nothing was binned
+		CLUSTER_CONSTANTS Constants() const
+		{
+			CLUSTER_CONSTANTS constants = {};
+			constants.clusterCount[0] = options.tilesX;
+			constants.clusterCount[1] = options.tilesY;
+			constants.clusterCount[2] = options.slices;
+			if (gridValid && !ranges.empty()) {
+				constants.lightCount = stats.lights;
+				constants.sliceScale = options.slices / std::log(farPlane / nearPlane);
+				constants.sliceBias = -std::log(nearPlane) * constants.sliceScale;
+			}
+			return constants;
+		}
+		// x + tilesX * (y + tilesY * slice), y counts up from the bottom of the screen
+		const std::vector<CLUSTER_RANGE>& Ranges() const {
+			return ranges;
+		}
+		const std::vector<unsigned>& Indices() const {
+			return indices;
+		}
+		CLUSTER_STATS Stats() const {
+			return stats;
+		}
+	};
+}
+#endif
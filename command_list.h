@@ -0,0 +1,357 @@
+#ifndef _COMMAND_LIST_H_
+#define _COMMAND_LIST_H_
+// Recording a frame's draws on several threads. ParallelRecorder splits a
+// sorted draw list into runs, records each run on a job system thread into a
+// command list of its own and executes the lists in run order on the calling
+// thread, so the backend sees the same commands single threaded recording
+// gives it:
+//   - every run's StateCache starts from the binds the draws before it leave
+//     (the state at the start plus the binds of the run's previous draw,
+//     which rebinds everything a draw uses), so the same binds are dropped
+//   - every run's ConstantRing starts at the slot its first draw would have
+//     taken, only the frame's first write discards
+// Backends with command lists of their own (D3D11 deferred contexts, the
+// recording backend's streams) record into those, any other one gets a
+// CommandList here that stores the calls and replays them. A list that does
+// not continue from the one before it (RenderBackend::ListsAreIndependent)
+// first binds again what its StateCache takes to be bound.
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "constant_ring.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "render_backend.h"
+#include "render_queue.h"
+
+namespace Level {
+
+	// takes every call and does nothing, for binds that only a StateCache should see
+	class NullBackend : public RenderBackend
+	{
+	public:
+		BufferHandle CreateBuffer(const BUFFER_DESC&, const void*) override {
+			return INVALID_BUFFER;
+		}
+		void ReleaseBuffer(BufferHandle) override {}
+		PipelineHandle CreatePipeline(const PIPELINE_DESC&) override {
+			return INVALID_PIPELINE;
+		}
+		void SetPipeline(PipelineHandle) override {}
+		void SetVertexBuffers(unsigned, unsigned, const BufferHandle*, const unsigned*, const unsigned*) override {}
+		void SetIndexBuffer(BufferHandle, INDEX_FORMAT, unsigned) override {}
+		void SetConstantBuffer(unsigned, BufferHandle, unsigned) override {}
+		void SetConstantBufferRange(unsigned, BufferHandle, unsigned, unsigned, unsigned) override {}
+		void SetShaderResource(unsigned, BufferHandle, unsigned) override {}
+		void UpdateBuffer(BufferHandle, const void*, unsigned) override {}
+		void UpdateBufferRange(BufferHandle, unsigned, const void*, unsigned, bool) override {}
+		void DrawIndexed(unsigned, unsigned, int) override {}
+		void DrawIndexedInstanced(unsigned, unsigned, unsigned, int, unsigned) override {}
+	};
+
+	// Stores binds, updates (with their data) and draws to replay on another backend
+	// later. Resources can not be created or released through a list.
+	class CommandList : public RenderBackend
+	{
+		enum OPCODE : unsigned char {
+			SET_PIPELINE, SET_VERTEX_BUFFERS, SET_INDEX_BUFFER, SET_CONSTANT_BUFFER, SET_CONSTANT_BUFFER_RANGE,
+			SET_SHADER_RESOURCE, UPDATE_BUFFER, UPDATE_BUFFER_RANGE, DRAW_INDEXED, DRAW_INDEXED_INSTANCED
+		};
+		std::vector<unsigned char> stream;
+
+		template<typename T>
+		void Write(const T& value) {
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			stream.insert(stream.end(), bytes, bytes + sizeof(T));
+		}
+		void WriteBytes(const void* data, unsigned byteCount) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			stream.insert(stream.end(), bytes, bytes + byteCount);
+		}
+		template<typename T>
+		static T Read(const unsigned char*& at) {
+			T value;
+			std::memcpy(&value, at, sizeof(T));
+			at += sizeof(T);
+			return value;
+		}
+
+	public:
+		void Reset() {
+			stream.clear();
+		}
+		bool Empty() const {
+			return stream.empty();
+		}
+		size_t Bytes() const {
+			return stream.size();
+		}
+
+		// every command in the order it was recorded
+		void Execute(RenderBackend& backend) const
+		{
+			static const unsigned MAX_VERTEX_BUFFERS = 32;
+			const unsigned char* at = stream.data();
+			const unsigned char* end = at + stream.size();
+			while (at < end) {
+				switch (static_cast<OPCODE>(*at++)) {
+				case SET_PIPELINE:
+					backend.SetPipeline(Read<PipelineHandle>(at));
+					break;
+				case SET_VERTEX_BUFFERS: {
+					unsigned startSlot = Read<unsigned>(at), count = Read<unsigned>(at);
+					BufferHandle buffers[MAX_VERTEX_BUFFERS];
+					unsigned strides[MAX_VERTEX_BUFFERS], offsets[MAX_VERTEX_BUFFERS];
+					for (unsigned i = 0; i < count; ++i) {
+						buffers[i] = Read<BufferHandle>(at);
+						strides[i] = Read<unsigned>(at);
+						offsets[i] = Read<unsigned>(at);
+					}
+					backend.SetVertexBuffers(startSlot, count, buffers, strides, offsets);
+					break; }
+				case SET_INDEX_BUFFER: {
+					BufferHandle buffer = Read<BufferHandle>(at);
+					INDEX_FORMAT format = Read<INDEX_FORMAT>(at);
+					backend.SetIndexBuffer(buffer, format, Read<unsigned>(at));
+					break; }
+				case SET_CONSTANT_BUFFER: {
+					unsigned slot = Read<unsigned>(at);
+					BufferHandle buffer = Read<BufferHandle>(at);
+					backend.SetConstantBuffer(slot, buffer, Read<unsigned>(at));
+					break; }
+				case SET_CONSTANT_BUFFER_RANGE: {
+					unsigned slot = Read<unsigned>(at);
+					BufferHandle buffer = Read<BufferHandle>(at);
+					unsigned byteOffset = Read<unsigned>(at), byteCount = Read<unsigned>(at);
+					backend.SetConstantBufferRange(slot, buffer, byteOffset, byteCount, Read<unsigned>(at));
+					break; }
+				case SET_SHADER_RESOURCE: {
+					unsigned slot = Read<unsigned>(at);
+					BufferHandle buffer = Read<BufferHandle>(at);
+					backend.SetShaderResource(slot, buffer, Read<unsigned>(at));
+					break; }
+				case UPDATE_BUFFER: {
+					BufferHandle buffer = Read<BufferHandle>(at);
+					unsigned byteCount = Read<unsigned>(at);
+					backend.UpdateBuffer(buffer, at, byteCount);
+					at += byteCount;
+					break; }
+				case UPDATE_BUFFER_RANGE: {
+					BufferHandle buffer = Read<BufferHandle>(at);
+					unsigned byteOffset = Read<unsigned>(at), byteCount = Read<unsigned>(at);
+					bool discard = Read<bool>(at);
+					backend.UpdateBufferRange(buffer, byteOffset, at, byteCount, discard);
+					at += byteCount;
+					break; }
+				case DRAW_INDEXED: {
+					unsigned indexCount = Read<unsigned>(at), startIndex = Read<unsigned>(at);
+					backend.DrawIndexed(indexCount, startIndex, Read<int>(at));
+					break; }
+				case DRAW_INDEXED_INSTANCED: {
+					unsigned indexCount = Read<unsigned>(at), instanceCount = Read<unsigned>(at), startIndex = Read<unsigned>(at);
+					int baseVertex = Read<int>(at);
+					backend.DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, Read<unsigned>(at));
+					break; }
+				}
+			}
+		}
+
+		BufferHandle CreateBuffer(const BUFFER_DESC&, const void*) override {
+			return INVALID_BUFFER;
+		}
+		void ReleaseBuffer(BufferHandle) override {}
+		PipelineHandle CreatePipeline(const PIPELINE_DESC&) override {
+			return INVALID_PIPELINE;
+		}
+
+		void SetPipeline(PipelineHandle pipeline) override
+		{
+			stream.push_back(SET_PIPELINE);
+			Write(pipeline);
+		}
+		void SetVertexBuffers(unsigned startSlot, unsigned count, const BufferHandle* buffers,
+			const unsigned* strides, const unsigned* offsets) override
+		{
+			stream.push_back(SET_VERTEX_BUFFERS);
+			Write(startSlot);
+			Write(count);
+			for (unsigned i = 0; i < count; ++i) {
+				Write(buffers[i]);
+				Write(strides[i]);
+				Write(offsets[i]);
+			}
+		}
+		void SetIndexBuffer(BufferHandle buffer, INDEX_FORMAT format, unsigned offset) override
+		{
+			stream.push_back(SET_INDEX_BUFFER);
+			Write(buffer);
+			Write(format);
+			Write(offset);
+		}
+		void SetConstantBuffer(unsigned slot, BufferHandle buffer, unsigned stages) override
+		{
+			stream.push_back(SET_CONSTANT_BUFFER);
+			Write(slot);
+			Write(buffer);
+			Write(stages);
+		}
+		void SetConstantBufferRange(unsigned slot, BufferHandle buffer, unsigned byteOffset, unsigned byteCount,
+			unsigned stages) override
+		{
+			stream.push_back(SET_CONSTANT_BUFFER_RANGE);
+			Write(slot);
+			Write(buffer);
+			Write(byteOffset);
+			Write(byteCount);
+			Write(stages);
+		}
+		void SetShaderResource(unsigned slot, BufferHandle buffer, unsigned stages) override
+		{
+			stream.push_back(SET_SHADER_RESOURCE);
+			Write(slot);
+			Write(buffer);
+			Write(stages);
+		}
+		void UpdateBuffer(BufferHandle buffer, const void* data, unsigned byteCount) override
+		{
+			stream.push_back(UPDATE_BUFFER);
+			Write(buffer);
+			Write(byteCount);
+			WriteBytes(data, byteCount);
+		}
+		void UpdateBufferRange(BufferHandle buffer, unsigned byteOffset, const void* data, unsigned byteCount,
+			bool discard) override
+		{
+			stream.push_back(UPDATE_BUFFER_RANGE);
+			Write(buffer);
+			Write(byteOffset);
+			Write(byteCount);
+			Write(discard);
+			WriteBytes(data, byteCount);
+		}
+		void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override
+		{
+			stream.push_back(DRAW_INDEXED);
+			Write(indexCount);
+			Write(startIndex);
+			Write(baseVertex);
+		}
+		void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount,
+			unsigned startIndex, int baseVertex, unsigned startInstance) override
+		{
+			stream.push_back(DRAW_INDEXED_INSTANCED);
+			Write(indexCount);
+			Write(instanceCount);
+			Write(startIndex);
+			Write(baseVertex);
+			Write(startInstance);
+		}
+	};
+
+	struct PARALLEL_RECORDING {
+		unsigned maxLists = 0;		// 0 for one per job system thread
+		unsigned minDraws = 1024;	// per list, fewer draws than twice this record on the calling thread
+		bool nativeLists = true;	// false records CommandLists even if the backend has lists of its own
+	};
+
+	struct RECORDING_STATS {
+		unsigned lists;		// 1 when the draws were recorded on the calling thread
+		bool native;		// the backend's own lists
+		size_t listBytes;	// what the CommandLists held, 0 for native ones
+	};
+
+	class ParallelRecorder
+	{
+		struct RUN {
+			unsigned begin, end;	// draws
+			RenderBackend* list;
+			StateCache cache;
+			ConstantRing constants;
+		};
+		PARALLEL_RECORDING options;
+		NullBackend nowhere;
+		std::vector<RUN> runs;
+		std::vector<std::unique_ptr<CommandList>> commandLists;
+		RECORDING_STATS stats = {};
+
+	public:
+		void SetOptions(const PARALLEL_RECORDING& recording) {
+			options = recording;
+		}
+		const PARALLEL_RECORDING& Options() const {
+			return options;
+		}
+		RECORDING_STATS Stats() const {
+			return stats;
+		}
+
+		// Draws [0, count) as if record(0, cache, constants, 0, count) ran here, cache
+		// must have been Begun on the backend the lists are executed on.
+		//   slotsBefore(i)                          ring slots draws [0, i) take
+		//   prime(run, cache, constants, i)         binds what draw i binds (cache passes nothing on),
+		//                                           constants starts at draw i's slot. sets up the run's
+		//                                           own state too, it is only called for runs after the first
+		//   record(run, cache, constants, begin, end)  records draws [begin, end), one thread per run
+		template<typename SLOTS, typename PRIME, typename RECORD>
+		void Record(StateCache& cache, ConstantRing& constants, unsigned count, JobSystem* jobs,
+			const SLOTS& slotsBefore, const PRIME& prime, const RECORD& record)
+		{
+			unsigned lists = jobs != nullptr ? jobs->Threads() : 1;
+			if (options.maxLists > 0)
+				lists = std::min(lists, options.maxLists);
+			lists = std::min(lists, count / std::max(options.minDraws, 1u));
+			if (lists < 2) {
+				stats = { 1, false, 0 };
+				record(0u, cache, constants, 0u, count);
+				return;
+			}
+			RenderBackend& backend = *cache.Target();
+			runs.resize(lists);
+			while (commandLists.size() < lists)
+				commandLists.emplace_back(new CommandList());
+			stats = { lists, true, 0 };
+			for (unsigned r = 0; r < lists; ++r) {
+				RUN& run = runs[r];
+				run.begin = static_cast<unsigned>(static_cast<unsigned long long>(count) * r / lists);
+				run.end = static_cast<unsigned>(static_cast<unsigned long long>(count) * (r + 1) / lists);
+				run.list = options.nativeLists ? backend.OpenCommandList() : nullptr;
+				if (run.list == nullptr) {
+					commandLists[r]->Reset();
+					run.list = commandLists[r].get();
+					stats.native = false;
+				}
+				run.cache = cache;
+				run.cache.Continue(nowhere, false);
+				if (r > 0) {
+					ConstantRing previous = constants.Continue(slotsBefore(run.begin - 1));
+					prime(r, run.cache, previous, run.begin - 1);
+				}
+				run.cache.Continue(*run.list, run.list != commandLists[r].get() && backend.ListsAreIndependent());
+				run.constants = constants.Continue(slotsBefore(run.begin));
+			}
+
+			ParallelFor(jobs, lists, 1, [&](unsigned begin, unsigned end) {
+				for (unsigned r = begin; r < end; ++r) {
+					LEVEL_PROFILE_SCOPE("Record command list");
+					record(r, runs[r].cache, runs[r].constants, runs[r].begin, runs[r].end);
+				}
+			});
+
+			LEVEL_PROFILE_SCOPE("Execute command lists");
+			for (unsigned r = 0; r < lists; ++r) {
+				RUN& run = runs[r];
+				const bool replayed = run.list == commandLists[r].get();
+				if (replayed) {
+					commandLists[r]->Execute(backend);
+					stats.listBytes += commandLists[r]->Bytes();
+				}
+				else
+					backend.ExecuteCommandList(run.list);
+				cache.Join(run.cache, replayed || !backend.ListsAreIndependent());
+				constants.Join(run.constants);
+			}
+		}
+	};
+}
+#endif
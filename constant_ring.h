@@ -0,0 +1,92 @@
+#ifndef _CONSTANT_RING_H_
+#define _CONSTANT_RING_H_
+// Per frame constants sub-allocated from one large DYNAMIC constant buffer.
+// Each draw takes the next CONSTANT_ALIGNMENT slot, writes only the bytes it
+// needs into it and binds that range, so no constants are rewritten while an
+// earlier draw of the frame may still read them. The first write of a frame
+// discards the whole buffer, later ones append without overwriting.
+// Runs of draws recorded on other threads each write through a copy made by
+// Continue, which starts at the slot the run's first draw would have taken.
+#include <algorithm>
+#include <cassert>
+#include "render_backend.h"
+
+namespace Level {
+
+	class ConstantRing
+	{
+		BufferHandle buffer = INVALID_BUFFER;
+		unsigned capacity = 0;		// slots
+		unsigned used = 0;			// slots taken this frame
+		bool discard = true;		// nothing written this frame yet
+		unsigned long long bytesWritten = 0;
+
+	public:
+		// starts a frame that takes at most slots slots, the buffer only ever grows
+		void BeginFrame(RenderBackend& backend, unsigned slots)
+		{
+			if (slots > capacity) {
+				Release(backend);
+				capacity = std::max({ slots, capacity * 2, 64u });
+				BUFFER_DESC desc = { BUFFER_TYPE::CONSTANT, BUFFER_USAGE::DYNAMIC, capacity * CONSTANT_ALIGNMENT };
+				buffer = backend.CreateBuffer(desc, nullptr);
+			}
+			used = 0;
+			discard = true;
+			bytesWritten = 0;
+		}
+
+		// byte offset of the next free slot, BeginFrame must have been given enough of them
+		unsigned Allocate() {
+			assert(used < capacity);
+			return used++ * CONSTANT_ALIGNMENT;
+		}
+		// bytes at offset (inside a slot from Allocate)
+		void Write(RenderBackend& backend, unsigned offset, const void* data, unsigned bytes)
+		{
+			backend.UpdateBufferRange(buffer, offset, data, bytes, discard);
+			discard = false;
+			bytesWritten += bytes;
+		}
+		// the slot at offset to a b register
+		void Bind(RenderBackend& backend, unsigned slot, unsigned offset, unsigned stages) {
+			backend.SetConstantBufferRange(slot, buffer, offset, CONSTANT_ALIGNMENT, stages);
+		}
+
+		// a copy that allocates from slot on, for a run of draws recorded elsewhere. it only
+		// discards if nothing before slot was written, and must never be Released
+		ConstantRing Continue(unsigned slot) const
+		{
+			ConstantRing run = *this;
+			run.used = slot;
+			run.discard = discard && slot == used;
+			run.bytesWritten = 0;
+			return run;
+		}
+		// takes back what a Continue'd copy allocated and wrote
+		void Join(const ConstantRing& run)
+		{
+			used = std::max(used, run.used);
+			discard = discard && run.discard;
+			bytesWritten += run.bytesWritten;
+		}
+
+		void Release(RenderBackend& backend)
+		{
+			backend.ReleaseBuffer(buffer);
+			buffer = INVALID_BUFFER;
+			capacity = 0;
+		}
+
+		unsigned SlotsUsed() const {
+			return used;
+		}
+		unsigned long long BytesWritten() const {
+			return bytesWritten;
+		}
+		size_t BufferBytes() const {
+			return static_cast<size_t>(capacity) * CONSTANT_ALIGNMENT;
+		}
+	};
+}
+#endif
@@ -0,0 +1,310 @@
+#ifndef _CULLING_H_
+#define _CULLING_H_
+// View frustum culling of placed instances.
+// World space bounds come from the .h2b vertices and the instance's world
+// matrix, a BVH is built over them once per level load, and each frame the
+// frustum of view * projection is tested against the tree. Subtrees that are
+// completely inside are accepted without testing their instances.
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include "h2bParser.h"
+#include "job_system.h"
+#include "level_file.h"
+
+namespace Level {
+
+	struct AABB {
+		float min[3], max[3];
+	};
+
+	inline AABB EmptyBounds() {
+		return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	}
+	inline void Grow(AABB& bounds, const AABB& other) {
+		for (int i = 0; i < 3; ++i) {
+			bounds.min[i] = std::min(bounds.min[i], other.min[i]);
+			bounds.max[i] = std::max(bounds.max[i], other.max[i]);
+		}
+	}
+
+	// object space bounds of every vertex of a model
+	inline AABB LocalBounds(const H2B::Parser& model)
+	{
+		AABB bounds = EmptyBounds();
+		for (const H2B::VERTEX& vertex : model.vertices) {
+			const float position[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+			for (int i = 0; i < 3; ++i) {
+				bounds.min[i] = std::min(bounds.min[i], position[i]);
+				bounds.max[i] = std::max(bounds.max[i], position[i]);
+			}
+		}
+		if (model.vertices.empty())
+			bounds = { { 0, 0, 0 }, { 0, 0, 0 } };
+		return bounds;
+	}
+
+	// box that contains the transformed box (center/extent form, row vectors)
+	inline AABB TransformBounds(const AABB& bounds, const MATRIX& world)
+	{
+		float center[3], extent[3];
+		for (int i = 0; i < 3; ++i) {
+			center[i] = (bounds.min[i] + bounds.max[i]) * 0.5f;
+			extent[i] = (bounds.max[i] - bounds.min[i]) * 0.5f;
+		}
+		AABB result;
+		for (int c = 0; c < 3; ++c) {
+			float worldCenter = world.data[12 + c], worldExtent = 0;
+			for (int r = 0; r < 3; ++r) {
+				worldCenter += center[r] * world.data[r * 4 + c];
+				worldExtent += extent[r] * std::fabs(world.data[r * 4 + c]);
+			}
+			result.min[c] = worldCenter - worldExtent;
+			result.max[c] = worldCenter + worldExtent;
+		}
+		return result;
+	}
+
+	// six planes (a, b, c, d), a point is inside when a*x + b*y + c*z + d >= 0
+	struct FRUSTUM {
+		float planes[6][4];
+	};
+
+	// planes of a row vector view * projection with D3D depth (0 <= z <= w)
+	inline FRUSTUM ExtractFrustum(const MATRIX& viewProjection)
+	{
+		const float* m = viewProjection.data;
+		FRUSTUM frustum;
+		for (int i = 0; i < 4; ++i) {
+			float x = m[i * 4 + 0], y = m[i * 4 + 1], z = m[i * 4 + 2], w = m[i * 4 + 3];
+			frustum.planes[0][i] = w + x;	// left
+			frustum.planes[1][i] = w - x;	// right
+			frustum.planes[2][i] = w + y;	// bottom
+			frustum.planes[3][i] = w - y;	// top
+			frustum.planes[4][i] = z;		// near
+			frustum.planes[5][i] = w - z;	// far
+		}
+		for (float* plane : frustum.planes) {
+			float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			if (length > 0)
+				for (int i = 0; i < 4; ++i)
+					plane[i] /= length;
+		}
+		return frustum;
+	}
+
+	enum CULL_RESULT { CULL_OUTSIDE, CULL_INTERSECTS, CULL_INSIDE };
+
+	// planeMask has a bit per plane still to test, planes the box is fully inside are cleared
+	inline CULL_RESULT TestBounds(const FRUSTUM& frustum, const AABB& bounds, unsigned& planeMask)
+	{
+		for (int p = 0; p < 6; ++p) {
+			if ((planeMask & (1u << p)) == 0)
+				continue;
+			const float* plane = frustum.planes[p];
+			// corner furthest along the normal, then the nearest one
+			float furthest = plane[3], nearest = plane[3];
+			for (int i = 0; i < 3; ++i) {
+				furthest += plane[i] * (plane[i] > 0 ? bounds.max[i] : bounds.min[i]);
+				nearest += plane[i] * (plane[i] > 0 ? bounds.min[i] : bounds.max[i]);
+			}
+			if (furthest < 0)
+				return CULL_OUTSIDE;
+			if (nearest >= 0)
+				planeMask &= ~(1u << p);
+		}
+		return planeMask == 0 ? CULL_INSIDE : CULL_INTERSECTS;
+	}
+
+	struct CULL_STATS {
+		unsigned instances;		// in the hierarchy
+		unsigned nodesTested;
+		unsigned boundsTested;	// instance bounds tested individually
+		unsigned visible;
+	};
+
+	class BoundingVolumeHierarchy
+	{
+		// interior nodes have left != 0 and their children at left, left + 1.
+		// every node covers order[first, first + count)
+		struct NODE {
+			AABB bounds;
+			unsigned first, count;
+			unsigned left;
+		};
+		static const unsigned LEAF_SIZE = 4;
+		// smaller trees are always walked on the calling thread
+		static const unsigned PARALLEL_INSTANCES = 4096;
+
+		std::vector<NODE> nodes;
+		std::vector<unsigned> order;	// instance indices, leaves are contiguous runs
+		std::vector<AABB> instanceBounds;
+		std::vector<std::pair<unsigned, unsigned>> stack; // node, plane mask
+		// parallel Query: subtrees left to walk and what each of them found
+		std::vector<std::pair<unsigned, unsigned>> frontier, expanded;
+		std::vector<std::vector<unsigned>> partialVisible;
+		std::vector<CULL_STATS> partialStats;
+
+		void Subdivide(unsigned node)
+		{
+			NODE& current = nodes[node];
+			if (current.count <= LEAF_SIZE)
+				return;
+			// median split of the centroids along the longest axis
+			float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (unsigned i = current.first; i < current.first + current.count; ++i)
+				for (int a = 0; a < 3; ++a) {
+					float centroid = instanceBounds[order[i]].min[a] + instanceBounds[order[i]].max[a];
+					low[a] = std::min(low[a], centroid);
+					high[a] = std::max(high[a], centroid);
+				}
+			int axis = 0;
+			for (int a = 1; a < 3; ++a)
+				if (high[a] - low[a] > high[axis] - low[axis])
+					axis = a;
+			unsigned first = current.first, count = current.count, half = count / 2;
+			std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+				[&](unsigned a, unsigned b) {
+					return instanceBounds[a].min[axis] + instanceBounds[a].max[axis] <
+						instanceBounds[b].min[axis] + instanceBounds[b].max[axis];
+				});
+
+			unsigned left = static_cast<unsigned>(nodes.size());
+			nodes[node].left = left;
+			nodes.push_back({ EmptyBounds(), first, half, 0 });
+			nodes.push_back({ EmptyBounds(), first + half, count - half, 0 });
+			for (unsigned child = left; child < left + 2; ++child) {
+				for (unsigned i = nodes[child].first; i < nodes[child].first + nodes[child].count; ++i)
+					Grow(nodes[child].bounds, instanceBounds[order[i]]);
+				Subdivide(child);
+			}
+		}
+
+		// walks the subtrees on work, appending what touches the frustum to visible
+		void Walk(const FRUSTUM& frustum, std::vector<std::pair<unsigned, unsigned>>& work,
+			std::vector<unsigned>& visible, CULL_STATS& stats) const
+		{
+			while (!work.empty()) {
+				unsigned node = work.back().first, mask = work.back().second;
+				work.pop_back();
+				const NODE& current = nodes[node];
+				if (mask != 0) {
+					++stats.nodesTested;
+					if (TestBounds(frustum, current.bounds, mask) == CULL_OUTSIDE)
+						continue;
+				}
+				if (mask == 0 || current.left == 0) {
+					for (unsigned i = current.first; i < current.first + current.count; ++i) {
+						unsigned instanceMask = mask;
+						if (mask != 0) {
+							++stats.boundsTested;
+							if (TestBounds(frustum, instanceBounds[order[i]], instanceMask) == CULL_OUTSIDE)
+								continue;
+						}
+						visible.push_back(order[i]);
+					}
+					continue;
+				}
+				work.push_back({ current.left + 1, mask });
+				work.push_back({ current.left, mask });
+			}
+		}
+
+	public:
+		void Build(const std::vector<AABB>& bounds)
+		{
+			instanceBounds = bounds;
+			nodes.clear();
+			order.resize(bounds.size());
+			for (unsigned i = 0; i < order.size(); ++i)
+				order[i] = i;
+			if (bounds.empty())
+				return;
+			nodes.reserve(2 * bounds.size() / LEAF_SIZE + 1);
+			nodes.push_back({ EmptyBounds(), 0, static_cast<unsigned>(bounds.size()), 0 });
+			for (const AABB& box : bounds)
+				Grow(nodes[0].bounds, box);
+			Subdivide(0);
+		}
+
+		// indices of the instances that touch the frustum, in no particular order
+		void Query(const FRUSTUM& frustum, std::vector<unsigned>& visible, CULL_STATS& stats)
+		{
+			visible.clear();
+			stats = CULL_STATS();
+			stats.instances = static_cast<unsigned>(instanceBounds.size());
+			if (nodes.empty())
+				return;
+			stack.clear();
+			stack.push_back({ 0u, 0x3Fu });
+			Walk(frustum, stack, visible, stats);
+			stats.visible = static_cast<unsigned>(visible.size());
+		}
+
+		// same result as Query, large trees are split into a few subtrees per thread
+		// near the root and those are walked in parallel
+		void Query(const FRUSTUM& frustum, std::vector<unsigned>& visible, CULL_STATS& stats, JobSystem* jobs)
+		{
+			if (jobs == nullptr || jobs->Threads() == 1 || instanceBounds.size() < PARALLEL_INSTANCES) {
+				Query(frustum, visible, stats);
+				return;
+			}
+			visible.clear();
+			stats = CULL_STATS();
+			stats.instances = static_cast<unsigned>(instanceBounds.size());
+			if (nodes.empty())
+				return;
+			// breadth first from the root, testing interior nodes on the way, until there is enough to share
+			frontier.assign(1, { 0u, 0x3Fu });
+			const size_t wanted = 4 * jobs->Threads();
+			bool split = true;
+			while (frontier.size() < wanted && split) {
+				split = false;
+				expanded.clear();
+				for (const auto& entry : frontier) {
+					const NODE& current = nodes[entry.first];
+					unsigned mask = entry.second;
+					if (current.left == 0 || mask == 0) {
+						expanded.push_back(entry);
+						continue;
+					}
+					++stats.nodesTested;
+					if (TestBounds(frustum, current.bounds, mask) == CULL_OUTSIDE)
+						continue;
+					expanded.push_back({ current.left, mask });
+					expanded.push_back({ current.left + 1, mask });
+					split = true;
+				}
+				frontier.swap(expanded);
+			}
+
+			const unsigned count = static_cast<unsigned>(frontier.size());
+			if (partialVisible.size() < count)
+				partialVisible.resize(count);
+			partialStats.assign(count, CULL_STATS());
+			jobs->ParallelFor(count, 1, [&](unsigned begin, unsigned end) {
+				std::vector<std::pair<unsigned, unsigned>> work;
+				for (unsigned i = begin; i < end; ++i) {
+					partialVisible[i].clear();
+					work.assign(1, frontier[i]);
+					Walk(frustum, work, partialVisible[i], partialStats[i]);
+				}
+			});
+			for (unsigned i = 0; i < count; ++i) {
+				visible.insert(visible.end(), partialVisible[i].begin(), partialVisible[i].end());
+				stats.nodesTested += partialStats[i].nodesTested;
+				stats.boundsTested += partialStats[i].boundsTested;
+			}
+			stats.visible = static_cast<unsigned>(visible.size());
+		}
+
+		const std::vector<AABB>& Bounds() const {
+			return instanceBounds;
+		}
+		size_t NodeCount() const {
+			return nodes.size();
+		}
+	};
+}
+#endif
@@ -0,0 +1,545 @@
+#ifndef _D3D11_BACKEND_H_
+#define _D3D11_BACKEND_H_
+// Level::RenderBackend on top of the D3D11 immediate context.
+// Needs Gateware (ReadFileIntoString) and D3D11 included first, see main.cpp.
+#include <d3dcompiler.h>	// required for compiling shaders on the fly, compiled bytecode is cached on disk
+#include <d3d11_1.h>		// constant buffer offsets (VSSetConstantBuffers1)
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "render_backend.h"
+#include "shader_cache.h"
+#include "load_object_oriented.h"
+#pragma comment(lib, "d3dcompiler.lib") 
+
+// Shaders + input layout, one set shared by every Model that uses them
+struct PipelineState {
+	Microsoft::WRL::ComPtr<ID3D11VertexShader>	vertexShader;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader>	pixelShader;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout>	vertexFormat;
+};
+
+// Creates each pipeline state once instead of once per Model.
+// Bytecode comes from Level::ShaderCache which persists it in ../ShaderCache,
+// so D3DCompile only runs when a shader's source, profile, flags or defines change.
+class PipelineStateCache {
+	Level::ShaderCache shaderCache;
+	// shader files are read once, keyed by path
+	std::unordered_map<std::string, std::string> sources;
+	// keyed by the shader cache keys of the VS/PS plus the layout
+	std::unordered_map<unsigned long long, PipelineState> states;
+
+	static bool CompileWithD3D(const Level::SHADER_SOURCE& shader, std::vector<unsigned char>& bytecode, std::string& errors)
+	{
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (const auto& define : shader.defines)
+			macros.push_back({ define.first.c_str(), define.second.c_str() });
+		macros.push_back({ nullptr, nullptr });
+
+		Microsoft::WRL::ComPtr<ID3DBlob> blob, messages;
+
+		HRESULT compilationResult =
+			D3DCompile(shader.source.c_str(), shader.source.length(),
+				nullptr, macros.data(), nullptr, shader.entryPoint.c_str(), shader.profile.c_str(), shader.flags, 0,
+				blob.GetAddressOf(), messages.GetAddressOf());
+
+		if (FAILED(compilationResult))
+		{
+			if (messages)
+				errors.assign((const char*)messages->GetBufferPointer(), messages->GetBufferSize());
+			return false;
+		}
+		const unsigned char* code = (const unsigned char*)blob->GetBufferPointer();
+		bytecode.assign(code, code + blob->GetBufferSize());
+		return true;
+	}
+
+	Level::SHADER_SOURCE MakeSource(const char* path, const char* profile, bool instanced, bool compactVertices)
+	{
+		auto found = sources.find(path);
+		if (found == sources.end())
+			found = sources.emplace(path, ReadFileIntoString(path)).first;
+
+		Level::SHADER_SOURCE shader;
+		shader.source = found->second;
+		shader.entryPoint = "main";
+		shader.profile = profile;
+		shader.flags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if _DEBUG
+		shader.flags |= D3DCOMPILE_DEBUG;
+#endif
+		if (instanced)
+			shader.defines.push_back({ "USE_INSTANCING", "1" });
+		if (compactVertices)
+			shader.defines.push_back({ "USE_COMPACT_VERTICES", "1" });
+		return shader;
+	}
+
+	const std::vector<unsigned char>& GetBytecode(const Level::SHADER_SOURCE& shader, const char* errorLabel)
+	{
+		std::string errors;
+		const std::vector<unsigned char>* bytecode = shaderCache.GetBytecode(shader, &errors);
+		if (bytecode == nullptr)
+		{
+			PrintLabeledDebugString(errorLabel, errors.c_str());
+			abort();
+		}
+		return *bytecode;
+	}
+
+	// attributes
+	void CreateVertexInputLayout(ID3D11Device* creator, const std::vector<unsigned char>& vsBytecode,
+		bool instanced, bool compactVertices, Microsoft::WRL::ComPtr<ID3D11InputLayout>& vertexFormat)
+	{
+		// per vertex data in slot 0, the instanced layout adds the world matrix rows in slot 1.
+		// Level::COMPACT_VERTEX: positions across the asset's bounds, half uvs, octahedral normals
+		const D3D11_INPUT_ELEMENT_DESC fullVertex[] = {
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "LOCATION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		const D3D11_INPUT_ELEMENT_DESC compactVertex[] = {
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "LOCATION", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		D3D11_INPUT_ELEMENT_DESC attributes[] = {
+			compactVertices ? compactVertex[0] : fullVertex[0],
+			compactVertices ? compactVertex[1] : fullVertex[1],
+			compactVertices ? compactVertex[2] : fullVertex[2],
+			{ "INSTANCE_WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "INSTANCE_WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "INSTANCE_WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "INSTANCE_WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		};
+		creator->CreateInputLayout(attributes, instanced ? 7 : 3,
+			vsBytecode.data(), vsBytecode.size(), vertexFormat.GetAddressOf());
+	}
+
+public:
+	PipelineStateCache() : shaderCache("../ShaderCache", CompileWithD3D) {}
+
+	// instanced/compactVertices select the USE_INSTANCING/USE_COMPACT_VERTICES vertex shader and its input layout
+	const PipelineState& Get(ID3D11Device* creator, const Level::PIPELINE_DESC& desc)
+	{
+		bool instanced = desc.instanced;
+		// shader model 5 for the StructuredBuffer material table
+		Level::SHADER_SOURCE vs = MakeSource(desc.vertexShaderPath, "vs_5_0", instanced, desc.compactVertices);
+		Level::SHADER_SOURCE ps = MakeSource(desc.pixelShaderPath, "ps_5_0", false, false);
+		unsigned long long vsKey = Level::ShaderCache::Key(vs);
+		unsigned long long psKey = Level::ShaderCache::Key(ps);
+		unsigned long long key = Level::HashBytes(&psKey, sizeof(psKey), Level::HashBytes(&vsKey, sizeof(vsKey)));
+
+		auto found = states.find(key);
+		if (found != states.end())
+			return found->second;
+
+		const std::vector<unsigned char>& vsBytecode = GetBytecode(vs, "Vertex Shader Errors:\n");
+		const std::vector<unsigned char>& psBytecode = GetBytecode(ps, "Pixel Shader Errors:\n");
+
+		PipelineState& state = states[key];
+		creator->CreateVertexShader(vsBytecode.data(), vsBytecode.size(), nullptr, state.vertexShader.GetAddressOf());
+		creator->CreatePixelShader(psBytecode.data(), psBytecode.size(), nullptr, state.pixelShader.GetAddressOf());
+		CreateVertexInputLayout(creator, vsBytecode, instanced, desc.compactVertices, state.vertexFormat);
+		return state;
+	}
+
+	// re-read the .hlsl files on the next Get (bytecode is still reused if they didn't change)
+	void Reload() {
+		sources.clear();
+	}
+	Level::SHADER_CACHE_STATS GetShaderStats() const {
+		return shaderCache.GetStats();
+	}
+	size_t PipelineCount() const {
+		return states.size();
+	}
+};
+
+
+// D3D11 implementation of the level's render backend. Handles index into
+// tables of ComPtrs, pipelines come from the PipelineStateCache above.
+// Constant buffer ranges need the D3D11.1 runtime, without it the range is
+// copied into a small per slot buffer instead (what every draw did before).
+// Command lists are D3D11Backends on deferred contexts that use their owner's
+// tables, so they need D3D11.1 too (the range copies can't be recorded).
+class D3D11Backend : public Level::RenderBackend
+{
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	// the backend whose tables the handles index, this one unless it records a command list
+	D3D11Backend* owner = this;
+
+	struct BufferSlot {
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view;	// STRUCTURED only
+		Level::BUFFER_DESC desc;
+		std::vector<unsigned char> shadow;	// CPU copy of DYNAMIC constant buffers without D3D11.1
+	};
+	std::vector<BufferSlot> buffers; // index = handle - 1
+	std::vector<Level::BufferHandle> freeBuffers;
+	// D3D11.0 fallback for SetConstantBufferRange, one per b register
+	Microsoft::WRL::ComPtr<ID3D11Buffer> rangeCopies[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	unsigned rangeCopySizes[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT] = {};
+
+	PipelineStateCache pipelineCache;
+	std::vector<const PipelineState*> pipelines; // index = handle - 1
+
+	// deferred contexts handed out by OpenCommandList and the ones ready for reuse
+	std::vector<std::unique_ptr<D3D11Backend>> openLists, freeLists;
+	// the runtime emulates command lists, see UpdateBufferRange
+	bool emulatedLists = false;
+	// command lists only: per buffer, 1 once the list has mapped it
+	std::vector<char> listMapped;
+
+	ID3D11Buffer* Get(Level::BufferHandle buffer) const {
+		const std::vector<BufferSlot>& table = owner->buffers;
+		return (buffer != Level::INVALID_BUFFER && buffer <= table.size()) ? table[buffer - 1].buffer.Get() : nullptr;
+	}
+
+	// a command list recording on a deferred context of immediate's device
+	D3D11Backend(D3D11Backend& immediate, ID3D11DeviceContext* deferred)
+		: device(immediate.device), context(deferred), owner(&immediate)
+	{
+		context.As(&context1);
+	}
+
+	// what the renderer bound around the level's own binds (targets, viewports, fixed
+	// function states, scene constants, samplers), a deferred context starts without it
+	void InheritState(ID3D11DeviceContext1* from)
+	{
+		using Microsoft::WRL::ComPtr;
+		ID3D11RenderTargetView* targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+		ComPtr<ID3D11DepthStencilView> depth;
+		from->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, targets, depth.GetAddressOf());
+		context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, targets, depth.Get());
+		for (ID3D11RenderTargetView* target : targets)
+			if (target != nullptr)
+				target->Release();
+
+		UINT count = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+		D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		from->RSGetViewports(&count, viewports);
+		context->RSSetViewports(count, viewports);
+		count = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+		D3D11_RECT scissors[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		from->RSGetScissorRects(&count, scissors);
+		context->RSSetScissorRects(count, scissors);
+
+		ComPtr<ID3D11RasterizerState> rasterizer;
+		from->RSGetState(rasterizer.GetAddressOf());
+		context->RSSetState(rasterizer.Get());
+		ComPtr<ID3D11DepthStencilState> depthState;
+		UINT stencilRef = 0;
+		from->OMGetDepthStencilState(depthState.GetAddressOf(), &stencilRef);
+		context->OMSetDepthStencilState(depthState.Get(), stencilRef);
+		ComPtr<ID3D11BlendState> blend;
+		FLOAT blendFactor[4];
+		UINT sampleMask = 0;
+		from->OMGetBlendState(blend.GetAddressOf(), blendFactor, &sampleMask);
+		context->OMSetBlendState(blend.Get(), blendFactor, sampleMask);
+
+		const UINT SLOTS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+		ID3D11Buffer* constants[SLOTS] = {};
+		UINT first[SLOTS], constantCounts[SLOTS];
+		ID3D11SamplerState* samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT] = {};
+		for (int stage = 0; stage < 2; ++stage) {
+			if (stage == 0) {
+				from->VSGetConstantBuffers1(0, SLOTS, constants, first, constantCounts);
+				context1->VSSetConstantBuffers1(0, SLOTS, constants, first, constantCounts);
+				from->VSGetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, samplers);
+				context->VSSetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, samplers);
+			}
+			else {
+				from->PSGetConstantBuffers1(0, SLOTS, constants, first, constantCounts);
+				context1->PSSetConstantBuffers1(0, SLOTS, constants, first, constantCounts);
+				from->PSGetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, samplers);
+				context->PSSetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, samplers);
+			}
+			for (ID3D11Buffer*& buffer : constants)
+				if (buffer != nullptr) {
+					buffer->Release();
+					buffer = nullptr;
+				}
+			for (ID3D11SamplerState*& sampler : samplers)
+				if (sampler != nullptr) {
+					sampler->Release();
+					sampler = nullptr;
+				}
+		}
+	}
+
+public:
+	D3D11Backend(ID3D11Device* creator, ID3D11DeviceContext* immediateContext)
+		: device(creator), context(immediateContext)
+	{
+		// only keep the 11.1 context if the driver can actually offset constant buffers
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+		if (SUCCEEDED(context.As(&context1)) &&
+			(FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+			!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer))
+			context1.Reset();
+		D3D11_FEATURE_DATA_THREADING threading = {};
+		emulatedLists = FAILED(device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))) ||
+			!threading.DriverCommandLists;
+	}
+
+	Level::BufferHandle CreateBuffer(const Level::BUFFER_DESC& desc, const void* initialData) override
+	{
+		D3D11_BUFFER_DESC bufferDesc = { 0 };
+		bufferDesc.ByteWidth = desc.byteWidth;
+		switch (desc.usage) {
+		case Level::BUFFER_USAGE::IMMUTABLE: bufferDesc.Usage = D3D11_USAGE_IMMUTABLE; break;
+		case Level::BUFFER_USAGE::DEFAULT: bufferDesc.Usage = D3D11_USAGE_DEFAULT; break;
+		case Level::BUFFER_USAGE::DYNAMIC:
+			bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+			bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			break;
+		}
+		switch (desc.type) {
+		case Level::BUFFER_TYPE::VERTEX: bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; break;
+		case Level::BUFFER_TYPE::INDEX: bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; break;
+		case Level::BUFFER_TYPE::CONSTANT: bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; break;
+		case Level::BUFFER_TYPE::STRUCTURED:
+			bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+			bufferDesc.StructureByteStride = desc.structureStride;
+			break;
+		}
+
+		D3D11_SUBRESOURCE_DATA bData = { initialData, 0, 0 };
+
+		BufferSlot slot;
+		slot.desc = desc;
+		if (FAILED(device->CreateBuffer(&bufferDesc, initialData ? &bData : nullptr, slot.buffer.GetAddressOf())))
+			return Level::INVALID_BUFFER;
+		if (desc.type == Level::BUFFER_TYPE::STRUCTURED && desc.structureStride > 0) {
+			D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+			viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+			viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+			viewDesc.Buffer.FirstElement = 0;
+			viewDesc.Buffer.NumElements = desc.byteWidth / desc.structureStride;
+			if (FAILED(device->CreateShaderResourceView(slot.buffer.Get(), &viewDesc, slot.view.GetAddressOf())))
+				return Level::INVALID_BUFFER;
+		}
+		if (desc.type == Level::BUFFER_TYPE::CONSTANT && desc.usage == Level::BUFFER_USAGE::DYNAMIC && !context1)
+			slot.shadow.assign(desc.byteWidth, 0);
+
+		if (freeBuffers.empty()) {
+			buffers.push_back(slot);
+			return static_cast<Level::BufferHandle>(buffers.size());
+		}
+		Level::BufferHandle handle = freeBuffers.back();
+		freeBuffers.pop_back();
+		buffers[handle - 1] = slot;
+		return handle;
+	}
+	void ReleaseBuffer(Level::BufferHandle buffer) override
+	{
+		if (Get(buffer) == nullptr)
+			return;
+		buffers[buffer - 1].buffer.ReleaseAndGetAddressOf();
+		buffers[buffer - 1].view.ReleaseAndGetAddressOf();
+		std::vector<unsigned char>().swap(buffers[buffer - 1].shadow);
+		freeBuffers.push_back(buffer);
+	}
+	Level::PipelineHandle CreatePipeline(const Level::PIPELINE_DESC& desc) override
+	{
+		const PipelineState* state = &pipelineCache.Get(device.Get(), desc);
+		for (size_t i = 0; i < pipelines.size(); ++i)
+			if (pipelines[i] == state)
+				return static_cast<Level::PipelineHandle>(i + 1);
+		pipelines.push_back(state);
+		return static_cast<Level::PipelineHandle>(pipelines.size());
+	}
+
+	void SetPipeline(Level::PipelineHandle pipeline) override
+	{
+		const PipelineState* state = owner->pipelines[pipeline - 1];
+		context->VSSetShader(state->vertexShader.Get(), nullptr, 0);
+		context->PSSetShader(state->pixelShader.Get(), nullptr, 0);
+		context->IASetInputLayout(state->vertexFormat.Get());
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	}
+	void SetVertexBuffers(unsigned startSlot, unsigned count, const Level::BufferHandle* vertexBuffers,
+		const unsigned* strides, const unsigned* offsets) override
+	{
+		ID3D11Buffer* buffs[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		for (unsigned i = 0; i < count; ++i)
+			buffs[i] = Get(vertexBuffers[i]);
+		context->IASetVertexBuffers(startSlot, count, buffs, strides, offsets);
+	}
+	void SetIndexBuffer(Level::BufferHandle buffer, Level::INDEX_FORMAT format, unsigned offset) override
+	{
+		context->IASetIndexBuffer(Get(buffer),
+			format == Level::INDEX_FORMAT::UINT16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, offset);
+	}
+	void SetConstantBuffer(unsigned slot, Level::BufferHandle buffer, unsigned stages) override
+	{
+		ID3D11Buffer* const buffs[] = { Get(buffer) };
+		if (stages & Level::STAGE_VERTEX)
+			context->VSSetConstantBuffers(slot, 1, buffs);
+		if (stages & Level::STAGE_PIXEL)
+			context->PSSetConstantBuffers(slot, 1, buffs);
+	}
+	void SetConstantBufferRange(unsigned slot, Level::BufferHandle buffer, unsigned byteOffset, unsigned byteCount,
+		unsigned stages) override
+	{
+		if (context1) {
+			ID3D11Buffer* const buffs[] = { Get(buffer) };
+			// offsets and sizes are counted in 16 byte constants
+			const UINT first[] = { byteOffset / 16 }, count[] = { byteCount / 16 };
+			if (stages & Level::STAGE_VERTEX)
+				context1->VSSetConstantBuffers1(slot, 1, buffs, first, count);
+			if (stages & Level::STAGE_PIXEL)
+				context1->PSSetConstantBuffers1(slot, 1, buffs, first, count);
+			return;
+		}
+		if (Get(buffer) == nullptr || slot >= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT)
+			return;
+		const std::vector<unsigned char>& shadow = owner->buffers[buffer - 1].shadow;
+		if (byteOffset + byteCount > shadow.size())
+			return;
+		if (!rangeCopies[slot] || rangeCopySizes[slot] != byteCount) {
+			D3D11_BUFFER_DESC copyDesc = { 0 };
+			copyDesc.ByteWidth = byteCount;
+			copyDesc.Usage = D3D11_USAGE_DEFAULT;
+			copyDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+			rangeCopies[slot].Reset();
+			if (FAILED(device->CreateBuffer(&copyDesc, nullptr, rangeCopies[slot].GetAddressOf())))
+				return;
+			rangeCopySizes[slot] = byteCount;
+		}
+		context->UpdateSubresource(rangeCopies[slot].Get(), 0, nullptr, shadow.data() + byteOffset, 0, 0);
+		ID3D11Buffer* const buffs[] = { rangeCopies[slot].Get() };
+		if (stages & Level::STAGE_VERTEX)
+			context->VSSetConstantBuffers(slot, 1, buffs);
+		if (stages & Level::STAGE_PIXEL)
+			context->PSSetConstantBuffers(slot, 1, buffs);
+	}
+	void SetShaderResource(unsigned slot, Level::BufferHandle buffer, unsigned stages) override
+	{
+		ID3D11ShaderResourceView* const views[] = {
+			(Get(buffer) != nullptr) ? owner->buffers[buffer - 1].view.Get() : nullptr };
+		if (stages & Level::STAGE_VERTEX)
+			context->VSSetShaderResources(slot, 1, views);
+		if (stages & Level::STAGE_PIXEL)
+			context->PSSetShaderResources(slot, 1, views);
+	}
+
+	void UpdateBuffer(Level::BufferHandle buffer, const void* data, unsigned byteCount) override
+	{
+		ID3D11Buffer* target = Get(buffer);
+		if (target == nullptr)
+			return;
+		if (owner->buffers[buffer - 1].desc.usage == Level::BUFFER_USAGE::DYNAMIC) {
+			D3D11_MAPPED_SUBRESOURCE mapping = { 0 };
+			if (SUCCEEDED(context->Map(target, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapping))) {
+				memcpy(mapping.pData, data, byteCount);
+				context->Unmap(target, 0);
+			}
+		}
+		else {
+			// easier way to map and unmap information
+			context->UpdateSubresource(target, 0, nullptr, data, 0, 0);
+		}
+	}
+
+	void UpdateBufferRange(Level::BufferHandle buffer, unsigned byteOffset, const void* data, unsigned byteCount,
+		bool discard) override
+	{
+		ID3D11Buffer* target = Get(buffer);
+		if (target == nullptr)
+			return;
+		BufferSlot& slot = owner->buffers[buffer - 1];
+		if (slot.desc.usage == Level::BUFFER_USAGE::IMMUTABLE || byteOffset + byteCount > slot.desc.byteWidth)
+			return;
+		if (slot.desc.usage == Level::BUFFER_USAGE::DEFAULT) {
+			// shared geometry pages, only part of the buffer is replaced
+			D3D11_BOX box = { byteOffset, 0, 0, byteOffset + byteCount, 1, 1 };
+			const unsigned char* source = static_cast<const unsigned char*>(data);
+			// a deferred context whose lists the runtime emulates offsets the source by the box
+			// as well (the documented UpdateSubresource workaround)
+			if (owner != this && owner->emulatedLists)
+				source -= byteOffset;
+			context->UpdateSubresource(target, 0, &box, source, 0, 0);
+			return;
+		}
+		// a command list must discard a dynamic buffer the first time it maps it
+		if (owner != this) {
+			if (listMapped.size() < owner->buffers.size())
+				listMapped.resize(owner->buffers.size(), 0);
+			discard |= !listMapped[buffer - 1];
+			listMapped[buffer - 1] = 1;
+		}
+		std::vector<unsigned char>& shadow = slot.shadow;
+		if (!shadow.empty()) {
+			// D3D11.0 can't map a constant buffer without discarding it, ranges are copied out when bound
+			memcpy(shadow.data() + byteOffset, data, byteCount);
+			return;
+		}
+		D3D11_MAPPED_SUBRESOURCE mapping = { 0 };
+		D3D11_MAP mode = discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+		if (SUCCEEDED(context->Map(target, 0, mode, 0, &mapping))) {
+			memcpy(static_cast<unsigned char*>(mapping.pData) + byteOffset, data, byteCount);
+			context->Unmap(target, 0);
+		}
+	}
+
+	void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override
+	{
+		context->DrawIndexed(indexCount, startIndex, baseVertex);
+	}
+	void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount,
+		unsigned startIndex, int baseVertex, unsigned startInstance) override
+	{
+		context->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+	}
+
+	Level::RenderBackend* OpenCommandList() override
+	{
+		if (!context1 || owner != this)
+			return nullptr;
+		std::unique_ptr<D3D11Backend> list;
+		if (!freeLists.empty()) {
+			list = std::move(freeLists.back());
+			freeLists.pop_back();
+		}
+		else {
+			Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferred;
+			if (FAILED(device->CreateDeferredContext(0, deferred.GetAddressOf())))
+				return nullptr;
+			list.reset(new D3D11Backend(*this, deferred.Get()));
+			if (!list->context1)
+				return nullptr;
+		}
+		list->InheritState(context1.Get());
+		openLists.push_back(std::move(list));
+		return openLists.back().get();
+	}
+	// the immediate context gets its own state back afterwards (RestoreContextState)
+	void ExecuteCommandList(Level::RenderBackend* list) override
+	{
+		for (size_t i = 0; i < openLists.size(); ++i) {
+			if (openLists[i].get() != list)
+				continue;
+			Microsoft::WRL::ComPtr<ID3D11CommandList> commands;
+			if (SUCCEEDED(openLists[i]->context->FinishCommandList(FALSE, commands.GetAddressOf())))
+				context->ExecuteCommandList(commands.Get(), TRUE);
+			openLists[i]->listMapped.clear();
+			freeLists.push_back(std::move(openLists[i]));
+			openLists.erase(openLists.begin() + i);
+			return;
+		}
+	}
+	bool ListsAreIndependent() const override {
+		return true;
+	}
+
+	// shader cache counters (compiles, disk hits, ...)
+	Level::SHADER_CACHE_STATS GetShaderCacheStats() const {
+		return pipelineCache.GetShaderStats();
+	}
+};
+#endif
@@ -0,0 +1,377 @@
+#ifndef _GEOMETRY_POOL_H_
+#define _GEOMETRY_POOL_H_
+// Level wide vertex/index storage.
+// Every asset's vertices and indices are sub-allocated from a few large shared
+// buffers ("pages") instead of a buffer pair per asset, so a frame binds
+// geometry once per page and each sub-mesh draw is a base vertex plus an index
+// offset into them. Indices stay local to their asset, DrawIndexed's
+// baseVertex moves them to where the asset's vertices were placed.
+// Ranges are freed when an asset goes away and Compact slides the remaining
+// ones together again (re-uploading them from their CPU copy).
+// A pool made with 2 byte indices also takes assets with 4 byte indices, they
+// share the index buffer and are bound with their own format.
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <vector>
+#include "render_backend.h"
+
+namespace Level {
+
+	// first fit allocator over [0, capacity) elements, free blocks are kept
+	// sorted by offset and merged with their neighbours when a range is freed
+	class RangeAllocator
+	{
+		std::map<unsigned, unsigned> freeBlocks;	// offset -> count
+		unsigned capacity = 0;
+		unsigned used = 0;
+
+	public:
+		// forgets every allocation
+		void Reset(unsigned elements)
+		{
+			capacity = elements;
+			used = 0;
+			freeBlocks.clear();
+			if (elements > 0)
+				freeBlocks[0] = elements;
+		}
+
+		// lowest free range of count elements starting on a multiple of alignment,
+		// false if no free block is large enough
+		bool Allocate(unsigned count, unsigned& offset, unsigned alignment = 1)
+		{
+			if (count == 0) {
+				offset = 0;
+				return true;
+			}
+			for (auto block = freeBlocks.begin(); block != freeBlocks.end(); ++block) {
+				unsigned start = (block->first + alignment - 1) / alignment * alignment;
+				unsigned end = block->first + block->second;
+				if (start >= end || end - start < count)
+					continue;
+				unsigned before = start - block->first, after = end - start - count;
+				if (before == 0)
+					freeBlocks.erase(block);
+				else
+					block->second = before;
+				if (after > 0)
+					freeBlocks[start + count] = after;
+				offset = start;
+				used += count;
+				return true;
+			}
+			return false;
+		}
+
+		// a range returned by Allocate
+		void Free(unsigned offset, unsigned count)
+		{
+			if (count == 0)
+				return;
+			used -= count;
+			auto next = freeBlocks.lower_bound(offset);
+			if (next != freeBlocks.begin()) {
+				auto previous = std::prev(next);
+				if (previous->first + previous->second == offset) {
+					offset = previous->first;
+					count += previous->second;
+					freeBlocks.erase(previous);
+				}
+			}
+			if (next != freeBlocks.end() && offset + count == next->first) {
+				count += next->second;
+				freeBlocks.erase(next);
+			}
+			freeBlocks[offset] = count;
+		}
+
+		unsigned Capacity() const {
+			return capacity;
+		}
+		unsigned Used() const {
+			return used;
+		}
+		unsigned FreeBlocks() const {
+			return static_cast<unsigned>(freeBlocks.size());
+		}
+		unsigned LargestFree() const
+		{
+			unsigned largest = 0;
+			for (const auto& block : freeBlocks)
+				largest = std::max(largest, block.second);
+			return largest;
+		}
+		// free elements that are not part of the block at the end
+		unsigned HoleElements() const
+		{
+			unsigned holes = capacity - used;
+			if (!freeBlocks.empty() && freeBlocks.rbegin()->first + freeBlocks.rbegin()->second == capacity)
+				holes -= freeBlocks.rbegin()->second;
+			return holes;
+		}
+		// offset -> count of every free block, lowest first
+		const std::map<unsigned, unsigned>& Blocks() const {
+			return freeBlocks;
+		}
+	};
+
+	// CPU copy of one asset's geometry, what Add uploads and Compact re-uploads
+	struct GEOMETRY_DATA {
+		const void* vertices;
+		unsigned vertexCount;
+		const void* indices;
+		unsigned indexCount;
+		unsigned indexBytes = 0;	// 2 or 4, 0 for the pool's own index size
+	};
+
+	// where an asset's geometry lives
+	struct GEOMETRY_RANGE {
+		unsigned page;
+		unsigned baseVertex;	// DrawIndexed baseVertex
+		unsigned firstIndex;	// added to the asset's own index offsets, in indices of indexBytes
+		unsigned vertexCount;
+		unsigned indexCount;
+		unsigned indexBytes;
+	};
+
+	struct GEOMETRY_STATS {
+		unsigned pages;				// shared vertex + index buffer pairs
+		unsigned buffers;			// GPU buffers the pool holds
+		unsigned ranges;			// assets placed
+		size_t capacityBytes;		// vertex + index bytes of every page
+		size_t usedBytes;
+		size_t holeBytes;			// free bytes between ranges, Compact gets them back
+		size_t largestFreeBytes;	// biggest free block in any page
+		unsigned freeBlocks;
+		double fragmentation;		// holes / all free bytes, 0 when each page's free space is one block at its end
+		unsigned compactions;
+		size_t bytesMoved;			// re-uploaded by Compact
+	};
+
+	class GeometryPool
+	{
+		struct PAGE {
+			BufferHandle vertexBuffer = INVALID_BUFFER;
+			BufferHandle indexBuffer = INVALID_BUFFER;
+			RangeAllocator vertices, indices;
+		};
+		std::vector<PAGE> pages;
+		// indexed by the caller's id (the asset handle), placed[id] says whether it holds a range
+		std::vector<GEOMETRY_RANGE> ranges;
+		std::vector<bool> placed;
+		unsigned vertexStride, indexStride;
+		unsigned pageVertices, pageIndices;
+		unsigned compactions = 0;
+		size_t bytesMoved = 0;
+
+		// a page that takes at least vertexCount vertices and indexSlots index slots
+		unsigned AddPage(RenderBackend& backend, unsigned vertexCount, unsigned indexSlots)
+		{
+			PAGE page;
+			page.vertices.Reset(std::max(vertexCount, pageVertices));
+			page.indices.Reset(std::max(indexSlots, pageIndices));
+			BUFFER_DESC vertexDesc = { BUFFER_TYPE::VERTEX, BUFFER_USAGE::DEFAULT, page.vertices.Capacity() * vertexStride };
+			BUFFER_DESC indexDesc = { BUFFER_TYPE::INDEX, BUFFER_USAGE::DEFAULT, page.indices.Capacity() * indexStride };
+			page.vertexBuffer = backend.CreateBuffer(vertexDesc, nullptr);
+			page.indexBuffer = backend.CreateBuffer(indexDesc, nullptr);
+			pages.push_back(page);
+			return static_cast<unsigned>(pages.size() - 1);
+		}
+		// the index allocators count indexStride sized slots, a wider index takes several
+		unsigned SlotsPerIndex(const GEOMETRY_RANGE& range) const {
+			return range.indexBytes / indexStride;
+		}
+		// takes the vertex and index range in one page, rolls back the vertices if the indices do not fit
+		bool Place(PAGE& page, const GEOMETRY_DATA& data, GEOMETRY_RANGE& range)
+		{
+			if (page.vertices.Allocate(data.vertexCount, range.baseVertex) == false)
+				return false;
+			unsigned slots = SlotsPerIndex(range), firstSlot = 0;
+			if (page.indices.Allocate(data.indexCount * slots, firstSlot, slots) == false) {
+				page.vertices.Free(range.baseVertex, data.vertexCount);
+				return false;
+			}
+			range.firstIndex = firstSlot / slots;
+			return true;
+		}
+		GEOMETRY_RANGE EmptyRange(const GEOMETRY_DATA& data) const {
+			return { 0, 0, 0, data.vertexCount, data.indexCount, data.indexBytes != 0 ? data.indexBytes : indexStride };
+		}
+		void Write(RenderBackend& backend, const GEOMETRY_RANGE& range, const GEOMETRY_DATA& data)
+		{
+			const PAGE& page = pages[range.page];
+			if (data.vertexCount > 0)
+				backend.UpdateBufferRange(page.vertexBuffer, range.baseVertex * vertexStride, data.vertices,
+					data.vertexCount * vertexStride, false);
+			if (data.indexCount > 0)
+				backend.UpdateBufferRange(page.indexBuffer, range.firstIndex * range.indexBytes, data.indices,
+					data.indexCount * range.indexBytes, false);
+		}
+
+	public:
+		// page sizes are in vertices and indexBytes sized index slots,
+		// an asset bigger than a page gets a page of its own size
+		GeometryPool(unsigned vertexBytes, unsigned indexBytes, unsigned verticesPerPage = 1u << 17, unsigned indicesPerPage = 1u << 19)
+			: vertexStride(vertexBytes), indexStride(indexBytes), pageVertices(verticesPerPage), pageIndices(indicesPerPage)
+		{
+		}
+
+		// places and uploads id's geometry (replacing what id had), false if a buffer could not be made
+		bool Add(RenderBackend& backend, unsigned id, const GEOMETRY_DATA& data)
+		{
+			Remove(id);
+			GEOMETRY_RANGE range = EmptyRange(data);
+			if (range.indexBytes < indexStride || range.indexBytes % indexStride != 0)
+				return false;
+			while (range.page < pages.size() && Place(pages[range.page], data, range) == false)
+				++range.page;
+			if (range.page == pages.size()) {
+				AddPage(backend, data.vertexCount, data.indexCount * SlotsPerIndex(range));
+				if (pages.back().vertexBuffer == INVALID_BUFFER || pages.back().indexBuffer == INVALID_BUFFER) {
+					backend.ReleaseBuffer(pages.back().vertexBuffer);
+					backend.ReleaseBuffer(pages.back().indexBuffer);
+					pages.pop_back();
+					return false;
+				}
+				Place(pages.back(), data, range);
+			}
+			if (id >= ranges.size()) {
+				ranges.resize(id + 1);
+				placed.resize(id + 1, false);
+			}
+			ranges[id] = range;
+			placed[id] = true;
+			Write(backend, range, data);
+			return true;
+		}
+
+		// gives id's ranges back, the GPU data stays until something else is placed there
+		void Remove(unsigned id)
+		{
+			if (!Contains(id))
+				return;
+			const GEOMETRY_RANGE& range = ranges[id];
+			pages[range.page].vertices.Free(range.baseVertex, range.vertexCount);
+			pages[range.page].indices.Free(range.firstIndex * SlotsPerIndex(range), range.indexCount * SlotsPerIndex(range));
+			placed[id] = false;
+		}
+
+		// packs every range to the front of the earliest page it fits in and frees
+		// the pages left empty. source(id) returns the GEOMETRY_DATA id was added with,
+		// only ranges that moved are uploaded again. returns the number moved
+		template<typename SOURCE>
+		unsigned Compact(RenderBackend& backend, SOURCE source)
+		{
+			std::vector<unsigned> live;
+			for (unsigned id = 0; id < ranges.size(); ++id)
+				if (placed[id])
+					live.push_back(id);
+			// current position order, so ranges only ever slide towards the front
+			std::sort(live.begin(), live.end(), [&](unsigned a, unsigned b) {
+				if (ranges[a].page != ranges[b].page)
+					return ranges[a].page < ranges[b].page;
+				return ranges[a].baseVertex < ranges[b].baseVertex;
+			});
+			for (PAGE& page : pages) {
+				page.vertices.Reset(page.vertices.Capacity());
+				page.indices.Reset(page.indices.Capacity());
+			}
+			unsigned moved = 0;
+			for (unsigned id : live) {
+				GEOMETRY_DATA data = source(id);
+				GEOMETRY_RANGE range = EmptyRange(data);
+				// the old page always fits it again (it only holds ranges that were in it before),
+				// unless source hands back more than was added
+				for (range.page = 0; range.page < pages.size(); ++range.page)
+					if (Place(pages[range.page], data, range))
+						break;
+				if (range.page == pages.size())
+					Place(pages[AddPage(backend, data.vertexCount, data.indexCount * SlotsPerIndex(range))], data, range);
+				const GEOMETRY_RANGE& old = ranges[id];
+				if (range.page != old.page || range.baseVertex != old.baseVertex || range.firstIndex != old.firstIndex) {
+					Write(backend, range, data);
+					bytesMoved += static_cast<size_t>(data.vertexCount) * vertexStride + static_cast<size_t>(data.indexCount) * range.indexBytes;
+					++moved;
+				}
+				ranges[id] = range;
+			}
+			// empty pages at the back go, earlier empty ones keep their index for the ranges after them
+			while (!pages.empty() && pages.back().vertices.Used() == 0 && pages.back().indices.Used() == 0) {
+				backend.ReleaseBuffer(pages.back().vertexBuffer);
+				backend.ReleaseBuffer(pages.back().indexBuffer);
+				pages.pop_back();
+			}
+			++compactions;
+			return moved;
+		}
+
+		// frees every page
+		void Release(RenderBackend& backend)
+		{
+			for (PAGE& page : pages) {
+				backend.ReleaseBuffer(page.vertexBuffer);
+				backend.ReleaseBuffer(page.indexBuffer);
+			}
+			pages.clear();
+			ranges.clear();
+			placed.clear();
+		}
+
+		bool Contains(unsigned id) const {
+			return id < placed.size() && placed[id];
+		}
+		const GEOMETRY_RANGE& Range(unsigned id) const {
+			return ranges[id];
+		}
+		BufferHandle VertexBuffer(unsigned page) const {
+			return pages[page].vertexBuffer;
+		}
+		BufferHandle IndexBuffer(unsigned page) const {
+			return pages[page].indexBuffer;
+		}
+		unsigned PageCount() const {
+			return static_cast<unsigned>(pages.size());
+		}
+		unsigned VertexStride() const {
+			return vertexStride;
+		}
+		unsigned IndexStride() const {
+			return indexStride;
+		}
+		const RangeAllocator& Vertices(unsigned page) const {
+			return pages[page].vertices;
+		}
+		const RangeAllocator& Indices(unsigned page) const {
+			return pages[page].indices;
+		}
+
+		GEOMETRY_STATS GetStats() const
+		{
+			GEOMETRY_STATS stats = {};
+			stats.pages = static_cast<unsigned>(pages.size());
+			stats.buffers = stats.pages * 2;
+			stats.compactions = compactions;
+			stats.bytesMoved = bytesMoved;
+			for (bool isPlaced : placed)
+				stats.ranges += isPlaced ? 1 : 0;
+			size_t freeBytes = 0;
+			for (const PAGE& page : pages) {
+				const RangeAllocator* allocators[] = { &page.vertices, &page.indices };
+				const unsigned strides[] = { vertexStride, indexStride };
+				for (int i = 0; i < 2; ++i) {
+					const RangeAllocator& allocator = *allocators[i];
+					stats.capacityBytes += static_cast<size_t>(allocator.Capacity()) * strides[i];
+					stats.usedBytes += static_cast<size_t>(allocator.Used()) * strides[i];
+					stats.holeBytes += static_cast<size_t>(allocator.HoleElements()) * strides[i];
+					stats.largestFreeBytes = std::max(stats.largestFreeBytes, static_cast<size_t>(allocator.LargestFree()) * strides[i]);
+					stats.freeBlocks += allocator.FreeBlocks();
+					freeBytes += static_cast<size_t>(allocator.Capacity() - allocator.Used()) * strides[i];
+				}
+			}
+			stats.fragmentation = freeBytes > 0 ? static_cast<double>(stats.holeBytes) / freeBytes : 0.0;
+			return stats;
+		}
+	};
+}
+#endif
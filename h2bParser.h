@@ -3,6 +3,25 @@
 #include <fstream>
 #include <vector>
 #include <set>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <utility>
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace H2B {
 
@@ -117,5 +136,284 @@ namespace H2B {
 			meshes.clear();
 		}
 	};
+
+	// Read-only window over a run of elements. MappedParser hands these out
+	// so vertex/index data points straight into the file mapping.
+	template<typename T>
+	struct Span {
+		const T* ptr = nullptr;
+		size_t count = 0;
+		const T* data() const { return ptr; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		const T* begin() const { return ptr; }
+		const T* end() const { return ptr + count; }
+		const T& operator[](size_t i) const { return ptr[i]; }
+	};
+
+	// Read-only memory mapping of a whole file (closed on destruction)
+	class MappedFile
+	{
+		const char* base = nullptr;
+		size_t length = 0;
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+		MappedFile& operator=(MappedFile&& other) noexcept
+		{
+			if (this != &other) {
+				Close();
+				base = other.base; other.base = nullptr;
+				length = other.length; other.length = 0;
+#if defined(_WIN32)
+				file = other.file; other.file = INVALID_HANDLE_VALUE;
+				mapping = other.mapping; other.mapping = nullptr;
+#endif
+			}
+			return *this;
+		}
+		~MappedFile() { Close(); }
+
+		const char* Data() const { return base; }
+		size_t Size() const { return length; }
+
+		bool Open(const char* path)
+		{
+			Close();
+#if defined(_WIN32)
+			file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+				Close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr) {
+				Close();
+				return false;
+			}
+			base = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (base == nullptr) {
+				Close();
+				return false;
+			}
+			length = static_cast<size_t>(fileSize.QuadPart);
+#else
+			int fd = open(path, O_RDONLY);
+			if (fd < 0)
+				return false;
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+				close(fd);
+				return false;
+			}
+			void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd); // the mapping keeps its own reference to the file
+			if (view == MAP_FAILED)
+				return false;
+			base = static_cast<const char*>(view);
+			length = static_cast<size_t>(info.st_size);
+#endif
+			return true;
+		}
+		void Close()
+		{
+#if defined(_WIN32)
+			if (base != nullptr)
+				UnmapViewOfFile(base);
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (base != nullptr)
+				munmap(const_cast<char*>(base), length);
+#endif
+			base = nullptr;
+			length = 0;
+		}
+	};
+
+	// Zero-copy counterparts of MATERIAL/MESH, names point into the mapping.
+	// ATTRIBUTES is copied since the file gives no alignment guarantee for it,
+	// the same goes for the batches that follow the variable length names.
+	struct MATERIAL_VIEW {
+		ATTRIBUTES attrib;
+		std::string_view name;
+		std::string_view map_Kd;
+		std::string_view map_Ks;
+		std::string_view map_Ka;
+		std::string_view map_Ke;
+		std::string_view map_Ns;
+		std::string_view map_d;
+		std::string_view disp;
+		std::string_view decal;
+		std::string_view bump;
+	};
+	struct MESH_VIEW {
+		std::string_view name;
+		BATCH drawInfo;
+		unsigned materialIndex;
+	};
+
+	// Memory mapped alternative to Parser. Nothing is copied out of the file
+	// except the small per material/batch/mesh records, every offset is checked
+	// against the file size first so a truncated .h2b is rejected up front.
+	class MappedParser
+	{
+		MappedFile file;
+
+		// bounds checked cursor used by the validation pass
+		struct Cursor {
+			const char* pos;
+			const char* end;
+			bool Take(unsigned long long bytes, const char*& out) {
+				if (bytes > static_cast<unsigned long long>(end - pos))
+					return false;
+				out = pos;
+				pos += bytes;
+				return true;
+			}
+			bool TakeString(std::string_view& out) {
+				const void* terminator = std::memchr(pos, '\0', end - pos);
+				if (terminator == nullptr)
+					return false;
+				out = std::string_view(pos, static_cast<const char*>(terminator) - pos);
+				pos = static_cast<const char*>(terminator) + 1;
+				return true;
+			}
+		};
+	public:
+		// fixed part of the file: version + 4 counts
+		static constexpr size_t HEADER_SIZE = 20;
+
+		char version[4];
+		unsigned vertexCount;
+		unsigned indexCount;
+		unsigned materialCount;
+		unsigned meshCount;
+		Span<VERTEX> vertices;
+		Span<unsigned> indices;
+		std::vector<MATERIAL_VIEW> materials;
+		std::vector<BATCH> batches;
+		std::vector<MESH_VIEW> meshes;
+
+		MappedParser() { Clear(); }
+
+		bool Parse(const char* h2bPath)
+		{
+			Clear();
+			if (file.Open(h2bPath) == false)
+				return false;
+			if (ParseMemory(file.Data(), file.Size()) == false) {
+				file.Close();
+				return false;
+			}
+			return true;
+		}
+		// Builds the views over an already loaded image of a .h2b file.
+		// The memory must outlive the views, Parse() keeps its own mapping alive.
+		bool ParseMemory(const char* data, size_t size)
+		{
+			ClearViews();
+			if (data == nullptr || size < HEADER_SIZE)
+				return false;
+			std::memcpy(version, data, 4);
+			if (version[1] < '1' || version[2] < '9' || version[3] < 'd')
+				return false;
+			std::memcpy(&vertexCount, data + 4, 4);
+			std::memcpy(&indexCount, data + 8, 4);
+			std::memcpy(&materialCount, data + 12, 4);
+			std::memcpy(&meshCount, data + 16, 4);
+
+			// smallest possible file for these counts (every string empty)
+			unsigned long long minimumSize = HEADER_SIZE
+				+ 36ull * vertexCount + 4ull * indexCount
+				+ (80ull + 10ull) * materialCount + 8ull * materialCount
+				+ (1ull + 12ull) * meshCount;
+			if (minimumSize > size)
+				return false;
+
+			Cursor cursor = { data + HEADER_SIZE, data + size };
+			const char* block = nullptr;
+			cursor.Take(36ull * vertexCount, block);
+			vertices.ptr = reinterpret_cast<const VERTEX*>(block);
+			vertices.count = vertexCount;
+			cursor.Take(4ull * indexCount, block);
+			indices.ptr = reinterpret_cast<const unsigned*>(block);
+			indices.count = indexCount;
+
+			static std::string_view MATERIAL_VIEW::* const names[10] = {
+				&MATERIAL_VIEW::name, &MATERIAL_VIEW::map_Kd, &MATERIAL_VIEW::map_Ks,
+				&MATERIAL_VIEW::map_Ka, &MATERIAL_VIEW::map_Ke, &MATERIAL_VIEW::map_Ns,
+				&MATERIAL_VIEW::map_d, &MATERIAL_VIEW::disp, &MATERIAL_VIEW::decal,
+				&MATERIAL_VIEW::bump };
+			materials.resize(materialCount);
+			for (unsigned i = 0; i < materialCount; ++i) {
+				if (cursor.Take(80, block) == false)
+					return Reject();
+				std::memcpy(&materials[i].attrib, block, 80);
+				for (int j = 0; j < 10; ++j)
+					if (cursor.TakeString(materials[i].*names[j]) == false)
+						return Reject();
+			}
+			if (cursor.Take(8ull * materialCount, block) == false)
+				return Reject();
+			batches.resize(materialCount);
+			if (materialCount > 0)
+				std::memcpy(batches.data(), block, 8ull * materialCount);
+
+			meshes.resize(meshCount);
+			for (unsigned i = 0; i < meshCount; ++i) {
+				if (cursor.TakeString(meshes[i].name) == false ||
+					cursor.Take(12, block) == false)
+					return Reject();
+				std::memcpy(&meshes[i].drawInfo, block, 8);
+				std::memcpy(&meshes[i].materialIndex, block + 8, 4);
+			}
+
+			// draw ranges must stay inside the index data
+			for (const BATCH& batch : batches)
+				if (static_cast<unsigned long long>(batch.indexOffset) + batch.indexCount > indexCount)
+					return Reject();
+			for (const MESH_VIEW& mesh : meshes)
+				if (static_cast<unsigned long long>(mesh.drawInfo.indexOffset) + mesh.drawInfo.indexCount > indexCount ||
+					(materialCount > 0 && mesh.materialIndex >= materialCount))
+					return Reject();
+			return true;
+		}
+		void Clear()
+		{
+			file.Close();
+			ClearViews();
+		}
+	private:
+		bool Reject()
+		{
+			ClearViews();
+			return false;
+		}
+		void ClearViews()
+		{
+			*reinterpret_cast<unsigned*>(version) = 0;
+			vertexCount = indexCount = materialCount = meshCount = 0;
+			vertices = Span<VERTEX>();
+			indices = Span<unsigned>();
+			materials.clear();
+			batches.clear();
+			meshes.clear();
+		}
+	};
 }
 #endif
\ No newline at end of file
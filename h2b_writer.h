@@ -0,0 +1,65 @@
+#ifndef _H2B_WRITER_H_
+#define _H2B_WRITER_H_
+// Writes H2B::Parser data back out in the layout Parser/MappedParser read:
+// version, the 4 counts, vertices, indices, every material's attributes
+// followed by its 10 strings (name .. bump, empty for nullptr), the batches
+// and every mesh's name, draw range and material index.
+// A parsed file written unchanged comes out byte for byte the same.
+#include <fstream>
+#include <vector>
+#include "h2bParser.h"
+
+namespace Level {
+
+	inline void AppendBytes(std::vector<char>& out, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	}
+	inline void AppendString(std::vector<char>& out, const char* text)
+	{
+		if (text != nullptr)
+			AppendBytes(out, text, std::strlen(text));
+		out.push_back('\0');
+	}
+
+	// the whole file in memory, the counts come from the vectors, not the header fields
+	inline void SerializeH2B(const H2B::Parser& model, std::vector<char>& out)
+	{
+		out.clear();
+		const unsigned counts[4] = { static_cast<unsigned>(model.vertices.size()), static_cast<unsigned>(model.indices.size()),
+			static_cast<unsigned>(model.materials.size()), static_cast<unsigned>(model.meshes.size()) };
+		AppendBytes(out, model.version, 4);
+		AppendBytes(out, counts, sizeof(counts));
+		AppendBytes(out, model.vertices.data(), sizeof(H2B::VERTEX) * model.vertices.size());
+		AppendBytes(out, model.indices.data(), sizeof(unsigned) * model.indices.size());
+		for (const H2B::MATERIAL& material : model.materials) {
+			AppendBytes(out, &material.attrib, 80);
+			for (int j = 0; j < 10; ++j)
+				AppendString(out, *((&material.name) + j));
+		}
+		// Parser reads one batch per material
+		for (size_t i = 0; i < model.materials.size(); ++i) {
+			H2B::BATCH batch = i < model.batches.size() ? model.batches[i] : H2B::BATCH{ 0, 0 };
+			AppendBytes(out, &batch, sizeof(batch));
+		}
+		for (const H2B::MESH& mesh : model.meshes) {
+			AppendString(out, mesh.name);
+			AppendBytes(out, &mesh.drawInfo, sizeof(mesh.drawInfo));
+			AppendBytes(out, &mesh.materialIndex, sizeof(mesh.materialIndex));
+		}
+	}
+
+	// false if the file can not be written
+	inline bool WriteH2B(const char* h2bPath, const H2B::Parser& model)
+	{
+		std::vector<char> bytes;
+		SerializeH2B(model, bytes);
+		std::ofstream file(h2bPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (file.is_open() == false)
+			return false;
+		file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		return static_cast<bool>(file);
+	}
+}
+#endif
@@ -0,0 +1,160 @@
+#ifndef _IMAGE_COMPARE_H_
+#define _IMAGE_COMPARE_H_
+// RGB images for the software backend: run length encoded .tga read/write and
+// a tolerance based comparison against stored reference frames.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Level {
+
+	struct IMAGE {
+		unsigned width = 0, height = 0;
+		std::vector<unsigned char> rgb; // top row first, 3 bytes per pixel
+	};
+
+	struct IMAGE_DIFF {
+		bool sizeMatches;
+		unsigned maxError;			// largest channel difference (0..255)
+		unsigned long long badPixels;	// pixels with a channel off by more than the tolerance
+		double badFraction;
+		double rmse;				// over all channels, 0..255
+	};
+
+	// 24 bit type 10 (RLE truecolor) .tga, readable by most image viewers
+	inline bool WriteTGA(const char* path, const IMAGE& image)
+	{
+		FILE* file = std::fopen(path, "wb");
+		if (file == nullptr)
+			return false;
+		unsigned char header[18] = { 0 };
+		header[2] = 10;
+		header[12] = image.width & 0xFF;
+		header[13] = (image.width >> 8) & 0xFF;
+		header[14] = image.height & 0xFF;
+		header[15] = (image.height >> 8) & 0xFF;
+		header[16] = 24;
+		header[17] = 0x20; // top left origin
+		std::vector<unsigned char> packets;
+		for (unsigned y = 0; y < image.height; ++y) {
+			// packets never cross a row
+			const unsigned char* row = image.rgb.data() + static_cast<size_t>(y) * image.width * 3;
+			unsigned x = 0;
+			while (x < image.width) {
+				unsigned run = 1;
+				while (x + run < image.width && run < 128 && std::equal(row + x * 3, row + x * 3 + 3, row + (x + run) * 3))
+					++run;
+				if (run > 1) {
+					packets.push_back(static_cast<unsigned char>(0x80 | (run - 1)));
+					packets.insert(packets.end(), { row[x * 3 + 2], row[x * 3 + 1], row[x * 3] });
+					x += run;
+					continue;
+				}
+				// raw packet until the next run of 2+
+				unsigned count = 1;
+				while (x + count < image.width && count < 128 &&
+					!(x + count + 1 < image.width && std::equal(row + (x + count) * 3, row + (x + count) * 3 + 3, row + (x + count + 1) * 3)))
+					++count;
+				packets.push_back(static_cast<unsigned char>(count - 1));
+				for (unsigned i = 0; i < count; ++i)
+					packets.insert(packets.end(), { row[(x + i) * 3 + 2], row[(x + i) * 3 + 1], row[(x + i) * 3] });
+				x += count;
+			}
+		}
+		bool written = std::fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+			std::fwrite(packets.data(), 1, packets.size(), file) == packets.size();
+		return std::fclose(file) == 0 && written;
+	}
+
+	// reads 24/32 bit raw or RLE .tga files (types 2 and 10)
+	inline bool ReadTGA(const char* path, IMAGE& image)
+	{
+		FILE* file = std::fopen(path, "rb");
+		if (file == nullptr)
+			return false;
+		std::vector<unsigned char> bytes;
+		unsigned char chunk[65536];
+		size_t read;
+		while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+			bytes.insert(bytes.end(), chunk, chunk + read);
+		std::fclose(file);
+		if (bytes.size() < 18)
+			return false;
+		unsigned type = bytes[2], depth = bytes[16], descriptor = bytes[17];
+		image.width = bytes[12] | (bytes[13] << 8);
+		image.height = bytes[14] | (bytes[15] << 8);
+		if ((type != 2 && type != 10) || (depth != 24 && depth != 32) || bytes[1] != 0)
+			return false;
+		unsigned pixelSize = depth / 8;
+		size_t pixels = static_cast<size_t>(image.width) * image.height;
+		image.rgb.assign(pixels * 3, 0);
+		size_t at = 18 + bytes[0];
+		auto copyPixel = [&](size_t pixel, size_t from) {
+			image.rgb[pixel * 3 + 0] = bytes[from + 2];
+			image.rgb[pixel * 3 + 1] = bytes[from + 1];
+			image.rgb[pixel * 3 + 2] = bytes[from + 0];
+		};
+		size_t pixel = 0;
+		while (pixel < pixels) {
+			unsigned count = 1;
+			bool repeat = false;
+			if (type == 10) {
+				if (at >= bytes.size())
+					return false;
+				repeat = (bytes[at] & 0x80) != 0;
+				count = (bytes[at] & 0x7F) + 1;
+				++at;
+			}
+			if (pixel + count > pixels || at + (repeat ? 1 : count) * pixelSize > bytes.size())
+				return false;
+			for (unsigned i = 0; i < count; ++i) {
+				copyPixel(pixel++, at);
+				if (!repeat)
+					at += pixelSize;
+			}
+			if (repeat)
+				at += pixelSize;
+		}
+		// bottom left origin unless bit 5 is set
+		if ((descriptor & 0x20) == 0) {
+			size_t rowBytes = static_cast<size_t>(image.width) * 3;
+			for (unsigned y = 0; y < image.height / 2; ++y)
+				std::swap_ranges(image.rgb.begin() + y * rowBytes, image.rgb.begin() + (y + 1) * rowBytes,
+					image.rgb.begin() + (image.height - 1 - y) * rowBytes);
+		}
+		return true;
+	}
+
+	// A pixel is "bad" if any channel differs by more than tolerance.
+	// Small rasterization differences (edge pixels, float rounding) stay below it.
+	inline IMAGE_DIFF CompareImages(const IMAGE& image, const IMAGE& reference, unsigned tolerance)
+	{
+		IMAGE_DIFF diff = {};
+		diff.sizeMatches = image.width == reference.width && image.height == reference.height &&
+			image.rgb.size() == reference.rgb.size();
+		if (!diff.sizeMatches) {
+			diff.badFraction = 1.0;
+			return diff;
+		}
+		double squared = 0;
+		for (size_t p = 0; p < image.rgb.size(); p += 3) {
+			unsigned worst = 0;
+			for (size_t c = 0; c < 3; ++c) {
+				int delta = static_cast<int>(image.rgb[p + c]) - static_cast<int>(reference.rgb[p + c]);
+				unsigned error = static_cast<unsigned>(delta < 0 ? -delta : delta);
+				worst = error > worst ? error : worst;
+				squared += static_cast<double>(delta) * delta;
+			}
+			diff.maxError = worst > diff.maxError ? worst : diff.maxError;
+			if (worst > tolerance)
+				++diff.badPixels;
+		}
+		size_t pixels = image.rgb.size() / 3;
+		diff.badFraction = pixels ? static_cast<double>(diff.badPixels) / pixels : 0.0;
+		diff.rmse = image.rgb.empty() ? 0.0 : std::sqrt(squared / image.rgb.size());
+		return diff;
+	}
+}
+#endif
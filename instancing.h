@@ -0,0 +1,112 @@
+#ifndef _INSTANCING_H_
+#define _INSTANCING_H_
+// Groups placed instances by asset, level of detail and sub-mesh so each group
+// can be drawn with a single DrawIndexedInstanced, and packs their world matrices into
+// the per-instance vertex buffer layout (one float4x4 per instance).
+#include <algorithm>
+#include <vector>
+#include "asset_cache.h"
+#include "job_system.h"
+#include "level_file.h"
+
+namespace Level {
+
+	// one placed copy of an asset, drawn with the asset's level of detail lod
+	struct INSTANCE {
+		AssetHandle asset;
+		MATRIX world;
+		unsigned lod = 0;
+	};
+
+	// one instanced draw: a sub-mesh of an asset at one level for a run of instances
+	struct INSTANCE_GROUP {
+		AssetHandle asset;
+		unsigned lod;
+		unsigned meshIndex;
+		unsigned materialIndex;
+		unsigned indexCount;
+		unsigned indexOffset;
+		unsigned firstInstance; // StartInstanceLocation into instanceData
+		unsigned instanceCount;
+	};
+
+	class InstanceBatcher
+	{
+		// scratch for the counting sort, kept to avoid reallocating every build
+		// (keyed by asset * MAX_LODS + lod)
+		std::vector<unsigned> assetStart;
+		std::vector<unsigned> order;
+	public:
+		std::vector<INSTANCE_GROUP> groups;
+		// world matrices packed per asset and level, every sub-mesh group of
+		// them shares the same run so each matrix is stored once
+		std::vector<MATRIX> instanceData;
+
+		// jobs (optional) copies the matrices in parallel
+		void Build(const std::vector<INSTANCE>& instances, const AssetCache& assets, JobSystem* jobs = nullptr)
+		{
+			groups.clear();
+			instanceData.clear();
+
+			// counting sort by asset handle and level, stable so instance order within them is kept
+			auto key = [&](const INSTANCE& instance) {
+				return instance.asset * MAX_LODS + std::min(instance.lod, assets.Lods(instance.asset).count - 1);
+			};
+			assetStart.assign(assets.Capacity() * MAX_LODS + 1, 0);
+			for (const INSTANCE& instance : instances)
+				if (assets.IsValid(instance.asset))
+					++assetStart[key(instance) + 1];
+			for (size_t i = 1; i < assetStart.size(); ++i)
+				assetStart[i] += assetStart[i - 1];
+			order.resize(assetStart.back());
+			std::vector<unsigned> cursor(assetStart.begin(), assetStart.end() - 1);
+			for (unsigned i = 0; i < instances.size(); ++i)
+				if (assets.IsValid(instances[i].asset))
+					order[cursor[key(instances[i])]++] = i;
+
+			instanceData.resize(order.size());
+			ParallelFor(jobs, static_cast<unsigned>(order.size()), 8192, [&](unsigned begin, unsigned end) {
+				for (unsigned i = begin; i < end; ++i)
+					instanceData[i] = instances[order[i]].world;
+			});
+
+			for (unsigned run = 0; run + 1 < assetStart.size(); ++run) {
+				unsigned count = assetStart[run + 1] - assetStart[run];
+				if (count == 0)
+					continue;
+				const AssetHandle asset = run / MAX_LODS;
+				const H2B::Parser& model = assets.Get(asset);
+				const ASSET_LODS& lods = assets.Lods(asset);
+				for (unsigned m = 0; m < model.meshCount; ++m) {
+					INSTANCE_GROUP group;
+					group.asset = asset;
+					group.lod = run % MAX_LODS;
+					group.meshIndex = m;
+					group.materialIndex = model.meshes[m].materialIndex;
+					group.indexCount = lods.Range(group.lod, m).indexCount;
+					group.indexOffset = lods.Range(group.lod, m).indexOffset;
+					group.firstInstance = assetStart[run];
+					group.instanceCount = count;
+					groups.push_back(group);
+				}
+			}
+		}
+
+		// draws needed without instancing (one per sub-mesh per instance)
+		static size_t DrawCallsWithoutInstancing(const std::vector<INSTANCE>& instances, const AssetCache& assets)
+		{
+			size_t draws = 0;
+			for (const INSTANCE& instance : instances)
+				if (assets.IsValid(instance.asset))
+					draws += assets.Get(instance.asset).meshCount;
+			return draws;
+		}
+		size_t DrawCalls() const {
+			return groups.size();
+		}
+		size_t InstanceBufferBytes() const {
+			return sizeof(MATRIX) * instanceData.size();
+		}
+	};
+}
+#endif
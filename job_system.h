@@ -0,0 +1,276 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+// Work stealing job scheduler. Every worker owns a deque: it pushes and pops
+// its own jobs at the back (newest first, still hot in cache) while idle
+// workers steal the oldest job from the front of someone else's. Threads
+// that are not workers submit into one shared queue. A job can depend on
+// others and is only queued once they have all finished. Waiting on a job
+// runs other jobs instead of blocking, so Wait and ParallelFor are safe to
+// call from inside a job. Every job belongs to the thread outside the system
+// that started its work (jobs submitted from a job inherit it), and a thread
+// that is not a worker only runs jobs of the one it waits for: a frame's
+// ParallelFor never picks up a streaming load's parse or LOD jobs.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "profiler.h"
+
+namespace Level {
+
+	struct JOB {
+		std::function<void()> work;
+		std::atomic<unsigned> blockers{ 1 };	// unfinished dependencies, +1 until submitted
+		std::atomic<bool> finished{ false };
+		std::mutex lock;						// guards dependents against finishing
+		std::vector<std::shared_ptr<JOB>> dependents;
+		std::thread::id owner;					// the thread outside the system whose work this is
+	};
+	typedef std::shared_ptr<JOB> JobHandle;
+
+	struct JOB_STATS {
+		unsigned long long executed;	// jobs run
+		unsigned long long stolen;		// of those, taken from another thread's queue
+	};
+
+	class JobSystem
+	{
+		struct QUEUE {
+			std::mutex lock;
+			std::deque<JobHandle> jobs;
+		};
+		// one per worker, the last one is shared by every other thread
+		std::vector<std::unique_ptr<QUEUE>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<unsigned> queued{ 0 };
+		std::atomic<bool> stop{ false };
+		std::mutex wakeLock;
+		std::condition_variable wake;
+		std::atomic<unsigned long long> executed{ 0 }, stolen{ 0 };
+
+		struct Worker {
+			const JobSystem* system;
+			unsigned index;
+			const JobSystem* runningIn;		// the job this thread is running, if any
+			std::thread::id owner;			// and that job's owner
+		};
+		static Worker& CurrentWorker()
+		{
+			static thread_local Worker self = { nullptr, 0, nullptr, std::thread::id() };
+			return self;
+		}
+		// queue of the calling thread in this system
+		unsigned CurrentQueue() const
+		{
+			const Worker& self = CurrentWorker();
+			return self.system == this ? self.index : static_cast<unsigned>(queues.size() - 1);
+		}
+
+		void Push(JobHandle job)
+		{
+			QUEUE& queue = *queues[CurrentQueue()];
+			++queued;
+			{
+				std::lock_guard<std::mutex> guard(queue.lock);
+				queue.jobs.push_back(std::move(job));
+			}
+			// taking the lock orders this with a worker checking queued before it sleeps
+			{ std::lock_guard<std::mutex> guard(wakeLock); }
+			wake.notify_one();
+		}
+
+		// owner of the jobs the calling thread submits
+		std::thread::id CurrentOwner() const
+		{
+			const Worker& self = CurrentWorker();
+			return self.runningIn == this ? self.owner : std::this_thread::get_id();
+		}
+
+		// own queue newest first, then the oldest job of the others. A default owner takes any job,
+		// otherwise only that owner's jobs are taken
+		bool TryRun(unsigned self, std::thread::id owner = std::thread::id())
+		{
+			const bool any = owner == std::thread::id();
+			JobHandle job;
+			{
+				QUEUE& own = *queues[self];
+				std::lock_guard<std::mutex> guard(own.lock);
+				for (auto at = own.jobs.rbegin(); at != own.jobs.rend(); ++at)
+					if (any || (*at)->owner == owner) {
+						job = std::move(*at);
+						own.jobs.erase(std::next(at).base());
+						break;
+					}
+			}
+			const size_t count = queues.size();
+			for (size_t offset = 1; !job && offset < count; ++offset) {
+				QUEUE& victim = *queues[(self + offset) % count];
+				std::lock_guard<std::mutex> guard(victim.lock);
+				for (auto at = victim.jobs.begin(); at != victim.jobs.end(); ++at)
+					if (any || (*at)->owner == owner) {
+						job = std::move(*at);
+						victim.jobs.erase(at);
+						++stolen;
+						break;
+					}
+			}
+			if (!job)
+				return false;
+			--queued;
+			Worker& running = CurrentWorker();
+			const Worker outer = running;
+			running.runningIn = this;
+			running.owner = job->owner;
+			{
+				LEVEL_PROFILE_SCOPE("Job");
+				job->work();
+			}
+			running.runningIn = outer.runningIn;
+			running.owner = outer.owner;
+			job->work = nullptr;
+			++executed;
+			Finish(job);
+			return true;
+		}
+
+		void Finish(const JobHandle& job)
+		{
+			std::vector<JobHandle> ready;
+			{
+				std::lock_guard<std::mutex> guard(job->lock);
+				job->finished = true;
+				ready.swap(job->dependents);
+			}
+			for (JobHandle& dependent : ready)
+				if (--dependent->blockers == 0)
+					Push(std::move(dependent));
+		}
+
+		void WorkerLoop(unsigned index)
+		{
+			CurrentWorker() = { this, index, nullptr, std::thread::id() };
+			LEVEL_PROFILE_THREAD("job worker " + std::to_string(index));
+			while (!stop) {
+				if (TryRun(index))
+					continue;
+				std::unique_lock<std::mutex> guard(wakeLock);
+				wake.wait(guard, [&]() { return stop || queued > 0; });
+			}
+		}
+
+	public:
+		// threads counts the calling thread, 0 uses every hardware thread.
+		// with 1 thread there are no workers and jobs run inside Wait/ParallelFor
+		explicit JobSystem(unsigned threads = 0)
+		{
+			if (threads == 0)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned i = 0; i < threads; ++i)
+				queues.emplace_back(new QUEUE);
+			for (unsigned i = 0; i + 1 < threads; ++i)
+				workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+		}
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+		~JobSystem()
+		{
+			{
+				std::lock_guard<std::mutex> guard(wakeLock);
+				stop = true;
+			}
+			wake.notify_all();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+
+		unsigned Threads() const {
+			return static_cast<unsigned>(workers.size() + 1);
+		}
+
+		// queues work once every dependency has finished
+		JobHandle Submit(std::function<void()> work, const std::vector<JobHandle>& dependencies)
+		{
+			JobHandle job = std::make_shared<JOB>();
+			job->work = std::move(work);
+			job->owner = CurrentOwner();
+			for (const JobHandle& dependency : dependencies) {
+				if (!dependency)
+					continue;
+				std::lock_guard<std::mutex> guard(dependency->lock);
+				if (dependency->finished == false) {
+					++job->blockers;
+					dependency->dependents.push_back(job);
+				}
+			}
+			if (--job->blockers == 0)
+				Push(job);
+			return job;
+		}
+		JobHandle Submit(std::function<void()> work, std::initializer_list<JobHandle> dependencies = {})
+		{
+			return Submit(std::move(work), std::vector<JobHandle>(dependencies));
+		}
+
+		// runs queued jobs on this thread until job has finished. Workers run any job, other
+		// threads only job's owner's (any job without workers, nobody else would run them)
+		void Wait(const JobHandle& job)
+		{
+			if (!job)
+				return;
+			const unsigned self = CurrentQueue();
+			const std::thread::id only = CurrentWorker().system == this || workers.empty() ? std::thread::id() : job->owner;
+			while (job->finished == false)
+				if (TryRun(self, only) == false)
+					std::this_thread::yield();
+		}
+
+		// body(begin, end) over [0, count) in chunks of grain, the caller takes part.
+		// one job per thread pulls chunks off a shared counter so uneven chunks balance out
+		template<typename BODY>
+		void ParallelFor(unsigned count, unsigned grain, const BODY& body)
+		{
+			grain = std::max(1u, grain);
+			unsigned chunks = (count + grain - 1) / grain;
+			if (chunks <= 1 || workers.empty()) {
+				if (count > 0)
+					body(0u, count);
+				return;
+			}
+			std::atomic<unsigned> next{ 0 };
+			auto run = [&]() {
+				for (unsigned chunk = next++; chunk < chunks; chunk = next++)
+					body(chunk * grain, std::min(count, (chunk + 1) * grain));
+			};
+			std::vector<JobHandle> helpers;
+			unsigned helperCount = std::min<unsigned>(chunks, Threads()) - 1;
+			for (unsigned i = 0; i < helperCount; ++i)
+				helpers.push_back(Submit(run));
+			run();
+			for (const JobHandle& helper : helpers)
+				Wait(helper);
+		}
+
+		JOB_STATS Stats() const {
+			return { executed.load(), stolen.load() };
+		}
+	};
+
+	// ParallelFor on jobs, or a plain loop without a job system
+	template<typename BODY>
+	void ParallelFor(JobSystem* jobs, unsigned count, unsigned grain, const BODY& body)
+	{
+		if (jobs != nullptr)
+			jobs->ParallelFor(count, grain, body);
+		else if (count > 0)
+			body(0u, count);
+	}
+}
+#endif
@@ -0,0 +1,4196 @@
+// Headless benchmarks for the CPU side of the level renderer.
+// Only uses the Gateware free headers so it builds and runs on any platform.
+//
+// usage: Level_Benchmark h2b [parse|mapped|both] [iterations] [folders...]
+//   Peak RSS is per process, run "parse" and "mapped" separately to compare it.
+//        Level_Benchmark assets [level.txt h2bFolder]...
+//        Level_Benchmark instancing [level.txt h2bFolder]...
+//        Level_Benchmark shadercache [shaderFolder] [models]
+//        Level_Benchmark frame [frames] [level.txt h2bFolder]... [--dump folder]
+//        Level_Benchmark culling [frames] [level.txt h2bFolder]... [--instances n]
+//        Level_Benchmark raster [frames] [level.txt h2bFolder]... [--threads n] [--write folder] [--compare folder] [--tolerance n]
+//        Level_Benchmark lvlb [iterations] [level.txt h2bFolder]... [--instances n]
+//   --instances 0 skips the generated level, cold times need the OS page cache to be droppable.
+//        Level_Benchmark parse [iterations] [level.txt h2bFolder]... [--megabytes n] [--threads n]
+//        Level_Benchmark streaming [level.txt h2bFolder]... [--instances n] [--fps n] [--budget ms] [--threads n]
+//   The first level is shown while every level (and a generated one) streams in.
+//        Level_Benchmark jobs [iterations] [level.txt h2bFolder]... [--instances n] [--frames n]
+//   Defaults to GameLevel2.txt plus a generated level, at 1, 2, 4, 8 and 16 threads.
+//        Level_Benchmark queue [frames] [level.txt h2bFolder]... [--instances n]
+//        Level_Benchmark upload [level.txt h2bFolder]...
+//        Level_Benchmark geometry [level.txt h2bFolder]...
+//   The first level is also swapped for a level with half of its assets to exercise compaction.
+//        Level_Benchmark vertexformat [level.txt h2bFolder]... [--tolerance n]
+//   Reports every asset's COMPACT size and error (the levels' folders), then renders each level both ways.
+//        Level_Benchmark optimize [folders...] [--threshold x] [--threads n] [--write folder]
+//   Optimizes every .h2b, --write stores the results (same file names) in folder.
+//        Level_Benchmark lod [frames] [level.txt h2bFolder]... [--tolerance n]
+//        Level_Benchmark static [level.txt h2bFolder]... [--chunk size] [--merge asset|material]
+//   Counts draw calls with and without static batches, sweeps the chunk size and compares the views.
+//        Level_Benchmark profiler [iterations] [level.txt h2bFolder]... [--frames n] [--trace file.json]
+//   Measures what a profiler scope costs, then profiles each level and writes a Chrome trace.
+//        Level_Benchmark suite [level.txt h2bFolder]... [--sizes 1000,10000,...] [--seed n] [--repeat n] [--frames n]
+//                              [--threads n] [--json out.json] [--compare baseline.json] [--threshold 0.15]
+//   Times parsing, .h2b loading, scene construction, culling and draw list building on levels
+//   of every size scattered from the given levels' assets, fails on regressions against --compare.
+//        Level_Benchmark batchmath [--sizes 10000,100000,1000000] [--seed n] [--repeat n]
+//   Scalar against SIMD bounds transform, frustum test and view depth, the results must be identical.
+//        Level_Benchmark scene [level.txt h2bFolder]... [--instances n] [--frames n]
+//   Per frame walks and memory per instance of the scene store against the old std::list<Model>.
+//        Level_Benchmark recording [frames] [level.txt h2bFolder]... [--instances n] [--draws n] [--threads 1,2,4,8]
+//   Command recording time per thread count, the streams must match single threaded recording.
+//        Level_Benchmark occlusion [frames] [level.txt h2bFolder]... [--width n] [--height n] [--occluders n] [--crack m] [--tolerance n]
+//   Walks the floor tiles of GameLevel.txt's dungeon and of two such rooms, culled instances must not change the picture.
+//        Level_Benchmark lights [frames] [level.txt h2bFolder]... [--lights 256,1024,4096,16384] [--threads n] [--tolerance n]
+//   Bins scattered lights into clusters against brute force, then renders with and without clusters.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include "h2bParser.h"
+#include "level_hash.h"
+#include "level_file.h"
+#include "asset_cache.h"
+#include "instancing.h"
+#include "shader_cache.h"
+#include "recording_backend.h"
+#include "software_backend.h"
+#include "culling.h"
+#include "batch_math.h"
+#include "scene_store.h"
+#include "level_binary.h"
+#include "load_object_oriented.h"
+#include "level_streaming.h"
+#include "job_system.h"
+#include "render_queue.h"
+#include "geometry_pool.h"
+#include "vertex_format.h"
+#include "mesh_optimizer.h"
+#include "h2b_writer.h"
+#include "level_of_detail.h"
+#include "profiler.h"
+
+#if defined(_WIN32)
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// resident set size of this process in bytes
+	size_t CurrentRSS()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.WorkingSetSize;
+#else
+		long pages = 0, resident = 0;
+		FILE* statm = std::fopen("/proc/self/statm", "r");
+		if (statm == nullptr)
+			return 0;
+		if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		std::fclose(statm);
+		return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	size_t PeakRSS()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.PeakWorkingSetSize;
+#else
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return static_cast<size_t>(usage.ru_maxrss) * 1024; // reported in KB on linux
+#endif
+	}
+
+	std::vector<std::string> FindFiles(const std::vector<std::string>& folders, const char* extension)
+	{
+		std::vector<std::string> files;
+		for (const std::string& folder : folders) {
+			std::error_code error;
+			for (const auto& entry : std::filesystem::directory_iterator(folder, error))
+				if (entry.is_regular_file() && entry.path().extension() == extension)
+					files.push_back(entry.path().string());
+			if (error)
+				std::cout << "WARNING: could not read folder " << folder << std::endl;
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	// reads every vertex/index so both parsers pay for actually touching the data
+	template<typename VERTS, typename INDS>
+	double TouchGeometry(const VERTS& vertices, const INDS& indices)
+	{
+		double sum = 0.0;
+		for (const H2B::VERTEX& v : vertices)
+			sum += v.pos.x + v.nrm.y;
+		for (unsigned i : indices)
+			sum += i;
+		return sum;
+	}
+
+	struct LoadResult {
+		double parseMs = 0.0;	// best time to parse every file once
+		double touchMs = 0.0;	// best time to read all geometry afterwards
+		size_t residentBytes = 0; // RSS growth while every file is held
+		size_t failures = 0;
+		double checksum = 0.0;
+	};
+
+	template<typename PARSER>
+	LoadResult LoadAll(const std::vector<std::string>& files, int iterations)
+	{
+		LoadResult result;
+		result.parseMs = result.touchMs = 1e30;
+		for (int it = 0; it < iterations; ++it) {
+			size_t before = CurrentRSS();
+			std::vector<PARSER> loaded(files.size());
+			Clock::time_point start = Clock::now();
+			result.failures = 0;
+			for (size_t i = 0; i < files.size(); ++i)
+				if (loaded[i].Parse(files[i].c_str()) == false)
+					++result.failures;
+			result.parseMs = std::min(result.parseMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			result.checksum = 0.0;
+			for (const PARSER& p : loaded)
+				result.checksum += TouchGeometry(p.vertices, p.indices);
+			result.touchMs = std::min(result.touchMs, MillisecondsSince(start));
+
+			size_t after = CurrentRSS();
+			result.residentBytes = after > before ? after - before : 0;
+		}
+		return result;
+	}
+
+	void PrintLoadResult(const char* label, const LoadResult& r)
+	{
+		std::printf("%-8s parse %9.3f ms  parse+read %9.3f ms  resident +%8.1f KB  failures %zu  checksum %.6g\n",
+			label, r.parseMs, r.parseMs + r.touchMs, r.residentBytes / 1024.0, r.failures, r.checksum);
+	}
+
+	// mapped views must describe exactly what Parser copies out, and a file
+	// missing its last byte must be rejected
+	size_t VerifyMappedParser(const std::vector<std::string>& files)
+	{
+		size_t mismatches = 0;
+		for (const std::string& path : files) {
+			H2B::Parser copy;
+			H2B::MappedParser mapped;
+			if (copy.Parse(path.c_str()) == false || mapped.Parse(path.c_str()) == false) {
+				std::cout << "MISMATCH (load failed): " << path << std::endl;
+				++mismatches;
+				continue;
+			}
+			bool same = copy.vertexCount == mapped.vertexCount && copy.indexCount == mapped.indexCount &&
+				copy.materialCount == mapped.materialCount && copy.meshCount == mapped.meshCount &&
+				std::memcmp(copy.vertices.data(), mapped.vertices.data(), sizeof(H2B::VERTEX) * copy.vertexCount) == 0 &&
+				std::memcmp(copy.indices.data(), mapped.indices.data(), sizeof(unsigned) * copy.indexCount) == 0 &&
+				std::memcmp(copy.batches.data(), mapped.batches.data(), sizeof(H2B::BATCH) * copy.materialCount) == 0;
+			for (unsigned i = 0; same && i < copy.materialCount; ++i)
+				same = std::memcmp(&copy.materials[i].attrib, &mapped.materials[i].attrib, 80) == 0 &&
+					mapped.materials[i].name == (copy.materials[i].name ? copy.materials[i].name : "");
+			for (unsigned i = 0; same && i < copy.meshCount; ++i)
+				same = mapped.meshes[i].name == (copy.meshes[i].name ? copy.meshes[i].name : "") &&
+					mapped.meshes[i].materialIndex == copy.meshes[i].materialIndex &&
+					mapped.meshes[i].drawInfo.indexCount == copy.meshes[i].drawInfo.indexCount &&
+					mapped.meshes[i].drawInfo.indexOffset == copy.meshes[i].drawInfo.indexOffset;
+
+			H2B::MappedFile image;
+			image.Open(path.c_str());
+			H2B::MappedParser truncated;
+			if (truncated.ParseMemory(image.Data(), image.Size() - 1)) {
+				std::cout << "MISMATCH (truncated file accepted): " << path << std::endl;
+				same = false;
+			}
+			if (!same) {
+				std::cout << "MISMATCH: " << path << std::endl;
+				++mismatches;
+			}
+		}
+		return mismatches;
+	}
+
+	int BenchmarkH2B(int argc, char** argv)
+	{
+		std::string mode = argc > 0 ? argv[0] : "both";
+		int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+		std::vector<std::string> folders;
+		for (int i = 2; i < argc; ++i)
+			folders.push_back(argv[i]);
+		if (folders.empty())
+			folders = { "../Models", "../Models2" };
+
+		std::vector<std::string> files = FindFiles(folders, ".h2b");
+		if (files.empty()) {
+			std::cout << "ERROR: no .h2b files found" << std::endl;
+			return 1;
+		}
+		size_t totalBytes = 0;
+		for (const std::string& f : files)
+			totalBytes += static_cast<size_t>(std::filesystem::file_size(f));
+		std::printf("h2b load: %zu files, %.1f KB, best of %d\n", files.size(), totalBytes / 1024.0, iterations);
+
+		if (mode == "parse" || mode == "both")
+			PrintLoadResult("Parse", LoadAll<H2B::Parser>(files, iterations));
+		if (mode == "mapped" || mode == "both")
+			PrintLoadResult("Mapped", LoadAll<H2B::MappedParser>(files, iterations));
+		std::printf("peak RSS %.1f KB\n", PeakRSS() / 1024.0);
+
+		if (mode == "both") {
+			size_t mismatches = VerifyMappedParser(files);
+			std::printf("mapped/parse agreement: %zu of %zu files match\n", files.size() - mismatches, files.size());
+			return mismatches == 0 ? 0 : 1;
+		}
+		return 0;
+	}
+
+	// default level/folder pairs, relative to the build folder like the renderer
+	std::vector<std::pair<std::string, std::string>> LevelArguments(int argc, char** argv)
+	{
+		std::vector<std::pair<std::string, std::string>> levels;
+		for (int i = 0; i + 1 < argc; i += 2)
+			levels.push_back({ argv[i], argv[i + 1] });
+		if (levels.empty())
+			levels = { { "../GameLevel.txt", "../Models" }, { "../GameLevel2.txt", "../Models2" } };
+		return levels;
+	}
+
+	// everything a placed model feeds into its draws: geometry, per mesh ranges/materials and world
+	unsigned long long DrawSignature(const H2B::Parser& model, const Level::MATRIX& world)
+	{
+		unsigned long long hash = Level::HashBytes(world.data, sizeof(world.data));
+		hash = Level::HashBytes(model.vertices.data(), sizeof(H2B::VERTEX) * model.vertices.size(), hash);
+		hash = Level::HashBytes(model.indices.data(), sizeof(unsigned) * model.indices.size(), hash);
+		for (const H2B::MESH& mesh : model.meshes) {
+			hash = Level::HashBytes(&mesh.drawInfo, sizeof(mesh.drawInfo), hash);
+			hash = Level::HashBytes(&model.materials[mesh.materialIndex].attrib, sizeof(H2B::ATTRIBUTES), hash);
+		}
+		return hash;
+	}
+
+	// Loads each level once with a parser per MESH (the old path) and once
+	// through Level::AssetCache, checks the draws match and reports the savings.
+	int BenchmarkAssets(int argc, char** argv)
+	{
+		int failures = 0;
+		for (const auto& level : LevelArguments(argc, argv)) {
+			Level::LevelFile file;
+			if (file.Read(level.first.c_str()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+
+			Clock::time_point start = Clock::now();
+			std::vector<unsigned long long> perInstance;
+			unsigned naiveParses = 0, naiveFailures = 0;
+			size_t naiveBytes = 0;
+			for (const Level::RECORD& record : file.records) {
+				if (record.type != Level::RECORD_TYPE::MESH)
+					continue;
+				H2B::Parser model;
+				if (model.Parse(Level::H2BPathFromName(level.second.c_str(), record.name).c_str()) == false) {
+					++naiveFailures;
+					continue;
+				}
+				++naiveParses;
+				naiveBytes += sizeof(H2B::VERTEX) * model.vertices.size() + sizeof(unsigned) * model.indices.size();
+				perInstance.push_back(DrawSignature(model, record.transform));
+			}
+			double naiveMs = MillisecondsSince(start);
+
+			start = Clock::now();
+			Level::AssetCache cache;
+			std::vector<std::pair<Level::AssetHandle, const Level::RECORD*>> instances;
+			for (const Level::RECORD& record : file.records) {
+				if (record.type != Level::RECORD_TYPE::MESH)
+					continue;
+				Level::AssetHandle asset = cache.Acquire(Level::H2BPathFromName(level.second.c_str(), record.name));
+				if (asset != Level::INVALID_ASSET) {
+					instances.push_back({ asset, &record });
+					cache.MarkUploaded(asset);
+				}
+			}
+			double cachedMs = MillisecondsSince(start);
+
+			std::vector<unsigned long long> shared;
+			for (const auto& instance : instances)
+				shared.push_back(DrawSignature(cache.Get(instance.first), instance.second->transform));
+			bool same = shared == perInstance;
+			failures += same ? 0 : 1;
+
+			Level::ASSET_STATS stats = cache.GetStats();
+			std::printf("%s\n", level.first.c_str());
+			// parses count only files that loaded, a missing file is opened once per record on the old
+			// path and once in total through the cache, which remembers it as missing
+			std::printf("  per instance: %3u parses  %3u failed opens  %3zu buffer creations  %9.1f KB  %8.3f ms\n",
+				naiveParses, naiveFailures, 2 * perInstance.size(), naiveBytes / 1024.0, naiveMs);
+			std::printf("  asset cache:  %3u parses  %3u failed opens  %3u buffer creations  %9.1f KB  %8.3f ms\n",
+				stats.parses, stats.failedParses, 2 * stats.uploads, stats.residentBytes / 1024.0, cachedMs);
+			std::printf("  unique assets %u  instances %u  bytes saved %zu  draw output %s\n",
+				stats.uniqueAssets, stats.instances, stats.bytesSaved, same ? "identical" : "DIFFERENT");
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// acquires every MESH record of a level through the cache, the way Level_Objects::LoadLevel does
+	bool LoadInstances(const std::string& levelPath, const std::string& h2bFolder,
+		Level::AssetCache& cache, std::vector<Level::INSTANCE>& instances)
+	{
+		Level::LevelFile file;
+		if (file.Read(levelPath.c_str()) == false) {
+			std::cout << "ERROR: level not found " << levelPath << std::endl;
+			return false;
+		}
+		for (const Level::RECORD& record : file.records) {
+			if (record.type != Level::RECORD_TYPE::MESH)
+				continue;
+			Level::INSTANCE instance;
+			instance.asset = cache.Acquire(Level::H2BPathFromName(h2bFolder.c_str(), record.name));
+			instance.world = record.transform;
+			if (instance.asset != Level::INVALID_ASSET)
+				instances.push_back(instance);
+		}
+		return true;
+	}
+
+	// Draw calls per frame with and without instancing, and a check that the
+	// instanced groups draw exactly the same (asset, sub-mesh, world) set. The
+	// shipped levels are also checked against fixed draw call counts.
+	int BenchmarkInstancing(int argc, char** argv)
+	{
+		struct EXPECTED {
+			const char* level;
+			size_t before, after;
+		};
+		const EXPECTED shipped[] = {
+			{ "GameLevel.txt", 176, 28 },
+			{ "GameLevel2.txt", 59, 24 },
+		};
+		int failures = 0;
+		for (const auto& level : LevelArguments(argc, argv)) {
+			Level::AssetCache cache;
+			std::vector<Level::INSTANCE> instances;
+			if (LoadInstances(level.first, level.second, cache, instances) == false)
+				return 1;
+
+			Level::InstanceBatcher batcher;
+			const int iterations = 1000;
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < iterations; ++i)
+				batcher.Build(instances, cache);
+			double buildUs = MillisecondsSince(start) * 1000.0 / iterations;
+
+			std::vector<unsigned long long> expected, drawn;
+			for (const Level::INSTANCE& instance : instances)
+				for (unsigned m = 0; m < cache.Get(instance.asset).meshCount; ++m)
+					expected.push_back(Level::HashBytes(instance.world.data, sizeof(instance.world.data), instance.asset * 1000ull + m));
+			for (const Level::INSTANCE_GROUP& group : batcher.groups)
+				for (unsigned i = 0; i < group.instanceCount; ++i)
+					drawn.push_back(Level::HashBytes(batcher.instanceData[group.firstInstance + i].data,
+						sizeof(Level::MATRIX), group.asset * 1000ull + group.meshIndex));
+			std::sort(expected.begin(), expected.end());
+			std::sort(drawn.begin(), drawn.end());
+			bool same = expected == drawn;
+			failures += same ? 0 : 1;
+
+			std::printf("%s\n", level.first.c_str());
+			const size_t before = Level::InstanceBatcher::DrawCallsWithoutInstancing(instances, cache), after = batcher.DrawCalls();
+			std::printf("  instances %zu  draw calls %zu -> %zu  instance buffer %zu bytes  build %.2f us  draws %s\n",
+				instances.size(), before, after, batcher.InstanceBufferBytes(), buildUs, same ? "identical" : "DIFFERENT");
+			for (const EXPECTED& entry : shipped)
+				if (std::filesystem::path(level.first).filename() == entry.level) {
+					const bool ok = before == entry.before && after == entry.after;
+					std::printf("  expected draw calls %zu -> %zu  %s\n", entry.before, entry.after, ok ? "ok" : "FAILED");
+					failures += ok ? 0 : 1;
+				}
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	std::string ReadText(const std::string& path)
+	{
+		std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	// Drives Level::ShaderCache with a stub compiler the way PipelineStateCache
+	// does for a level load (one VS/PS request per model) through a cold start,
+	// a warm start, a source edit and a corrupted cache file.
+	int BenchmarkShaderCache(int argc, char** argv)
+	{
+		std::string shaderFolder = argc > 0 ? argv[0] : "../Shaders";
+		unsigned models = argc > 1 ? static_cast<unsigned>(std::max(1, std::atoi(argv[1]))) : 100;
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "level_benchmark_shader_cache";
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+
+		unsigned compilerCalls = 0;
+		Level::ShaderCache::Compiler stub = [&](const Level::SHADER_SOURCE& shader, std::vector<unsigned char>& bytecode, std::string&) {
+			++compilerCalls;
+			unsigned long long hash = Level::ShaderCache::Key(shader);
+			bytecode.resize(4096);
+			for (size_t i = 0; i < bytecode.size(); ++i)
+				bytecode[i] = static_cast<unsigned char>(hash >> ((i % 8) * 8)) ^ static_cast<unsigned char>(i);
+			return true;
+		};
+
+		Level::SHADER_SOURCE vs = { ReadText(shaderFolder + "/VertexShader.hlsl"), "main", "vs_4_0", 0, {} };
+		Level::SHADER_SOURCE ps = { ReadText(shaderFolder + "/PixelShader.hlsl"), "main", "ps_4_0", 0, {} };
+		if (vs.source.empty() || ps.source.empty()) {
+			std::cout << "ERROR: shaders not found in " << shaderFolder << std::endl;
+			return 1;
+		}
+
+		auto loadLevel = [&](const char* label) {
+			Level::ShaderCache cache(directory.string(), stub);
+			compilerCalls = 0;
+			Clock::time_point start = Clock::now();
+			for (unsigned i = 0; i < models; ++i) {
+				cache.GetBytecode(vs);
+				cache.GetBytecode(ps);
+			}
+			Level::SHADER_CACHE_STATS stats = cache.GetStats();
+			std::printf("  %-16s %8.3f ms  compiler calls %u  memory hits %u  disk hits %u  stale files %u  writes %u\n",
+				label, MillisecondsSince(start), compilerCalls, stats.memoryHits, stats.diskHits, stats.staleFiles, stats.diskWrites);
+			return stats;
+		};
+
+		std::printf("shader cache: %u models, cache in %s\n", models, directory.string().c_str());
+		Level::SHADER_CACHE_STATS cold = loadLevel("cold start");
+		Level::SHADER_CACHE_STATS warm = loadLevel("warm start");
+
+		vs.source += "\n// edited\n";
+		Level::SHADER_CACHE_STATS edited = loadLevel("edited VS");
+
+		// flip a byte in the middle of every persisted entry
+		for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+			std::fstream file(entry.path(), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+			file.seekp(Level::ShaderCache::HEADER_SIZE + 100);
+			file.put('\x5a');
+		}
+		Level::SHADER_CACHE_STATS corrupted = loadLevel("corrupted files");
+		std::filesystem::remove_all(directory, error);
+
+		bool ok = cold.compiles == 2 && warm.compiles == 0 && warm.diskHits == 2 &&
+			edited.compiles == 1 && corrupted.staleFiles >= 2 && corrupted.compiles == 2;
+		std::printf("  cache behaviour %s\n", ok ? "as expected" : "UNEXPECTED");
+		return ok ? 0 : 1;
+	}
+
+	// Level_Objects::LoadLevel log sink, missing files already show up in the asset stats
+	struct QuietLog {
+		void LogCategorized(const char*, const char*) const {}
+	};
+
+	// Builds frames for each level through Level_Objects::RenderLevel into a
+	// Level::RecordingBackend, per Model and instanced, and reports the CPU cost
+	// and command counters. --dump writes every recorded command stream as text
+	// so two builds can be diffed.
+	int BenchmarkFrame(int argc, char** argv)
+	{
+		int frames = 1000;
+		std::string dumpFolder;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+				dumpFolder = argv[++i];
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level::RecordingBackend backend;
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			objects.UploadLevelToGPU(backend);
+			Level::RECORDING_COUNTERS upload = backend.Counters();
+
+			Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+			Level::BufferHandle sceneBuffer = backend.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(scene) }, nullptr);
+
+			std::printf("%s\n", level.first.c_str());
+			Level::ASSET_STATS assets = objects.GetAssetStats();
+			std::printf("  %u instances of %u assets  upload: %u buffers  %u pipelines  %.1f KB\n", assets.instances,
+				assets.uniqueAssets, upload.buffersCreated, upload.pipelinesCreated, upload.bytesUploaded / 1024.0);
+			for (bool instanced : { false, true }) {
+				objects.SetInstancing(instanced);
+				// same as Renderer::Render minus the render target setup
+				auto buildFrame = [&](int frame) {
+					backend.ResetFrame();
+					scene.vMatrix.data[12] = static_cast<float>(frame);
+					backend.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+					backend.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+					objects.RenderLevel(backend);
+				};
+				Clock::time_point start = Clock::now();
+				for (int f = 0; f < frames; ++f)
+					buildFrame(f);
+				double frameUs = MillisecondsSince(start) * 1000.0 / frames;
+				// the reported stream is always frame 0 so it is comparable between runs
+				buildFrame(0);
+
+				const Level::RECORDING_COUNTERS& counters = backend.Counters();
+				std::printf("  %-10s %7.2f us/frame  %4u draws  %5u instances  %7llu indices  %4u state changes  %4u updates  %7.1f KB  stream %zu bytes %016llx\n",
+					instanced ? "instanced" : "per model", frameUs, counters.draws, counters.instances, counters.indices,
+					counters.stateChanges, counters.bufferUpdates, counters.bytesUploaded / 1024.0,
+					backend.Stream().size(), backend.StreamHash());
+
+				if (!dumpFolder.empty()) {
+					std::string path = dumpFolder + "/" + std::filesystem::path(level.first).stem().string() +
+						(instanced ? ".instanced.txt" : ".models.txt");
+					std::ofstream dump(path, std::ios_base::out | std::ios_base::trunc);
+					for (const std::string& line : backend.Disassemble())
+						dump << line << "\n";
+				}
+			}
+			objects.UnloadLevel();
+		}
+		return 0;
+	}
+
+	// Renders each level with Level::SoftwareBackend at 800x600 and 1080p,
+	// reports ms/frame (geometry = RenderLevel, raster = EndFrame) and compares
+	// the frames against the stored references with a per channel tolerance.
+	int BenchmarkRaster(int argc, char** argv)
+	{
+		int frames = 5;
+		unsigned threads = 0, tolerance = 8;
+		double maxBadFraction = 0.001;
+		std::string writeFolder, referenceFolder = "../References";
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--write") == 0 && i + 1 < argc)
+				writeFolder = argv[++i];
+			else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+				referenceFolder = argv[++i];
+			else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+				tolerance = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		const unsigned resolutions[][2] = { { 800, 600 }, { 1920, 1080 } };
+		// main.cpp's clear color
+		const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+
+		int failures = 0;
+		Level::SoftwareBackend backend(resolutions[0][0], resolutions[0][1], threads);
+		std::printf("software rasterizer: %u threads, %d lanes, best of %d frames\n", backend.Threads(), Level::Simd::LANES, frames);
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			objects.UploadLevelToGPU(backend);
+			Level::BufferHandle sceneBuffer = backend.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(Level::SCENE_CONSTANTS) }, nullptr);
+			std::printf("%s\n", level.first.c_str());
+
+			for (const auto& resolution : resolutions) {
+				backend.Resize(resolution[0], resolution[1]);
+				Level::SCENE_CONSTANTS scene = Level::DefaultScene(static_cast<float>(resolution[0]) / resolution[1]);
+				objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+				double bestGeometry = 1e30, bestRaster = 1e30, bestTotal = 1e30;
+				auto renderFrame = [&]() {
+					Clock::time_point start = Clock::now();
+					backend.BeginFrame(clearColor);
+					backend.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+					backend.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+					objects.RenderLevel(backend);
+					double geometry = MillisecondsSince(start);
+					Clock::time_point rasterStart = Clock::now();
+					backend.EndFrame();
+					double raster = MillisecondsSince(rasterStart);
+					bestGeometry = std::min(bestGeometry, geometry);
+					bestRaster = std::min(bestRaster, raster);
+					bestTotal = std::min(bestTotal, geometry + raster);
+				};
+
+				// the per model path has to produce the same picture
+				objects.SetInstancing(false);
+				renderFrame();
+				Level::IMAGE perModel = backend.Image();
+				objects.SetInstancing(true);
+				bestGeometry = bestRaster = bestTotal = 1e30;
+				for (int f = 0; f < frames; ++f)
+					renderFrame();
+
+				const Level::SOFTWARE_STATS& stats = backend.Stats();
+				Level::IMAGE_DIFF paths = Level::CompareImages(backend.Image(), perModel, tolerance);
+				Level::CULL_STATS culled = objects.GetCullStats();
+				std::printf("  %4ux%-4u %8.2f ms/frame (geometry %.2f raster %.2f)  %u/%u models visible  %llu triangles  %llu culled  %llu clipped  %llu binned  %llu pixels shaded  per model %s\n",
+					resolution[0], resolution[1], bestTotal, bestGeometry, bestRaster, culled.visible, culled.instances, stats.trianglesIn, stats.trianglesCulled,
+					stats.trianglesClipped, stats.trianglesBinned, stats.pixelsShaded,
+					paths.badPixels == 0 ? "matches" : "DIFFERENT");
+				failures += paths.badPixels == 0 ? 0 : 1;
+
+				char name[256];
+				std::snprintf(name, sizeof(name), "%s_%ux%u.tga",
+					std::filesystem::path(level.first).stem().string().c_str(), resolution[0], resolution[1]);
+				if (!writeFolder.empty()) {
+					std::filesystem::create_directories(writeFolder);
+					if (Level::WriteTGA((writeFolder + "/" + name).c_str(), backend.Image()) == false) {
+						std::cout << "ERROR: could not write " << writeFolder << "/" << name << std::endl;
+						++failures;
+					}
+				}
+				Level::IMAGE reference;
+				if (Level::ReadTGA((referenceFolder + "/" + name).c_str(), reference)) {
+					Level::IMAGE_DIFF diff = Level::CompareImages(backend.Image(), reference, tolerance);
+					bool same = diff.sizeMatches && diff.badFraction <= maxBadFraction;
+					std::printf("            reference %s: %llu pixels off by more than %u (%.4f%%)  max error %u  rmse %.3f  %s\n",
+						name, diff.badPixels, tolerance, diff.badFraction * 100.0, diff.maxError, diff.rmse, same ? "PASS" : "FAIL");
+					failures += same ? 0 : 1;
+				}
+			}
+			backend.ReleaseBuffer(sceneBuffer);
+			objects.UnloadLevel();
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Walks a camera around each level (shipped and tiled up to --instances
+	// copies) and compares BVH culling with testing every instance's bounds:
+	// cull cost, nodes/bounds tested and the draws left to submit.
+	int BenchmarkCulling(int argc, char** argv)
+	{
+		int frames = 256;
+		unsigned scaledInstances = 100000;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				scaledInstances = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		// the renderer's projection
+		Level::MATRIX projection = Level::PerspectiveLH(65.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+
+		int failures = 0;
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level::AssetCache cache;
+			std::vector<Level::INSTANCE> shipped;
+			if (LoadInstances(level.first, level.second, cache, shipped) == false)
+				return 1;
+			std::vector<Level::AABB> assetBounds(cache.Capacity());
+			for (const Level::INSTANCE& instance : shipped)
+				assetBounds[instance.asset] = Level::LocalBounds(cache.Get(instance.asset));
+			Level::AABB levelBounds = Level::EmptyBounds();
+			for (const Level::INSTANCE& instance : shipped)
+				Level::Grow(levelBounds, Level::TransformBounds(assetBounds[instance.asset], instance.world));
+			float size[3];
+			for (int i = 0; i < 3; ++i)
+				size[i] = std::max(1.0f, levelBounds.max[i] - levelBounds.min[i]);
+
+			// copies of the level on a square grid in x/z
+			std::vector<Level::INSTANCE> scaled;
+			unsigned copies = static_cast<unsigned>(std::ceil(static_cast<double>(scaledInstances) / std::max<size_t>(1, shipped.size())));
+			unsigned side = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(copies))));
+			for (unsigned copy = 0; copy < copies && scaled.size() < scaledInstances; ++copy)
+				for (const Level::INSTANCE& instance : shipped) {
+					if (scaled.size() == scaledInstances)
+						break;
+					Level::INSTANCE moved = instance;
+					moved.world.data[12] += (copy % side) * size[0] * 1.1f;
+					moved.world.data[14] += (copy / side) * size[2] * 1.1f;
+					scaled.push_back(moved);
+				}
+
+			std::printf("%s\n", level.first.c_str());
+			for (const std::vector<Level::INSTANCE>* instances : { &shipped, &scaled }) {
+				std::vector<Level::AABB> bounds;
+				bounds.reserve(instances->size());
+				for (const Level::INSTANCE& instance : *instances)
+					bounds.push_back(Level::TransformBounds(assetBounds[instance.asset], instance.world));
+				Level::BoundingVolumeHierarchy bvh;
+				Clock::time_point start = Clock::now();
+				bvh.Build(bounds);
+				double buildMs = MillisecondsSince(start);
+
+				// eye height walk around the mean instance position at the median instance
+				// distance, looking along the path (a ground plane would skew the bounds)
+				float center[3] = { 0, 0, 0 };
+				for (const Level::AABB& box : bounds)
+					for (int i = 0; i < 3; ++i)
+						center[i] += (box.min[i] + box.max[i]) * 0.5f / bounds.size();
+				std::vector<float> distances;
+				for (const Level::AABB& box : bounds)
+					distances.push_back(std::hypot((box.min[0] + box.max[0]) * 0.5f - center[0], (box.min[2] + box.max[2]) * 0.5f - center[2]));
+				std::nth_element(distances.begin(), distances.begin() + distances.size() / 2, distances.end());
+				float radius = distances[distances.size() / 2];
+				double bvhMs = 0, bruteMs = 0;
+				unsigned long long nodesTested = 0, boundsTested = 0, visibleTotal = 0, drawsAll = 0, drawsCulled = 0, groupsCulled = 0;
+				std::vector<unsigned> visible, expected;
+				std::vector<bool> assetVisible;
+				bool same = true;
+				for (int f = 0; f < frames; ++f) {
+					float angle = 6.2831853f * f / frames;
+					Level::FLOAT3 eye = { center[0] + radius * std::cos(angle), center[1] + 2.0f, center[2] + radius * std::sin(angle) };
+					Level::FLOAT3 target = { eye.x - std::sin(angle), eye.y - 0.2f, eye.z + std::cos(angle) };
+					Level::FRUSTUM frustum = Level::ExtractFrustum(Level::Multiply(Level::LookAtLH(eye, target, { 0, 1, 0 }), projection));
+
+					Level::CULL_STATS stats;
+					start = Clock::now();
+					bvh.Query(frustum, visible, stats);
+					std::sort(visible.begin(), visible.end());
+					bvhMs += MillisecondsSince(start);
+
+					start = Clock::now();
+					expected.clear();
+					for (unsigned i = 0; i < bounds.size(); ++i) {
+						unsigned mask = 0x3F;
+						if (Level::TestBounds(frustum, bounds[i], mask) != Level::CULL_OUTSIDE)
+							expected.push_back(i);
+					}
+					bruteMs += MillisecondsSince(start);
+					same = same && expected == visible;
+
+					nodesTested += stats.nodesTested;
+					boundsTested += stats.boundsTested;
+					visibleTotal += stats.visible;
+					assetVisible.assign(cache.Capacity(), false);
+					for (unsigned i : visible) {
+						drawsCulled += cache.Get((*instances)[i].asset).meshCount;
+						assetVisible[(*instances)[i].asset] = true;
+					}
+					for (Level::AssetHandle asset = 0; asset < cache.Capacity(); ++asset)
+						if (assetVisible[asset])
+							groupsCulled += cache.Get(asset).meshCount;
+				}
+				drawsAll = Level::InstanceBatcher::DrawCallsWithoutInstancing(*instances, cache);
+				failures += same ? 0 : 1;
+				std::printf("  %7zu instances  %6zu nodes  build %7.2f ms  cull %8.2f us/frame (all bounds %8.2f us)  tested %7.1f nodes %7.1f bounds  visible %8.1f  draws %zu -> %.1f (instanced %.1f)  %s\n",
+					instances->size(), bvh.NodeCount(), buildMs, bvhMs * 1000.0 / frames, bruteMs * 1000.0 / frames,
+					static_cast<double>(nodesTested) / frames, static_cast<double>(boundsTested) / frames,
+					static_cast<double>(visibleTotal) / frames, static_cast<size_t>(drawsAll),
+					static_cast<double>(drawsCulled) / frames, static_cast<double>(groupsCulled) / frames,
+					same ? "matches brute force" : "MISMATCH");
+			}
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// drops a file from the OS page cache so the next read comes from disk, false if unsupported
+	bool EvictFromCache(const std::string& path)
+	{
+#if defined(_WIN32)
+		(void)path;
+		return false;
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		fdatasync(file);
+		bool evicted = posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		close(file);
+		return evicted;
+#endif
+	}
+
+	// one MESH record in the exporter's text layout, world is row major like Level::MATRIX
+	void WriteMeshRecord(std::ofstream& file, const std::string& name, const float* world)
+	{
+		char line[128];
+		file << "MESH\r\n" << name << "\r\n";
+		for (int row = 0; row < 4; ++row) {
+			std::snprintf(line, sizeof(line), "%s(%8.4f, %8.4f, %8.4f, %7.4f)%s\r\n", row == 0 ? "<Matrix 4x4 " : "            ",
+				world[row * 4], world[row * 4 + 1], world[row * 4 + 2], world[row * 4 + 3], row == 3 ? ">" : "");
+			file << line;
+		}
+	}
+
+	// a GameLevel.txt in the exporter's format with the MESH records of a level
+	// repeated on a grid in x/z until it has the requested instance count
+	bool WriteSyntheticLevel(const std::string& path, const Level::LevelFile& source, unsigned instances)
+	{
+		std::vector<const Level::RECORD*> meshes;
+		for (const Level::RECORD& record : source.records)
+			if (record.type == Level::RECORD_TYPE::MESH)
+				meshes.push_back(&record);
+		if (meshes.empty())
+			return false;
+		std::ofstream file(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (file.is_open() == false)
+			return false;
+		unsigned side = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(instances) / meshes.size())));
+		char suffix[16];
+		file << "# Game Level Exporter v1.3\r\n";
+		for (unsigned i = 0; i < instances; ++i) {
+			const Level::RECORD& record = *meshes[i % meshes.size()];
+			unsigned copy = static_cast<unsigned>(i / meshes.size());
+			std::string name = record.name.substr(0, record.name.find_last_of("."));
+			std::snprintf(suffix, sizeof(suffix), ".%07u", i);
+			Level::MATRIX world = record.transform;
+			world.data[12] += 40.0f * (copy % side);
+			world.data[14] += 40.0f * (copy / side);
+			WriteMeshRecord(file, name + suffix, world.data);
+		}
+		return static_cast<bool>(file);
+	}
+
+	// every record of the compiled level matches the parsed text bit for bit
+	bool SameRecords(const Level::LevelFile& text, const Level::LevelBinary& binary)
+	{
+		if (text.records.size() != binary.RecordCount())
+			return false;
+		for (unsigned i = 0; i < binary.RecordCount(); ++i) {
+			const Level::RECORD& record = text.records[i];
+			if (record.type != binary.Type(i) || record.name != binary.Name(i) ||
+				std::memcmp(record.transform.data, binary.Transform(i).data, sizeof(Level::MATRIX)) != 0)
+				return false;
+			if (record.type == Level::RECORD_TYPE::MESH &&
+				Level::H2BPathFromName(".", record.name) != "./" + std::string(binary.Asset(i)))
+				return false;
+		}
+		return true;
+	}
+
+	// what the loader does with a compiled level: walk every record
+	double TouchRecords(const Level::LevelBinary& binary)
+	{
+		double sum = 0.0;
+		for (unsigned i = 0; i < binary.RecordCount(); ++i)
+			sum += binary.Name(i).size() + binary.Asset(i).size() + binary.Transform(i).data[12];
+		return sum;
+	}
+	double TouchRecords(const Level::LevelFile& text)
+	{
+		double sum = 0.0;
+		for (const Level::RECORD& record : text.records)
+			sum += record.name.size() + record.transform.data[12];
+		return sum;
+	}
+
+	// Compiles each level to .lvlb and compares loading it against parsing the
+	// text, cold (page cache dropped) and warm, including a generated large level.
+	int BenchmarkLevelBinary(int argc, char** argv)
+	{
+		int iterations = 5;
+		unsigned syntheticInstances = 1000000;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				syntheticInstances = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				iterations = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		std::vector<std::string> levels;
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data()))
+			levels.push_back(level.first);
+		if (syntheticInstances > 0) {
+			Level::LevelFile source;
+			std::string synthetic = (std::filesystem::temp_directory_path() / "level_benchmark_synthetic.txt").string();
+			if (source.Read(levels[0].c_str()) == false || WriteSyntheticLevel(synthetic, source, syntheticInstances) == false) {
+				std::cout << "ERROR: could not write " << synthetic << std::endl;
+				return 1;
+			}
+			levels.push_back(synthetic);
+		}
+
+		int failures = 0;
+		for (const std::string& textPath : levels) {
+			std::string binaryPath = Level::LevelBinary::PathFor(textPath);
+			Clock::time_point start = Clock::now();
+			if (Level::LevelBinary::Compile(textPath.c_str(), binaryPath.c_str()) == false) {
+				std::cout << "ERROR: could not compile " << textPath << std::endl;
+				return 1;
+			}
+			double compileMs = MillisecondsSince(start);
+
+			// cold: first load after the file was dropped from the page cache
+			bool cold = EvictFromCache(textPath);
+			start = Clock::now();
+			Level::LevelFile text;
+			text.Read(textPath.c_str());
+			double checksum = TouchRecords(text);
+			double textColdMs = MillisecondsSince(start);
+			cold = EvictFromCache(binaryPath) && cold;
+			start = Clock::now();
+			Level::LevelBinary binary;
+			bool opened = binary.Open(binaryPath.c_str());
+			checksum += TouchRecords(binary);
+			double binaryColdMs = MillisecondsSince(start);
+			if (opened == false) {
+				std::cout << "ERROR: could not open " << binaryPath << std::endl;
+				return 1;
+			}
+			binary.Close();
+
+			double textMs = 1e30, binaryMs = 1e30, currentMs = 1e30;
+			bool current = true;
+			for (int it = 0; it < iterations; ++it) {
+				start = Clock::now();
+				text.Read(textPath.c_str());
+				checksum += TouchRecords(text);
+				textMs = std::min(textMs, MillisecondsSince(start));
+
+				start = Clock::now();
+				binary.Open(binaryPath.c_str());
+				checksum += TouchRecords(binary);
+				binaryMs = std::min(binaryMs, MillisecondsSince(start));
+
+				start = Clock::now();
+				current = binary.IsCurrent(textPath.c_str()) && current;
+				currentMs = std::min(currentMs, MillisecondsSince(start));
+			}
+			bool same = SameRecords(text, binary);
+
+			// a stale file must be caught: same size, one byte changed
+			std::string stalePath = binaryPath + ".stale.txt";
+			bool rejectsStale = false;
+			{
+				std::string bytes = ReadText(textPath);
+				bytes[bytes.size() / 2] ^= 1;
+				std::ofstream(stalePath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc) << bytes;
+				rejectsStale = binary.IsCurrent(stalePath.c_str()) == false;
+				std::remove(stalePath.c_str());
+			}
+			if (!same || !current || !rejectsStale)
+				++failures;
+
+			std::printf("%s: %zu records, %u strings, text %.1f KB, lvlb %.1f KB, compile %.2f ms\n", textPath.c_str(),
+				text.records.size(), binary.StringCount(), std::filesystem::file_size(textPath) / 1024.0,
+				std::filesystem::file_size(binaryPath) / 1024.0, compileMs);
+			std::printf("  %-6s text %9.3f ms  lvlb %9.3f ms  %6.1fx\n", cold ? "cold" : "first",
+				textColdMs, binaryColdMs, textColdMs / std::max(binaryColdMs, 1e-6));
+			std::printf("  %-6s text %9.3f ms  lvlb %9.3f ms  %6.1fx  (+ %.3f ms source hash check)\n", "warm",
+				textMs, binaryMs, textMs / std::max(binaryMs, 1e-6), currentMs);
+			std::printf("  records %s, source %s, stale source %s (checksum %.0f)\n",
+				same ? "match" : "MISMATCH", current ? "current" : "NOT CURRENT",
+				rejectsStale ? "rejected" : "NOT REJECTED", checksum);
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// the line at a time sscanf reader LevelFile replaced, kept as the baseline
+	bool LegacyLevelRead(const char* path, std::vector<Level::RECORD>& records)
+	{
+		records.clear();
+		std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+		if (file.is_open() == false)
+			return false;
+		auto readLine = [&](std::string& line) {
+			if (!std::getline(file, line))
+				return false;
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			return true;
+		};
+		std::string line;
+		while (readLine(line)) {
+			Level::RECORD record;
+			if (line == "MESH")
+				record.type = Level::RECORD_TYPE::MESH;
+			else if (line == "LIGHT")
+				record.type = Level::RECORD_TYPE::LIGHT;
+			else if (line == "CAMERA")
+				record.type = Level::RECORD_TYPE::CAMERA;
+			else
+				continue;
+			if (!readLine(record.name))
+				break;
+			for (int i = 0; i < 4; ++i) {
+				readLine(line);
+				float* row = &record.transform.data[i * 4];
+				row[0] = row[1] = row[2] = row[3] = 0.0f;
+				if (line.size() > 13)
+					std::sscanf(line.c_str() + 13, "%f, %f, %f, %f", &row[0], &row[1], &row[2], &row[3]);
+			}
+			records.push_back(std::move(record));
+		}
+		return true;
+	}
+
+	bool SameRecords(const std::vector<Level::RECORD>& a, const std::vector<Level::RECORD>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); ++i)
+			if (a[i].type != b[i].type || a[i].name != b[i].name ||
+				std::memcmp(a[i].transform.data, b[i].transform.data, sizeof(Level::MATRIX)) != 0)
+				return false;
+		return true;
+	}
+
+	// Parses each level with the old sscanf reader and with LevelFile on one and
+	// on several threads, reports MB/s and checks all three agree bit for bit.
+	// Then feeds LevelFile malformed records and checks where it says they broke.
+	int BenchmarkLevelParse(int argc, char** argv)
+	{
+		int iterations = 5;
+		unsigned megabytes = 100, threads = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--megabytes") == 0 && i + 1 < argc)
+				megabytes = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				iterations = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		std::vector<std::string> levels;
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data()))
+			levels.push_back(level.first);
+		std::string synthetic;
+		if (megabytes > 0) {
+			Level::LevelFile source;
+			synthetic = (std::filesystem::temp_directory_path() / "level_benchmark_parse.txt").string();
+			if (source.Read(levels[0].c_str()) == false || source.records.empty()) {
+				std::cout << "ERROR: could not read " << levels[0] << std::endl;
+				return 1;
+			}
+			// about 235 bytes per generated MESH record
+			unsigned instances = static_cast<unsigned>(megabytes * 1024.0 * 1024.0 / 235.0);
+			if (WriteSyntheticLevel(synthetic, source, instances) == false) {
+				std::cout << "ERROR: could not write " << synthetic << std::endl;
+				return 1;
+			}
+			levels.push_back(synthetic);
+		}
+
+		int failures = 0;
+		for (const std::string& path : levels) {
+			double megabytesRead = std::filesystem::file_size(path) / (1024.0 * 1024.0);
+			std::vector<Level::RECORD> legacy;
+			double legacyMs = 1e30;
+			for (int it = 0; it < iterations; ++it) {
+				Clock::time_point start = Clock::now();
+				LegacyLevelRead(path.c_str(), legacy);
+				legacyMs = std::min(legacyMs, MillisecondsSince(start));
+			}
+			Level::LevelFile single, parallel;
+			double singleMs = 1e30, parallelMs = 1e30;
+			bool read = true;
+			for (int it = 0; it < iterations; ++it) {
+				Clock::time_point start = Clock::now();
+				read = single.Read(path.c_str(), 1) && read;
+				singleMs = std::min(singleMs, MillisecondsSince(start));
+				start = Clock::now();
+				read = parallel.Read(path.c_str(), threads) && read;
+				parallelMs = std::min(parallelMs, MillisecondsSince(start));
+			}
+			bool same = read && SameRecords(legacy, single.records) && SameRecords(legacy, parallel.records);
+			if (!same)
+				++failures;
+			std::printf("%s: %zu records  %.1f MB\n", path.c_str(), legacy.size(), megabytesRead);
+			std::printf("  sscanf lines     %9.2f ms  %8.1f MB/s\n", legacyMs, megabytesRead / (legacyMs / 1000.0));
+			std::printf("  LevelFile 1      %9.2f ms  %8.1f MB/s  %5.1fx\n", singleMs,
+				megabytesRead / (singleMs / 1000.0), legacyMs / singleMs);
+			std::printf("  LevelFile %-3u    %9.2f ms  %8.1f MB/s  %5.1fx  records %s\n", threads, parallelMs,
+				megabytesRead / (parallelMs / 1000.0), legacyMs / parallelMs, same ? "match" : "MISMATCH");
+		}
+		if (!synthetic.empty())
+			std::remove(synthetic.c_str());
+
+		// malformed input, and the line/column each one must be reported at
+		struct MALFORMED {
+			const char* text;
+			unsigned line, column;
+		};
+		const MALFORMED malformed[] = {
+			{ "MESH\r\nBox\r\n<Matrix 4x4 (1, 0, 0, 0)\r\n(0, 1, 0, 0)\r\n(0, 0, 1, 0)\r\n(0, 0, 0, 1)>\r\n", 0, 0 },
+			{ "MESH\r\nBox\r\n<Matrix 4x4 (1, 0, 0 0)\r\n(0, 1, 0, 0)\r\n(0, 0, 1, 0)\r\n(0, 0, 0, 1)>\r\n", 3, 22 },
+			{ "# header\r\nCAMERA\r\nCam\r\n<Matrix 4x4 (1, 0, 0, 0)\r\n  (0, 1, x, 0)\r\n", 5, 10 },
+			{ "LIGHT\r\nSun\r\n<Matrix 4x4 (1, 0, 0, 0)\r\n(0, 1, 0, 0)\r\n", 4, 13 },
+			{ "MESH\r\nBox\r\n<Matrix 4x4 (1, 0, 0, 0)\r\n(0, 1, 0, 0)\r\n(0, 0, 1, 0)\r\n(0, 0, 0, 1)\r\n", 6, 13 },
+			{ "MESH\r\nBox\r\n(1, 0, 0, 0)\r\n", 3, 1 },
+			{ "MESH\r\n\r\n", 2, 1 },
+		};
+		for (const MALFORMED& test : malformed) {
+			Level::LevelFile file;
+			bool ok = file.Parse(test.text, std::strlen(test.text), 1);
+			bool expected = test.line == 0 ? ok : !ok && file.error.line == test.line && file.error.column == test.column;
+			if (!expected)
+				++failures;
+			std::printf("  malformed test: %-50s %s\n", ok ? "parsed" : file.ErrorString().c_str(), expected ? "ok" : "WRONG");
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Streams levels in with Level::LevelStreamer while the current level renders
+	// into a RecordingBackend at a fixed frame rate. Frames rendered during the
+	// load must stay under the budget, the swap frame is compared with the
+	// synchronous load it replaces, and a cancelled load must leave the current
+	// level untouched. The old level has to be freed FRAMES_IN_FLIGHT frames later.
+	// The frames and the load share one Level::JobSystem (--threads, 0 for none),
+	// so waiting on a frame's jobs must never run one of the load's.
+	int BenchmarkStreaming(int argc, char** argv)
+	{
+		double frameRate = 240.0, budgetMs = 1000.0 / 60.0;
+		unsigned syntheticInstances = 100000, threads = 4;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				syntheticInstances = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+				budgetMs = std::max(0.1, std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+				frameRate = std::max(1.0, std::atof(argv[++i]));
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		std::vector<std::pair<std::string, std::string>> levels = LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data());
+		// the level that is on screen while the others load
+		const std::pair<std::string, std::string> shown = levels[0];
+		std::string synthetic;
+		if (syntheticInstances > 0) {
+			Level::LevelFile source;
+			synthetic = (std::filesystem::temp_directory_path() / "level_benchmark_streaming.txt").string();
+			if (source.Read(shown.first.c_str()) == false || WriteSyntheticLevel(synthetic, source, syntheticInstances) == false) {
+				std::cout << "ERROR: could not write " << synthetic << std::endl;
+				return 1;
+			}
+			levels.push_back({ synthetic, shown.second });
+		}
+		const std::chrono::duration<double, std::milli> framePeriod(1000.0 / frameRate);
+		Level::MATRIX view = Level::DefaultScene(800.0f / 600.0f).vMatrix;
+		Level::MATRIX projection = Level::DefaultScene(800.0f / 600.0f).pMatrix;
+		// worker threads even on a single core, the frame's waits and the load's jobs interleave anyway
+		std::unique_ptr<Level::JobSystem> jobs(threads > 0 ? new Level::JobSystem(threads) : nullptr);
+		if (jobs)
+			std::printf("%u job threads shared by the frames and the load\n", jobs->Threads());
+
+		int failures = 0;
+		for (size_t l = 0; l < levels.size(); ++l) {
+			const auto& level = levels[l];
+			// what SelectLevel used to do inside a frame
+			double syncMs = 0.0;
+			{
+				Level::RecordingBackend backend;
+				Level_Objects objects;
+				objects.SetJobSystem(jobs.get());
+				objects.SetLevelOfDetail(true);
+				Clock::time_point start = Clock::now();
+				bool loaded = objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog());
+				objects.UploadLevelToGPU(backend);
+				syncMs = MillisecondsSince(start);
+				objects.UnloadLevel();
+				if (!loaded) {
+					std::cout << "ERROR: level not found " << level.first << std::endl;
+					return 1;
+				}
+			}
+
+			for (bool cancel : { false, true }) {
+				Level::RecordingBackend backend;
+				std::unique_ptr<Level_Objects> current(new Level_Objects());
+				current->SetJobSystem(jobs.get());
+				current->LoadLevel(shown.first.c_str(), shown.second.c_str(), QuietLog());
+				current->UploadLevelToGPU(backend);
+				const Level_Objects* original = current.get();
+				Level::LevelStreamer streamer;
+				streamer.SetJobSystem(jobs.get());
+				// the renderer's settings, levels of detail are the longest load jobs
+				streamer.SetLevelOfDetail(true);
+
+				std::vector<double> loadingFrames;
+				double swapMs = 0.0;
+				unsigned long long swapFrame = 0, releasedAt = 0;
+				float lastProgress = 0.0f;
+				unsigned progressSteps = 0;
+				bool progressMonotonic = true;
+				Clock::time_point requested = Clock::now();
+				streamer.Request(level.first, level.second, QuietLog());
+				// the worker checks between records, a small level can finish before it sees this
+				if (cancel)
+					streamer.Cancel();
+				double loadMs = 0.0;
+				Clock::time_point tick = Clock::now();
+				for (unsigned long long frame = 1; frame < 100000; ++frame) {
+					unsigned releasedBefore = backend.Counters().buffersReleased;
+					Clock::time_point start = Clock::now();
+					backend.ResetFrame();
+					bool swapped = streamer.BeginFrame(backend, current);
+					current->SetViewProjection(view, projection);
+					current->RenderLevel(backend);
+					double frameMs = MillisecondsSince(start);
+
+					float progress = streamer.Progress();
+					if (streamer.Loading()) {
+						progressMonotonic = progressMonotonic && progress >= lastProgress;
+						progressSteps += progress != lastProgress;
+						lastProgress = progress;
+					}
+					if (swapped) {
+						swapMs = frameMs;
+						swapFrame = frame;
+						loadMs = MillisecondsSince(requested);
+					}
+					else if (swapFrame == 0)
+						loadingFrames.push_back(frameMs);
+					// ResetFrame cleared the counters, any release this frame is the retired level
+					if (swapFrame != 0 && releasedAt == 0 && backend.Counters().buffersReleased > 0 && releasedBefore == 0)
+						releasedAt = frame;
+					if (swapFrame != 0 && frame > swapFrame + Level::LevelStreamer::FRAMES_IN_FLIGHT + 1)
+						break;
+					if (cancel && !streamer.Loading()) {
+						loadMs = MillisecondsSince(requested);
+						break;
+					}
+					tick += std::chrono::duration_cast<Clock::duration>(framePeriod);
+					std::this_thread::sleep_until(tick);
+				}
+
+				std::sort(loadingFrames.begin(), loadingFrames.end());
+				double worst = loadingFrames.empty() ? 0.0 : loadingFrames.back();
+				double median = loadingFrames.empty() ? 0.0 : loadingFrames[loadingFrames.size() / 2];
+				bool ok;
+				if (cancel) {
+					bool cancelled = streamer.State() == Level::LevelStreamer::STATE::CANCELLED;
+					// a load that won the race must have been swapped in like any other
+					ok = (cancelled ? current.get() == original : swapFrame != 0) && worst <= budgetMs;
+					std::printf("  cancel: %s after %.2f ms, current level %s, %zu frames worst %.3f ms  %s\n",
+						cancelled ? "stopped" : "finished before the cancel", loadMs,
+						current.get() == original ? "kept" : "replaced", loadingFrames.size(), worst, ok ? "ok" : "FAILED");
+				}
+				else {
+					bool retiredInTime = releasedAt == swapFrame + Level::LevelStreamer::FRAMES_IN_FLIGHT && streamer.RetiredCount() == 0;
+					ok = swapFrame != 0 && worst <= budgetMs && swapMs < syncMs && retiredInTime && progressMonotonic;
+					std::printf("%s\n", level.first.c_str());
+					std::printf("  synchronous load + upload %9.2f ms (one frame)\n", syncMs);
+					std::printf("  streamed: ready after %.2f ms, %zu frames while loading  median %.3f ms  worst %.3f ms (budget %.2f)\n",
+						loadMs, loadingFrames.size(), median, worst, budgetMs);
+					std::printf("  swap frame (upload) %.3f ms  %.1fx shorter than the synchronous hitch\n", swapMs, syncMs / std::max(swapMs, 1e-6));
+					std::printf("  old level freed at frame +%llu (expected +%u), %u progress steps%s  %s\n",
+						releasedAt ? releasedAt - swapFrame : 0ull, Level::LevelStreamer::FRAMES_IN_FLIGHT, progressSteps,
+						progressMonotonic ? "" : " NOT MONOTONIC", ok ? "ok" : "FAILED");
+				}
+				if (!ok)
+					++failures;
+				streamer.Flush();
+				current->UnloadLevel();
+			}
+		}
+		if (!synthetic.empty()) {
+			std::remove(synthetic.c_str());
+			std::remove(Level::LevelBinary::PathFor(synthetic).c_str());
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Loads each level and renders frames through Level_Objects with a
+	// Level::JobSystem of 1, 2, 4, 8 and 16 threads and reports the speedup over
+	// one thread. Loading spreads .h2b parsing and bounds over the jobs, frames
+	// split BVH culling and instance batching. The camera alternates between two
+	// views so every frame regroups the visible instances. Every thread count must
+	// record the same command stream. First a load on another thread shares the
+	// job system with small frames, none of its jobs may run inside a frame's waits.
+	int BenchmarkJobs(int argc, char** argv)
+	{
+		int iterations = 3, frames = 200;
+		unsigned syntheticInstances = 100000;
+		std::vector<unsigned> threadCounts = { 1, 2, 4, 8, 16 };
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				syntheticInstances = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::max(1, std::atoi(argv[++i]));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				iterations = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		std::vector<std::pair<std::string, std::string>> levels;
+		if (levelArguments.empty())
+			levels = { { "../GameLevel2.txt", "../Models2" } };
+		else
+			levels = LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data());
+		std::string synthetic;
+		if (syntheticInstances > 0) {
+			Level::LevelFile source;
+			synthetic = (std::filesystem::temp_directory_path() / "level_benchmark_jobs.txt").string();
+			if (source.Read("../GameLevel.txt") == false || WriteSyntheticLevel(synthetic, source, syntheticInstances) == false) {
+				std::cout << "ERROR: could not write " << synthetic << std::endl;
+				return 1;
+			}
+			levels.push_back({ synthetic, "../Models" });
+		}
+
+		int failures = 0;
+		{
+			// a load on its own thread runs ParallelFors of long items (like LoadLevel's parses and levels
+			// of detail) while this thread renders small frames, like LevelStreamer: waiting on a
+			// frame's jobs must never run one of the load's
+			Level::JobSystem jobs(4);
+			const std::thread::id frameThread = std::this_thread::get_id();
+			const int loadJobs = 256;
+			const double loadJobMs = 2.0;
+			std::atomic<unsigned> loadJobsOnFrameThread{ 0 };
+			std::atomic<bool> loading{ true };
+			std::thread loader([&]() {
+				for (int round = 0; round < loadJobs / 8; ++round)
+					jobs.ParallelFor(8, 1, [&](unsigned begin, unsigned end) {
+						for (unsigned j = begin; j < end; ++j) {
+							loadJobsOnFrameThread += std::this_thread::get_id() == frameThread;
+							Clock::time_point start = Clock::now();
+							while (MillisecondsSince(start) < loadJobMs) {
+							}
+						}
+					});
+				loading = false;
+			});
+			std::vector<double> frameTimes;
+			while (loading) {
+				Clock::time_point start = Clock::now();
+				// 64 items of 20 us
+				jobs.ParallelFor(64, 1, [&](unsigned, unsigned) {
+					Clock::time_point itemStart = Clock::now();
+					while (MillisecondsSince(itemStart) < 0.02) {
+					}
+				});
+				frameTimes.push_back(MillisecondsSince(start));
+			}
+			loader.join();
+			std::sort(frameTimes.begin(), frameTimes.end());
+			const bool ok = loadJobsOnFrameThread == 0;
+			std::printf("scheduler: %zu frames while %d x %.0f ms load jobs ran on %u threads, median %.3f ms worst %.3f ms, %u load jobs on the frame thread  %s\n",
+				frameTimes.size(), loadJobs, loadJobMs, jobs.Threads(), frameTimes.empty() ? 0.0 : frameTimes[frameTimes.size() / 2],
+				frameTimes.empty() ? 0.0 : frameTimes.back(), loadJobsOnFrameThread.load(), ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		}
+		for (const auto& level : levels) {
+			// two cameras high above the middle of the level, looking down at it from opposite sides
+			Level::LevelFile file;
+			if (file.Read(level.first.c_str()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (const Level::RECORD& record : file.records)
+				for (int a = 0; a < 3; ++a) {
+					low[a] = std::min(low[a], record.transform.data[12 + a]);
+					high[a] = std::max(high[a], record.transform.data[12 + a]);
+				}
+			float span = std::max(high[0] - low[0], high[2] - low[2]) + 10.0f;
+			Level::FLOAT3 center = { (low[0] + high[0]) * 0.5f, (low[1] + high[1]) * 0.5f, (low[2] + high[2]) * 0.5f };
+			Level::MATRIX projection = Level::PerspectiveLH(65.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, span * 4.0f);
+			Level::MATRIX views[2] = {
+				Level::LookAtLH({ center.x - span * 0.25f, center.y + span * 0.5f, center.z - span * 0.6f }, center, { 0, 1, 0 }),
+				Level::LookAtLH({ center.x + span * 0.25f, center.y + span * 0.5f, center.z + span * 0.6f }, center, { 0, 1, 0 }) };
+			{
+				// compiles the .lvlb so every measured load reads the same thing
+				Level_Objects warm;
+				warm.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog());
+			}
+
+			std::printf("%s (%zu records)\n", level.first.c_str(), file.records.size());
+			double loadOne = 0.0, frameOne = 0.0;
+			unsigned long long referenceStream = 0;
+			for (unsigned threads : threadCounts) {
+				Level::JobSystem jobs(threads);
+				double loadMs = 1e30;
+				for (int it = 0; it < iterations; ++it) {
+					Level_Objects objects;
+					objects.SetJobSystem(&jobs);
+					Clock::time_point start = Clock::now();
+					objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog());
+					loadMs = std::min(loadMs, MillisecondsSince(start));
+				}
+
+				Level::RecordingBackend backend;
+				Level_Objects objects;
+				objects.SetJobSystem(&jobs);
+				objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog());
+				objects.UploadLevelToGPU(backend);
+				Level::JOB_STATS before = jobs.Stats();
+				Clock::time_point start = Clock::now();
+				for (int f = 0; f < frames; ++f) {
+					backend.ResetFrame();
+					objects.SetViewProjection(views[f & 1], projection);
+					objects.RenderLevel(backend);
+				}
+				double frameMs = MillisecondsSince(start) / frames;
+				Level::JOB_STATS after = jobs.Stats();
+				// frames alternate views, the last one used views[1]
+				unsigned long long stream = backend.StreamHash();
+				if (threads == threadCounts.front()) {
+					loadOne = loadMs;
+					frameOne = frameMs;
+					referenceStream = stream;
+				}
+				bool same = stream == referenceStream;
+				if (!same)
+					++failures;
+				std::printf("  %2u threads  load %9.2f ms  %5.2fx   frame %8.3f ms  %5.2fx  %5llu jobs %5llu stolen per frame  visible %u  %s\n",
+					threads, loadMs, loadOne / loadMs, frameMs, frameOne / frameMs,
+					(after.executed - before.executed) / frames, (after.stolen - before.stolen) / frames,
+					objects.GetCullStats().visible, same ? "same stream" : "STREAM MISMATCH");
+				objects.UnloadLevel();
+			}
+		}
+		if (!synthetic.empty()) {
+			std::remove(synthetic.c_str());
+			std::remove(Level::LevelBinary::PathFor(synthetic).c_str());
+		}
+		std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Checks the render queue headless: the radix sort against std::stable_sort,
+	// the key order (state, opaque near first, translucent last and far first)
+	// and StateCache dropping only repeated binds. Then renders each level from
+	// the default camera with and without the queue and reports the state
+	// changes it avoids per frame, both must submit the same draws.
+	int BenchmarkQueue(int argc, char** argv)
+	{
+		int frames = 1000;
+		unsigned syntheticInstances = 10000;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				syntheticInstances = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+
+		{
+			std::printf("sort keys\n");
+			Level::RenderQueue queue;
+			std::vector<std::pair<unsigned long long, unsigned>> expected;
+			unsigned long long random = 0x9E3779B97F4A7C15ull;
+			for (unsigned i = 0; i < 100000; ++i) {
+				random = random * 6364136223846793005ull + 1442695040888963407ull;
+				// few distinct states so equal keys test stability
+				unsigned long long key = (random >> 40) % 4 == 0 ? random : (random >> 60) << 48 | (random & 0xFF);
+				queue.Push(key, i);
+				expected.push_back({ key, i });
+			}
+			Clock::time_point start = Clock::now();
+			queue.Sort();
+			double sortMs = MillisecondsSince(start);
+			std::stable_sort(expected.begin(), expected.end(),
+				[](const std::pair<unsigned long long, unsigned>& a, const std::pair<unsigned long long, unsigned>& b) { return a.first < b.first; });
+			bool same = queue.Size() == expected.size();
+			for (size_t i = 0; same && i < expected.size(); ++i)
+				same = queue.Key(i) == expected[i].first && queue.Draw(i) == expected[i].second;
+			std::printf("  100000 keys radix sorted in %.3f ms\n", sortMs);
+			check(same, "radix sort matches std::stable_sort");
+
+			using namespace Level::SORT_KEY;
+			check(Opaque(1, 5, 2, 1.0f) < Opaque(1, 5, 2, 2.0f) && Opaque(1, 5, 2, 100.0f) < Opaque(1, 5, 3, 0.5f) &&
+				Opaque(1, 5, 9, 100.0f) < Opaque(1, 6, 0, 0.5f) && Opaque(1, 9, 9, 100.0f) < Opaque(2, 0, 0, 0.5f),
+				"opaque: pipeline, geometry, material, then near first");
+			check(Translucent(1, 5, 2, 2.0f) < Translucent(1, 5, 2, 1.0f) && Translucent(2, 0, 0, 3.0f) < Translucent(1, 0, 0, 2.0f) &&
+				Opaque(127, 65535, 65535, 1e30f) < Translucent(0, 0, 0, 1e30f),
+				"translucent: after every opaque draw, far first");
+			check(Depth(-1.0f) == 0 && Depth(0.0f) == 0 && Depth(0.001f) < Depth(0.002f) && Depth(1000.0f) < Depth(1001.0f),
+				"depth bits keep the order of positive view depths");
+		}
+		{
+			Level::RecordingBackend recording;
+			Level::StateCache cache;
+			cache.Begin(recording);
+			const Level::BufferHandle vertex[] = { 3, 4 };
+			const unsigned strides[] = { 32, 64 }, offsets[] = { 0, 0 };
+			cache.SetPipeline(1);
+			cache.SetPipeline(1);
+			cache.SetVertexBuffers(0, 2, vertex, strides, offsets);
+			cache.SetVertexBuffers(0, 1, vertex, strides, offsets);
+			cache.SetIndexBuffer(5, Level::INDEX_FORMAT::UINT32, 0);
+			cache.SetIndexBuffer(5, Level::INDEX_FORMAT::UINT16, 0);
+			cache.SetConstantBuffer(1, 6, Level::STAGE_VERTEX_PIXEL);
+			cache.SetConstantBuffer(1, 6, Level::STAGE_VERTEX_PIXEL);
+			cache.SetConstantBuffer(2, 6, Level::STAGE_VERTEX_PIXEL);
+			Level::STATE_STATS before = cache.Stats();
+			unsigned recorded = recording.Counters().stateChanges;
+			cache.ReleaseBuffer(7);
+			cache.SetPipeline(1);
+			Level::STATE_STATS after = cache.Stats();
+			std::printf("state cache\n");
+			check(before.issued == 6 && before.skipped == 3 && recorded == 6,
+				"repeated binds dropped, changed format/slot passed on");
+			check(after.issued == 7, "releasing a buffer forgets the bound state");
+		}
+
+		std::vector<std::pair<std::string, std::string>> levels = LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data());
+		std::string synthetic;
+		if (syntheticInstances > 0) {
+			Level::LevelFile source;
+			synthetic = (std::filesystem::temp_directory_path() / "level_benchmark_queue.txt").string();
+			if (source.Read("../GameLevel.txt") == false || WriteSyntheticLevel(synthetic, source, syntheticInstances) == false) {
+				std::cout << "ERROR: could not write " << synthetic << std::endl;
+				return 1;
+			}
+			levels.push_back({ synthetic, "../Models" });
+		}
+		Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+		for (const auto& level : levels) {
+			Level::RecordingBackend backend;
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			objects.UploadLevelToGPU(backend);
+			objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+			// the camera only sees the first copy of the generated level, draw all of it
+			objects.SetCulling(level.first != synthetic);
+			std::printf("%s\n", level.first.c_str());
+			for (bool instanced : { false, true }) {
+				objects.SetInstancing(instanced);
+				Level::RECORDING_COUNTERS counters[2];
+				double frameUs[2];
+				Level::STATE_STATS state = {};
+				for (bool sorted : { false, true }) {
+					objects.SetRenderQueue(sorted);
+					Clock::time_point start = Clock::now();
+					for (int f = 0; f < frames; ++f) {
+						backend.ResetFrame();
+						objects.RenderLevel(backend);
+					}
+					frameUs[sorted] = MillisecondsSince(start) * 1000.0 / frames;
+					counters[sorted] = backend.Counters();
+					if (sorted)
+						state = objects.GetStateStats();
+				}
+				std::printf("  %-10s %6u draws  state changes %6u -> %6u (%6u avoided, %6u dropped by the cache)  updates %6u -> %6u  %8.2f -> %8.2f us/frame\n",
+					instanced ? "instanced" : "per model", counters[1].draws, counters[0].stateChanges, counters[1].stateChanges,
+					counters[0].stateChanges - std::min(counters[0].stateChanges, counters[1].stateChanges), state.skipped,
+					counters[0].bufferUpdates, counters[1].bufferUpdates, frameUs[0], frameUs[1]);
+				bool sameDraws = counters[0].draws == counters[1].draws && counters[0].instances == counters[1].instances &&
+					counters[0].indices == counters[1].indices;
+				check(sameDraws && counters[1].stateChanges <= counters[0].stateChanges, "same draws, no more state changes");
+			}
+			objects.UnloadLevel();
+		}
+		if (!synthetic.empty()) {
+			std::remove(synthetic.c_str());
+			std::remove(Level::LevelBinary::PathFor(synthetic).c_str());
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Asserts what a frame uploads with the material table and constant ring:
+	// per model draws write only their world matrix and material index, instanced
+	// groups only a material index, nothing else changes once the visible set is
+	// stable. The shipped levels are also checked against fixed byte counts so a
+	// regression in either level shows up as a number.
+	int BenchmarkUpload(int argc, char** argv)
+	{
+		struct EXPECTED {
+			const char* level;
+			unsigned long long perModel, instanced;
+		};
+		const EXPECTED shipped[] = {
+			{ "GameLevel.txt", 176 * sizeof(MeshData), 28 * 16 },
+			{ "GameLevel2.txt", 59 * sizeof(MeshData), 24 * 16 },
+		};
+		// MeshData before the material table: world matrix + the full ATTRIBUTES
+		const unsigned long long oldDrawBytes = sizeof(Level::MATRIX) + sizeof(H2B::ATTRIBUTES);
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		for (const auto& level : LevelArguments(argc, argv)) {
+			Level::RecordingBackend backend;
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			backend.ResetFrame();
+			objects.UploadLevelToGPU(backend);
+			Level::UPLOAD_STATS upload = objects.GetUploadStats();
+			std::printf("%s\n  material table %llu bytes (%llu materials), uploaded once\n", level.first.c_str(),
+				upload.materialTableBytes, upload.materialTableBytes / sizeof(H2B::ATTRIBUTES));
+
+			const EXPECTED* expected = nullptr;
+			for (const EXPECTED& entry : shipped)
+				if (std::filesystem::path(level.first).filename() == entry.level)
+					expected = &entry;
+			for (bool instanced : { false, true }) {
+				objects.SetInstancing(instanced);
+				// the first frame may regroup the instances, the second is the steady state
+				backend.ResetFrame();
+				objects.RenderLevel(backend);
+				backend.ResetFrame();
+				objects.RenderLevel(backend);
+				const Level::RECORDING_COUNTERS& counters = backend.Counters();
+				upload = objects.GetUploadStats();
+				unsigned long long before = counters.draws * oldDrawBytes;
+				std::printf("  %-10s %4u draws  %7llu bytes/frame (was %7llu)  %4u updates\n", instanced ? "instanced" : "per model",
+					counters.draws, counters.bytesUploaded, before, counters.bufferUpdates);
+				check(upload.instanceBytes == 0 && counters.bytesUploaded == upload.constantBytes, "only per draw constants are uploaded");
+				if (instanced)
+					check(upload.constantBytes <= 16ull * counters.draws, "a material index per instanced group at most");
+				else
+					check(upload.constantBytes == counters.draws * sizeof(MeshData) && counters.bufferUpdates == counters.draws,
+						"world matrix + material index per draw");
+				if (expected != nullptr)
+					check(counters.bytesUploaded == (instanced ? expected->instanced : expected->perModel), "matches the expected bytes for this level");
+			}
+			objects.UnloadLevel();
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Checks the level geometry allocator headless: the range allocator against a
+	// per element reference, the pool's page contents before and after freeing and
+	// compacting, and a level swap that keeps some assets (which have to end up
+	// compacted and still draw the same picture as a fresh load). Then reports the
+	// shared buffers of each level against a vertex + index buffer per asset.
+	int BenchmarkGeometry(int argc, char** argv)
+	{
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		std::mt19937 random(14);
+
+		{
+			const unsigned capacity = 4096;
+			Level::RangeAllocator allocator;
+			allocator.Reset(capacity);
+			std::vector<int> owner(capacity, -1);
+			std::vector<std::pair<unsigned, unsigned>> live;
+			bool firstFit = true, overlap = false, accounting = true, coalesced = true;
+			for (int op = 0; op < 20000; ++op) {
+				if (live.empty() || random() % 3 != 0) {
+					unsigned count = 1 + random() % 96, expected = capacity, run = 0;
+					for (unsigned i = 0; i < capacity && expected == capacity; ++i) {
+						run = owner[i] < 0 ? run + 1 : 0;
+						if (run == count)
+							expected = i + 1 - count;
+					}
+					unsigned offset = 0;
+					bool allocated = allocator.Allocate(count, offset);
+					firstFit &= allocated == (expected != capacity) && (!allocated || offset == expected);
+					if (allocated) {
+						for (unsigned i = offset; i < offset + count && i < capacity; ++i) {
+							overlap |= owner[i] >= 0;
+							owner[i] = op;
+						}
+						live.push_back({ offset, count });
+					}
+				}
+				else {
+					size_t victim = random() % live.size();
+					allocator.Free(live[victim].first, live[victim].second);
+					for (unsigned i = live[victim].first; i < live[victim].first + live[victim].second; ++i)
+						owner[i] = -1;
+					live[victim] = live.back();
+					live.pop_back();
+				}
+				unsigned used = 0, freeElements = 0, end = 0;
+				for (const auto& range : live)
+					used += range.second;
+				for (const auto& block : allocator.Blocks()) {
+					coalesced &= block.first > end || (end == 0 && block.first == 0);
+					for (unsigned i = block.first; i < block.first + block.second; ++i)
+						accounting &= owner[i] < 0;
+					freeElements += block.second;
+					end = block.first + block.second;
+				}
+				accounting &= allocator.Used() == used && freeElements + used == capacity;
+			}
+			for (const auto& range : live)
+				allocator.Free(range.first, range.second);
+			std::printf("range allocator (20000 random allocations/frees over %u elements)\n", capacity);
+			check(firstFit, "allocations take the lowest free run that fits");
+			check(!overlap && accounting, "no overlaps, free blocks + used cover the capacity");
+			check(coalesced, "freed neighbours are merged into one block");
+			check(allocator.FreeBlocks() == 1 && allocator.LargestFree() == capacity, "everything freed is one block again");
+		}
+
+		{
+			// small pages so the synthetic assets need several, asset 7 needs a page of its own
+			Level::SoftwareBackend backend(8, 8, 1);
+			Level::GeometryPool pool(12, 4, 1024, 3072);
+			const unsigned assets = 48;
+			std::vector<std::vector<unsigned char>> vertices(assets), indices(assets);
+			for (unsigned id = 0; id < assets; ++id) {
+				vertices[id].resize(12 * (id == 7 ? 1500 : 20 + random() % 380));
+				indices[id].resize(4 * (30 + random() % 1170));
+				for (size_t i = 0; i < vertices[id].size(); ++i)
+					vertices[id][i] = static_cast<unsigned char>(id * 131 + i);
+				for (size_t i = 0; i < indices[id].size(); ++i)
+					indices[id][i] = static_cast<unsigned char>(id * 71 + i * 3);
+			}
+			auto source = [&](unsigned id) {
+				return Level::GEOMETRY_DATA{ vertices[id].data(), static_cast<unsigned>(vertices[id].size() / 12),
+					indices[id].data(), static_cast<unsigned>(indices[id].size() / 4) };
+			};
+			auto contentsMatch = [&]() {
+				for (unsigned id = 0; id < assets; ++id) {
+					if (!pool.Contains(id))
+						continue;
+					const Level::GEOMETRY_RANGE& range = pool.Range(id);
+					const std::vector<unsigned char>* vertexBytes = backend.Contents(pool.VertexBuffer(range.page));
+					const std::vector<unsigned char>* indexBytes = backend.Contents(pool.IndexBuffer(range.page));
+					if (vertexBytes == nullptr || indexBytes == nullptr ||
+						static_cast<size_t>(range.baseVertex) * 12 + vertices[id].size() > vertexBytes->size() ||
+						static_cast<size_t>(range.firstIndex) * 4 + indices[id].size() > indexBytes->size() ||
+						std::memcmp(vertexBytes->data() + range.baseVertex * 12, vertices[id].data(), vertices[id].size()) != 0 ||
+						std::memcmp(indexBytes->data() + range.firstIndex * 4, indices[id].data(), indices[id].size()) != 0)
+						return false;
+				}
+				return true;
+			};
+			bool added = true;
+			for (unsigned id = 0; id < assets; ++id)
+				added &= pool.Add(backend, id, source(id));
+			Level::GEOMETRY_STATS full = pool.GetStats();
+			std::printf("geometry pool (%u synthetic assets, 1024 vertex / 3072 index pages)\n", assets);
+			std::printf("      %u pages  %u buffers  %zu of %zu bytes used\n", full.pages, full.buffers, full.usedBytes, full.capacityBytes);
+			check(added && full.ranges == assets && contentsMatch(), "every asset uploaded to its range");
+			check(pool.Range(7).vertexCount == 1500 && pool.Vertices(pool.Range(7).page).Capacity() == 1500,
+				"an asset bigger than a page gets a page of its own");
+
+			for (unsigned id = 0; id < assets; ++id)
+				if (id % 2 == 0 || id % 5 == 0)
+					pool.Remove(id);
+			Level::GEOMETRY_STATS holes = pool.GetStats();
+			unsigned moved = pool.Compact(backend, source);
+			Level::GEOMETRY_STATS compacted = pool.GetStats();
+			std::printf("      freed %u assets: %zu hole bytes in %u free blocks, fragmentation %.2f\n",
+				assets - holes.ranges, holes.holeBytes, holes.freeBlocks, holes.fragmentation);
+			std::printf("      compacted: %u assets moved (%zu bytes), %u -> %u pages, fragmentation %.2f\n",
+				moved, compacted.bytesMoved, holes.pages, compacted.pages, compacted.fragmentation);
+			check(holes.holeBytes > 0 && holes.fragmentation > 0.0, "freeing leaves holes");
+			check(compacted.holeBytes == 0 && compacted.fragmentation == 0.0 && compacted.ranges == holes.ranges,
+				"compacting closes every hole and keeps every asset");
+			check(moved > 0 && compacted.pages < holes.pages && contentsMatch(), "moved ranges were re-uploaded, empty pages released");
+			// the first asset of page 0 leaves a hole that it fits back into
+			unsigned reused = 0;
+			while (!pool.Contains(reused) || pool.Range(reused).page != 0 || pool.Range(reused).baseVertex != 0)
+				++reused;
+			unsigned before = pool.PageCount();
+			pool.Remove(reused);
+			added = pool.Add(backend, reused, source(reused));
+			check(added && pool.PageCount() == before && pool.Range(reused).page == 0 && pool.Range(reused).baseVertex == 0 &&
+				contentsMatch(), "a freed range is reused before a new page is made");
+
+			pool.Release(backend);
+			Level::GEOMETRY_STATS released = pool.GetStats();
+			check(released.pages == 0 && released.ranges == 0 && released.capacityBytes == 0, "release frees every page");
+		}
+
+		// a level with every other asset of the first level, loaded over it
+		std::vector<std::pair<std::string, std::string>> levels = LevelArguments(argc, argv);
+		if (!levels.empty()) {
+			Level::LevelFile source;
+			std::string subset = (std::filesystem::temp_directory_path() / "level_benchmark_geometry.txt").string();
+			bool written = source.Read(levels[0].first.c_str());
+			if (written) {
+				std::vector<std::string> assetNames;
+				std::ofstream file(subset, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+				file << "# Game Level Exporter v1.3\r\n";
+				char line[128];
+				for (const Level::RECORD& record : source.records) {
+					if (record.type != Level::RECORD_TYPE::MESH)
+						continue;
+					std::string asset = record.name.substr(0, record.name.find_last_of("."));
+					size_t index = std::find(assetNames.begin(), assetNames.end(), asset) - assetNames.begin();
+					if (index == assetNames.size())
+						assetNames.push_back(asset);
+					if (index % 2 == 0)
+						continue;
+					file << "MESH\r\n" << record.name << "\r\n";
+					const float* m = record.transform.data;
+					for (int row = 0; row < 4; ++row) {
+						std::snprintf(line, sizeof(line), "%s(%.9g, %.9g, %.9g, %.9g)%s\r\n", row == 0 ? "<Matrix 4x4 " : "            ",
+							m[row * 4], m[row * 4 + 1], m[row * 4 + 2], m[row * 4 + 3], row == 3 ? ">" : "");
+						file << line;
+					}
+				}
+				written = static_cast<bool>(file);
+			}
+			if (!written) {
+				std::cout << "ERROR: could not write " << subset << std::endl;
+				return 1;
+			}
+			const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+			Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+			Level::SoftwareBackend backend(800, 600);
+			Level::BufferHandle sceneBuffer = backend.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(Level::SCENE_CONSTANTS) }, nullptr);
+			auto render = [&](Level_Objects& objects) {
+				objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+				backend.BeginFrame(clearColor);
+				backend.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+				backend.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+				objects.RenderLevel(backend);
+				backend.EndFrame();
+				return backend.Image();
+			};
+			Level_Objects fresh, swapped;
+			bool loaded = fresh.LoadLevel(subset.c_str(), levels[0].second.c_str(), QuietLog());
+			if (loaded)
+				fresh.UploadLevelToGPU(backend);
+			Level::IMAGE expected = render(fresh);
+			loaded &= swapped.LoadLevel(levels[0].first.c_str(), levels[0].second.c_str(), QuietLog());
+			swapped.UploadLevelToGPU(backend);
+			Level::GEOMETRY_STATS first = swapped.GetGeometryStats();
+			loaded &= swapped.LoadLevel(subset.c_str(), levels[0].second.c_str(), QuietLog());
+			Level::GEOMETRY_STATS kept = swapped.GetGeometryStats();
+			swapped.UploadLevelToGPU(backend);
+			Level::IMAGE_DIFF diff = Level::CompareImages(render(swapped), expected, 0);
+			std::printf("level swap %s -> every other asset (%u of %u assets kept)\n", levels[0].first.c_str(), kept.ranges, first.ranges);
+			std::printf("      %zu bytes moved by compaction, %zu -> %zu bytes used\n", kept.bytesMoved, first.usedBytes, kept.usedBytes);
+			check(loaded, "both levels loaded");
+			check(kept.compactions == 1 && kept.bytesMoved > 0 && kept.holeBytes == 0, "unloading compacted the assets that stayed");
+			check(diff.sizeMatches && diff.badPixels == 0, "same picture as loading the smaller level fresh");
+			swapped.UnloadLevel();
+			Level::GEOMETRY_STATS empty = swapped.GetGeometryStats();
+			check(empty.pages == 0 && empty.ranges == 0, "unloading the last level frees every page");
+			fresh.UnloadLevel();
+			backend.ReleaseBuffer(sceneBuffer);
+			std::filesystem::remove(subset);
+			std::filesystem::remove(Level::LevelBinary::PathFor(subset));
+		}
+
+		for (const auto& level : levels) {
+			Level::RecordingBackend backend;
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			objects.UploadLevelToGPU(backend);
+			Level::GEOMETRY_STATS stats = objects.GetGeometryStats();
+			std::printf("%s\n  %u assets in %u shared buffers (a pair per asset: %u)  %zu of %zu bytes used  %u free blocks  fragmentation %.2f\n",
+				level.first.c_str(), stats.ranges, stats.buffers, stats.ranges * 2, stats.usedBytes, stats.capacityBytes,
+				stats.freeBlocks, stats.fragmentation);
+			check(stats.pages == 1 && stats.holeBytes == 0, "one page, packed");
+			objects.UnloadLevel();
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// COMPACT vs FULL vertices: bytes and quantization error per asset of every
+	// level folder, then each level rendered in both formats on the software rasterizer.
+	int BenchmarkVertexFormat(int argc, char** argv)
+	{
+		// quantizing moves silhouettes and nearly coplanar faces by a fraction of a pixel,
+		// which flips some edge pixels, so this allows more of them than raster's references
+		unsigned tolerance = 8;
+		const double maxBadFraction = 0.01;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+				tolerance = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		std::vector<std::pair<std::string, std::string>> levels =
+			LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data());
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+
+		{
+			bool roundTrip = true;
+			for (unsigned bits = 0; bits < 0x10000; ++bits) {
+				unsigned short half = static_cast<unsigned short>(bits);
+				float value = Level::HalfToFloat(half);
+				if (value == value && Level::FloatToHalf(value) != half)
+					roundTrip = false;
+			}
+			// 2049 is halfway between 2048 and 2050, ties go to the even mantissa
+			bool rounding = Level::HalfToFloat(Level::FloatToHalf(2049.0f)) == 2048.0f &&
+				Level::HalfToFloat(Level::FloatToHalf(2051.0f)) == 2052.0f &&
+				Level::HalfToFloat(Level::FloatToHalf(1e6f)) == INFINITY &&
+				Level::HalfToFloat(Level::FloatToHalf(-1e-9f)) == 0.0f;
+			std::printf("compact vertex: %zu bytes, full vertex: %zu bytes\n", sizeof(Level::COMPACT_VERTEX), sizeof(H2B::VERTEX));
+			check(roundTrip, "every half survives half -> float -> half");
+			check(rounding, "floats round to the nearest half, ties to even");
+			float worst = 0;
+			for (int i = 0; i < 20000; ++i) {
+				float phi = i * 2.39996323f, z = 1.0f - (i + 0.5f) / 10000.0f, r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+				const float normal[3] = { r * std::cos(phi), r * std::sin(phi), z };
+				short encoded[2];
+				float decoded[3];
+				Level::OctahedralEncode(normal, encoded);
+				Level::OctahedralDecode(encoded, decoded);
+				worst = std::max(worst, Level::AngleDegrees(normal, decoded));
+			}
+			std::printf("      octahedral normals: %.4f degrees worst over 20000 directions\n", worst);
+			check(worst < 0.01f, "octahedral normals within 0.01 degrees");
+		}
+
+		{
+			// a 16 bit pool still takes an asset that needs 32 bit indices, its
+			// indices start on a 4 byte boundary and firstIndex counts 4 byte indices
+			Level::SoftwareBackend backend(8, 8, 1);
+			Level::GeometryPool pool(sizeof(Level::COMPACT_VERTEX), 2, 1024, 4096);
+			std::vector<Level::COMPACT_VERTEX> vertices(3 * 100);
+			for (size_t i = 0; i < vertices.size(); ++i)
+				vertices[i].position[0] = static_cast<unsigned short>(i);
+			std::vector<unsigned short> shortIndices = { 0, 1, 2 };
+			std::vector<unsigned> longIndices = { 99, 0, 98, 1, 97 };
+			bool added = pool.Add(backend, 0, { vertices.data(), 100, shortIndices.data(), 3, 2 });
+			added &= pool.Add(backend, 1, { vertices.data() + 100, 100, longIndices.data(), 5, 4 });
+			added &= pool.Add(backend, 2, { vertices.data() + 200, 100, shortIndices.data(), 3, 2 });
+			bool contents = added;
+			for (unsigned id = 0; id < 3 && contents; ++id) {
+				const Level::GEOMETRY_RANGE& range = pool.Range(id);
+				const std::vector<unsigned char>* vertexBytes = backend.Contents(pool.VertexBuffer(range.page));
+				const std::vector<unsigned char>* indexBytes = backend.Contents(pool.IndexBuffer(range.page));
+				const void* expected = id == 1 ? static_cast<const void*>(longIndices.data()) : shortIndices.data();
+				contents = vertexBytes != nullptr && indexBytes != nullptr &&
+					std::memcmp(vertexBytes->data() + range.baseVertex * sizeof(Level::COMPACT_VERTEX), vertices.data() + id * 100,
+						100 * sizeof(Level::COMPACT_VERTEX)) == 0 &&
+					std::memcmp(indexBytes->data() + range.firstIndex * range.indexBytes, expected, range.indexCount * range.indexBytes) == 0;
+			}
+			std::printf("geometry pool with 16 bit indices\n");
+			check(contents && pool.PageCount() == 1 && pool.Range(1).indexBytes == 4 && pool.Range(1).firstIndex == 2,
+				"16 and 32 bit assets share a page, 32 bit ones aligned");
+			check(!pool.Add(backend, 3, { vertices.data(), 100, shortIndices.data(), 3, 3 }), "an index size that is not a slot multiple is refused");
+			pool.Remove(0);
+			pool.Remove(2);
+			unsigned moved = pool.Compact(backend, [&](unsigned id) {
+				return Level::GEOMETRY_DATA{ vertices.data() + id * 100, 100, longIndices.data(), 5, 4 };
+			});
+			check(moved == 1 && pool.Range(1).firstIndex == 0 && pool.GetStats().holeBytes == 0, "compaction moves the 32 bit asset to the front");
+			pool.Release(backend);
+		}
+
+		// every asset of the levels' folders
+		std::vector<std::string> folders;
+		for (const auto& level : levels)
+			if (std::find(folders.begin(), folders.end(), level.second) == folders.end())
+				folders.push_back(level.second);
+		for (const std::string& folder : folders) {
+			std::vector<std::string> files = FindFiles({ folder }, ".h2b");
+			size_t fullBytes = 0, compactBytes = 0, shortAssets = 0;
+			Level::VERTEX_ERROR worst = {};
+			std::printf("%s (%zu assets)\n  %-28s %8s %8s %10s %10s %6s %11s %11s %9s %9s\n", folder.c_str(), files.size(),
+				"asset", "vertices", "indices", "full KB", "compact KB", "index", "position", "relative", "normal", "uv");
+			for (const std::string& path : files) {
+				H2B::Parser model;
+				if (model.Parse(path.c_str()) == false) {
+					std::printf("  ERROR: could not parse %s\n", path.c_str());
+					++failures;
+					continue;
+				}
+				Level::COMPACT_GEOMETRY compact;
+				Level::Compress(model, Level::LocalBounds(model), compact);
+				Level::VERTEX_ERROR error = Level::MeasureError(model, compact);
+				const unsigned indexBytes = compact.shortIndices.empty() ? 4 : 2;
+				const size_t full = sizeof(H2B::VERTEX) * model.vertices.size() + sizeof(unsigned) * model.indices.size();
+				const size_t packed = sizeof(Level::COMPACT_VERTEX) * compact.vertices.size() + indexBytes * model.indices.size();
+				std::printf("  %-28s %8zu %8zu %10.1f %10.1f %4u-bit %11.6f %11.2e %9.4f %9.6f\n",
+					std::filesystem::path(path).stem().string().c_str(), model.vertices.size(), model.indices.size(),
+					full / 1024.0, packed / 1024.0, indexBytes * 8, error.position, error.relative, error.normalDegrees, error.uv);
+				fullBytes += full;
+				compactBytes += packed;
+				shortAssets += indexBytes == 2 ? 1 : 0;
+				worst.position = std::max(worst.position, error.position);
+				worst.relative = std::max(worst.relative, error.relative);
+				worst.normalDegrees = std::max(worst.normalDegrees, error.normalDegrees);
+				worst.uv = std::max(worst.uv, error.uv);
+			}
+			std::printf("  %-28s %17s %10.1f %10.1f %6s %11.6f %11.2e %9.4f %9.6f\n", "total / worst", "",
+				fullBytes / 1024.0, compactBytes / 1024.0, "", worst.position, worst.relative, worst.normalDegrees, worst.uv);
+			std::printf("  compact is %.1f%% of full, %zu of %zu assets use 16 bit indices\n",
+				fullBytes > 0 ? 100.0 * compactBytes / fullBytes : 0.0, shortAssets, files.size());
+			// half a unorm16 step in each axis
+			check(worst.relative <= 0.87f / 65535.0f, "positions within half a quantization step");
+			check(worst.normalDegrees < 0.01f, "normals within 0.01 degrees");
+		}
+
+		const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+		Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+		for (const auto& level : levels) {
+			Level::SoftwareBackend backend(800, 600);
+			Level::BufferHandle sceneBuffer = backend.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(Level::SCENE_CONSTANTS) }, nullptr);
+			auto render = [&](Level_Objects& objects, bool instancing) {
+				objects.SetInstancing(instancing);
+				objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+				backend.BeginFrame(clearColor);
+				backend.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+				backend.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+				objects.RenderLevel(backend);
+				backend.EndFrame();
+				return backend.Image();
+			};
+			Level_Objects full, compact;
+			bool formatSet = compact.SetVertexFormat(Level::VERTEX_FORMAT::COMPACT);
+			if (full.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false ||
+				compact.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			full.UploadLevelToGPU(backend);
+			compact.UploadLevelToGPU(backend);
+			Level::GEOMETRY_STATS fullStats = full.GetGeometryStats(), compactStats = compact.GetGeometryStats();
+			std::printf("%s\n  geometry used: full %.1f KB  compact %.1f KB (%.1f%%)\n", level.first.c_str(),
+				fullStats.usedBytes / 1024.0, compactStats.usedBytes / 1024.0,
+				fullStats.usedBytes > 0 ? 100.0 * compactStats.usedBytes / fullStats.usedBytes : 0.0);
+			check(formatSet && compact.GetVertexFormat() == Level::VERTEX_FORMAT::COMPACT &&
+				!compact.SetVertexFormat(Level::VERTEX_FORMAT::FULL), "format only changes before the first upload");
+			check(compactStats.usedBytes < fullStats.usedBytes, "compact geometry is smaller");
+			Level::IMAGE perModel;
+			for (bool instancing : { false, true }) {
+				Level::IMAGE expected = render(full, instancing);
+				Level::IMAGE_DIFF diff = Level::CompareImages(render(compact, instancing), expected, tolerance);
+				std::printf("      %-9s %llu pixels off by more than %u (%.4f%%)  max error %u  rmse %.3f\n",
+					instancing ? "instanced" : "per model", diff.badPixels, tolerance, diff.badFraction * 100.0, diff.maxError, diff.rmse);
+				check(diff.sizeMatches && diff.badFraction <= maxBadFraction,
+					instancing ? "instanced compact draws match full ones" : "per model compact draws match full ones");
+				if (instancing)
+					check(Level::CompareImages(backend.Image(), perModel, 0).badPixels == 0, "compact per model and instanced draws are identical");
+				else
+					perModel = backend.Image();
+			}
+			compact.UnloadLevel();
+			full.UnloadLevel();
+			backend.ReleaseBuffer(sceneBuffer);
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// every triangle of every draw range as its corners' bytes, rotated so the
+	// smallest corner is first (winding kept) and sorted, equal if a range draws the same
+	std::vector<std::string> DrawnTriangles(const H2B::Parser& model)
+	{
+		std::vector<std::string> drawn;
+		unsigned draw = 0;
+		for (const H2B::BATCH& range : Level::DrawRanges(model)) {
+			std::vector<std::string> triangles;
+			for (unsigned t = 0; t + 2 < range.indexCount; t += 3) {
+				std::string corners[3];
+				for (int k = 0; k < 3; ++k)
+					corners[k].assign(reinterpret_cast<const char*>(&model.vertices[model.indices[range.indexOffset + t + k]]),
+						sizeof(H2B::VERTEX));
+				int first = 0;
+				for (int k = 1; k < 3; ++k)
+					if (corners[k] < corners[first])
+						first = k;
+				triangles.push_back(corners[first] + corners[(first + 1) % 3] + corners[(first + 2) % 3]);
+			}
+			std::sort(triangles.begin(), triangles.end());
+			drawn.push_back(std::to_string(draw++));
+			drawn.insert(drawn.end(), triangles.begin(), triangles.end());
+		}
+		return drawn;
+	}
+
+	// Runs the mesh optimizer over every .h2b of the folders and reports
+	// ACMR/ATVR (16 entry FIFO) and overdraw before and after per asset.
+	// Checks the writer round trips the original files, that every range still
+	// draws the same triangles and that a second run on --threads threads
+	// produces the same bytes.
+	int BenchmarkOptimize(int argc, char** argv)
+	{
+		Level::MESH_OPTIMIZE_OPTIONS options;
+		unsigned threads = 4;
+		std::string writeFolder;
+		std::vector<std::string> folders;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+				options.overdrawThreshold = static_cast<float>(std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--write") == 0 && i + 1 < argc)
+				writeFolder = argv[++i];
+			else
+				folders.push_back(argv[i]);
+		}
+		if (folders.empty())
+			folders = { "../Models", "../Models2" };
+		std::vector<std::string> files = FindFiles(folders, ".h2b");
+		if (files.empty()) {
+			std::cout << "ERROR: no .h2b files found" << std::endl;
+			return 1;
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+
+		std::printf("mesh optimizer: overdraw threshold %.2f, ACMR/ATVR with a %u entry FIFO\n",
+			options.overdrawThreshold, Level::VERTEX_CACHE_SIZE);
+		std::printf("  %-28s %8s %8s %7s %13s %13s %13s %8s\n", "asset", "vertices", "welded", "unused",
+			"ACMR", "ATVR", "overdraw", "ms");
+		std::vector<std::vector<char>> optimized(files.size());
+		bool roundTrip = true, sameTriangles = true, readable = true, allOptimized = true, noWorse = true;
+		unsigned long long trianglesTotal = 0, transformedBefore = 0, transformedAfter = 0, verticesBefore = 0, verticesAfter = 0;
+		unsigned long long coveredBefore = 0, shadedBefore = 0, coveredAfter = 0, shadedAfter = 0;
+		for (size_t f = 0; f < files.size(); ++f) {
+			H2B::Parser model;
+			if (model.Parse(files[f].c_str()) == false) {
+				std::printf("  ERROR: could not parse %s\n", files[f].c_str());
+				allOptimized = false;
+				continue;
+			}
+			std::ifstream original(files[f], std::ios_base::in | std::ios_base::binary);
+			std::vector<char> originalBytes((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+			Level::SerializeH2B(model, optimized[f]);
+			roundTrip &= optimized[f] == originalBytes;
+
+			std::vector<std::string> trianglesBefore = DrawnTriangles(model);
+			Level::OVERDRAW_STATS overdrawBefore = Level::AnalyzeOverdraw(model);
+			Level::MESH_OPTIMIZE_STATS stats = {};
+			Clock::time_point start = Clock::now();
+			bool done = Level::OptimizeMesh(model, options, &stats);
+			double milliseconds = MillisecondsSince(start);
+			allOptimized &= done;
+			Level::OVERDRAW_STATS overdrawAfter = Level::AnalyzeOverdraw(model);
+			sameTriangles &= DrawnTriangles(model) == trianglesBefore;
+			noWorse &= stats.cacheAfter.acmr <= stats.cacheBefore.acmr * std::max(1.0f, options.overdrawThreshold) + 1e-9;
+			Level::SerializeH2B(model, optimized[f]);
+
+			// both parsers read the result back as written
+			H2B::MappedParser reread;
+			readable &= reread.ParseMemory(optimized[f].data(), optimized[f].size()) &&
+				reread.vertices.size() == model.vertices.size() && reread.indices.size() == model.indices.size() &&
+				std::memcmp(reread.vertices.data(), model.vertices.data(), sizeof(H2B::VERTEX) * model.vertices.size()) == 0 &&
+				std::memcmp(reread.indices.data(), model.indices.data(), sizeof(unsigned) * model.indices.size()) == 0 &&
+				reread.meshes.size() == model.meshes.size();
+			for (size_t m = 0; readable && m < model.meshes.size(); ++m)
+				readable &= reread.meshes[m].drawInfo.indexOffset == model.meshes[m].drawInfo.indexOffset &&
+					reread.meshes[m].drawInfo.indexCount == model.meshes[m].drawInfo.indexCount &&
+					reread.meshes[m].materialIndex == model.meshes[m].materialIndex;
+
+			char acmr[32], atvr[32], overdraw[32];
+			std::snprintf(acmr, sizeof(acmr), "%.3f->%.3f", stats.cacheBefore.acmr, stats.cacheAfter.acmr);
+			std::snprintf(atvr, sizeof(atvr), "%.3f->%.3f", stats.cacheBefore.atvr, stats.cacheAfter.atvr);
+			std::snprintf(overdraw, sizeof(overdraw), "%.3f->%.3f", overdrawBefore.overdraw, overdrawAfter.overdraw);
+			std::printf("  %-28s %8u %8u %7u %13s %13s %13s %8.2f\n", std::filesystem::path(files[f]).stem().string().c_str(),
+				stats.verticesIn, stats.welded, stats.unused, acmr, atvr, overdraw, milliseconds);
+			trianglesTotal += stats.cacheBefore.triangles;
+			transformedBefore += stats.cacheBefore.transformed;
+			transformedAfter += stats.cacheAfter.transformed;
+			verticesBefore += stats.cacheBefore.vertices;
+			verticesAfter += stats.cacheAfter.vertices;
+			coveredBefore += overdrawBefore.covered;
+			shadedBefore += overdrawBefore.shaded;
+			coveredAfter += overdrawAfter.covered;
+			shadedAfter += overdrawAfter.shaded;
+		}
+		auto ratio = [](unsigned long long a, unsigned long long b) { return b > 0 ? static_cast<double>(a) / b : 0.0; };
+		std::printf("  %-28s %8s %8s %7s %6.3f->%.3f %6.3f->%.3f %6.3f->%.3f\n", "all", "", "", "",
+			ratio(transformedBefore, trianglesTotal), ratio(transformedAfter, trianglesTotal),
+			ratio(transformedBefore, verticesBefore), ratio(transformedAfter, verticesAfter),
+			ratio(shadedBefore, coveredBefore), ratio(shadedAfter, coveredAfter));
+		check(roundTrip, "writing a parsed file reproduces it byte for byte");
+		check(allOptimized, "every asset optimized");
+		check(sameTriangles, "every range draws the same triangles, same winding");
+		check(readable, "optimized files parse back as written");
+		check(noWorse && transformedAfter < transformedBefore, "ACMR better overall, no asset worse than the threshold allows");
+
+		// again from scratch on threads, one asset per job
+		std::vector<std::vector<char>> again(files.size());
+		{
+			Level::JobSystem jobs(threads);
+			Level::ParallelFor(&jobs, static_cast<unsigned>(files.size()), 1, [&](unsigned begin, unsigned end) {
+				for (unsigned f = begin; f < end; ++f) {
+					H2B::Parser model;
+					if (model.Parse(files[f].c_str()) && Level::OptimizeMesh(model, options))
+						Level::SerializeH2B(model, again[f]);
+				}
+			});
+		}
+		unsigned long long digest = Level::HASH_SEED;
+		for (const std::vector<char>& bytes : optimized)
+			digest = Level::HashBytes(bytes.data(), bytes.size(), digest);
+		std::printf("  output digest %016llx\n", digest);
+		check(again == optimized, "a second run on other threads gives the same bytes");
+
+		if (!writeFolder.empty()) {
+			std::filesystem::create_directories(writeFolder);
+			bool written = true;
+			for (size_t f = 0; f < files.size(); ++f) {
+				std::string path = writeFolder + "/" + std::filesystem::path(files[f]).filename().string();
+				std::ofstream file(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+				file.write(optimized[f].data(), static_cast<std::streamsize>(optimized[f].size()));
+				written &= static_cast<bool>(file);
+			}
+			std::printf("  wrote %zu files to %s\n", files.size(), writeFolder.c_str());
+			check(written, "optimized files written");
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Builds the levels of detail of every asset of each level and reports the
+	// triangles and error per level, then flies the renderer's camera (65 degree
+	// FOV) out from the level along a spiral and records the triangles submitted
+	// per frame with and without them, per model and instanced. The same path
+	// with the distance jittering every frame counts level switches with and
+	// without hysteresis, and the default camera's picture is compared with the
+	// full meshes on the software rasterizer.
+	int BenchmarkLod(int argc, char** argv)
+	{
+		int frames = 256;
+		unsigned tolerance = 8;
+		// at the default camera only the far assets use a simplified level
+		const double maxBadFraction = 0.01;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+				tolerance = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level::AssetCache cache;
+			std::vector<Level::INSTANCE> instances;
+			if (LoadInstances(level.first, level.second, cache, instances) == false)
+				return 1;
+			std::vector<Level::AssetHandle> assets;
+			for (const Level::INSTANCE& instance : instances)
+				if (std::find(assets.begin(), assets.end(), instance.asset) == assets.end())
+					assets.push_back(instance.asset);
+			Clock::time_point start = Clock::now();
+			cache.BuildLods(assets);
+			double buildMs = MillisecondsSince(start);
+
+			std::printf("%s\n  %-28s %9s %25s %26s %8s\n", level.first.c_str(), "asset", "triangles",
+				"per level", "error (% of radius)", "vertices");
+			bool monotonic = true, rangesValid = true;
+			for (Level::AssetHandle asset : assets) {
+				const Level::ASSET_LODS& lods = cache.Lods(asset);
+				const H2B::Parser& model = cache.Get(asset);
+				char triangles[64] = "", errors[64] = "";
+				for (unsigned k = 1; k < Level::MAX_LODS; ++k) {
+					char column[16];
+					if (k < lods.count)
+						std::snprintf(column, sizeof(column), " %7u", lods.triangles[k]);
+					std::strcat(triangles, k < lods.count ? column : "       -");
+					if (k < lods.count)
+						std::snprintf(column, sizeof(column), " %7.3f", lods.error[k] * 100.0f);
+					std::strcat(errors, k < lods.count ? column : "       -");
+					if (k < lods.count)
+						monotonic &= lods.triangles[k] < lods.triangles[k - 1] && lods.error[k] >= lods.error[k - 1];
+				}
+				for (unsigned k = 0; k < lods.count; ++k)
+					for (unsigned m = 0; m < lods.meshCount; ++m) {
+						const H2B::BATCH& range = lods.Range(k, m);
+						rangesValid &= static_cast<size_t>(range.indexOffset) + range.indexCount <= model.indices.size();
+						for (unsigned i = 0; i < range.indexCount && rangesValid; ++i)
+							rangesValid &= model.indices[range.indexOffset + i] < model.vertices.size();
+					}
+				std::printf("  %-28s %9u %25s %26s %8u\n", std::filesystem::path(cache.Path(asset)).stem().string().c_str(),
+					lods.triangles[0], triangles, errors, lods.vertices);
+			}
+			Level::ASSET_STATS stats = cache.GetStats();
+			std::printf("  %u of %u assets simplified in %.1f ms, %.1f KB with levels of detail\n",
+				stats.lodAssets, stats.uniqueAssets, buildMs, stats.residentBytes / 1024.0);
+			check(monotonic, "every level has fewer triangles and no less error");
+			check(rangesValid, "every level's ranges index the asset's vertices");
+
+			Level_Objects objects;
+			objects.SetLevelOfDetail(true);
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			Level::RecordingBackend recorder;
+			objects.UploadLevelToGPU(recorder);
+
+			// spiral out from above the level's middle, two turns from 5 to 60 units
+			float center[3] = { 0, 0, 0 };
+			for (const Level::INSTANCE& instance : instances)
+				for (int i = 0; i < 3; ++i)
+					center[i] += instance.world.data[12 + i] / instances.size();
+			Level::MATRIX projection = Level::PerspectiveLH(65.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+			auto camera = [&](int frame, float jitter) {
+				float t = static_cast<float>(frame) / std::max(1, frames - 1);
+				float angle = 2.0f * 6.2831853f * t;
+				float distance = (5.0f + 55.0f * t) * (1.0f + jitter);
+				Level::FLOAT3 eye = { center[0] + distance * std::cos(angle), center[1] + 0.5f * distance, center[2] + distance * std::sin(angle) };
+				return Level::LookAtLH(eye, { center[0], center[1], center[2] }, { 0, 1, 0 });
+			};
+			auto renderPath = [&](bool instancing, float jitter, unsigned long long& triangles, unsigned long long& switches,
+				std::vector<unsigned long long>* perFrame) {
+				objects.SetInstancing(instancing);
+				triangles = switches = 0;
+				double ms = 0;
+				for (int f = 0; f < frames; ++f) {
+					objects.SetViewProjection(camera(f, (f & 1) ? jitter : -jitter), projection);
+					recorder.ResetFrame();
+					Clock::time_point frameStart = Clock::now();
+					objects.RenderLevel(recorder);
+					ms += MillisecondsSince(frameStart);
+					unsigned long long submitted = recorder.Counters().indices / 3;
+					triangles += submitted;
+					switches += objects.GetLodStats().switches;
+					if (perFrame != nullptr)
+						perFrame->push_back(submitted);
+					if (submitted != objects.GetLodStats().triangles)
+						rangesValid = false;
+				}
+				return ms * 1000.0 / frames;
+			};
+
+			// levels depend on the last frame's, every path starts from level 0
+			auto startPath = [&](bool lod, const Level::LOD_SELECTION& selection) {
+				objects.SetLevelOfDetail(false);
+				objects.RenderLevel(recorder);
+				objects.SetLevelOfDetail(lod, Level::LOD_OPTIONS(), selection);
+			};
+			std::vector<unsigned long long> full, reduced, perModel;
+			unsigned long long fullTriangles, lodTriangles, modelTriangles, switches;
+			startPath(false, Level::LOD_SELECTION());
+			double fullUs = renderPath(true, 0.0f, fullTriangles, switches, &full);
+			startPath(true, Level::LOD_SELECTION());
+			double lodUs = renderPath(true, 0.0f, lodTriangles, switches, &reduced);
+			startPath(true, Level::LOD_SELECTION());
+			renderPath(false, 0.0f, modelTriangles, switches, &perModel);
+			std::printf("  camera path, %d frames: %.0f -> %.0f triangles/frame (%.1f%%)  RenderLevel %.2f -> %.2f us/frame\n",
+				frames, static_cast<double>(fullTriangles) / frames, static_cast<double>(lodTriangles) / frames,
+				fullTriangles > 0 ? 100.0 * lodTriangles / fullTriangles : 0.0, fullUs, lodUs);
+			std::printf("  %8s %12s %12s\n", "frame", "full", "lod");
+			for (int f = 0; f < frames; f += std::max(1, frames / 8))
+				std::printf("  %8d %12llu %12llu\n", f, full[f], reduced[f]);
+			bool neverMore = true;
+			for (int f = 0; f < frames; ++f)
+				neverMore &= reduced[f] <= full[f];
+			check(rangesValid, "recorded triangles match the level of detail stats");
+			check(neverMore, "no frame submits more triangles than the full meshes");
+			check(lodTriangles < fullTriangles, "the camera path submits fewer triangles");
+			check(perModel == reduced, "per model and instanced draws submit the same triangles");
+
+			// the distance jumps 2% back and forth every frame
+			unsigned long long jitterTriangles, damped, undamped;
+			startPath(true, Level::LOD_SELECTION());
+			renderPath(true, 0.02f, jitterTriangles, damped, nullptr);
+			Level::LOD_SELECTION noHysteresis;
+			noHysteresis.hysteresis = 0.0f;
+			startPath(true, noHysteresis);
+			renderPath(true, 0.02f, jitterTriangles, undamped, nullptr);
+			std::printf("  jittering path: %llu level switches with hysteresis, %llu without\n", damped, undamped);
+			check(damped < undamped, "hysteresis keeps instances from switching back and forth");
+
+			objects.UnloadLevel();
+
+			// the renderer's starting view, with and without levels of detail
+			Level::SoftwareBackend raster(800, 600);
+			Level_Objects simplified, reference;
+			simplified.SetLevelOfDetail(true);
+			if (simplified.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false ||
+				reference.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false)
+				return 1;
+			simplified.UploadLevelToGPU(raster);
+			reference.UploadLevelToGPU(raster);
+			Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+			Level::BufferHandle sceneBuffer = raster.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(scene) }, nullptr);
+			auto render = [&](Level_Objects& target) {
+				target.SetViewProjection(scene.vMatrix, scene.pMatrix);
+				raster.BeginFrame(clearColor);
+				raster.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+				raster.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+				target.RenderLevel(raster);
+				raster.EndFrame();
+				return raster.Image();
+			};
+			Level::IMAGE expected = render(reference);
+			Level::IMAGE_DIFF diff = Level::CompareImages(render(simplified), expected, tolerance);
+			Level::LOD_STATS lodStats = simplified.GetLodStats();
+			std::printf("  default camera: %u/%u/%u/%u instances per level, %llu of %llu triangles, %llu pixels off by more than %u (%.4f%%)\n",
+				lodStats.instances[0], lodStats.instances[1], lodStats.instances[2], lodStats.instances[3],
+				lodStats.triangles, lodStats.baseTriangles, diff.badPixels, tolerance, diff.badFraction * 100.0);
+			check(diff.sizeMatches && diff.badFraction <= maxBadFraction, "the default view matches the full meshes");
+			raster.ReleaseBuffer(sceneBuffer);
+			reference.UnloadLevel();
+			simplified.UnloadLevel();
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkStatic(int argc, char** argv)
+	{
+		Level::STATIC_BATCH_OPTIONS options;
+		unsigned tolerance = 8;
+		// batched normals are normalized once on the CPU instead of after the world matrix,
+		// COMPACT batches are quantized over the batch's bounds instead of the asset's
+		const double maxBadFraction[2] = { 0.001, 0.01 };
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--chunk") == 0 && i + 1 < argc)
+				options.chunkSize = static_cast<float>(std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--merge") == 0 && i + 1 < argc)
+				options.merge = std::strcmp(argv[++i], "asset") == 0 ? Level::BATCH_MERGE::ASSET_MATERIAL : Level::BATCH_MERGE::MATERIAL;
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+		Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			std::printf("%s (chunk %.1f, merge by %s)\n", level.first.c_str(), options.chunkSize,
+				options.merge == Level::BATCH_MERGE::MATERIAL ? "material" : "asset material");
+
+			// draw calls of each path at the starting view and with nothing culled
+			struct PATH_RESULT {
+				unsigned draws, culledDraws;
+				unsigned long long indices;
+				double us;
+			};
+			auto measure = [&](bool batching, bool instancing, const Level::STATIC_BATCH_OPTIONS& pathOptions,
+				PATH_RESULT& result, Level::STATIC_BATCH_STATS* stats) {
+				Level_Objects objects;
+				objects.SetStaticBatching(batching, pathOptions);
+				objects.SetInstancing(instancing);
+				if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false)
+					return false;
+				Level::RecordingBackend recorder;
+				objects.UploadLevelToGPU(recorder);
+				objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+				const int frames = 64;
+				Clock::time_point start = Clock::now();
+				for (int f = 0; f < frames; ++f) {
+					recorder.ResetFrame();
+					objects.RenderLevel(recorder);
+				}
+				result.us = MillisecondsSince(start) * 1000.0 / frames;
+				result.culledDraws = recorder.Counters().draws;
+				objects.SetCulling(false);
+				recorder.ResetFrame();
+				objects.RenderLevel(recorder);
+				result.draws = recorder.Counters().draws;
+				result.indices = recorder.Counters().indices;
+				if (stats != nullptr)
+					*stats = objects.GetStaticBatchStats();
+				objects.UnloadLevel();
+				return true;
+			};
+			Level::AssetCache cache;
+			std::vector<Level::INSTANCE> instances;
+			if (LoadInstances(level.first, level.second, cache, instances) == false)
+				return 1;
+			PATH_RESULT perModel, instanced, batched;
+			Level::STATIC_BATCH_STATS stats;
+			if (measure(false, false, options, perModel, nullptr) == false || measure(false, true, options, instanced, nullptr) == false ||
+				measure(true, true, options, batched, &stats) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			std::printf("  %-20s %10s %14s %12s %14s\n", "path", "draws", "default view", "indices", "RenderLevel us");
+			std::printf("  %-20s %10u %14u %12llu %14.2f\n", "per model", perModel.draws, perModel.culledDraws, perModel.indices, perModel.us);
+			std::printf("  %-20s %10u %14u %12llu %14.2f\n", "instanced", instanced.draws, instanced.culledDraws, instanced.indices, instanced.us);
+			std::printf("  %-20s %10u %14u %12llu %14.2f\n", "static + instanced", batched.draws, batched.culledDraws, batched.indices, batched.us);
+			std::printf("  %u of %u instances in %u batches replacing %u sub-mesh draws, %.1f KB baked vs %.1f KB shared (%.1fx)\n",
+				stats.instances, static_cast<unsigned>(instances.size()), stats.batches,
+				stats.subMeshes, stats.bakedBytes / 1024.0, stats.sourceBytes / 1024.0,
+				stats.sourceBytes > 0 ? static_cast<double>(stats.bakedBytes) / stats.sourceBytes : 0.0);
+			check(stats.batches > 0, "some instances were batched");
+			check(batched.indices == perModel.indices, "batches submit the same indices as the per model path");
+			check(batched.draws < perModel.draws, "batching draws less than one call per sub-mesh");
+
+			// bigger cells make fewer, bigger batches that cull worse
+			std::printf("  %8s %8s %10s %14s\n", "chunk", "batches", "draws", "default view");
+			const float chunks[] = { 4.0f, 8.0f, 16.0f, 32.0f, 0.0f };
+			unsigned previousBatches = 0xFFFFFFFF;
+			bool fewer = true;
+			for (float chunk : chunks) {
+				Level::STATIC_BATCH_OPTIONS sweep = options;
+				sweep.chunkSize = chunk;
+				PATH_RESULT result;
+				Level::STATIC_BATCH_STATS sweepStats;
+				measure(true, true, sweep, result, &sweepStats);
+				std::printf("  %8s %8u %10u %14u\n", chunk > 0.0f ? std::to_string(static_cast<int>(chunk)).c_str() : "one",
+					sweepStats.batches, result.draws, result.culledDraws);
+				fewer &= sweepStats.batches <= previousBatches;
+				previousBatches = sweepStats.batches;
+			}
+			check(fewer, "larger chunks never make more batches");
+
+			// the starting view drawn through the batches in both vertex formats
+			for (Level::VERTEX_FORMAT format : { Level::VERTEX_FORMAT::FULL, Level::VERTEX_FORMAT::COMPACT }) {
+				Level::SoftwareBackend raster(800, 600);
+				Level_Objects baked, reference;
+				baked.SetStaticBatching(true, options);
+				baked.SetVertexFormat(format);
+				reference.SetVertexFormat(format);
+				if (baked.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false ||
+					reference.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false)
+					return 1;
+				baked.UploadLevelToGPU(raster);
+				reference.UploadLevelToGPU(raster);
+				Level::BufferHandle sceneBuffer = raster.CreateBuffer(
+					{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(scene) }, nullptr);
+				auto render = [&](Level_Objects& target) {
+					target.SetViewProjection(scene.vMatrix, scene.pMatrix);
+					raster.BeginFrame(clearColor);
+					raster.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+					raster.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+					target.RenderLevel(raster);
+					raster.EndFrame();
+					return raster.Image();
+				};
+				Level::IMAGE expected = render(reference);
+				Level::IMAGE_DIFF diff = Level::CompareImages(render(baked), expected, tolerance);
+				std::printf("  %s format: %llu pixels off by more than %u (%.4f%%)\n",
+					format == Level::VERTEX_FORMAT::FULL ? "full" : "compact", diff.badPixels, tolerance, diff.badFraction * 100.0);
+				check(diff.sizeMatches && diff.badFraction <= maxBadFraction[format == Level::VERTEX_FORMAT::COMPACT],
+					format == Level::VERTEX_FORMAT::FULL ? "the batched view matches the unbatched one" : "compact batches match compact instances");
+				raster.ReleaseBuffer(sceneBuffer);
+				reference.UnloadLevel();
+				baked.UnloadLevel();
+			}
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkProfiler(int argc, char** argv)
+	{
+		int iterations = 1000000;
+		int frames = 120;
+		std::string tracePath;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::max(1, std::atoi(argv[++i]));
+			else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+				tracePath = argv[++i];
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				iterations = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		Level::Profiler& profiler = Level::Profiler::Instance();
+#if defined(LEVEL_ENABLE_PROFILER)
+		std::printf("LEVEL_ENABLE_PROFILER is on, the LEVEL_PROFILE_* macros in the level code record\n");
+#else
+		std::printf("LEVEL_ENABLE_PROFILER is off, the LEVEL_PROFILE_* macros compile to nothing (timings below use the classes)\n");
+#endif
+
+		// what one scope costs, drained every block so the ring never wraps
+		const int block = 16384;
+		profiler.SetWindow(0, 1);
+		volatile unsigned long long sink = 0;
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < iterations; ++i)
+			sink = sink + profiler.Now();
+		double clockNs = MillisecondsSince(start) * 1e6 / iterations;
+		double scopeMs = 0, drainMs = 0;
+		for (int done = 0; done < iterations; done += block) {
+			start = Clock::now();
+			for (int i = 0; i < block; ++i) {
+				Level::ScopedTimer timer("overhead");
+				sink = sink + i;
+			}
+			scopeMs += MillisecondsSince(start);
+			start = Clock::now();
+			profiler.EndFrame();
+			drainMs += MillisecondsSince(start);
+		}
+		const int scopes = (iterations + block - 1) / block * block;
+		double scopeNs = scopeMs * 1e6 / scopes;
+		std::printf("  steady_clock read %.1f ns, scope %.1f ns, EndFrame %.1f ns per event (%d scopes)\n",
+			clockNs, scopeNs, drainMs * 1e6 / scopes, scopes);
+		check(profiler.Stats().dropped == 0, "no event was dropped between EndFrames");
+
+		// writers on several threads while this one drains, each writes less than its ring holds
+		{
+			const unsigned writers = 4, perWriter = 20000;
+			Level::PROFILER_STATS before = profiler.Stats();
+			std::atomic<unsigned> running{ writers };
+			std::vector<std::thread> threads;
+			for (unsigned t = 0; t < writers; ++t)
+				threads.emplace_back([&]() {
+					for (unsigned i = 0; i < perWriter; ++i) {
+						Level::ScopedTimer timer("writer");
+						if (i % 64 == 0)
+							profiler.Count("writer counter", 1);
+					}
+					--running;
+				});
+			while (running > 0)
+				profiler.EndFrame();
+			for (std::thread& thread : threads)
+				thread.join();
+			profiler.EndFrame();
+			Level::PROFILER_STATS after = profiler.Stats();
+			unsigned long long expected = writers * (perWriter + (perWriter + 63) / 64);
+			std::printf("  %u threads: %llu of %llu events collected over %llu frames, %llu dropped\n", writers,
+				after.events - before.events, expected, after.frames - before.frames, after.dropped - before.dropped);
+			check(after.events - before.events == expected && after.dropped == before.dropped, "every thread's events are collected");
+		}
+
+		// a level through the profiler, frame scopes and counters like the renderer's
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			// the trace also keeps the load and upload frame
+			profiler.SetWindow(static_cast<unsigned>(frames) + 1, static_cast<unsigned>(frames));
+			Level::JobSystem jobs(4);	// worker tracks even on a single core
+			Level_Objects objects;
+			objects.SetJobSystem(&jobs);
+			objects.SetLevelOfDetail(true);
+			Level::RecordingBackend recorder;
+			{
+				Level::ScopedTimer timer("Load");
+				if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+					std::cout << "ERROR: level not found " << level.first << std::endl;
+					return 1;
+				}
+			}
+			{
+				Level::ScopedTimer timer("Upload");
+				objects.UploadLevelToGPU(recorder);
+			}
+			profiler.EndFrame();
+
+			Level::MATRIX projection = Level::PerspectiveLH(65.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+			Level::PROFILER_STATS before = profiler.Stats();
+			double renderMs = 0;
+			unsigned long long draws = 0;
+			for (int f = 0; f < frames; ++f) {
+				float angle = 6.2831853f * f / frames;
+				objects.SetViewProjection(Level::LookAtLH({ 20.0f * std::cos(angle), 10.0f, 20.0f * std::sin(angle) }, { 0, 0, 0 }, { 0, 1, 0 }),
+					projection);
+				recorder.ResetFrame();
+				Clock::time_point frameStart = Clock::now();
+				{
+					Level::ScopedTimer timer("Render");
+					objects.RenderLevel(recorder);
+				}
+				renderMs += MillisecondsSince(frameStart);
+				draws += objects.GetDrawCallCount();
+				profiler.Count("draws", objects.GetDrawCallCount());
+				profiler.Count("state binds", objects.GetStateStats().issued);
+				profiler.Count("bytes uploaded", objects.GetUploadStats().constantBytes + objects.GetUploadStats().instanceBytes);
+				profiler.EndFrame();
+			}
+			Level::PROFILER_STATS after = profiler.Stats();
+			double eventsPerFrame = static_cast<double>(after.events - before.events) / frames;
+			std::printf("%s\n%s", level.first.c_str(), profiler.FormatSummary().c_str());
+			std::printf("  %.1f events per frame, about %.2f%% of a %.1f us RenderLevel at %.1f ns each\n", eventsPerFrame,
+				100.0 * eventsPerFrame * scopeNs / (renderMs * 1e6 / frames), renderMs * 1000.0 / frames, scopeNs);
+
+			bool renderFound = false, drawsMatch = false;
+			for (const Level::SCOPE_SUMMARY& scope : profiler.Summary())
+				if (scope.name == "Render")
+					renderFound = scope.calls == 1.0 && scope.p99 >= scope.p95 && scope.p95 > 0.0;
+			for (const Level::COUNTER_SUMMARY& counter : profiler.CounterSummary())
+				if (counter.name == "draws")
+					drawsMatch = std::abs(counter.average - static_cast<double>(draws) / frames) < 0.01;
+			check(renderFound, "one Render scope per frame with p95 <= p99");
+			check(drawsMatch, "the draws counter averages the level's draw calls");
+
+			std::string path = tracePath.empty() ? "profile.json" : tracePath;
+			bool written = profiler.WriteChromeTrace(path.c_str());
+			std::ifstream file(path, std::ios_base::binary);
+			std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			size_t renders = 0;
+			for (size_t at = json.find("\"name\":\"Render\",\"ph\":\"X\""); at != std::string::npos;
+				at = json.find("\"name\":\"Render\",\"ph\":\"X\"", at + 1))
+				++renders;
+			std::printf("  %s: %.1f KB, %zu Render events\n", path.c_str(), json.size() / 1024.0, renders);
+			check(written && json.compare(0, 15, "{\"traceEvents\":") == 0 && json.find(",\n]") == std::string::npos,
+				"the trace is written as one traceEvents array");
+			check(renders == static_cast<size_t>(frames), "the trace keeps every profiled frame");
+			file.close();
+			if (tracePath.empty())
+				std::remove(path.c_str());
+			objects.UnloadLevel();
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// an asset a scattered level can place: its .h2b (as named in the generated level) and a
+	// transform the source level used for it, which keeps the asset's scale and tilt
+	struct SCATTER_SOURCE {
+		std::string asset;
+		Level::MATRIX transform;
+	};
+
+	// a GameLevel.txt with instances records picked at random from sources, spread over
+	// a square sized for spacing x spacing units per instance with a random turn about y.
+	// The same seed writes the same file on every platform (mt19937 is fully specified)
+	bool WriteScatteredLevel(const std::string& path, const std::vector<SCATTER_SOURCE>& sources, unsigned instances,
+		unsigned seed, float spacing = 4.0f)
+	{
+		if (sources.empty())
+			return false;
+		std::ofstream file(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (file.is_open() == false)
+			return false;
+		std::mt19937 random(seed);
+		auto unit = [&]() { return static_cast<float>(random() >> 8) * (1.0f / 16777216.0f); };
+		const float side = spacing * std::sqrt(static_cast<float>(instances));
+		char suffix[16];
+		file << "# Game Level Exporter v1.3\r\n";
+		for (unsigned i = 0; i < instances; ++i) {
+			const SCATTER_SOURCE& source = sources[random() % sources.size()];
+			const float angle = 6.2831853f * unit();
+			Level::MATRIX turn = Level::IdentityMatrix();
+			turn.data[0] = turn.data[10] = std::cos(angle);
+			turn.data[2] = -std::sin(angle);
+			turn.data[8] = std::sin(angle);
+			Level::MATRIX world = source.transform;
+			world.data[12] = world.data[14] = 0.0f;
+			world = Level::Multiply(world, turn);
+			world.data[12] = side * (unit() - 0.5f);
+			world.data[13] = source.transform.data[13];
+			world.data[14] = side * (unit() - 0.5f);
+			std::snprintf(suffix, sizeof(suffix), ".%07u", i);
+			WriteMeshRecord(file, source.asset + suffix, world.data);
+		}
+		return static_cast<bool>(file);
+	}
+
+	// the timed stages of one suite run, times are the best of the repeats
+	struct SUITE_RESULT {
+		unsigned instances;
+		double generateMs, parseMs, h2bMs, sceneMs;	// once per level
+		double cullUs, batchUs, queueUs;				// per frame
+		double visible, groups, draws;				// per frame
+	};
+
+	const char* const SUITE_KEYS[] = { "parse_ms", "h2b_ms", "scene_ms", "cull_us", "batch_us", "queue_us" };
+
+	void SuiteTimes(const SUITE_RESULT& result, double times[6])
+	{
+		const double values[6] = { result.parseMs, result.h2bMs, result.sceneMs, result.cullUs, result.batchUs, result.queueUs };
+		std::copy(values, values + 6, times);
+	}
+
+	// the "key": number pairs of every result line of a suite JSON file
+	std::vector<std::pair<unsigned, std::vector<double>>> ReadSuiteJson(const std::string& path)
+	{
+		std::vector<std::pair<unsigned, std::vector<double>>> results;
+		std::ifstream file(path);
+		std::string line;
+		auto number = [&](const char* key, double& value) {
+			size_t at = line.find(std::string("\"") + key + "\":");
+			if (at == std::string::npos)
+				return false;
+			value = std::strtod(line.c_str() + at + std::strlen(key) + 3, nullptr);
+			return true;
+		};
+		while (std::getline(file, line)) {
+			double instances;
+			if (!number("instances", instances))
+				continue;
+			std::vector<double> times(6, 0.0);
+			bool complete = true;
+			for (int k = 0; k < 6; ++k)
+				complete &= number(SUITE_KEYS[k], times[k]);
+			if (complete)
+				results.push_back({ static_cast<unsigned>(instances), times });
+		}
+		return results;
+	}
+
+	// Scattered levels of every size built from the given levels' assets, each CPU stage
+	// timed on its own: level text parsing, .h2b loading, scene construction (instances,
+	// bounds, BVH, instance groups), culling and draw list building (instance groups of the
+	// visible set, sorted per sub-mesh queue). Results go to stdout and, one line per size,
+	// to a JSON file that a later run can --compare against.
+	// "1000,10000,..." (zeros are skipped)
+	std::vector<unsigned> ParseSizes(const char* text)
+	{
+		std::vector<unsigned> sizes;
+		for (const char* at = text; *at != '\0';) {
+			char* end;
+			unsigned long size = std::strtoul(at, &end, 10);
+			if (end == at)
+				break;
+			if (size > 0)
+				sizes.push_back(static_cast<unsigned>(size));
+			at = *end == ',' ? end + 1 : end;
+		}
+		return sizes;
+	}
+
+	int BenchmarkSuite(int argc, char** argv)
+	{
+		std::vector<unsigned> sizes = { 1000, 10000, 100000, 1000000 };
+		unsigned seed = 1, threads = 1;
+		int repeat = 3, frames = 32;
+		double threshold = 0.15;
+		std::string jsonPath, comparePath;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc)
+				sizes = ParseSizes(argv[++i]);
+			else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+				seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+			else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+				repeat = std::max(1, std::atoi(argv[++i]));
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::max(1, std::atoi(argv[++i]));
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+				jsonPath = argv[++i];
+			else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+				comparePath = argv[++i];
+			else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+				threshold = std::atof(argv[++i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		std::unique_ptr<Level::JobSystem> jobs(threads > 1 ? new Level::JobSystem(threads) : nullptr);
+
+		// every .h2b the source levels use, copied into one folder with a prefix per level
+		// so assets of the same name in different folders stay apart
+		const std::filesystem::path folder = std::filesystem::temp_directory_path() / "level_benchmark_suite";
+		std::error_code error;
+		std::filesystem::remove_all(folder, error);
+		std::filesystem::create_directories(folder / "assets", error);
+		std::vector<SCATTER_SOURCE> sources;
+		unsigned levelIndex = 0;
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level::LevelFile file;
+			if (file.Read(level.first.c_str()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			const std::string prefix = "L" + std::to_string(levelIndex++) + "_";
+			for (const Level::RECORD& record : file.records) {
+				if (record.type != Level::RECORD_TYPE::MESH)
+					continue;
+				std::filesystem::path h2b = Level::H2BPathFromName(level.second.c_str(), record.name);
+				std::filesystem::path copy = folder / "assets" / (prefix + h2b.filename().string());
+				if (!std::filesystem::exists(copy) &&
+					!std::filesystem::copy_file(h2b, copy, std::filesystem::copy_options::overwrite_existing, error))
+					continue;
+				sources.push_back({ prefix + h2b.stem().string(), record.transform });
+			}
+		}
+		if (sources.empty()) {
+			std::cout << "ERROR: no assets to place" << std::endl;
+			return 1;
+		}
+		const std::string assetFolder = (folder / "assets").string();
+		std::printf("suite: %zu source placements, seed %u, %u thread(s), best of %d, %d frames\n",
+			sources.size(), seed, threads, repeat, frames);
+		std::printf("  %9s %9s %9s %9s %9s %10s %10s %10s %9s %8s %8s\n", "instances", "generate", "parse ms", "h2b ms",
+			"scene ms", "cull us", "batch us", "queue us", "visible", "groups", "draws");
+
+		std::vector<SUITE_RESULT> results;
+		const Level::MATRIX projection = Level::PerspectiveLH(65.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+		for (unsigned size : sizes) {
+			SUITE_RESULT result = {};
+			result.instances = size;
+			const std::string levelPath = (folder / ("level_" + std::to_string(size) + ".txt")).string();
+			Clock::time_point start = Clock::now();
+			if (WriteScatteredLevel(levelPath, sources, size, seed) == false) {
+				std::cout << "ERROR: could not write " << levelPath << std::endl;
+				return 1;
+			}
+			result.generateMs = MillisecondsSince(start);
+			result.parseMs = result.h2bMs = result.sceneMs = 1e30;
+
+			Level::LevelFile file;
+			for (int r = 0; r < repeat; ++r) {
+				start = Clock::now();
+				file = Level::LevelFile();
+				file.Read(levelPath.c_str());
+				result.parseMs = std::min(result.parseMs, MillisecondsSince(start));
+			}
+			// the distinct files in first use order and every record's index into them
+			std::vector<std::string> files;
+			std::vector<unsigned> recordFile;
+			std::unordered_map<std::string, unsigned> fileIndex;
+			for (const Level::RECORD& record : file.records)
+				if (record.type == Level::RECORD_TYPE::MESH) {
+					auto inserted = fileIndex.emplace(Level::H2BPathFromName(assetFolder.c_str(), record.name), static_cast<unsigned>(files.size()));
+					if (inserted.second)
+						files.push_back(inserted.first->first);
+					recordFile.push_back(inserted.first->second);
+				}
+			std::unique_ptr<Level::AssetCache> cache;
+			std::vector<Level::AssetHandle> handles;
+			for (int r = 0; r < repeat; ++r) {
+				cache.reset(new Level::AssetCache());
+				start = Clock::now();
+				handles = cache->AcquireAll(files, jobs.get());
+				result.h2bMs = std::min(result.h2bMs, MillisecondsSince(start));
+			}
+
+			std::vector<Level::INSTANCE> instances;
+			std::vector<Level::AABB> assetBounds, bounds;
+			Level::BoundingVolumeHierarchy bvh;
+			Level::InstanceBatcher batcher;
+			for (int r = 0; r < repeat; ++r) {
+				start = Clock::now();
+				instances.clear();
+				unsigned m = 0;
+				for (const Level::RECORD& record : file.records)
+					if (record.type == Level::RECORD_TYPE::MESH) {
+						Level::INSTANCE instance;
+						instance.asset = handles[recordFile[m++]];
+						instance.world = record.transform;
+						if (instance.asset != Level::INVALID_ASSET)
+							instances.push_back(instance);
+					}
+				assetBounds.assign(cache->Capacity(), Level::EmptyBounds());
+				for (Level::AssetHandle handle : handles)
+					if (handle != Level::INVALID_ASSET)
+						assetBounds[handle] = Level::LocalBounds(cache->Get(handle));
+				bounds.resize(instances.size());
+				Level::ParallelFor(jobs.get(), static_cast<unsigned>(instances.size()), 4096, [&](unsigned begin, unsigned end) {
+					for (unsigned i = begin; i < end; ++i)
+						bounds[i] = Level::TransformBounds(assetBounds[instances[i].asset], instances[i].world);
+				});
+				bvh.Build(bounds);
+				batcher.Build(instances, *cache, jobs.get());
+				result.sceneMs = std::min(result.sceneMs, MillisecondsSince(start));
+			}
+
+			// eye height walk across the middle of the field, the same path at every size
+			std::vector<unsigned> visible;
+			std::vector<Level::INSTANCE> visibleInstances;
+			Level::RenderQueue queue;
+			double bestCullMs = 1e30, bestBatchMs = 1e30, bestQueueMs = 1e30;
+			unsigned long long visibleTotal = 0, groupTotal = 0, drawTotal = 0;
+			for (int r = 0; r < repeat; ++r) {
+				double cullMs = 0, batchMs = 0, queueMs = 0;
+				visibleTotal = groupTotal = drawTotal = 0;
+				for (int f = 0; f < frames; ++f) {
+					float angle = 6.2831853f * f / frames;
+					Level::FLOAT3 eye = { 20.0f * std::cos(angle), 2.0f, 20.0f * std::sin(angle) };
+					Level::FLOAT3 target = { eye.x - std::sin(angle), eye.y - 0.2f, eye.z + std::cos(angle) };
+					Level::MATRIX view = Level::LookAtLH(eye, target, { 0, 1, 0 });
+					Level::FRUSTUM frustum = Level::ExtractFrustum(Level::Multiply(view, projection));
+
+					Level::CULL_STATS stats;
+					start = Clock::now();
+					bvh.Query(frustum, visible, stats, jobs.get());
+					std::sort(visible.begin(), visible.end());
+					cullMs += MillisecondsSince(start);
+
+					start = Clock::now();
+					visibleInstances.resize(visible.size());
+					for (size_t i = 0; i < visible.size(); ++i)
+						visibleInstances[i] = instances[visible[i]];
+					batcher.Build(visibleInstances, *cache, jobs.get());
+					batchMs += MillisecondsSince(start);
+
+					// what the per model path sorts: a key per visible sub-mesh
+					start = Clock::now();
+					queue.Clear();
+					for (unsigned i : visible) {
+						const H2B::Parser& model = cache->Get(instances[i].asset);
+						const float* w = instances[i].world.data;
+						float depth = (w[12] - eye.x) * view.data[2] + (w[13] - eye.y) * view.data[6] + (w[14] - eye.z) * view.data[10];
+						for (unsigned m = 0; m < model.meshCount; ++m)
+							queue.Push(Level::SORT_KEY::Opaque(0, instances[i].asset, model.meshes[m].materialIndex, depth), i);
+					}
+					queue.Sort();
+					queueMs += MillisecondsSince(start);
+
+					visibleTotal += visible.size();
+					groupTotal += batcher.groups.size();
+					drawTotal += queue.Size();
+				}
+				bestCullMs = std::min(bestCullMs, cullMs);
+				bestBatchMs = std::min(bestBatchMs, batchMs);
+				bestQueueMs = std::min(bestQueueMs, queueMs);
+			}
+			result.cullUs = bestCullMs * 1000.0 / frames;
+			result.batchUs = bestBatchMs * 1000.0 / frames;
+			result.queueUs = bestQueueMs * 1000.0 / frames;
+			result.visible = static_cast<double>(visibleTotal) / frames;
+			result.groups = static_cast<double>(groupTotal) / frames;
+			result.draws = static_cast<double>(drawTotal) / frames;
+			std::printf("  %9u %9.1f %9.2f %9.2f %9.2f %10.2f %10.2f %10.2f %9.1f %8.1f %8.1f\n", size, result.generateMs,
+				result.parseMs, result.h2bMs, result.sceneMs, result.cullUs, result.batchUs, result.queueUs,
+				result.visible, result.groups, result.draws);
+			results.push_back(result);
+			std::filesystem::remove(levelPath, error);
+		}
+		std::filesystem::remove_all(folder, error);
+
+		if (!jsonPath.empty()) {
+			std::ofstream json(jsonPath, std::ios_base::out | std::ios_base::trunc);
+			json << "{\"suite\":\"level_benchmark\",\"version\":1,\"seed\":" << seed << ",\"threads\":" << threads
+				<< ",\"repeat\":" << repeat << ",\"frames\":" << frames << ",\"results\":[\n";
+			char line[512];
+			for (size_t r = 0; r < results.size(); ++r) {
+				const SUITE_RESULT& result = results[r];
+				std::snprintf(line, sizeof(line), "{\"instances\":%u,\"generate_ms\":%.3f,\"parse_ms\":%.3f,\"h2b_ms\":%.3f,"
+					"\"scene_ms\":%.3f,\"cull_us\":%.3f,\"batch_us\":%.3f,\"queue_us\":%.3f,\"visible\":%.1f,\"groups\":%.1f,\"draws\":%.1f}%s\n",
+					result.instances, result.generateMs, result.parseMs, result.h2bMs, result.sceneMs, result.cullUs,
+					result.batchUs, result.queueUs, result.visible, result.groups, result.draws, r + 1 < results.size() ? "," : "");
+				json << line;
+			}
+			json << "]}\n";
+			if (!json) {
+				std::cout << "ERROR: could not write " << jsonPath << std::endl;
+				return 1;
+			}
+			std::printf("  results written to %s\n", jsonPath.c_str());
+		}
+
+		// slower than the baseline by more than threshold, ignoring differences under 0.05 ms
+		// for the load stages and 2 us for the per frame ones (timer and scheduling noise)
+		int regressions = 0;
+		if (!comparePath.empty()) {
+			std::vector<std::pair<unsigned, std::vector<double>>> baseline = ReadSuiteJson(comparePath);
+			if (baseline.empty()) {
+				std::cout << "ERROR: no results in " << comparePath << std::endl;
+				return 1;
+			}
+			std::printf("  against %s (regression above +%.0f%%)\n  %9s", comparePath.c_str(), threshold * 100.0, "instances");
+			for (const char* key : SUITE_KEYS)
+				std::printf(" %10s", key);
+			std::printf("\n");
+			for (const SUITE_RESULT& result : results) {
+				auto old = std::find_if(baseline.begin(), baseline.end(),
+					[&](const std::pair<unsigned, std::vector<double>>& entry) { return entry.first == result.instances; });
+				if (old == baseline.end())
+					continue;
+				double times[6];
+				SuiteTimes(result, times);
+				std::printf("  %9u", result.instances);
+				for (int k = 0; k < 6; ++k) {
+					double before = old->second[k];
+					bool slower = times[k] > before * (1.0 + threshold) && times[k] - before > (k < 3 ? 0.05 : 2.0);
+					regressions += slower ? 1 : 0;
+					char change[16];
+					std::snprintf(change, sizeof(change), "%+.1f%%%s", before > 0.0 ? 100.0 * (times[k] - before) / before : 0.0, slower ? "!" : "");
+					std::printf(" %10s", change);
+				}
+				std::printf("\n");
+			}
+			std::printf("  %d regression(s)\n", regressions);
+		}
+		return regressions == 0 ? 0 : 1;
+	}
+
+	// the layout Level_Objects had before the scene store: a list node per Model,
+	// a pointer per Model in load order and the INSTANCE records beside them
+	struct MODEL_LIST {
+		std::list<Model> objects;
+		std::vector<Model*> models;
+		std::vector<Level::INSTANCE> instances;
+	};
+
+	// per frame walks over the scene store against the Model list, memory per instance,
+	// handles surviving removals and slot reuse, and a level edited through Level_Objects'
+	// handles drawing what the edited level file draws
+	int BenchmarkScene(int argc, char** argv)
+	{
+		unsigned generated = 100000;
+		int frames = 200;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				generated = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+				frames = std::max(1, std::atoi(argv[++i]));
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		struct SOURCE {
+			std::string label;
+			std::vector<Level::RECORD> meshes;
+			std::vector<std::string> files;	// .h2b per mesh, what instances share
+			unsigned count;
+		};
+		std::vector<SOURCE> sources;
+		std::vector<Level::RECORD> everyMesh;
+		std::vector<std::string> everyFile;
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level::LevelFile file;
+			if (file.Read(level.first.c_str()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			SOURCE source = { level.first, {}, {}, 0 };
+			for (const Level::RECORD& record : file.records)
+				if (record.type == Level::RECORD_TYPE::MESH) {
+					source.meshes.push_back(record);
+					source.files.push_back(Level::H2BPathFromName(level.second.c_str(), record.name));
+				}
+			source.count = static_cast<unsigned>(source.meshes.size());
+			everyMesh.insert(everyMesh.end(), source.meshes.begin(), source.meshes.end());
+			everyFile.insert(everyFile.end(), source.files.begin(), source.files.end());
+			sources.push_back(source);
+		}
+		if (generated > 0 && !everyMesh.empty())
+			sources.push_back({ "generated", everyMesh, everyFile, generated });
+
+		std::printf("scene store against std::list<Model>, best of %d frames\n", frames);
+		int failures = 0;
+		for (const SOURCE& source : sources) {
+			// the records repeated on a grid, asset handles by .h2b file
+			std::unordered_map<std::string, Level::AssetHandle> assetOf;
+			std::vector<Level::RECORD> placed(source.count);
+			std::vector<Level::AssetHandle> assets(source.count);
+			for (unsigned i = 0; i < source.count; ++i) {
+				const unsigned copy = i / static_cast<unsigned>(source.meshes.size());
+				placed[i] = source.meshes[i % source.meshes.size()];
+				placed[i].transform.data[12] += 50.0f * (copy % 64);
+				placed[i].transform.data[14] += 50.0f * (copy / 64);
+				if (copy > 0)
+					placed[i].name += "_" + std::to_string(copy);
+				assets[i] = assetOf.emplace(source.files[i % source.files.size()], static_cast<Level::AssetHandle>(assetOf.size())).first->second;
+			}
+
+			// built the way each LoadLevel built it
+			MODEL_LIST list;
+			for (unsigned i = 0; i < source.count; ++i) {
+				Model model;
+				model.SetName(placed[i].name);
+				model.SetWorldMatrix(placed[i].transform);
+				model.SetAsset(assets[i]);
+				list.objects.push_back(std::move(model));
+			}
+			for (Model& model : list.objects) {
+				list.models.push_back(&model);
+				Level::INSTANCE instance;
+				instance.asset = model.GetAsset();
+				instance.world = model.GetWorldMatrix();
+				list.instances.push_back(instance);
+			}
+			Level::SceneStore scene;
+			scene.Reserve(source.count);
+			std::vector<Level::InstanceHandle> handles;
+			for (unsigned i = 0; i < source.count; ++i)
+				handles.push_back(scene.Add(assets[i], placed[i].transform, placed[i].name));
+			for (unsigned i = 0; i < source.count; ++i) {
+				const Level::MATRIX& world = scene.Instance(i).world;
+				scene.SetBounds(i, { { world.data[12] - 1, world.data[13] - 1, world.data[14] - 1 }, { world.data[12] + 1, world.data[13] + 1, world.data[14] + 1 } });
+			}
+
+			// every third instance visible, in load order like the culled list
+			std::vector<unsigned> visible;
+			for (unsigned i = 0; i < source.count; i += 3)
+				visible.push_back(i);
+			// small levels walk several times per sample so the clock can resolve them
+			const unsigned passes = std::max(1u, 100000u / source.count);
+			auto best = [&](const auto& body) {
+				double fastest = 1e30;
+				for (int f = 0; f < frames; ++f) {
+					Clock::time_point start = Clock::now();
+					for (unsigned pass = 0; pass < passes; ++pass)
+						body();
+					fastest = std::min(fastest, MillisecondsSince(start) * 1000.0 / passes);
+				}
+				return fastest;
+			};
+			// the loops RenderLevel and the upload ran: every object in the list, then the visible ones through models[i]
+			struct WALK {
+				float depth;
+				unsigned long long assets;
+				bool operator==(const WALK& other) const {
+					return depth == other.depth && assets == other.assets;
+				}
+			};
+			// every walk starts from a volatile, or the compiler may keep the sum of the first pass for the rest
+			volatile unsigned long long zero = 0;
+			const unsigned long long& start = const_cast<const unsigned long long&>(zero);
+			WALK listAll = {}, storeAll = {}, listVisibleWalk = {}, storeVisibleWalk = {};
+			double listWalk = best([&]() {
+				WALK walk = { 0.0f, start };
+				for (const Model& model : list.objects) {
+					walk.depth += model.GetWorldMatrix().data[14];
+					walk.assets += model.GetAsset();
+				}
+				listAll = walk;
+			});
+			double storeWalk = best([&]() {
+				WALK walk = { 0.0f, start };
+				for (const Level::INSTANCE& instance : scene.Instances()) {
+					walk.depth += instance.world.data[14];
+					walk.assets += instance.asset;
+				}
+				storeAll = walk;
+			});
+			double listVisible = best([&]() {
+				WALK walk = { 0.0f, start };
+				for (unsigned i : visible) {
+					walk.depth += list.models[i]->GetWorldMatrix().data[14];
+					walk.assets += list.models[i]->GetAsset() + list.instances[i].lod;
+				}
+				listVisibleWalk = walk;
+			});
+			double storeVisible = best([&]() {
+				WALK walk = { 0.0f, start };
+				for (unsigned i : visible) {
+					const Level::INSTANCE& instance = scene.Instance(i);
+					walk.depth += instance.world.data[14];
+					walk.assets += instance.asset + instance.lod;
+				}
+				storeVisibleWalk = walk;
+			});
+			const bool same = listAll == storeAll && listVisibleWalk == storeVisibleWalk;
+
+			// what each layout allocates (list nodes carry two links), both hold the same names so
+			// the list is charged the heap the store's names use
+			const size_t storeBytes = scene.MemoryBytes();
+			size_t listBytes = (sizeof(Model) + 2 * sizeof(void*)) * list.objects.size() +
+				sizeof(Model*) * list.models.capacity() + sizeof(Level::INSTANCE) * list.instances.capacity();
+			for (unsigned i = 0; i < scene.Size(); ++i)
+				listBytes += Level::StringHeapBytes(scene.Name(i));
+
+			// removals move the last instance into the hole, handles keep finding their instance
+			std::mt19937 random(source.count);
+			std::vector<char> removed(source.count, 0);
+			for (unsigned k = 0; k < source.count / 10; ++k) {
+				unsigned victim = random() % source.count;
+				if (scene.Remove(handles[victim]) == removed[victim])
+					failures += 1;
+				removed[victim] = 1;
+			}
+			bool handlesHold = true;
+			for (unsigned i = 0; i < source.count && handlesHold; ++i) {
+				const unsigned index = scene.IndexOf(handles[i]);
+				handlesHold = removed[i] ? index == 0xFFFFFFFF :
+					index < scene.Size() && scene.Name(index) == placed[i].name && scene.Instance(index).asset == assets[i];
+			}
+			const unsigned live = scene.Size();
+			Level::InstanceHandle added = scene.Add(0, Level::IdentityMatrix(), "added");
+			handlesHold &= scene.Size() == live + 1 && scene.IndexOf(added) == live && scene.HandleOf(live) == added;
+			for (unsigned i = 0; i < source.count && handlesHold; ++i)
+				handlesHold = !removed[i] || !scene.Contains(handles[i]);
+			failures += same && handlesHold ? 0 : 1;
+
+			std::printf("%s: %u instances, %u assets\n", source.label.c_str(), source.count, static_cast<unsigned>(assetOf.size()));
+			std::printf("  walk all     list %9.2f us  store %9.2f us  %5.2fx\n", listWalk, storeWalk, listWalk / std::max(storeWalk, 1e-3));
+			std::printf("  walk visible list %9.2f us  store %9.2f us  %5.2fx  (%zu instances)\n", listVisible, storeVisible,
+				listVisible / std::max(storeVisible, 1e-3), visible.size());
+			std::printf("  memory       list %7.1f B/instance (an allocation each)  store %7.1f B/instance (with bounds and handles)\n",
+				static_cast<double>(listBytes) / source.count, static_cast<double>(storeBytes) / source.count);
+			std::printf("  results %s  handles after %u removals %s\n", same ? "identical" : "DIFFERENT",
+				source.count - live, handlesHold ? "valid" : "BROKEN");
+		}
+
+		// the first instance removed and the second lifted through their handles, against the level
+		// file written again without the first and with the second lifted, with and without static batches.
+		// The level's last instance takes the removed one's index, so batches bake their triangles in
+		// another order and a few coplanar depth ties may fall the other way
+		const double maxBadFraction = 0.001;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		const std::string edited = (std::filesystem::temp_directory_path() / "level_benchmark_scene.txt").string();
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level::LevelFile file;
+			std::vector<const Level::RECORD*> meshes;
+			if (file.Read(level.first.c_str()))
+				for (const Level::RECORD& record : file.records)
+					if (record.type == Level::RECORD_TYPE::MESH)
+						meshes.push_back(&record);
+			if (meshes.size() < 2)
+				continue;
+			Level::MATRIX lifted = meshes[1]->transform;
+			lifted.data[13] += 0.5f;
+			{
+				std::ofstream out(edited, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+				out << "# Game Level Exporter v1.3\r\n";
+				const char* types[] = { "MESH", "LIGHT", "CAMERA" };
+				char line[128];
+				for (const Level::RECORD& record : file.records) {
+					if (&record == meshes[0])
+						continue;
+					out << types[static_cast<int>(record.type)] << "\r\n" << record.name << "\r\n";
+					const float* m = &record == meshes[1] ? lifted.data : record.transform.data;
+					for (int row = 0; row < 4; ++row) {
+						std::snprintf(line, sizeof(line), "%s(%.9g, %.9g, %.9g, %.9g)%s\r\n", row == 0 ? "<Matrix 4x4 " : "            ",
+							m[row * 4], m[row * 4 + 1], m[row * 4 + 2], m[row * 4 + 3], row == 3 ? ">" : "");
+						out << line;
+					}
+				}
+			}
+			std::printf("%s: edited through handles\n", level.first.c_str());
+			const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+			Level::SCENE_CONSTANTS camera = Level::DefaultScene(800.0f / 600.0f);
+			for (bool batching : { false, true }) {
+				Level::SoftwareBackend backend(800, 600);
+				Level::BufferHandle sceneBuffer = backend.CreateBuffer(
+					{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(Level::SCENE_CONSTANTS) }, nullptr);
+				auto render = [&](Level_Objects& objects) {
+					objects.SetViewProjection(camera.vMatrix, camera.pMatrix);
+					backend.BeginFrame(clearColor);
+					backend.UpdateBuffer(sceneBuffer, &camera, sizeof(camera));
+					backend.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+					objects.RenderLevel(backend);
+					backend.EndFrame();
+					return backend.Image();
+				};
+				Level_Objects expected, objects;
+				expected.SetStaticBatching(batching);
+				objects.SetStaticBatching(batching);
+				bool loaded = expected.LoadLevel(edited.c_str(), level.second.c_str(), QuietLog()) &&
+					objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog());
+				if (!loaded) {
+					check(false, "both levels loaded");
+					continue;
+				}
+				expected.UploadLevelToGPU(backend);
+				objects.UploadLevelToGPU(backend);
+				const Level::IMAGE reference = render(expected);
+				const Level::IMAGE before = render(objects);
+
+				const Level::InstanceHandle removed = objects.FindInstance(meshes[0]->name);
+				const Level::InstanceHandle moved = objects.FindInstance(meshes[1]->name);
+				const unsigned instances = objects.GetScene().Size();
+				bool handled = removed != Level::INVALID_INSTANCE && moved != Level::INVALID_INSTANCE &&
+					objects.RemoveInstance(removed) && objects.MoveInstance(moved, lifted);
+				handled &= !objects.RemoveInstance(removed) && !objects.MoveInstance(removed, lifted) &&
+					objects.GetScene().Size() == instances - 1 && objects.GetAssetStats().instances == instances - 1;
+				const Level::IMAGE after = render(objects);
+				Level::IMAGE_DIFF changed = Level::CompareImages(after, before, 0);
+				Level::IMAGE_DIFF diff = Level::CompareImages(after, reference, 0);
+				std::printf("  static batching %s: %u -> %u instances  %llu pixels changed  %llu differ from the edited file\n",
+					batching ? "on " : "off", instances, objects.GetScene().Size(), changed.badPixels, diff.badPixels);
+				check(handled, "handles edit the level, stale handles are refused");
+				check(changed.badPixels > 0, "the edit changed the picture");
+				check(diff.sizeMatches && diff.badFraction <= maxBadFraction, "same picture as loading the edited level file");
+				objects.UnloadLevel();
+				check(!objects.MoveInstance(moved, lifted) &&
+					objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) && !objects.MoveInstance(moved, lifted),
+					"handles of an unloaded level stay stale after the next load");
+				objects.UnloadLevel();
+				expected.UnloadLevel();
+				backend.ReleaseBuffer(sceneBuffer);
+			}
+		}
+		std::filesystem::remove(edited);
+		std::filesystem::remove(Level::LevelBinary::PathFor(edited));
+		return failures == 0 ? 0 : 1;
+	}
+
+	// scalar culling.h functions against the batch_math.h kernels on random instances,
+	// the kernels have to match them bit for bit
+	int BenchmarkBatchMath(int argc, char** argv)
+	{
+		std::vector<unsigned> sizes = { 10000, 100000, 1000000 };
+		unsigned seed = 1;
+		int repeat = 5;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc)
+				sizes = ParseSizes(argv[++i]);
+			else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+				seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+			else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+				repeat = std::max(1, std::atoi(argv[++i]));
+		}
+#if defined(LEVEL_SIMD_AVX)
+		const char* instructions = "AVX";
+#elif defined(LEVEL_SIMD_SSE)
+		const char* instructions = "SSE2";
+#else
+		const char* instructions = "portable";
+#endif
+		std::printf("batch math: %s, %d lanes, best of %d, million instances/s\n", instructions, Level::Simd::LANES, repeat);
+		std::printf("%10s  %-10s %10s %10s %8s\n", "instances", "kernel", "scalar", "simd", "speedup");
+
+		// a camera in the middle of the scattered instances, about a third of them visible
+		const Level::MATRIX view = Level::LookAtLH({ 0, 10, -20 }, { 0, 0, 0 }, { 0, 1, 0 });
+		const Level::FRUSTUM frustum = Level::ExtractFrustum(Level::Multiply(view, Level::PerspectiveLH(1.2f, 16.0f / 9.0f, 0.1f, 400.0f)));
+		int failures = 0;
+		for (unsigned count : sizes) {
+			std::mt19937 random(seed);
+			std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+			std::vector<Level::AABB> local(count);
+			std::vector<Level::MATRIX> world(count);
+			Level::BOUNDS_SOA localSoa;
+			Level::MATRICES_SOA worldSoa;
+			localSoa.Resize(count);
+			worldSoa.Resize(count);
+			for (unsigned i = 0; i < count; ++i) {
+				for (int a = 0; a < 3; ++a) {
+					float center = unit(random), extent = 0.1f + std::fabs(unit(random));
+					local[i].min[a] = center - extent;
+					local[i].max[a] = center + extent;
+				}
+				world[i] = Level::IdentityMatrix();
+				for (int r = 0; r < 3; ++r)
+					for (int c = 0; c < 3; ++c)
+						world[i].data[r * 4 + c] = (r == c ? 1.0f : 0.0f) + 0.5f * unit(random);
+				for (int c = 0; c < 3; ++c)
+					world[i].data[12 + c] = 200.0f * unit(random);
+				localSoa.Set(i, local[i]);
+				worldSoa.Set(i, world[i]);
+			}
+
+			// enough passes that the small sizes still take a measurable time
+			const unsigned passes = std::max(1u, 2000000u / count);
+			auto best = [&](const auto& body) {
+				double fastest = 1e30;
+				for (int r = 0; r < repeat; ++r) {
+					Clock::time_point start = Clock::now();
+					for (unsigned pass = 0; pass < passes; ++pass)
+						body();
+					fastest = std::min(fastest, MillisecondsSince(start) / passes);
+				}
+				return count / (fastest * 1000.0);
+			};
+			auto report = [&](const char* kernel, double scalar, double simd, bool identical) {
+				std::printf("%10u  %-10s %10.1f %10.1f %7.2fx%s\n", count, kernel, scalar, simd, simd / scalar, identical ? "" : "  MISMATCH");
+				failures += !identical;
+			};
+
+			std::vector<Level::AABB> bounds(count);
+			Level::BOUNDS_SOA boundsSoa;
+			boundsSoa.Resize(count);
+			double scalar = best([&]() {
+				for (unsigned i = 0; i < count; ++i)
+					bounds[i] = Level::TransformBounds(local[i], world[i]);
+			});
+			double simd = best([&]() {
+				Level::TransformBounds(localSoa, worldSoa, boundsSoa, 0, count);
+			});
+			bool identical = true;
+			for (unsigned i = 0; i < count && identical; ++i) {
+				Level::AABB batched = boundsSoa.Get(i);
+				identical = std::memcmp(&batched, &bounds[i], sizeof(Level::AABB)) == 0;
+			}
+			report("transform", scalar, simd, identical);
+
+			std::vector<unsigned char> results(count), batchedResults(count);
+			unsigned visible = 0, batchedVisible = 0;
+			scalar = best([&]() {
+				visible = 0;
+				for (unsigned i = 0; i < count; ++i) {
+					unsigned planeMask = 0x3F;
+					results[i] = static_cast<unsigned char>(Level::TestBounds(frustum, bounds[i], planeMask));
+					visible += results[i] != Level::CULL_OUTSIDE;
+				}
+			});
+			simd = best([&]() {
+				batchedVisible = Level::CullBounds(frustum, boundsSoa, batchedResults.data(), 0, count);
+			});
+			report("frustum", scalar, simd, visible == batchedVisible && results == batchedResults);
+
+			// the view is read through a volatile every pass, or the compiler hoists the scalar loop out of the passes
+			std::vector<float> depths(count), batchedDepths(count);
+			volatile float viewOffset = 0.0f;
+			scalar = best([&]() {
+				Level::MATRIX passView = view;
+				passView.data[14] += viewOffset;
+				for (unsigned i = 0; i < count; ++i)
+					depths[i] = Level::ViewDepth(bounds[i], passView);
+			});
+			simd = best([&]() {
+				Level::MATRIX passView = view;
+				passView.data[14] += viewOffset;
+				Level::ViewDepths(passView, boundsSoa, batchedDepths.data(), 0, count);
+			});
+			report("depth", scalar, simd, std::memcmp(depths.data(), batchedDepths.data(), sizeof(float) * count) == 0);
+			std::printf("%10u  %u visible\n", count, visible);
+		}
+		if (failures > 0)
+			std::printf("ERROR: %d kernel(s) differ from the scalar results\n", failures);
+		return failures == 0 ? 0 : 1;
+	}
+
+	// recording alone: draws binds, a constant slot and a DrawIndexed each (what a sorted Model
+	// sub-mesh records) through a ParallelRecorder, then level frames with every instance drawn,
+	// both against single threaded recording
+	int BenchmarkRecording(int argc, char** argv)
+	{
+		int frames = 20;
+		unsigned syntheticInstances = 100000, draws = 1000000;
+		std::vector<unsigned> threadCounts = { 1, 2, 4, 8 };
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+				syntheticInstances = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--draws") == 0 && i + 1 < argc)
+				draws = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threadCounts = ParseSizes(argv[++i]);
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+		if (draws > 0) {
+			// 64 geometry pages, 4 pipelines, the state changes every few draws like a sorted queue
+			Level::RecordingBackend backend;
+			Level::BUFFER_DESC ringDesc = { Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, Level::CONSTANT_ALIGNMENT };
+			backend.CreateBuffer(ringDesc, nullptr);
+			auto drawOne = [](Level::RenderBackend& target, Level::ConstantRing& constants, unsigned k) {
+				const unsigned state = k / 7;
+				const Level::BufferHandle vertex[] = { 2 + state % 64 };
+				const unsigned strides[] = { 36 }, offsets[] = { 0 };
+				target.SetPipeline(1 + state / 64 % 4);
+				target.SetVertexBuffers(0, 1, vertex, strides, offsets);
+				target.SetIndexBuffer(100 + state % 64, Level::INDEX_FORMAT::UINT32, 0);
+				MeshData data = {};
+				data.wMatrix = Level::IdentityMatrix();
+				data.wMatrix.data[12] = static_cast<float>(k);
+				data.materialIndex = state % 300;
+				const unsigned offset = constants.Allocate();
+				constants.Write(target, offset, &data, sizeof(data));
+				constants.Bind(target, 1, offset, Level::STAGE_VERTEX_PIXEL);
+				target.DrawIndexed(36 + k % 5 * 3, k % 11 * 64, 0);
+			};
+			auto record = [&](unsigned, Level::StateCache& cache, Level::ConstantRing& constants, unsigned begin, unsigned end) {
+				for (unsigned k = begin; k < end; ++k)
+					drawOne(cache, constants, k);
+			};
+			auto prime = [&](unsigned, Level::StateCache& cache, Level::ConstantRing& constants, unsigned k) {
+				drawOne(cache, constants, k);
+			};
+			auto slotsBefore = [](unsigned k) { return k; };
+
+			std::printf("%u draws, recording only\n", draws);
+			std::printf("  %-18s %10s %8s %6s\n", "lists", "ms", "speedup", "same");
+			Level::StateCache cache;
+			Level::ConstantRing constants;
+			double serialMs = 1e30;
+			unsigned long long serialHash = 0;
+			Level::STATE_STATS serialState = {};
+			for (int f = 0; f < 3; ++f) {
+				backend.ResetFrame();
+				cache.Begin(backend);
+				constants.BeginFrame(cache, draws);
+				Clock::time_point start = Clock::now();
+				record(0, cache, constants, 0, draws);
+				serialMs = std::min(serialMs, MillisecondsSince(start));
+			}
+			serialHash = backend.StreamHash();
+			serialState = cache.Stats();
+			std::printf("  %-18s %10.2f %8s %6s\n", "single threaded", serialMs, "1.00x", "-");
+			for (bool native : { true, false }) {
+				for (unsigned threads : threadCounts) {
+					Level::JobSystem jobs(threads);
+					Level::ParallelRecorder recorder;
+					Level::PARALLEL_RECORDING options;
+					options.minDraws = 1;
+					options.nativeLists = native;
+					recorder.SetOptions(options);
+					double ms = 1e30;
+					for (int f = 0; f < 3; ++f) {
+						backend.ResetFrame();
+						cache.Begin(backend);
+						constants.BeginFrame(cache, draws);
+						Clock::time_point start = Clock::now();
+						recorder.Record(cache, constants, draws, &jobs, slotsBefore, prime, record);
+						ms = std::min(ms, MillisecondsSince(start));
+					}
+					const bool same = backend.StreamHash() == serialHash && cache.Stats().issued == serialState.issued &&
+						cache.Stats().skipped == serialState.skipped && constants.SlotsUsed() == draws;
+					char label[64];
+					std::snprintf(label, sizeof(label), "%u %s", recorder.Stats().lists, recorder.Stats().lists == 1 ? "(one thread)" : native ? "native" : "replayed");
+					std::printf("  %-18s %10.2f %7.2fx %6s\n", label, ms, serialMs / ms, same ? "yes" : "NO");
+					failures += same ? 0 : 1;
+				}
+			}
+		}
+
+		std::vector<std::pair<std::string, std::string>> levels = LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data());
+		if (syntheticInstances > 0) {
+			Level::LevelFile source;
+			std::string synthetic = (std::filesystem::temp_directory_path() / "level_benchmark_recording.txt").string();
+			if (source.Read("../GameLevel.txt") == false || WriteSyntheticLevel(synthetic, source, syntheticInstances) == false) {
+				std::cout << "ERROR: could not write " << synthetic << std::endl;
+				return 1;
+			}
+			levels.push_back({ synthetic, "../Models" });
+		}
+		Level::SCENE_CONSTANTS scene = Level::DefaultScene(800.0f / 600.0f);
+		for (const auto& level : levels) {
+			Level::RecordingBackend backend;
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			objects.UploadLevelToGPU(backend);
+			objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+			objects.SetCulling(false);
+			std::printf("%s\n", level.first.c_str());
+			for (bool instanced : { false, true }) {
+				objects.SetInstancing(instanced);
+				auto frame = [&]() {
+					double best = 1e30;
+					for (int f = 0; f < frames; ++f) {
+						backend.ResetFrame();
+						Clock::time_point start = Clock::now();
+						objects.RenderLevel(backend);
+						best = std::min(best, MillisecondsSince(start));
+					}
+					return best;
+				};
+				objects.SetJobSystem(nullptr);
+				objects.SetParallelRecording(false);
+				const double serialMs = frame();
+				const unsigned long long serialHash = backend.StreamHash();
+				const Level::RECORDING_COUNTERS serialCounters = backend.Counters();
+				const Level::STATE_STATS serialState = objects.GetStateStats();
+				const unsigned long long serialConstants = objects.GetUploadStats().constantBytes;
+				std::printf("  %s, %u draws\n", instanced ? "instanced" : "per Model", serialCounters.draws);
+				std::printf("    %-16s %10s %8s\n", "lists", "frame ms", "speedup");
+				std::printf("    %-16s %10.3f %8s\n", "single threaded", serialMs, "1.00x");
+				bool same = true;
+				for (bool native : { true, false }) {
+					for (unsigned threads : threadCounts) {
+						Level::JobSystem jobs(threads);
+						Level::PARALLEL_RECORDING options;
+						// small levels split too, so they are checked as well
+						options.minDraws = 8;
+						options.nativeLists = native;
+						objects.SetJobSystem(&jobs);
+						objects.SetParallelRecording(true, options);
+						const double ms = frame();
+						same &= backend.StreamHash() == serialHash && backend.Counters().commands == serialCounters.commands &&
+							backend.Counters().bytesUploaded == serialCounters.bytesUploaded &&
+							objects.GetStateStats().issued == serialState.issued && objects.GetStateStats().skipped == serialState.skipped &&
+							objects.GetUploadStats().constantBytes == serialConstants;
+						char label[64];
+						std::snprintf(label, sizeof(label), "%u %s", objects.GetRecordingStats().lists,
+							objects.GetRecordingStats().lists == 1 ? "(one thread)" : native ? "native" : "replayed");
+						std::printf("    %-16s %10.3f %7.2fx\n", label, ms, serialMs / ms);
+					}
+				}
+				objects.SetJobSystem(nullptr);
+				check(same, "streams, counters and state stats match single threaded");
+			}
+		}
+		if (failures > 0)
+			std::printf("ERROR: %d recording(s) differ from single threaded recording\n", failures);
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Walks a camera over the level's floor tiles (GameLevel.txt's dungeon and
+	// the dungeon with a copy built onto its far wall by default) at eye height
+	// and renders every frame with and without occlusion culling: instances and
+	// draws left, occluders drawn, boxes culled and what the culling costs. Both
+	// frames go through Level::SoftwareBackend, the pictures have to match since
+	// only hidden instances may be skipped.
+	int BenchmarkOcclusion(int argc, char** argv)
+	{
+		int frames = 120;
+		unsigned tolerance = 0;
+		Level::OCCLUSION_OPTIONS options;
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+				options.width = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+				options.height = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--crack") == 0 && i + 1 < argc)
+				options.crackWidth = static_cast<float>(std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--occluders") == 0 && i + 1 < argc)
+				options.maxOccluders = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+				tolerance = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		// the dungeon is one room, from inside it nothing is behind a wall. The second room is its copy moved
+		// 24.5 along z, a little less than the dungeon is long, so the copy's near wall stands in the original's far wall
+		std::vector<std::pair<std::string, std::string>> levels = LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data());
+		std::string twoRooms;
+		if (levelArguments.empty()) {
+			twoRooms = (std::filesystem::temp_directory_path() / "level_benchmark_occlusion.txt").string();
+			levels = { { "../GameLevel.txt", "../Models" } };
+			Level::LevelFile source;
+			std::ofstream file(twoRooms, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+			if (source.Read(levels[0].first.c_str()) && file.is_open()) {
+				char suffix[16];
+				unsigned index = 0;
+				file << "# Game Level Exporter v1.3\r\n";
+				for (float shift : { 0.0f, 24.5f })
+					for (const Level::RECORD& record : source.records) {
+						if (record.type != Level::RECORD_TYPE::MESH)
+							continue;
+						Level::MATRIX world = record.transform;
+						world.data[14] += shift;
+						std::snprintf(suffix, sizeof(suffix), ".%07u", index++);
+						WriteMeshRecord(file, record.name.substr(0, record.name.find_last_of(".")) + suffix, world.data);
+					}
+			}
+			if (file.is_open() && file.good())
+				levels.push_back({ twoRooms, "../Models" });
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+		const unsigned width = 400, height = 300;
+
+		for (const auto& level : levels) {
+			Level_Objects objects;
+			objects.SetOcclusionCulling(true, options);
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			Level::SoftwareBackend raster(width, height);
+			objects.UploadLevelToGPU(raster);
+			Level::BufferHandle sceneBuffer = raster.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(Level::SCENE_CONSTANTS) }, nullptr);
+
+			// waypoints: the floor tiles in nearest neighbour order, or a ring inside the level without floors
+			const Level::SceneStore& store = objects.GetScene();
+			Level::AABB levelBounds = Level::EmptyBounds();
+			std::vector<Level::FLOAT3> waypoints;
+			for (unsigned i = 0; i < store.Size(); ++i) {
+				const Level::AABB& box = store.Bounds()[i];
+				Level::Grow(levelBounds, box);
+				if (store.Name(i).compare(0, 5, "Floor") == 0)
+					waypoints.push_back({ (box.min[0] + box.max[0]) * 0.5f, box.max[1] + 1.6f, (box.min[2] + box.max[2]) * 0.5f });
+			}
+			const Level::FLOAT3 middle = { (levelBounds.min[0] + levelBounds.max[0]) * 0.5f, levelBounds.min[1] + 1.6f,
+				(levelBounds.min[2] + levelBounds.max[2]) * 0.5f };
+			const float size[2] = { levelBounds.max[0] - levelBounds.min[0], levelBounds.max[2] - levelBounds.min[2] };
+			if (waypoints.size() < 2) {
+				waypoints.clear();
+				for (int k = 0; k < 8; ++k) {
+					const float angle = 6.2831853f * k / 8;
+					waypoints.push_back({ middle.x + 0.3f * size[0] * std::cos(angle), middle.y, middle.z + 0.3f * size[1] * std::sin(angle) });
+				}
+			}
+			for (size_t k = 1; k < waypoints.size(); ++k) {
+				size_t closest = k;
+				for (size_t j = k + 1; j < waypoints.size(); ++j) {
+					Level::FLOAT3 a = Level::Subtract(waypoints[j], waypoints[k - 1]), b = Level::Subtract(waypoints[closest], waypoints[k - 1]);
+					if (Level::Dot(a, a) < Level::Dot(b, b))
+						closest = j;
+				}
+				std::swap(waypoints[k], waypoints[closest]);
+			}
+			// the first half of the path loops through the waypoints looking one waypoint ahead,
+			// the second circles the level at eye height a little outside its walls, looking at the middle
+			const float radius = 0.8f * std::max(size[0], size[1]);
+			auto along = [&](float t) {
+				t -= std::floor(t);
+				const float at = t * waypoints.size();
+				const size_t k = static_cast<size_t>(at) % waypoints.size();
+				const Level::FLOAT3& a = waypoints[k];
+				const Level::FLOAT3& b = waypoints[(k + 1) % waypoints.size()];
+				const float f = at - std::floor(at);
+				return Level::FLOAT3{ a.x + (b.x - a.x) * f, a.y + (b.y - a.y) * f, a.z + (b.z - a.z) * f };
+			};
+
+			std::printf("%s\n  %u occluders (%u quads), %zu waypoints, %ux%u depth buffer, %d frames at %ux%u\n", level.first.c_str(),
+				objects.GetOcclusionStats().occluders, objects.GetOcclusionStats().quads, waypoints.size(), options.width, options.height, frames, width, height);
+			std::printf("  %6s %10s %10s %8s %8s %9s %7s %7s %9s %9s %10s\n", "frame", "instances", "occluded", "draws", "draws", "occluders",
+				"tested", "culled", "raster", "test", "pixels");
+			std::printf("  %6s %10s %10s %8s %8s %9s %7s %7s %9s %9s %10s\n", "", "(frustum)", "", "off", "on", "", "", "", "ms", "ms", "different");
+			unsigned long long drawsOff = 0, drawsOn = 0, culled = 0, tested = 0, culledInside = 0, testedInside = 0, badPixels = 0;
+			double renderOffMs = 0, renderOnMs = 0, rasterizeMs = 0, testMs = 0, worstMs = 0, worstBad = 0;
+			bool neverMore = true;
+			for (int f = 0; f < frames; ++f) {
+				const float t = 2.0f * f / frames;
+				Level::SCENE_CONSTANTS scene = Level::DefaultScene(static_cast<float>(width) / height);
+				Level::FLOAT3 eye = along(t), target = along(t + 1.0f / waypoints.size());
+				target.y = eye.y;
+				if (t >= 1.0f) {
+					const float angle = 6.2831853f * (t - 1.0f);
+					eye = { middle.x + radius * std::cos(angle), middle.y, middle.z + radius * std::sin(angle) };
+					target = middle;
+				}
+				scene.vMatrix = Level::LookAtLH(eye, target, { 0.0f, 1.0f, 0.0f });
+				scene.cameraPos[0] = eye.x;
+				scene.cameraPos[1] = eye.y;
+				scene.cameraPos[2] = eye.z;
+				objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+				auto render = [&](bool occlusion, double& ms) {
+					objects.SetOcclusionCulling(occlusion, options);
+					raster.BeginFrame(clearColor);
+					raster.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+					raster.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+					Clock::time_point start = Clock::now();
+					objects.RenderLevel(raster);
+					ms += MillisecondsSince(start);
+					raster.EndFrame();
+					return raster.Image();
+				};
+				Level::IMAGE reference = render(false, renderOffMs);
+				const size_t offDraws = objects.GetDrawCallCount();
+				const unsigned inFrustum = objects.GetCullStats().visible;
+				Level::IMAGE occluded = render(true, renderOnMs);
+				const size_t onDraws = objects.GetDrawCallCount();
+				const Level::OCCLUSION_STATS stats = objects.GetOcclusionStats();
+				Level::IMAGE_DIFF diff = Level::CompareImages(occluded, reference, tolerance);
+
+				drawsOff += offDraws;
+				drawsOn += onDraws;
+				culled += stats.culled;
+				tested += stats.tested;
+				if (t < 1.0f) {
+					culledInside += stats.culled;
+					testedInside += stats.tested;
+				}
+				badPixels += diff.badPixels;
+				rasterizeMs += stats.rasterizeMs;
+				testMs += stats.testMs;
+				worstMs = std::max(worstMs, stats.rasterizeMs + stats.testMs);
+				worstBad = std::max(worstBad, diff.badFraction);
+				neverMore &= onDraws <= offDraws;
+				if (f % std::max(1, frames / 12) == 0)
+					std::printf("  %6d %10u %10u %8zu %8zu %9u %7u %7u %9.3f %9.3f %10llu\n", f, inFrustum, inFrustum - stats.culled,
+						offDraws, onDraws, stats.rasterized, stats.tested, stats.culled, stats.rasterizeMs, stats.testMs, diff.badPixels);
+			}
+			std::printf("  per frame: %.1f -> %.1f draws  %.1f of %.1f boxes culled  cull %.3f ms (rasterize %.3f, test %.3f, worst %.3f)\n",
+				static_cast<double>(drawsOff) / frames, static_cast<double>(drawsOn) / frames, static_cast<double>(culled) / frames,
+				static_cast<double>(tested) / frames, (rasterizeMs + testMs) / frames, rasterizeMs / frames, testMs / frames, worstMs);
+			std::printf("  RenderLevel %.3f -> %.3f ms/frame, %llu pixels different over the path (worst frame %.4f%%)\n",
+				renderOffMs / frames, renderOnMs / frames, badPixels, worstBad * 100.0);
+			std::printf("  culled %llu of %llu boxes tested on the waypoints, %llu of %llu outside the walls\n",
+				culledInside, testedInside, culled - culledInside, tested - testedInside);
+			check(objects.GetOcclusionStats().occluders > 0, "the level has occluders");
+			check(neverMore, "no frame draws more with occlusion culling");
+			check(culled > 0, "the camera path culls hidden instances");
+			// cracks narrower than options.crackWidth are closed, and seen head on a few are open all the way
+			// through the wall: a pixel may look through one at what was culled behind it
+			const double maxBadFraction = 0.0001;
+			check(worstBad <= maxBadFraction, "culled instances were hidden in every frame (but for cracks)");
+			if (level.first == twoRooms)
+				check(culledInside >= testedInside / 4, "the walk through the two rooms culls a quarter of the boxes");
+			raster.ReleaseBuffer(sceneBuffer);
+			objects.UnloadLevel();
+		}
+		if (!twoRooms.empty()) {
+			std::remove(twoRooms.c_str());
+			std::remove(Level::LevelBinary::PathFor(twoRooms).c_str());
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	// Scatters 256 to 16384 point and spot lights over each level and bins them
+	// from a camera circling it: binning time, clusters occupied and list sizes,
+	// against testing every light with every cluster. The lists must be exactly
+	// the brute force ones. Then the level is rendered by Level::SoftwareBackend
+	// with the default grid and with a single cluster holding every light, the
+	// pictures have to match (and differ from the level without its lights).
+	int BenchmarkLights(int argc, char** argv)
+	{
+		int frames = 60;
+		unsigned threads = 4, tolerance = 2;
+		std::vector<unsigned> counts = { 256, 1024, 4096, 16384 };
+		std::vector<char*> levelArguments;
+		for (int i = 0; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+				counts = ParseSizes(argv[++i]);
+			else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+			else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+				tolerance = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (i == 0 && std::atoi(argv[i]) > 0)
+				frames = std::atoi(argv[i]);
+			else
+				levelArguments.push_back(argv[i]);
+		}
+		int failures = 0;
+		auto check = [&](bool ok, const char* what) {
+			std::printf("    %-62s %s\n", what, ok ? "ok" : "FAILED");
+			if (!ok)
+				++failures;
+		};
+		const float clearColor[3] = { 0.0f, 0.0f, 0.5f };
+		const unsigned width = 400, height = 300;
+		Level::JobSystem jobs(threads);
+		Level::CLUSTER_OPTIONS grid;
+		std::printf("%u job threads, %ux%ux%u clusters\n", threads, grid.tilesX, grid.tilesY, grid.slices);
+
+		for (const auto& level : LevelArguments(static_cast<int>(levelArguments.size()), levelArguments.data())) {
+			Level_Objects objects;
+			if (objects.LoadLevel(level.first.c_str(), level.second.c_str(), QuietLog()) == false) {
+				std::cout << "ERROR: level not found " << level.first << std::endl;
+				return 1;
+			}
+			const std::vector<Level::LIGHT> levelLights = objects.GetLights();
+			unsigned spots = 0;
+			for (const Level::LIGHT& light : levelLights)
+				spots += light.type == Level::LIGHT_TYPE::SPOT;
+			std::printf("%s\n  %zu LIGHT records: %zu point, %u spot\n", level.first.c_str(), levelLights.size(), levelLights.size() - spots, spots);
+			check(!levelLights.empty(), "the level's LIGHT records were loaded");
+
+			Level::AABB levelBounds = Level::EmptyBounds();
+			for (const Level::AABB& box : objects.GetScene().Bounds())
+				Level::Grow(levelBounds, box);
+			const Level::FLOAT3 middle = { (levelBounds.min[0] + levelBounds.max[0]) * 0.5f, (levelBounds.min[1] + levelBounds.max[1]) * 0.5f,
+				(levelBounds.min[2] + levelBounds.max[2]) * 0.5f };
+			const float radius = 0.6f * std::max(levelBounds.max[0] - levelBounds.min[0], levelBounds.max[2] - levelBounds.min[2]);
+			// a quarter spots, ranges of 1 to 5 units, anywhere in the level's bounds
+			auto scatter = [&](unsigned count) {
+				std::mt19937 random(count);
+				std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+				std::vector<Level::LIGHT> lights(count);
+				for (unsigned l = 0; l < count; ++l) {
+					Level::LIGHT& light = lights[l];
+					light.type = l % 4 == 3 ? Level::LIGHT_TYPE::SPOT : Level::LIGHT_TYPE::POINT;
+					float* position = &light.position.x;
+					for (int a = 0; a < 3; ++a)
+						position[a] = levelBounds.min[a] + (levelBounds.max[a] - levelBounds.min[a]) * unit(random);
+					light.direction = Level::Normalize({ unit(random) - 0.5f, -unit(random), unit(random) - 0.5f });
+					light.color = { unit(random), unit(random), unit(random) };
+					light.range = 1.0f + 4.0f * unit(random);
+					light.outerAngle = 0.2f + 0.6f * unit(random);
+					light.innerAngle = light.outerAngle * 0.8f;
+				}
+				return lights;
+			};
+			auto camera = [&](int f) {
+				Level::SCENE_CONSTANTS scene = Level::DefaultScene(static_cast<float>(width) / height);
+				const float angle = 6.2831853f * f / frames;
+				const Level::FLOAT3 eye = { middle.x + radius * std::cos(angle), levelBounds.max[1] + 2.0f, middle.z + radius * std::sin(angle) };
+				scene.vMatrix = Level::LookAtLH(eye, middle, { 0.0f, 1.0f, 0.0f });
+				scene.cameraPos[0] = eye.x;
+				scene.cameraPos[1] = eye.y;
+				scene.cameraPos[2] = eye.z;
+				return scene;
+			};
+
+			std::printf("  %7s %9s %9s %9s %12s %12s %9s %9s %9s %6s\n", "lights", "bin", "worst", "brute", "tests", "brute", "occupied", "entries",
+				"average", "max");
+			std::printf("  %7s %9s %9s %9s %12s %12s %9s %9s %9s %6s\n", "", "ms", "ms", "ms", "", "tests", "clusters", "", "per list", "");
+			bool allMatch = true;
+			for (unsigned count : counts) {
+				const std::vector<Level::LIGHT> lights = scatter(count);
+				Level::LightClusters clusters, reference;
+				double binMs = 0, worstMs = 0, bruteMs = 0;
+				unsigned long long tests = 0, bruteTests = 0, occupied = 0, entries = 0;
+				unsigned maxPerCluster = 0, mismatches = 0;
+				for (int f = 0; f < frames; ++f) {
+					const Level::SCENE_CONSTANTS scene = camera(f);
+					clusters.Bin(lights, scene.vMatrix, scene.pMatrix, &jobs);
+					reference.BinBruteForce(lights, scene.vMatrix, scene.pMatrix);
+					const Level::CLUSTER_STATS stats = clusters.Stats();
+					binMs += stats.binMs;
+					worstMs = std::max(worstMs, stats.binMs);
+					bruteMs += reference.Stats().binMs;
+					tests += stats.tests;
+					bruteTests += reference.Stats().tests;
+					occupied += stats.occupied;
+					entries += stats.entries;
+					maxPerCluster = std::max(maxPerCluster, stats.maxPerCluster);
+					const std::vector<Level::CLUSTER_RANGE>& a = clusters.Ranges();
+					const std::vector<Level::CLUSTER_RANGE>& b = reference.Ranges();
+					bool same = a.size() == b.size() && clusters.Indices() == reference.Indices();
+					for (size_t c = 0; same && c < a.size(); ++c)
+						same = a[c].offset == b[c].offset && a[c].count == b[c].count;
+					mismatches += !same;
+				}
+				allMatch &= mismatches == 0;
+				std::printf("  %7u %9.3f %9.3f %9.3f %12.0f %12.0f %9.1f %9.0f %9.2f %6u%s\n", count, binMs / frames, worstMs, bruteMs / frames,
+					static_cast<double>(tests) / frames, static_cast<double>(bruteTests) / frames, static_cast<double>(occupied) / frames,
+					static_cast<double>(entries) / frames, occupied > 0 ? static_cast<double>(entries) / occupied : 0.0, maxPerCluster,
+					mismatches > 0 ? "  DIFFERENT" : "");
+			}
+			check(allMatch, "every frame's lists are the brute force lists");
+
+			// the level's own lights and 256 more, rendered from the first camera
+			std::vector<Level::LIGHT> shown = levelLights;
+			const std::vector<Level::LIGHT> extra = scatter(256);
+			shown.insert(shown.end(), extra.begin(), extra.end());
+			Level::SoftwareBackend raster(width, height);
+			objects.UploadLevelToGPU(raster);
+			objects.SetLights(shown);
+			Level::BufferHandle sceneBuffer = raster.CreateBuffer(
+				{ Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(Level::SCENE_CONSTANTS) }, nullptr);
+			const Level::SCENE_CONSTANTS scene = camera(0);
+			objects.SetViewProjection(scene.vMatrix, scene.pMatrix);
+			auto render = [&](bool lit, const Level::CLUSTER_OPTIONS& options) {
+				objects.SetClusteredLighting(lit, options);
+				raster.BeginFrame(clearColor);
+				raster.UpdateBuffer(sceneBuffer, &scene, sizeof(scene));
+				raster.SetConstantBuffer(0, sceneBuffer, Level::STAGE_VERTEX_PIXEL);
+				objects.RenderLevel(raster);
+				raster.EndFrame();
+				return raster.Image();
+			};
+			Level::CLUSTER_OPTIONS single;
+			single.tilesX = single.tilesY = single.slices = 1;
+			const Level::IMAGE unlit = render(false, grid);
+			const Level::IMAGE clustered = render(true, grid);
+			const Level::CLUSTER_STATS stats = objects.GetClusterStats();
+			const Level::IMAGE everyLight = render(true, single);
+			const Level::IMAGE_DIFF diff = Level::CompareImages(clustered, everyLight, tolerance);
+			const Level::IMAGE_DIFF lighting = Level::CompareImages(clustered, unlit, tolerance);
+			std::printf("  %zu lights at %ux%u: %u clusters occupied, %u entries (max %u), %llu pixels lit, %llu pixels off against one cluster\n",
+				shown.size(), width, height, stats.occupied, stats.entries, stats.maxPerCluster, lighting.badPixels, diff.badPixels);
+			check(lighting.badPixels > 0, "the lights change the picture");
+			check(diff.badPixels == 0, "clustered lists light like every light at once");
+			raster.ReleaseBuffer(sceneBuffer);
+			objects.UnloadLevel();
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	void PrintUsage()
+	{
+		std::cout << "usage: Level_Benchmark h2b [parse|mapped|both] [iterations] [folders...]" << std::endl;
+		std::cout << "       Level_Benchmark assets [level.txt h2bFolder]..." << std::endl;
+		std::cout << "       Level_Benchmark instancing [level.txt h2bFolder]..." << std::endl;
+		std::cout << "       Level_Benchmark shadercache [shaderFolder] [models]" << std::endl;
+		std::cout << "       Level_Benchmark frame [frames] [level.txt h2bFolder]... [--dump folder]" << std::endl;
+		std::cout << "       Level_Benchmark culling [frames] [level.txt h2bFolder]... [--instances n]" << std::endl;
+		std::cout << "       Level_Benchmark raster [frames] [level.txt h2bFolder]... [--threads n] [--write folder] [--compare folder] [--tolerance n]" << std::endl;
+		std::cout << "       Level_Benchmark lvlb [iterations] [level.txt h2bFolder]... [--instances n]" << std::endl;
+		std::cout << "       Level_Benchmark parse [iterations] [level.txt h2bFolder]... [--megabytes n] [--threads n]" << std::endl;
+		std::cout << "       Level_Benchmark streaming [level.txt h2bFolder]... [--instances n] [--fps n] [--budget ms] [--threads n]" << std::endl;
+		std::cout << "       Level_Benchmark jobs [iterations] [level.txt h2bFolder]... [--instances n] [--frames n]" << std::endl;
+		std::cout << "       Level_Benchmark queue [frames] [level.txt h2bFolder]... [--instances n]" << std::endl;
+		std::cout << "       Level_Benchmark upload [level.txt h2bFolder]..." << std::endl;
+		std::cout << "       Level_Benchmark geometry [level.txt h2bFolder]..." << std::endl;
+		std::cout << "       Level_Benchmark vertexformat [level.txt h2bFolder]... [--tolerance n]" << std::endl;
+		std::cout << "       Level_Benchmark optimize [folders...] [--threshold x] [--threads n] [--write folder]" << std::endl;
+		std::cout << "       Level_Benchmark lod [frames] [level.txt h2bFolder]... [--tolerance n]" << std::endl;
+		std::cout << "       Level_Benchmark static [level.txt h2bFolder]... [--chunk size] [--merge asset|material]" << std::endl;
+		std::cout << "       Level_Benchmark profiler [iterations] [level.txt h2bFolder]... [--frames n] [--trace file.json]" << std::endl;
+		std::cout << "       Level_Benchmark suite [level.txt h2bFolder]... [--sizes 1000,10000,...] [--seed n] [--repeat n] [--frames n]" << std::endl;
+		std::cout << "                             [--threads n] [--json out.json] [--compare baseline.json] [--threshold 0.15]" << std::endl;
+		std::cout << "       Level_Benchmark batchmath [--sizes 10000,100000,1000000] [--seed n] [--repeat n]" << std::endl;
+		std::cout << "       Level_Benchmark scene [level.txt h2bFolder]... [--instances n] [--frames n]" << std::endl;
+		std::cout << "       Level_Benchmark recording [frames] [level.txt h2bFolder]... [--instances n] [--draws n] [--threads 1,2,4,8]" << std::endl;
+		std::cout << "       Level_Benchmark occlusion [frames] [level.txt h2bFolder]... [--width n] [--height n] [--occluders n] [--crack m]" << std::endl;
+		std::cout << "                                 [--tolerance n]" << std::endl;
+		std::cout << "       Level_Benchmark lights [frames] [level.txt h2bFolder]... [--lights 256,1024,4096,16384] [--threads n] [--tolerance n]" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		PrintUsage();
+		return 1;
+	}
+	std::string benchmark = argv[1];
+	if (benchmark == "h2b")
+		return BenchmarkH2B(argc - 2, argv + 2);
+	if (benchmark == "assets")
+		return BenchmarkAssets(argc - 2, argv + 2);
+	if (benchmark == "instancing")
+		return BenchmarkInstancing(argc - 2, argv + 2);
+	if (benchmark == "shadercache")
+		return BenchmarkShaderCache(argc - 2, argv + 2);
+	if (benchmark == "frame")
+		return BenchmarkFrame(argc - 2, argv + 2);
+	if (benchmark == "culling")
+		return BenchmarkCulling(argc - 2, argv + 2);
+	if (benchmark == "raster")
+		return BenchmarkRaster(argc - 2, argv + 2);
+	if (benchmark == "lvlb")
+		return BenchmarkLevelBinary(argc - 2, argv + 2);
+	if (benchmark == "parse")
+		return BenchmarkLevelParse(argc - 2, argv + 2);
+	if (benchmark == "streaming")
+		return BenchmarkStreaming(argc - 2, argv + 2);
+	if (benchmark == "jobs")
+		return BenchmarkJobs(argc - 2, argv + 2);
+	if (benchmark == "queue")
+		return BenchmarkQueue(argc - 2, argv + 2);
+	if (benchmark == "upload")
+		return BenchmarkUpload(argc - 2, argv + 2);
+	if (benchmark == "geometry")
+		return BenchmarkGeometry(argc - 2, argv + 2);
+	if (benchmark == "vertexformat")
+		return BenchmarkVertexFormat(argc - 2, argv + 2);
+	if (benchmark == "optimize")
+		return BenchmarkOptimize(argc - 2, argv + 2);
+	if (benchmark == "lod")
+		return BenchmarkLod(argc - 2, argv + 2);
+	if (benchmark == "static")
+		return BenchmarkStatic(argc - 2, argv + 2);
+	if (benchmark == "profiler")
+		return BenchmarkProfiler(argc - 2, argv + 2);
+	if (benchmark == "suite")
+		return BenchmarkSuite(argc - 2, argv + 2);
+	if (benchmark == "batchmath")
+		return BenchmarkBatchMath(argc - 2, argv + 2);
+	if (benchmark == "scene")
+		return BenchmarkScene(argc - 2, argv + 2);
+	if (benchmark == "recording")
+		return BenchmarkRecording(argc - 2, argv + 2);
+	if (benchmark == "occlusion")
+		return BenchmarkOcclusion(argc - 2, argv + 2);
+	if (benchmark == "lights")
+		return BenchmarkLights(argc - 2, argv + 2);
+	PrintUsage();
+	return 1;
+}
@@ -0,0 +1,250 @@
+#ifndef _LEVEL_BINARY_H_
+#define _LEVEL_BINARY_H_
+// Compiled level (.lvlb): the records of a GameLevel.txt laid out so a single
+// memory mapping can be used as is, nothing is parsed at load time.
+//
+//   HEADER
+//   STRING[stringCount]        offset/length into the character data
+//   char[charactersSize]       interned names and asset files, each null terminated
+//   ENTRY[recordCount]         type, name string, asset string (MESH only)
+//   MATRIX[recordCount]        transforms, 16 byte aligned
+//
+// The header keeps the size and FNV-1a hash of the text it was compiled from
+// so a stale .lvlb is rejected instead of loading an outdated level.
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "h2bParser.h"
+#include "level_file.h"
+#include "level_hash.h"
+
+namespace Level {
+
+	class LevelBinary
+	{
+	public:
+		static const unsigned FORMAT_VERSION = 1;
+		static const unsigned NO_STRING = 0xFFFFFFFF;
+
+		struct HEADER {
+			char magic[4];			// "LVLB"
+			unsigned version;
+			unsigned long long sourceHash;
+			unsigned long long sourceSize;
+			unsigned recordCount;
+			unsigned stringCount;
+			unsigned long long stringsOffset;
+			unsigned long long charactersOffset;
+			unsigned long long charactersSize;
+			unsigned long long recordsOffset;
+			unsigned long long transformsOffset;
+		};
+		struct STRING {
+			unsigned offset, length;
+		};
+		struct ENTRY {
+			unsigned type;			// RECORD_TYPE
+			unsigned name;
+			unsigned asset;			// "<name up to the last .>.h2b", NO_STRING for LIGHT/CAMERA
+			unsigned reserved;
+		};
+
+	private:
+		H2B::MappedFile file;
+		const HEADER* header = nullptr;
+		const STRING* strings = nullptr;
+		const char* characters = nullptr;
+		const ENTRY* entries = nullptr;
+		const MATRIX* transforms = nullptr;
+
+		static unsigned long long Align(unsigned long long offset, unsigned long long alignment) {
+			return (offset + alignment - 1) & ~(alignment - 1);
+		}
+		static bool InFile(unsigned long long offset, unsigned long long bytes, unsigned long long fileSize) {
+			return offset <= fileSize && bytes <= fileSize - offset;
+		}
+		bool Fail() {
+			Close();
+			return false;
+		}
+
+	public:
+		// "../GameLevel.txt" -> "../GameLevel.lvlb"
+		static std::string PathFor(const std::string& textPath)
+		{
+			size_t dot = textPath.find_last_of('.');
+			size_t slash = textPath.find_last_of("/\\");
+			if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+				return textPath + ".lvlb";
+			return textPath.substr(0, dot) + ".lvlb";
+		}
+
+		// hash and size of a level text file, false if it can't be read
+		static bool HashSource(const char* textPath, unsigned long long& hash, unsigned long long& size)
+		{
+			H2B::MappedFile source;
+			if (source.Open(textPath) == false)
+				return false;
+			hash = HashBytes(source.Data(), source.Size());
+			size = source.Size();
+			return true;
+		}
+
+		// writes the records of a parsed level text file
+		static bool Write(const char* binaryPath, const LevelFile& level, unsigned long long sourceHash, unsigned long long sourceSize)
+		{
+			std::vector<STRING> stringTable;
+			std::string characterData;
+			std::unordered_map<std::string, unsigned> interned;
+			auto intern = [&](const std::string& text) {
+				auto found = interned.find(text);
+				if (found != interned.end())
+					return found->second;
+				unsigned index = static_cast<unsigned>(stringTable.size());
+				stringTable.push_back({ static_cast<unsigned>(characterData.size()), static_cast<unsigned>(text.size()) });
+				characterData.append(text);
+				characterData.push_back('\0');
+				interned.emplace(text, index);
+				return index;
+			};
+			std::vector<ENTRY> entryTable;
+			std::vector<MATRIX> transformTable;
+			entryTable.reserve(level.records.size());
+			transformTable.reserve(level.records.size());
+			for (const RECORD& record : level.records) {
+				ENTRY entry = { static_cast<unsigned>(record.type), intern(record.name), NO_STRING, 0 };
+				if (record.type == RECORD_TYPE::MESH)
+					entry.asset = intern(record.name.substr(0, record.name.find_last_of(".")) + ".h2b");
+				entryTable.push_back(entry);
+				transformTable.push_back(record.transform);
+			}
+
+			HEADER out = {};
+			std::memcpy(out.magic, "LVLB", 4);
+			out.version = FORMAT_VERSION;
+			out.sourceHash = sourceHash;
+			out.sourceSize = sourceSize;
+			out.recordCount = static_cast<unsigned>(entryTable.size());
+			out.stringCount = static_cast<unsigned>(stringTable.size());
+			out.stringsOffset = Align(sizeof(HEADER), 16);
+			out.charactersOffset = out.stringsOffset + sizeof(STRING) * stringTable.size();
+			out.charactersSize = characterData.size();
+			out.recordsOffset = Align(out.charactersOffset + out.charactersSize, 16);
+			out.transformsOffset = Align(out.recordsOffset + sizeof(ENTRY) * entryTable.size(), 16);
+
+			// write then rename so a crash never leaves a half written level behind
+			std::string temporary = std::string(binaryPath) + ".tmp";
+			{
+				std::ofstream stream(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+				if (stream.is_open() == false)
+					return false;
+				auto padTo = [&](unsigned long long offset) {
+					static const char zeros[16] = { 0 };
+					unsigned long long at = static_cast<unsigned long long>(stream.tellp());
+					stream.write(zeros, static_cast<std::streamsize>(offset - at));
+				};
+				stream.write(reinterpret_cast<const char*>(&out), sizeof(out));
+				padTo(out.stringsOffset);
+				stream.write(reinterpret_cast<const char*>(stringTable.data()), sizeof(STRING) * stringTable.size());
+				stream.write(characterData.data(), characterData.size());
+				padTo(out.recordsOffset);
+				stream.write(reinterpret_cast<const char*>(entryTable.data()), sizeof(ENTRY) * entryTable.size());
+				padTo(out.transformsOffset);
+				stream.write(reinterpret_cast<const char*>(transformTable.data()), sizeof(MATRIX) * transformTable.size());
+				if (!stream)
+					return false;
+			}
+			std::remove(binaryPath);
+			return std::rename(temporary.c_str(), binaryPath) == 0;
+		}
+
+		// converter: GameLevel.txt -> .lvlb
+		static bool Compile(const char* textPath, const char* binaryPath)
+		{
+			unsigned long long hash = 0, size = 0;
+			LevelFile level;
+			if (HashSource(textPath, hash, size) == false || level.Read(textPath) == false)
+				return false;
+			return Write(binaryPath, level, hash, size);
+		}
+
+		// maps the file and checks every offset, index and string lies inside it
+		bool Open(const char* binaryPath)
+		{
+			Close();
+			if (file.Open(binaryPath) == false || file.Size() < sizeof(HEADER))
+				return Fail();
+			const unsigned long long size = file.Size();
+			const char* base = file.Data();
+			header = reinterpret_cast<const HEADER*>(base);
+			if (std::memcmp(header->magic, "LVLB", 4) != 0 || header->version != FORMAT_VERSION ||
+				!InFile(header->stringsOffset, sizeof(STRING) * static_cast<unsigned long long>(header->stringCount), size) ||
+				!InFile(header->charactersOffset, header->charactersSize, size) ||
+				!InFile(header->recordsOffset, sizeof(ENTRY) * static_cast<unsigned long long>(header->recordCount), size) ||
+				!InFile(header->transformsOffset, sizeof(MATRIX) * static_cast<unsigned long long>(header->recordCount), size) ||
+				header->stringsOffset % 4 || header->recordsOffset % 4 || header->transformsOffset % 4)
+				return Fail();
+			strings = reinterpret_cast<const STRING*>(base + header->stringsOffset);
+			characters = base + header->charactersOffset;
+			entries = reinterpret_cast<const ENTRY*>(base + header->recordsOffset);
+			transforms = reinterpret_cast<const MATRIX*>(base + header->transformsOffset);
+			// strings must be null terminated inside the character data
+			for (unsigned i = 0; i < header->stringCount; ++i)
+				if (static_cast<unsigned long long>(strings[i].offset) + strings[i].length >= header->charactersSize ||
+					characters[strings[i].offset + strings[i].length] != '\0')
+					return Fail();
+			for (unsigned i = 0; i < header->recordCount; ++i)
+				if (entries[i].type > static_cast<unsigned>(RECORD_TYPE::CAMERA) || entries[i].name >= header->stringCount ||
+					(entries[i].asset != NO_STRING && entries[i].asset >= header->stringCount))
+					return Fail();
+			return true;
+		}
+		void Close()
+		{
+			file.Close();
+			header = nullptr;
+			strings = nullptr;
+			characters = nullptr;
+			entries = nullptr;
+			transforms = nullptr;
+		}
+		// false if the text was edited after this file was compiled (or can't be read)
+		bool IsCurrent(const char* textPath) const
+		{
+			unsigned long long hash = 0, size = 0;
+			return header != nullptr && HashSource(textPath, hash, size) &&
+				size == header->sourceSize && hash == header->sourceHash;
+		}
+
+		bool IsOpen() const {
+			return header != nullptr;
+		}
+		unsigned RecordCount() const {
+			return header ? header->recordCount : 0;
+		}
+		unsigned StringCount() const {
+			return header ? header->stringCount : 0;
+		}
+		RECORD_TYPE Type(unsigned record) const {
+			return static_cast<RECORD_TYPE>(entries[record].type);
+		}
+		std::string_view Name(unsigned record) const {
+			return String(entries[record].name);
+		}
+		// empty for LIGHT/CAMERA records
+		std::string_view Asset(unsigned record) const {
+			return entries[record].asset == NO_STRING ? std::string_view() : String(entries[record].asset);
+		}
+		const MATRIX& Transform(unsigned record) const {
+			return transforms[record];
+		}
+		std::string_view String(unsigned index) const {
+			return std::string_view(characters + strings[index].offset, strings[index].length);
+		}
+	};
+}
+#endif
@@ -0,0 +1,364 @@
+#ifndef _LEVEL_FILE_H_
+#define _LEVEL_FILE_H_
+// Reads the "Game Level Exporter" text format (GameLevel.txt).
+// Gateware free so the level can be loaded by the headless tools as well.
+// The file is mapped and parsed in one pass, large files in record aligned
+// chunks on several threads. Malformed records stop the read with the line
+// and column of the problem instead of loading a garbage matrix.
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "h2bParser.h"
+
+namespace Level {
+
+	// row major 4x4, same memory layout as GW::MATH::GMATRIXF
+	struct MATRIX {
+		float data[16];
+	};
+
+	inline MATRIX IdentityMatrix()
+	{
+		MATRIX identity = { { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 } };
+		return identity;
+	}
+
+	enum class RECORD_TYPE { MESH, LIGHT, CAMERA };
+
+	// one MESH/LIGHT/CAMERA block of the level file
+	struct RECORD {
+		RECORD_TYPE type;
+		std::string name;
+		MATRIX transform;
+	};
+
+	// "Wall_Modular.001" -> "<folder>/Wall_Modular.h2b" (strip the .001)
+	inline std::string H2BPathFromName(const char* h2bFolderPath, const std::string& name)
+	{
+		std::string modelFile = name.substr(0, name.find_last_of("."));
+		modelFile += ".h2b";
+		return std::string(h2bFolderPath) + "/" + modelFile;
+	}
+
+	// locale independent decimal float ("-12.3847", "1e-5"), returns the end of
+	// the number or nullptr if there isn't one at text. Short mantissas are
+	// converted with one exact float operation, anything else by from_chars
+	// so the result is always the correctly rounded value.
+	inline const char* ParseFloat(const char* text, const char* end, float& value)
+	{
+		static const float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+		const char* at = text;
+		bool negative = false;
+		if (at < end && (*at == '-' || *at == '+'))
+			negative = *at++ == '-';
+		unsigned long long mantissa = 0;
+		int significant = 0, exponent = 0;
+		bool digits = false;
+		for (; at < end && *at >= '0' && *at <= '9'; ++at, digits = true) {
+			if (significant < 19) {
+				mantissa = mantissa * 10 + (*at - '0');
+				significant += mantissa != 0;
+			}
+			else {
+				++exponent;
+				++significant;
+			}
+		}
+		if (at < end && *at == '.') {
+			for (++at; at < end && *at >= '0' && *at <= '9'; ++at, digits = true) {
+				if (significant < 19) {
+					mantissa = mantissa * 10 + (*at - '0');
+					significant += mantissa != 0;
+					--exponent;
+				}
+				else
+					++significant;
+			}
+		}
+		if (!digits)
+			return nullptr;
+		if (at < end && (*at == 'e' || *at == 'E')) {
+			const char* e = at + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '-' || *e == '+'))
+				negativeExponent = *e++ == '-';
+			if (e < end && *e >= '0' && *e <= '9') {
+				int written = 0;
+				for (; e < end && *e >= '0' && *e <= '9'; ++e)
+					written = written < 100000 ? written * 10 + (*e - '0') : written;
+				exponent += negativeExponent ? -written : written;
+				at = e;
+			}
+		}
+		if (mantissa == 0)
+			value = 0.0f;
+		else if (significant <= 19 && mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+			float exact = static_cast<float>(mantissa);
+			value = exponent < 0 ? exact / powers[-exponent] : exact * powers[exponent];
+		}
+		else if (std::from_chars(text + (*text == '+' || *text == '-'), at, value).ec != std::errc())
+			value = 0.0f; // out of float range
+		if (negative)
+			value = -value;
+		return at;
+	}
+
+	// where a level file stopped making sense, line and column count from 1
+	struct PARSE_ERROR {
+		unsigned line = 0, column = 0;
+		std::string message;
+	};
+
+	class LevelFile
+	{
+		// files at least this big are split into chunks parsed on their own threads
+		static const size_t PARALLEL_BYTES = 1 << 20;
+
+		struct CHUNK {
+			const char* begin;
+			const char* end;
+			std::vector<RECORD> records;
+			unsigned lines = 0;		// line breaks in [begin, end)
+			PARSE_ERROR error;		// line relative to the chunk
+		};
+
+		// line without the '\r' of CRLF files, at moves past the '\n'
+		static bool NextLine(const char*& at, const char* end, const char*& line, const char*& lineEnd)
+		{
+			if (at >= end)
+				return false;
+			line = at;
+			const char* newline = static_cast<const char*>(std::memchr(at, '\n', end - at));
+			lineEnd = newline ? newline : end;
+			at = newline ? newline + 1 : end;
+			if (lineEnd > line && lineEnd[-1] == '\r')
+				--lineEnd;
+			return true;
+		}
+		static bool Is(const char* line, const char* lineEnd, const char* word)
+		{
+			size_t length = std::strlen(word);
+			return static_cast<size_t>(lineEnd - line) == length && std::memcmp(line, word, length) == 0;
+		}
+		static bool RecordType(const char* line, const char* lineEnd, RECORD_TYPE& type)
+		{
+			if (Is(line, lineEnd, "MESH"))
+				type = RECORD_TYPE::MESH;
+			else if (Is(line, lineEnd, "LIGHT"))
+				type = RECORD_TYPE::LIGHT;
+			else if (Is(line, lineEnd, "CAMERA"))
+				type = RECORD_TYPE::CAMERA;
+			else
+				return false;
+			return true;
+		}
+		static const char* SkipSpaces(const char* at, const char* end)
+		{
+			while (at < end && (*at == ' ' || *at == '\t'))
+				++at;
+			return at;
+		}
+
+		// "<Matrix 4x4 (x, y, z, w)" for the first row, "(x, y, z, w)" after it and ")>" closing the last
+		static bool ParseRow(const char* line, const char* lineEnd, int row, float* values, const char*& failed, const char*& message)
+		{
+			const char* at = SkipSpaces(line, lineEnd);
+			if (row == 0) {
+				static const char header[] = "<Matrix 4x4";
+				if (static_cast<size_t>(lineEnd - at) < sizeof(header) - 1 || std::memcmp(at, header, sizeof(header) - 1) != 0) {
+					failed = at, message = "expected \"<Matrix 4x4\"";
+					return false;
+				}
+				at = SkipSpaces(at + sizeof(header) - 1, lineEnd);
+			}
+			if (at >= lineEnd || *at != '(') {
+				failed = at, message = "expected '(' starting a matrix row";
+				return false;
+			}
+			++at;
+			for (int i = 0; i < 4; ++i) {
+				at = SkipSpaces(at, lineEnd);
+				const char* number = ParseFloat(at, lineEnd, values[i]);
+				if (number == nullptr) {
+					failed = at, message = "expected a number";
+					return false;
+				}
+				at = SkipSpaces(number, lineEnd);
+				char expected = i < 3 ? ',' : ')';
+				if (at >= lineEnd || *at != expected) {
+					failed = at, message = i < 3 ? "expected ',' between matrix values" : "expected ')' after 4 matrix values";
+					return false;
+				}
+				++at;
+			}
+			if (row == 3) {
+				if (at >= lineEnd || *at != '>') {
+					failed = at, message = "expected '>' closing the matrix";
+					return false;
+				}
+				++at;
+			}
+			at = SkipSpaces(at, lineEnd);
+			if (at < lineEnd) {
+				failed = at, message = "unexpected text after the matrix row";
+				return false;
+			}
+			return true;
+		}
+
+		// records of [begin, end), which starts at the beginning of a line
+		static void ParseChunk(CHUNK& chunk)
+		{
+			const char* at = chunk.begin;
+			const char* line = nullptr;
+			const char* lineEnd = nullptr;
+			auto fail = [&](const char* where, const char* message) {
+				chunk.error.line = chunk.lines;
+				chunk.error.column = static_cast<unsigned>(where - line) + 1;
+				chunk.error.message = message;
+			};
+			while (NextLine(at, chunk.end, line, lineEnd)) {
+				++chunk.lines;
+				RECORD record;
+				// anything between records (the exporter's header comment, blank lines) is ignored
+				if (RecordType(line, lineEnd, record.type) == false)
+					continue;
+				if (NextLine(at, chunk.end, line, lineEnd) == false) {
+					fail(lineEnd, "record ends before its name");
+					return;
+				}
+				++chunk.lines;
+				record.name.assign(line, lineEnd);
+				if (record.name.empty()) {
+					fail(line, "record has an empty name");
+					return;
+				}
+				for (int row = 0; row < 4; ++row) {
+					if (NextLine(at, chunk.end, line, lineEnd) == false) {
+						fail(lineEnd, "record ends before its 4 matrix rows");
+						return;
+					}
+					++chunk.lines;
+					const char* failed = nullptr;
+					const char* message = nullptr;
+					if (ParseRow(line, lineEnd, row, &record.transform.data[row * 4], failed, message) == false) {
+						fail(failed, message);
+						return;
+					}
+				}
+				chunk.records.push_back(std::move(record));
+			}
+		}
+
+		// start of the first record at or after at, a type line whose matrix begins two lines
+		// later (a row never starts with '<' and a name line is never followed by one)
+		static const char* NextRecord(const char* at, const char* begin, const char* end)
+		{
+			if (at > begin && at[-1] != '\n') {
+				const char* newline = static_cast<const char*>(std::memchr(at, '\n', end - at));
+				at = newline ? newline + 1 : end;
+			}
+			const char* next = at;
+			const char* line = nullptr;
+			const char* lineEnd = nullptr;
+			while (NextLine(next, end, line, lineEnd)) {
+				RECORD_TYPE type;
+				const char* matrix = next;
+				const char* row = nullptr;
+				const char* rowEnd = nullptr;
+				if (RecordType(line, lineEnd, type) && NextLine(matrix, end, row, rowEnd) &&
+					NextLine(matrix, end, row, rowEnd)) {
+					row = SkipSpaces(row, rowEnd);
+					if (row < rowEnd && *row == '<')
+						return line;
+				}
+			}
+			return end;
+		}
+
+	public:
+		std::vector<RECORD> records;
+		PARSE_ERROR error;		// set when Read/Parse returns false
+
+		// threads = 0 uses every hardware thread, files under 1MB are always parsed on one
+		bool Read(const char* gameLevelPath, unsigned threads = 0)
+		{
+			records.clear();
+			error = PARSE_ERROR();
+			H2B::MappedFile file;
+			if (file.Open(gameLevelPath))
+				return Parse(file.Data(), file.Size(), threads);
+			// an empty file can't be mapped but is still a (empty) level
+			std::ifstream exists(gameLevelPath, std::ios_base::in | std::ios_base::binary);
+			if (exists.is_open() == false) {
+				error.message = std::string("cannot open ") + gameLevelPath;
+				return false;
+			}
+			return Parse(nullptr, 0, threads);
+		}
+
+		// parses a whole level already in memory, records keep the file's order
+		bool Parse(const char* text, size_t size, unsigned threads = 0)
+		{
+			records.clear();
+			error = PARSE_ERROR();
+			if (threads == 0)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			size_t chunkCount = size < PARALLEL_BYTES ? 1 : std::min<size_t>(threads, size / (PARALLEL_BYTES / 4));
+			chunkCount = std::max<size_t>(1, chunkCount);
+
+			// chunk boundaries are moved forward to the next record so every chunk parses on its own
+			std::vector<CHUNK> chunks(chunkCount);
+			const char* end = text + size;
+			const char* previous = text;
+			for (size_t i = 0; i < chunkCount; ++i) {
+				chunks[i].begin = previous;
+				const char* split = i + 1 == chunkCount ? end : std::max(previous, text + size * (i + 1) / chunkCount);
+				chunks[i].end = previous = NextRecord(split, text, end);
+			}
+			if (chunkCount == 1)
+				ParseChunk(chunks[0]);
+			else {
+				std::vector<std::thread> workers;
+				for (size_t i = 1; i < chunkCount; ++i)
+					workers.emplace_back(ParseChunk, std::ref(chunks[i]));
+				ParseChunk(chunks[0]);
+				for (std::thread& worker : workers)
+					worker.join();
+			}
+
+			size_t total = 0;
+			unsigned line = 0;
+			for (CHUNK& chunk : chunks) {
+				if (!chunk.error.message.empty()) {
+					error = chunk.error;
+					error.line += line;
+					records.clear();
+					return false;
+				}
+				line += chunk.lines;
+				total += chunk.records.size();
+			}
+			records.reserve(total);
+			for (CHUNK& chunk : chunks)
+				std::move(chunk.records.begin(), chunk.records.end(), std::back_inserter(records));
+			return true;
+		}
+
+		// "line 12, column 20: expected a number"
+		std::string ErrorString() const
+		{
+			if (error.line == 0)
+				return error.message;
+			return "line " + std::to_string(error.line) + ", column " + std::to_string(error.column) + ": " + error.message;
+		}
+
+	};
+}
+#endif
@@ -0,0 +1,27 @@
+#ifndef _LEVEL_HASH_H_
+#define _LEVEL_HASH_H_
+// 64 bit FNV-1a, used for cache keys and stale file detection (not security)
+#include <cstddef>
+#include <string>
+
+namespace Level {
+
+	static const unsigned long long HASH_SEED = 14695981039346656037ull;
+
+	inline unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash = HASH_SEED)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	// strings are hashed with their length so ("ab","c") and ("a","bc") differ
+	inline unsigned long long HashString(const std::string& text, unsigned long long hash = HASH_SEED)
+	{
+		unsigned long long length = text.size();
+		hash = HashBytes(&length, sizeof(length), hash);
+		return HashBytes(text.data(), text.size(), hash);
+	}
+}
+#endif
@@ -0,0 +1,80 @@
+#ifndef _LEVEL_MATH_H_
+#define _LEVEL_MATH_H_
+// Small row vector/row major matrix helpers for the headless code, same
+// conventions as GW::MATH (v' = v * M, translation in the 4th row, left handed).
+#include <cmath>
+#include "level_file.h"
+
+namespace Level {
+
+	struct FLOAT3 {
+		float x, y, z;
+	};
+
+	inline FLOAT3 Subtract(const FLOAT3& a, const FLOAT3& b) {
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+	inline float Dot(const FLOAT3& a, const FLOAT3& b) {
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+	inline FLOAT3 Cross(const FLOAT3& a, const FLOAT3& b) {
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+	inline FLOAT3 Normalize(const FLOAT3& v) {
+		float length = std::sqrt(Dot(v, v));
+		return length > 0 ? FLOAT3{ v.x / length, v.y / length, v.z / length } : v;
+	}
+
+	inline MATRIX Multiply(const MATRIX& a, const MATRIX& b)
+	{
+		MATRIX result;
+		for (int r = 0; r < 4; ++r)
+			for (int c = 0; c < 4; ++c)
+				result.data[r * 4 + c] = a.data[r * 4 + 0] * b.data[0 * 4 + c] + a.data[r * 4 + 1] * b.data[1 * 4 + c] +
+					a.data[r * 4 + 2] * b.data[2 * 4 + c] + a.data[r * 4 + 3] * b.data[3 * 4 + c];
+		return result;
+	}
+
+	// (x, y, z, 1) * m
+	inline void TransformPoint(const float point[3], const MATRIX& m, float out[4])
+	{
+		for (int c = 0; c < 4; ++c)
+			out[c] = point[0] * m.data[c] + point[1] * m.data[4 + c] + point[2] * m.data[8 + c] + m.data[12 + c];
+	}
+
+	// (x, y, z) * upper 3x3 of m
+	inline void TransformNormal(const float normal[3], const MATRIX& m, float out[3])
+	{
+		for (int c = 0; c < 3; ++c)
+			out[c] = normal[0] * m.data[c] + normal[1] * m.data[4 + c] + normal[2] * m.data[8 + c];
+	}
+
+	// GW::MATH::GMatrix::LookAtLHF
+	inline MATRIX LookAtLH(const FLOAT3& eye, const FLOAT3& target, const FLOAT3& up)
+	{
+		FLOAT3 zAxis = Normalize(Subtract(target, eye));
+		FLOAT3 xAxis = Normalize(Cross(up, zAxis));
+		FLOAT3 yAxis = Cross(zAxis, xAxis);
+		MATRIX view = { {
+			xAxis.x, yAxis.x, zAxis.x, 0,
+			xAxis.y, yAxis.y, zAxis.y, 0,
+			xAxis.z, yAxis.z, zAxis.z, 0,
+			-Dot(xAxis, eye), -Dot(yAxis, eye), -Dot(zAxis, eye), 1 } };
+		return view;
+	}
+
+	// GW::MATH::GMatrix::ProjectionDirectXLHF, depth 0..1
+	inline MATRIX PerspectiveLH(float fovY, float aspectRatio, float nearPlane, float farPlane)
+	{
+		float yScale = 1.0f / std::tan(fovY * 0.5f);
+		float xScale = yScale / aspectRatio;
+		float depth = farPlane / (farPlane - nearPlane);
+		MATRIX projection = { {
+			xScale, 0, 0, 0,
+			0, yScale, 0, 0,
+			0, 0, depth, 1,
+			0, 0, -nearPlane * depth, 0 } };
+		return projection;
+	}
+}
+#endif
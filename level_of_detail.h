@@ -0,0 +1,147 @@
+#ifndef _LEVEL_OF_DETAIL_H_
+#define _LEVEL_OF_DETAIL_H_
+// Simplified versions of an asset drawn in its place once it is small on screen.
+// GenerateLods runs mesh_simplifier.h over the asset's meshes at falling triangle
+// targets and appends each level's vertices and indices to the asset's own, so
+// the geometry pool, COMPACT packing and the GPU see one bigger asset and a
+// level is only another index range per mesh (same material, same batch order).
+// SelectLod picks the coarsest level whose error, projected with the camera's
+// field of view, stays under a fraction of the screen height.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "h2bParser.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+namespace Level {
+
+	// the base mesh plus up to 3 simplified levels
+	static const unsigned MAX_LODS = 4;
+
+	struct LOD_OPTIONS {
+		unsigned levels = MAX_LODS - 1;	// simplified levels to try
+		float reduction = 0.5f;		// each level aims for this fraction of the previous level's triangles
+		float minReduction = 0.8f;	// a level keeping more than this fraction is dropped and ends the chain
+		unsigned minTriangles = 64;	// smaller assets and levels are not simplified further
+		float maxError = 0.1f;		// largest error a level may have, relative to the asset's bounding radius
+	};
+
+	struct ASSET_LODS {
+		unsigned count = 1;		// levels, 1 is the base mesh only
+		unsigned meshCount = 0;
+		std::vector<H2B::BATCH> ranges;	// count * meshCount, level 0 is the meshes' own drawInfo
+		unsigned triangles[MAX_LODS] = {};
+		float error[MAX_LODS] = {};	// relative to the bounding radius, grows with the level
+		unsigned vertices = 0;		// vertices the simplified levels added to the asset
+
+		const H2B::BATCH& Range(unsigned lod, unsigned mesh) const {
+			return ranges[std::min(lod, count - 1) * meshCount + mesh];
+		}
+	};
+
+	struct LOD_SELECTION {
+		// largest error allowed on screen, as a fraction of the screen height (about 1 pixel at 1080p)
+		float screenError = 0.001f;
+		// a coarser level has to fit (1 - hysteresis) of the limit, the current one may
+		// use up to (1 + hysteresis) before a finer level comes back
+		float hysteresis = 0.25f;
+	};
+
+	// per frame counters of the visible instances
+	struct LOD_STATS {
+		unsigned instances[MAX_LODS];	// visible instances drawn at each level
+		unsigned switches;				// instances whose level changed this frame
+		unsigned long long triangles;	// triangles submitted
+		unsigned long long baseTriangles;	// what the same instances cost at level 0
+	};
+
+	// level 0 only, what every asset has before (or without) GenerateLods
+	inline void BaseLods(const H2B::Parser& model, ASSET_LODS& lods)
+	{
+		lods = ASSET_LODS();
+		lods.meshCount = static_cast<unsigned>(model.meshes.size());
+		for (const H2B::MESH& mesh : model.meshes) {
+			lods.ranges.push_back(mesh.drawInfo);
+			lods.triangles[0] += mesh.drawInfo.indexCount / 3;
+		}
+	}
+
+	// Appends up to options.levels simplified levels to model's vertices/indices
+	// and describes them in lods. Returns the level count (1 if nothing was worth simplifying).
+	inline unsigned GenerateLods(H2B::Parser& model, ASSET_LODS& lods, const LOD_OPTIONS& options = LOD_OPTIONS())
+	{
+		BaseLods(model, lods);
+		if (lods.meshCount == 0 || lods.triangles[0] < options.minTriangles || model.vertices.empty())
+			return lods.count;
+		float low[3] = { model.vertices[0].pos.x, model.vertices[0].pos.y, model.vertices[0].pos.z };
+		float high[3] = { low[0], low[1], low[2] };
+		for (const H2B::VERTEX& vertex : model.vertices) {
+			const float p[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+			for (int i = 0; i < 3; ++i) {
+				low[i] = std::min(low[i], p[i]);
+				high[i] = std::max(high[i], p[i]);
+			}
+		}
+		const float radius = 0.5f * std::sqrt((high[0] - low[0]) * (high[0] - low[0]) +
+			(high[1] - low[1]) * (high[1] - low[1]) + (high[2] - low[2]) * (high[2] - low[2]));
+		MeshSimplifier simplifier;
+		if (radius <= 0.0f || simplifier.Begin(model, lods.ranges) == false)
+			return lods.count;
+
+		std::vector<H2B::VERTEX> vertices;
+		std::vector<unsigned> indices;
+		std::vector<H2B::BATCH> ranges;
+		unsigned previous = lods.triangles[0];
+		for (unsigned level = 1; level <= options.levels && level < MAX_LODS; ++level) {
+			unsigned target = static_cast<unsigned>(previous * options.reduction);
+			if (target < options.minTriangles)
+				break;
+			unsigned left = simplifier.Simplify(target, options.maxError * radius);
+			if (left == 0 || left > previous * options.minReduction)
+				break;
+			simplifier.Extract(vertices, indices, ranges);
+
+			// the level's indices are relative to the asset like the base mesh's
+			const unsigned baseVertex = static_cast<unsigned>(model.vertices.size());
+			const unsigned baseIndex = static_cast<unsigned>(model.indices.size());
+			model.vertices.insert(model.vertices.end(), vertices.begin(), vertices.end());
+			for (unsigned index : indices)
+				model.indices.push_back(baseVertex + index);
+			for (H2B::BATCH& range : ranges) {
+				range.indexOffset += baseIndex;
+				OptimizeVertexCache(model.indices.data() + range.indexOffset, range.indexCount);
+				lods.ranges.push_back(range);
+			}
+			lods.triangles[level] = left;
+			lods.error[level] = simplifier.Error() / radius;
+			lods.vertices += static_cast<unsigned>(vertices.size());
+			lods.count = level + 1;
+			previous = left;
+		}
+		model.vertexCount = static_cast<unsigned>(model.vertices.size());
+		model.indexCount = static_cast<unsigned>(model.indices.size());
+		return lods.count;
+	}
+
+	// bounding sphere radius on screen as a fraction of the screen height, projectionScale is the
+	// projection's y scale (1 / tan(fovY / 2)), inside the sphere counts as at its surface
+	inline float ScreenRadius(float radius, float viewDepth, float projectionScale)
+	{
+		return 0.5f * radius * projectionScale / std::max(viewDepth, radius);
+	}
+
+	// coarsest level whose error fits on screen, current is the level used last frame
+	inline unsigned SelectLod(const ASSET_LODS& lods, float screenRadius, unsigned current, const LOD_SELECTION& selection)
+	{
+		unsigned lod = 0;
+		for (unsigned k = 1; k < lods.count; ++k) {
+			float limit = selection.screenError * (k <= current ? 1.0f + selection.hysteresis : 1.0f - selection.hysteresis);
+			if (lods.error[k] * screenRadius > limit)
+				break;
+			lod = k;
+		}
+		return lod;
+	}
+}
+#endif
@@ -0,0 +1,211 @@
+#ifndef _LEVEL_STREAMING_H_
+#define _LEVEL_STREAMING_H_
+// Loads the next level on a background thread while the current one keeps
+// rendering. Parsing, .h2b loading, bounds/BVH and instance batching all
+// happen on the worker; only the GPU upload runs on the render thread, in
+// BeginFrame, which swaps the finished level in before the frame is drawn.
+// The replaced level stays alive until no frame still in flight can
+// reference its buffers.
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "load_object_oriented.h"
+#include "render_backend.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Level {
+
+	class LevelStreamer
+	{
+	public:
+		enum class STATE { IDLE, LOADING, READY, FAILED, CANCELLED };
+		// frames the GPU may still be working on after they were submitted
+		static const unsigned FRAMES_IN_FLIGHT = 3;
+
+	private:
+		struct RETIRED {
+			std::unique_ptr<Level_Objects> level;
+			unsigned long long lastFrame;	// last frame that drew it
+		};
+
+		std::thread worker;
+		std::unique_ptr<Level_Objects> pending;
+		LOAD_PROGRESS progress;
+		std::atomic<STATE> state{ STATE::IDLE };
+		std::string pendingPath;
+		std::vector<RETIRED> retired;
+		unsigned long long frame = 0;
+		JobSystem* jobs = nullptr;
+		VERTEX_FORMAT vertexFormat = VERTEX_FORMAT::FULL;
+		bool levelOfDetail = false;
+		bool staticBatching = false;
+		bool occlusionCulling = false;
+		bool clusteredLighting = true;
+
+		// loading should never take time slices from the render thread
+		static void LowerThreadPriority()
+		{
+#if defined(_WIN32)
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+			setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+		}
+
+		// joins a worker that has finished (or been told to stop) and drops its level
+		void Reap()
+		{
+			if (worker.joinable())
+				worker.join();
+			pending.reset();
+		}
+
+	public:
+		LevelStreamer() = default;
+		LevelStreamer(const LevelStreamer&) = delete;
+		LevelStreamer& operator=(const LevelStreamer&) = delete;
+		~LevelStreamer() {
+			Flush();
+		}
+
+		// starts loading a level in the background, a load already running is cancelled first
+		// LOG is copied to the worker, see Level_Objects::LoadLevel
+		template<typename LOG>
+		void Request(const std::string& gameLevelPath, const std::string& h2bFolderPath, LOG log)
+		{
+			progress.cancel = true;
+			Reap();
+			progress.done = 0;
+			progress.total = 0;
+			progress.cancel = false;
+			pending.reset(new Level_Objects());
+			pending->SetJobSystem(jobs);
+			pending->SetVertexFormat(vertexFormat);
+			pending->SetLevelOfDetail(levelOfDetail);
+			pending->SetStaticBatching(staticBatching);
+			pending->SetOcclusionCulling(occlusionCulling);
+			pending->SetClusteredLighting(clusteredLighting);
+			pendingPath = gameLevelPath;
+			state = STATE::LOADING;
+			Level_Objects* level = pending.get();
+			worker = std::thread([this, level, gameLevelPath, h2bFolderPath, log]() mutable {
+				LowerThreadPriority();
+				LEVEL_PROFILE_THREAD("level loader");
+				bool loaded = level->LoadLevel(gameLevelPath.c_str(), h2bFolderPath.c_str(), log, &progress);
+				state = loaded ? STATE::READY : progress.cancel ? STATE::CANCELLED : STATE::FAILED;
+			});
+		}
+
+		// job system handed to the levels loaded from now on, it must outlive them
+		void SetJobSystem(JobSystem* system) {
+			jobs = system;
+		}
+		// vertex layout of the levels loaded from now on, see Level_Objects::SetVertexFormat
+		void SetVertexFormat(VERTEX_FORMAT format) {
+			vertexFormat = format;
+		}
+		// levels of detail for the levels loaded from now on, see Level_Objects::SetLevelOfDetail
+		void SetLevelOfDetail(bool enabled) {
+			levelOfDetail = enabled;
+		}
+		// static batches for the levels loaded from now on, see Level_Objects::SetStaticBatching
+		void SetStaticBatching(bool enabled) {
+			staticBatching = enabled;
+		}
+		// occluders for the levels loaded from now on, see Level_Objects::SetOcclusionCulling
+		void SetOcclusionCulling(bool enabled) {
+			occlusionCulling = enabled;
+		}
+		// point and spot lights for the levels loaded from now on, see Level_Objects::SetClusteredLighting
+		void SetClusteredLighting(bool enabled) {
+			clusteredLighting = enabled;
+		}
+
+		// asks the running load to stop, does not wait for it (BeginFrame cleans up)
+		void Cancel() {
+			progress.cancel = true;
+		}
+
+		// Call once per frame before drawing. Frees retired levels that are out of
+		// flight, and if a load finished uploads it and swaps it into current.
+		// Returns true on the frame the level changed.
+		bool BeginFrame(RenderBackend& backend, std::unique_ptr<Level_Objects>& current)
+		{
+			++frame;
+			for (size_t i = 0; i < retired.size();) {
+				if (frame > retired[i].lastFrame + FRAMES_IN_FLIGHT) {
+					retired[i].level->UnloadLevel();
+					retired[i] = std::move(retired.back());
+					retired.pop_back();
+				}
+				else
+					++i;
+			}
+
+			STATE now = state;
+			if (now == STATE::FAILED || now == STATE::CANCELLED) {
+				Reap();
+				return false;
+			}
+			if (now != STATE::READY)
+				return false;
+			if (worker.joinable())
+				worker.join();
+			pending->UploadLevelToGPU(backend);
+			if (current)
+				retired.push_back({ std::move(current), frame - 1 });
+			current = std::move(pending);
+			state = STATE::IDLE;
+			return true;
+		}
+
+		// cancels any load and frees every retired level now, the GPU must be idle
+		void Flush()
+		{
+			progress.cancel = true;
+			Reap();
+			if (state == STATE::LOADING || state == STATE::READY)
+				state = STATE::CANCELLED;
+			for (RETIRED& old : retired)
+				old.level->UnloadLevel();
+			retired.clear();
+		}
+
+		STATE State() const {
+			return state;
+		}
+		// fraction of the MESH records loaded, 1 once the level is ready to swap
+		float Progress() const
+		{
+			STATE now = state;
+			if (now == STATE::READY)
+				return 1.0f;
+			unsigned total = progress.total;
+			return now == STATE::LOADING && total > 0 ? static_cast<float>(progress.done) / total : 0.0f;
+		}
+		bool Loading() const {
+			STATE now = state;
+			return now == STATE::LOADING || now == STATE::READY;
+		}
+		// level being loaded (or the last one requested)
+		const std::string& PendingPath() const {
+			return pendingPath;
+		}
+		size_t RetiredCount() const {
+			return retired.size();
+		}
+	};
+}
+#endif
@@ -1,10 +1,44 @@
+#ifndef _LOAD_OBJECT_ORIENTED_H_
+#define _LOAD_OBJECT_ORIENTED_H_
 // This is a sample of how to load a level in a object oriented fashion.
 // Feel free to use this code as a base and tweak it for your needs.
+// All GPU work goes through Level::RenderBackend so this file has no Gateware/D3D
+// dependency, the renderer passes a D3D11Backend and the headless tools a RecordingBackend.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 // This reads .h2b files which are optimized binary .obj+.mtl files
 #include "h2bParser.h"
+// Game level text reader and the shared .h2b asset cache
+#include "level_file.h"
+#include "level_binary.h"
+#include "asset_cache.h"
+#include "geometry_pool.h"
+#include "vertex_format.h"
+#include "instancing.h"
+#include "level_of_detail.h"
+#include "static_batching.h"
+#include "culling.h"
+#include "batch_math.h"
+#include "occlusion.h"
+#include "clustered_lights.h"
+#include "scene_store.h"
+#include "render_backend.h"
+#include "render_queue.h"
+#include "constant_ring.h"
+#include "command_list.h"
+#include "scene_constants.h"
+#include "job_system.h"
+#include "profiler.h"
 
-void PrintLabeledDebugString(const char* label, const char* toPrint)
+inline void PrintLabeledDebugString(const char* label, const char* toPrint)
 {
 	std::cout << label << toPrint << std::endl;
 #if defined WIN32 //OutputDebugStringA is a windows-only function 
@@ -13,426 +47,1379 @@ void PrintLabeledDebugString(const char* label, const char* toPrint)
 #endif
 }
 
-// Pipeline/State Objects
-struct PipelineHandles
-{
-	ID3D11DeviceContext* context;
-	ID3D11RenderTargetView* targetView;
-	ID3D11DepthStencilView* depthStencil;
-};
+namespace Level {
+	// shared between LoadLevel and another thread watching or cancelling it
+	struct LOAD_PROGRESS {
+		std::atomic<unsigned> done{ 0 };	// MESH records processed
+		std::atomic<unsigned> total{ 0 };	// MESH records in the level, 0 until the file is read
+		std::atomic<bool> cancel{ false };	// LoadLevel stops at the next record and returns false
+	};
 
-// Uniform/ShaderVariable Buffer
-struct SceneData
-{
-	GW::MATH::GVECTORF sunAmbient, cameraPos;
-	GW::MATH::GVECTORF lightDirc, lightColor;// lighting info
-	GW::MATH::GMATRIXF vMatrix, pMatrix; // viewing info
-};
+	// what the last RenderLevel wrote to the GPU, materials only go up once per level
+	struct UPLOAD_STATS {
+		unsigned long long constantBytes;		// per draw constants written to the ring
+		unsigned long long instanceBytes;		// world matrices, only when the visible set changed
+		unsigned long long lightBytes;			// cluster constants, ranges and light lists
+		unsigned long long materialTableBytes;	// written by UploadLevelToGPU
+	};
+}
 
+// Uniform/ShaderVariable Buffer (b1), one constant ring slot per draw (Level::MESH_CONSTANTS)
 struct MeshData
 {
-	GW::MATH::GMATRIXF wMatrix;
-	// connect to the h2b material
-	H2B::ATTRIBUTES h2b_attrib;
+	Level::MATRIX wMatrix;
+	// connect to the h2b material, index into the level's material table (t0)
+	unsigned materialIndex = 0;
+	// the asset's position bounds (t1), only read by COMPACT vertex shaders
+	unsigned boundsIndex = 0;
+	unsigned padding[2] = {};
+};
+
+// shaders + input layout used by the level
+static const Level::PIPELINE_DESC MODEL_PIPELINE = { "../Shaders/VertexShader.hlsl", "../Shaders/PixelShader.hlsl", false, false };
+static const Level::PIPELINE_DESC INSTANCED_PIPELINE = { "../Shaders/VertexShader.hlsl", "../Shaders/PixelShader.hlsl", true, false };
+// same shaders reading Level::COMPACT_VERTEX
+static const Level::PIPELINE_DESC COMPACT_MODEL_PIPELINE = { "../Shaders/VertexShader.hlsl", "../Shaders/PixelShader.hlsl", false, true };
+static const Level::PIPELINE_DESC COMPACT_INSTANCED_PIPELINE = { "../Shaders/VertexShader.hlsl", "../Shaders/PixelShader.hlsl", true, true };
+
+// where one cached .h2b asset's geometry lives in the level's shared buffers
+// (Level::GeometryPool), shared by every Model that places it
+struct ModelAssetBuffers {
+	// Vertex Buffer (the pool page holding the asset)
+	Level::BufferHandle vertexBuffer = Level::INVALID_BUFFER;
+	// Index Buffer (same page)
+	Level::BufferHandle microsoftIndexBuffer = Level::INVALID_BUFFER;
+	unsigned page = 0;
+	// the asset's indices start at firstIndex and point baseVertex vertices further
+	unsigned firstIndex = 0;
+	int baseVertex = 0;
+	// H2B::VERTEX or Level::COMPACT_VERTEX, 32 or 16 bit indices
+	unsigned vertexStride = sizeof(H2B::VERTEX);
+	Level::INDEX_FORMAT indexFormat = Level::INDEX_FORMAT::UINT32;
+
+	void Locate(const Level::GeometryPool& geometry, Level::AssetHandle asset)
+	{
+		const Level::GEOMETRY_RANGE& range = geometry.Range(asset);
+		page = range.page;
+		vertexBuffer = geometry.VertexBuffer(range.page);
+		microsoftIndexBuffer = geometry.IndexBuffer(range.page);
+		firstIndex = range.firstIndex;
+		baseVertex = static_cast<int>(range.baseVertex);
+		vertexStride = geometry.VertexStride();
+		indexFormat = range.indexBytes == 2 ? Level::INDEX_FORMAT::UINT16 : Level::INDEX_FORMAT::UINT32;
+	}
 };
 
 class Model {
 	// Name of the Model in the GameLevel (useful for debugging)
 	std::string name;
-	// Shader variables needed by this model. 
-	// Loads and stores CPU model data from .h2b file
-	H2B::Parser cpuModel; // reads the .h2b format
+	// Shader variables needed by this model.
+	// The CPU model data lives once in the level's Level::AssetCache
+	Level::AssetHandle asset = Level::INVALID_ASSET;
+
+	Level::MATRIX world;// TODO: Add matrix/light/etc vars..
 
-	GW::MATH::GMATRIXF world;// TODO: Add matrix/light/etc vars..
-	
 public:
 	// TODO: API Rendering vars here (unique to this model)
 
-	// Vertex Buffer
-	Microsoft::WRL::ComPtr<ID3D11Buffer>		vertexBuffer;
-	
-	// Vertex/Pixel Shaders
-	Microsoft::WRL::ComPtr<ID3D11VertexShader>	vertexShader;
-	Microsoft::WRL::ComPtr<ID3D11PixelShader>	pixelShader;
-	Microsoft::WRL::ComPtr<ID3D11InputLayout>	vertexFormat;
-	
-	// Index Buffer
-	Microsoft::WRL::ComPtr<ID3D11Buffer> microsoftIndexBuffer;
-	
-	// mesh data buffer
-	Microsoft::WRL::ComPtr<ID3D11Buffer> meshDataBuffer;
-
-	GW::MATH::GMATRIXF view;		  // view matrix
-	GW::MATH::GMATRIXF projection;	  // projection matrix
-	GW::MATH::GMATRIXF rotatedWorld;  // rotate world
+	// Vertex/Pixel Shaders + input layout (shared by every Model)
+	Level::PipelineHandle pipeline = Level::INVALID_PIPELINE;
 
 	// structs 
-	SceneData _sceneData;			  // struct accessors
 	MeshData _meshData;				  // struct accessors
 
 	inline void SetName(std::string modelName) {
 		name = modelName;
 	}
-	inline void SetWorldMatrix(GW::MATH::GMATRIXF worldMatrix) {
+	inline void SetWorldMatrix(const Level::MATRIX& worldMatrix) {
 		world = worldMatrix;
 		_meshData.wMatrix = world;
 	}
-	bool LoadModelDataFromDisk(const char* h2bPath) {
-		// if this succeeds "cpuModel" should now contain all the model's info
-		return cpuModel.Parse(h2bPath);
+	inline void SetAsset(Level::AssetHandle handle) {
+		asset = handle;
+	}
+	inline Level::AssetHandle GetAsset() const {
+		return asset;
 	}
-	bool UploadModelData2GPU(ID3D11Device* creator) /*specific API device for loading*/{
+	inline const Level::MATRIX& GetWorldMatrix() const {
+		return world;
+	}
+	bool UploadModelData2GPU(Level::RenderBackend& backend, const Level::PIPELINE_DESC& pipelineDesc) /*specific API device for loading*/{
 		// TODO: Use chosen API to upload this model's graphics data to GPU
-		
-		InitializePipeline(creator);
+		// (vertex/index buffers belong to the shared asset, see ModelAssetBuffers,
+		// the world matrix goes through the level's constant ring when drawing)
 
-		CreateVertexBuffer(creator, cpuModel.vertices.data(), sizeof(H2B::VERTEX) * cpuModel.vertexCount);
-		
-		CreateIndexBuffer(creator, cpuModel.indices.data(), sizeof(unsigned int) * cpuModel.indexCount);
-
-		CreateMeshBuffer(creator);
+		InitializePipeline(backend, pipelineDesc);
 
 		return true; 
 
 	}
-	void InitializePipeline(ID3D11Device* creator)
+	// shaders and input layout are shared, the backend hands every Model the same pipeline
+	void InitializePipeline(Level::RenderBackend& backend, const Level::PIPELINE_DESC& pipelineDesc)
 	{
-		UINT compilerFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if _DEBUG
-		compilerFlags |= D3DCOMPILE_DEBUG;
-#endif
-		Microsoft::WRL::ComPtr<ID3DBlob> vsBlob = CompileVertexShader(creator, compilerFlags);
-		Microsoft::WRL::ComPtr<ID3DBlob> psBlob = CompilePixelShader(creator, compilerFlags);
-
-		CreateVertexInputLayout(creator, vsBlob);
+		pipeline = backend.CreatePipeline(pipelineDesc);
 	}
-	Microsoft::WRL::ComPtr<ID3DBlob> CompileVertexShader(ID3D11Device* creator, UINT compilerFlags)
-	{
-		std::string vertexShaderSource = ReadFileIntoString("../Shaders/VertexShader.hlsl");
-
-		Microsoft::WRL::ComPtr<ID3DBlob> vsBlob, errors;
-
-		HRESULT compilationResult =
-			D3DCompile(vertexShaderSource.c_str(), vertexShaderSource.length(),
-				nullptr, nullptr, nullptr, "main", "vs_4_0", compilerFlags, 0,
-				vsBlob.GetAddressOf(), errors.GetAddressOf());
 
-		if (SUCCEEDED(compilationResult))
-		{
-			creator->CreateVertexShader(vsBlob->GetBufferPointer(),
-				vsBlob->GetBufferSize(), nullptr, vertexShader.GetAddressOf());
-		}
-		else
-		{
-			PrintLabeledDebugString("Vertex Shader Errors:\n", (char*)errors->GetBufferPointer());
-			abort();
-			return nullptr;
-		}
+	// firstMaterial is where the asset's materials start in the level's material table,
+	// lod picks which of the asset's levels of detail is drawn
+	bool DrawModel(Level::RenderBackend& backend, const H2B::Parser& cpuModel, const Level::ASSET_LODS& lods, unsigned lod,
+		const ModelAssetBuffers& buffers, Level::ConstantRing& constants, unsigned firstMaterial) /*specific API command list or context*/{
+		// TODO: Use chosen API to setup the pipeline for this model and draw it
+		SetUpPipeline(backend, buffers);
 
-		return vsBlob;
+		for (unsigned i = 0; i < cpuModel.meshCount; i++)
+			DrawMesh(backend, cpuModel, buffers, i, lods.Range(lod, i), constants, firstMaterial);
+		return true;
 	}
 
-	Microsoft::WRL::ComPtr<ID3DBlob> CompilePixelShader(ID3D11Device* creator, UINT compilerFlags)
+	// one sub-mesh (drawInfo is its index range at the level drawn), SetUpPipeline must have
+	// been called for this model. only the world matrix and a material index go up, into the next slot of the ring
+	void DrawMesh(Level::RenderBackend& backend, const H2B::Parser& cpuModel, const ModelAssetBuffers& buffers,
+		unsigned meshIndex, const H2B::BATCH& drawInfo, Level::ConstantRing& constants, unsigned firstMaterial)
 	{
-		std::string pixelShaderSource = ReadFileIntoString("../Shaders/PixelShader.hlsl");
-
-		Microsoft::WRL::ComPtr<ID3DBlob> psBlob, errors;
-
-		HRESULT compilationResult =
-			D3DCompile(pixelShaderSource.c_str(), pixelShaderSource.length(),
-				nullptr, nullptr, nullptr, "main", "ps_4_0", compilerFlags, 0,
-				psBlob.GetAddressOf(), errors.GetAddressOf());
+		_meshData.wMatrix = world;
+		_meshData.materialIndex = firstMaterial + cpuModel.meshes[meshIndex].materialIndex;
+		_meshData.boundsIndex = asset;
 
-		if (SUCCEEDED(compilationResult))
-		{
-			creator->CreatePixelShader(psBlob->GetBufferPointer(),
-				psBlob->GetBufferSize(), nullptr, pixelShader.GetAddressOf());
-		}
-		else
-		{
-			PrintLabeledDebugString("Pixel Shader Errors:\n", (char*)errors->GetBufferPointer());
-			abort();
-			return nullptr;
-		}
+		unsigned offset = constants.Allocate();
+		constants.Write(backend, offset, &_meshData, sizeof(_meshData));
+		constants.Bind(backend, 1, offset, Level::STAGE_VERTEX_PIXEL);
 
-		return psBlob;
+		backend.DrawIndexed(drawInfo.indexCount, buffers.firstIndex + drawInfo.indexOffset, buffers.baseVertex);
 	}
-	// attributes
-	void CreateVertexInputLayout(ID3D11Device* creator, Microsoft::WRL::ComPtr<ID3DBlob>& vsBlob)
+
+	void SetUpPipeline(Level::RenderBackend& backend, const ModelAssetBuffers& buffers)
 	{
-		// TODO: Part 1E 
-		D3D11_INPUT_ELEMENT_DESC attributes[3];
-
-		attributes[0].SemanticName = "POSITION";
-		attributes[0].SemanticIndex = 0;
-		attributes[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		attributes[0].InputSlot = 0;
-		attributes[0].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-		attributes[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-		attributes[0].InstanceDataStepRate = 0;
-
-		attributes[1].SemanticName = "LOCATION";
-		attributes[1].SemanticIndex = 0;
-		attributes[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		attributes[1].InputSlot = 0;
-		attributes[1].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-		attributes[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-		attributes[1].InstanceDataStepRate = 0;
-
-		attributes[2].SemanticName = "NORMAL";
-		attributes[2].SemanticIndex = 0;
-		attributes[2].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		attributes[2].InputSlot = 0;
-		attributes[2].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-		attributes[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-		attributes[2].InstanceDataStepRate = 0;
-
-		creator->CreateInputLayout(attributes, ARRAYSIZE(attributes),
-			vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
-			vertexFormat.GetAddressOf());
+		SetVertexAndIndexBuffers(backend, buffers);
+		SetShaders(backend);
 	}
-	
-	// mesh buffer
-	void CreateMeshBuffer(ID3D11Device* creator) {
 
-		D3D11_BUFFER_DESC bufferMesh = { 0 };
-		bufferMesh.Usage = D3D11_USAGE_DEFAULT;
-		bufferMesh.ByteWidth = sizeof(_meshData);
-		bufferMesh.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		bufferMesh.CPUAccessFlags = 0;
-		bufferMesh.MiscFlags = 0;
-		bufferMesh.StructureByteStride = 0;
-		creator->CreateBuffer(&bufferMesh, nullptr, meshDataBuffer.GetAddressOf());
+	void SetVertexAndIndexBuffers(Level::RenderBackend& backend, const ModelAssetBuffers& buffers)
+	{
+		const unsigned strides[] = { buffers.vertexStride };
+		const unsigned offsets[] = { 0 };
+		const Level::BufferHandle buffs[] = { buffers.vertexBuffer };
+		backend.SetVertexBuffers(0, 1, buffs, strides, offsets);
+		backend.SetIndexBuffer(buffers.microsoftIndexBuffer, buffers.indexFormat, 0);
 
 	}
 
-	// index buffer
-	void CreateIndexBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes)
+	void SetShaders(Level::RenderBackend& backend)
 	{
-		D3D11_BUFFER_DESC bufferIndex;
-		bufferIndex.Usage = D3D11_USAGE_IMMUTABLE;
-		bufferIndex.ByteWidth = sizeInBytes;
-		bufferIndex.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		bufferIndex.CPUAccessFlags = 0;
-		bufferIndex.MiscFlags = 0;
-		bufferIndex.StructureByteStride = 0;
-		
-		D3D11_SUBRESOURCE_DATA bData = { data, 0, 0 };
-		
-		creator->CreateBuffer(&bufferIndex, &bData, microsoftIndexBuffer.GetAddressOf());
-
-		//CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_INDEX_BUFFER);
-		//creator->CreateBuffer(&bDesc, &bData, microsoftIndexBuffer.GetAddressOf());
+		backend.SetPipeline(pipeline);
 	}
 
-	// vertex buffer
-	void CreateVertexBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes)
-	{
-		D3D11_BUFFER_DESC bufferVert;
-		bufferVert.Usage = D3D11_USAGE_IMMUTABLE;
-		bufferVert.ByteWidth = sizeInBytes;
-		bufferVert.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		bufferVert.CPUAccessFlags = 0;
-		bufferVert.MiscFlags = 0;
-		bufferVert.StructureByteStride = 0;
-	
-		D3D11_SUBRESOURCE_DATA bData = { data, 0, 0 };
-		
-		creator->CreateBuffer(&bufferVert, &bData, vertexBuffer.GetAddressOf());
 
-		//CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_VERTEX_BUFFER);
-		//creator->CreateBuffer(&bDesc, &bData, vertexBuffer.GetAddressOf());
-	}
+	//bool FreeResources(/*specific API device for unloading*/) {
+	//	// TODO: Use chosen API to free all GPU resources used by this model
 
-	bool DrawModel(PipelineHandles curHandles) /*specific API command list or context*/{
-		// TODO: Use chosen API to setup the pipeline for this model and draw it
-		SetUpPipeline(curHandles);
+	//	return true;
+	//}
+};
 
-		//D3D11_MAPPED_SUBRESOURCE meshMapping = { 0 }; 
-		
-		_meshData.wMatrix = world;
-		for (int i = 0; i < cpuModel.meshCount; i++)	
-		{
-			//curHandles.context->Map(meshDataBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &meshMapping);
-			//memcpy(meshMapping.pData, &_meshData, sizeof(_meshData));
-			//curHandles.context->Unmap(meshDataBuffer.Get(), 0);
 
-			_meshData.h2b_attrib = cpuModel.materials[cpuModel.meshes[i].materialIndex].attrib;
+// Draws every instance of an asset's sub-mesh with one DrawIndexedInstanced.
+// World matrices are streamed through a per-instance vertex buffer (input slot 1)
+// and VertexShader.hlsl is compiled with USE_INSTANCING to read them from there.
+struct InstancedDrawPath {
+	// Vertex/Pixel Shaders + instanced input layout
+	Level::PipelineHandle pipeline = Level::INVALID_PIPELINE;
 
-			// easier way to map and unmap information
-			curHandles.context->UpdateSubresource(meshDataBuffer.Get(), 0, nullptr, &_meshData, 0, 0);
-			
-			curHandles.context->DrawIndexed(cpuModel.meshes[i].drawInfo.indexCount, cpuModel.meshes[i].drawInfo.indexOffset, 0);
-		}	
-		return true;
-	}
+	// per instance world matrices
+	Level::BufferHandle instanceBuffer = Level::INVALID_BUFFER;
 
-	void SetUpPipeline(PipelineHandles handles)
-	{
-		SetVertexAndIndexBuffers(handles);
-		SetShaders(handles);
+	// groups + packed matrices for the current level
+	Level::InstanceBatcher batcher;
+	// material of the last group drawn and the ring slot that holds its index
+	struct BOUND_MATERIAL {
+		unsigned material = 0xFFFFFFFF;
+		unsigned offset = 0;
+	};
+	BOUND_MATERIAL lastMaterial;
 
-		handles.context->IASetInputLayout(vertexFormat.Get());
-		handles.context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	// CPU half of the upload, groups every instance of the level (safe off the render thread)
+	void Prepare(const std::vector<Level::INSTANCE>& instances, const Level::AssetCache& assets, Level::JobSystem* jobs = nullptr)
+	{
+		batcher.Build(instances, assets, jobs);
+	}
 
-		handles.context->VSSetConstantBuffers(1, 1, meshDataBuffer.GetAddressOf());
-		handles.context->PSSetConstantBuffers(1, 1, meshDataBuffer.GetAddressOf());
+	// GPU half, creates the buffers for the groups Prepare built
+	void Upload(Level::RenderBackend& backend, const Level::PIPELINE_DESC& pipelineDesc)
+	{
+		pipeline = backend.CreatePipeline(pipelineDesc);
+		CreateInstanceBuffer(backend);
 	}
 
-	void SetVertexAndIndexBuffers(PipelineHandles handles)
+	// regroups the given (visible) instances and rewrites the instance buffer in place,
+	// the buffer was sized for every instance of the level by Upload
+	void Rebuild(Level::RenderBackend& backend, const std::vector<Level::INSTANCE>& instances, const Level::AssetCache& assets,
+		Level::JobSystem* jobs = nullptr)
 	{
-		const UINT strides[] = { sizeof(H2B::VERTEX)};
-		const UINT offsets[] = { 0 };
-		ID3D11Buffer* const buffs[] = { vertexBuffer.Get() };
-		handles.context->IASetVertexBuffers(0, ARRAYSIZE(buffs), buffs, strides, offsets);
-		handles.context->IASetIndexBuffer(microsoftIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+		batcher.Build(instances, assets, jobs);
+		if (!batcher.instanceData.empty())
+			backend.UpdateBuffer(instanceBuffer, batcher.instanceData.data(), static_cast<unsigned>(batcher.InstanceBufferBytes()));
+	}
 
+	// instance buffer, dynamic so a later pass can rewrite the visible instances per frame
+	void CreateInstanceBuffer(Level::RenderBackend& backend)
+	{
+		backend.ReleaseBuffer(instanceBuffer);
+		instanceBuffer = Level::INVALID_BUFFER;
+		if (batcher.instanceData.empty())
+			return;
+		Level::BUFFER_DESC bufferInstance = { Level::BUFFER_TYPE::VERTEX, Level::BUFFER_USAGE::DYNAMIC,
+			static_cast<unsigned>(batcher.InstanceBufferBytes()) };
+		instanceBuffer = backend.CreateBuffer(bufferInstance, batcher.instanceData.data());
 	}
 
-	void SetShaders(PipelineHandles handles)
+	// the world matrix comes from the instance buffer, so a group only writes its
+	// material and bounds index into a ring slot, and only when its material differs
+	// from the last group's (materials belong to one asset, so the bounds match too)
+	void BindMaterial(Level::RenderBackend& backend, Level::ConstantRing& constants, unsigned groupMaterial, unsigned boundsIndex,
+		BOUND_MATERIAL& last)
 	{
-		handles.context->VSSetShader(vertexShader.Get(), nullptr, 0);
-		handles.context->PSSetShader(pixelShader.Get(), nullptr, 0);
+		if (groupMaterial != last.material) {
+			const unsigned index[4] = { groupMaterial, boundsIndex, 0, 0 };
+			last.offset = constants.Allocate();
+			constants.Write(backend, last.offset + offsetof(MeshData, materialIndex), index, sizeof(index));
+			last.material = groupMaterial;
+		}
+		constants.Bind(backend, 1, last.offset, Level::STAGE_VERTEX_PIXEL);
 	}
 
+	// firstMaterial[asset] is where the asset's materials start in the level's material table
+	void Draw(Level::RenderBackend& backend, const std::vector<ModelAssetBuffers>& assetBuffers,
+		Level::ConstantRing& constants, const std::vector<unsigned>& firstMaterial)
+	{
+		if (batcher.groups.empty())
+			return;
+		backend.SetPipeline(pipeline);
 
-	//bool FreeResources(/*specific API device for unloading*/) {
-	//	// TODO: Use chosen API to free all GPU resources used by this model
+		// assets share pool pages, so buffers are only bound when the page changes
+		Level::BufferHandle bound = Level::INVALID_BUFFER;
+		ForgetMaterial();
+		for (const Level::INSTANCE_GROUP& group : batcher.groups)
+		{
+			const ModelAssetBuffers& buffers = assetBuffers[group.asset];
+			if (buffers.vertexBuffer != bound) {
+				const unsigned strides[] = { buffers.vertexStride, sizeof(Level::MATRIX) };
+				const unsigned offsets[] = { 0, 0 };
+				const Level::BufferHandle buffs[] = { buffers.vertexBuffer, instanceBuffer };
+				backend.SetVertexBuffers(0, 2, buffs, strides, offsets);
+				bound = buffers.vertexBuffer;
+			}
+			// assets on one page can still differ in index size
+			backend.SetIndexBuffer(buffers.microsoftIndexBuffer, buffers.indexFormat, 0);
+			BindMaterial(backend, constants, firstMaterial[group.asset] + group.materialIndex, group.asset, lastMaterial);
 
-	//	return true;
-	//}
-	
-	// Clears MESH/INDEX/VERTEX BUFFERS
-	void Mesh_Vert_Index_BuffClear() { // thx mr. fernandez for the notice of release
-		meshDataBuffer.ReleaseAndGetAddressOf();
-		microsoftIndexBuffer.ReleaseAndGetAddressOf();
-		vertexBuffer.ReleaseAndGetAddressOf();
+			backend.DrawIndexedInstanced(group.indexCount, group.instanceCount, buffers.firstIndex + group.indexOffset,
+				buffers.baseVertex, group.firstInstance);
+		}
+	}
+
+	// one group in any order, binds everything it needs so backend should be a
+	// Level::StateCache to drop the binds that are already in place.
+	// last is the material the group before it bound (runs recorded on other threads keep their own)
+	void DrawGroup(Level::RenderBackend& backend, const std::vector<ModelAssetBuffers>& assetBuffers,
+		Level::ConstantRing& constants, const std::vector<unsigned>& firstMaterial, const Level::INSTANCE_GROUP& group,
+		BOUND_MATERIAL& last)
+	{
+		const ModelAssetBuffers& buffers = assetBuffers[group.asset];
+		backend.SetPipeline(pipeline);
+		const unsigned strides[] = { buffers.vertexStride, sizeof(Level::MATRIX) };
+		const unsigned offsets[] = { 0, 0 };
+		const Level::BufferHandle buffs[] = { buffers.vertexBuffer, instanceBuffer };
+		backend.SetVertexBuffers(0, 2, buffs, strides, offsets);
+		backend.SetIndexBuffer(buffers.microsoftIndexBuffer, buffers.indexFormat, 0);
+		BindMaterial(backend, constants, firstMaterial[group.asset] + group.materialIndex, group.asset, last);
+		backend.DrawIndexedInstanced(group.indexCount, group.instanceCount, buffers.firstIndex + group.indexOffset,
+			buffers.baseVertex, group.firstInstance);
+	}
+	// the next group writes its material, call once per frame before the first DrawGroup
+	void ForgetMaterial() {
+		lastMaterial = BOUND_MATERIAL();
+	}
+
+	void Release(Level::RenderBackend& backend) {
+		backend.ReleaseBuffer(instanceBuffer);
+		instanceBuffer = Level::INVALID_BUFFER;
 	}
 };
 
 
 class Level_Objects {
 
-	// store all our models
-	std::list<Model> allObjectsInLevel;
-	// TODO: This could be a good spot for any global data like cameras or lights
+	// every placed instance of the level in load order (until something is removed),
+	// index i is also the BVH's instance i. Outside code holds InstanceHandles (FindInstance),
+	// unloading removes every instance so handles of a previous level never resolve again
+	Level::SceneStore scene;
+	// the per Model draw path, pointed at one instance at a time (its pipeline is shared by all of them)
+	Model modelPath;
+	// every unique .h2b used by the level, parsed once and shared by its Models
+	Level::AssetCache assetCache;
+	// every cached asset's vertices/indices packed into a few shared buffers,
+	// assetBuffers (indexed by Level::AssetHandle) says where each one went
+	Level::GeometryPool geometry{ sizeof(H2B::VERTEX), sizeof(unsigned) };
+	std::vector<ModelAssetBuffers> assetBuffers;
+	// COMPACT keeps each asset's packed copy (indexed by Level::AssetHandle) for the
+	// pool to upload and compact, plus every asset's position bounds in one buffer (t1)
+	Level::VERTEX_FORMAT vertexFormat = Level::VERTEX_FORMAT::FULL;
+	std::vector<Level::COMPACT_GEOMETRY> compactGeometry;
+	Level::BufferHandle boundsTable = Level::INVALID_BUFFER;
+	// one DrawIndexedInstanced per asset sub-mesh instead of a draw per Model
+	InstancedDrawPath instancedPath;
+	bool useInstancing = true;
+	bool batchesPrepared = false;	// instancedPath groups every instance, not a visible subset
+	// optional, spreads asset parsing, bounds and per frame culling/batching over threads
+	Level::JobSystem* jobs = nullptr;
+	// backend the level was uploaded with, used to free GPU data on unload
+	Level::RenderBackend* gpu = nullptr;
+	// object space bounds per asset, indexed by Level::AssetHandle
+	std::vector<Level::AABB> assetBounds;
+	// frustum culling against the camera given to SetViewProjection
+	Level::BoundingVolumeHierarchy bvh;
+	Level::FRUSTUM frustum;
+	bool hasCamera = false;
+	bool useCulling = true;
+	Level::CULL_STATS cullStats = {};
+	// simplified levels built at load and picked per visible instance (the scene's INSTANCE::lod) by screen size
+	bool useLevelOfDetail = false;
+	Level::LOD_OPTIONS lodOptions;
+	Level::LOD_SELECTION lodSelection;
+	Level::LOD_STATS lodStats = {};
+	float projectionScale = 0.0f;	// y scale of the camera's projection
+	bool lodChanged = false;		// an uploaded visible instance changed level
+	// instances baked into world space batches per material and grid cell (static_batching.h),
+	// drawn from their own geometry pool with constants written once at upload
+	bool useStaticBatching = false;
+	Level::STATIC_BATCH_OPTIONS staticOptions;
+	Level::StaticBatcher staticBatcher;
+	Level::GeometryPool staticGeometry{ sizeof(H2B::VERTEX), sizeof(unsigned) };
+	std::vector<ModelAssetBuffers> staticBuffers;		// indexed by batch
+	std::vector<Level::COMPACT_GEOMETRY> staticCompact;
+	Level::BoundingVolumeHierarchy staticBvh;
+	Level::BufferHandle staticConstants = Level::INVALID_BUFFER;	// a MeshData slot per batch
+	Level::PipelineHandle staticPipeline = Level::INVALID_PIPELINE;
+	Level::CULL_STATS staticCullStats = {};
+	std::vector<unsigned> visibleBatches;
+	// big walls and floors picked at load hide what is behind them (occlusion.h),
+	// tested after the frustum on the instances and static batches it kept
+	bool useOcclusion = false;
+	Level::OCCLUSION_OPTIONS occlusionOptions;
+	Level::OcclusionCuller occlusion;
+	bool occlusionRan = false;		// the last RenderLevel drew occluders
+	Level::MATRIX viewProjection = Level::IdentityMatrix();
+	Level::FLOAT3 cameraPosition = { 0.0f, 0.0f, 0.0f };
+	std::vector<unsigned> visible;
+	std::vector<unsigned> uploadedVisible;	// what the instance buffer currently holds
+	std::vector<Level::INSTANCE> visibleInstances;
+	// draws sorted by state and depth, submitted through a cache that drops redundant binds
+	struct QUEUED_DRAW {
+		unsigned model, mesh;
+	};
+	Level::RenderQueue renderQueue;
+	std::vector<QUEUED_DRAW> queuedDraws;
+	std::vector<float> assetDepth;		// farthest visible instance per asset, for translucent groups
+	Level::StateCache stateCache;
+	bool useRenderQueue = true;
+	// per draw world matrix + material index, sub-allocated every frame
+	Level::ConstantRing drawConstants;
+	// long sorted draw lists are recorded in runs on the job system's threads (command_list.h),
+	// each run points a model path of its own or tracks its own bound material
+	bool useParallelRecording = true;
+	Level::ParallelRecorder recorder;
+	std::vector<Model> runModels;
+	std::vector<InstancedDrawPath::BOUND_MATERIAL> runMaterials;
+	std::vector<unsigned> materialSlots;	// ring slots the sorted groups before each one take
+	// every material of the level's assets in one immutable buffer (t0),
+	// an asset's materials start at firstMaterial[asset]
+	Level::BufferHandle materialTable = Level::INVALID_BUFFER;
+	std::vector<unsigned> firstMaterial;
+	Level::UPLOAD_STATS uploadStats = {};
+	Level::MATRIX viewMatrix = Level::IdentityMatrix();
+	Level::MATRIX projectionMatrix = Level::IdentityMatrix();
+	// the level's LIGHT records as point and spot lights (t2), binned into the camera's
+	// clusters every frame and uploaded as per cluster ranges (t3) into one light list (t4)
+	std::vector<Level::LIGHT> lights;
+	bool useClusteredLights = true;
+	Level::LightClusters lightClusters;
+	Level::BufferHandle lightTable = Level::INVALID_BUFFER;
+	Level::BufferHandle clusterConstants = Level::INVALID_BUFFER;	// b2
+	Level::BufferHandle clusterRanges = Level::INVALID_BUFFER;
+	Level::BufferHandle clusterLights = Level::INVALID_BUFFER;
+	unsigned clusterRangeCount = 0;			// clusters clusterRanges holds
+	unsigned clusterLightCapacity = 0;		// indices clusterLights holds
+	Level::CLUSTER_CONSTANTS writtenClusters = {};	// what clusterConstants holds, rewritten only when it changes
+	bool clustersWritten = false;
 
-	GW::MATH::GVECTORF _lightDir;     // light direction vector
-	GW::MATH::GVECTORF _lightColor;   // light color vector
-	Model mod;
 public:
 	
 	// Imports the default level txt format and creates a Model from each .h2b
+	// LOG is anything with LogCategorized(category, message), e.g. GW::SYSTEM::GLog
+	// progress (optional) is updated per MESH record and can cancel the load from another thread,
+	// everything but the GPU upload happens here so it can run off the render thread
+	template<typename LOG>
 	bool LoadLevel(	const char* gameLevelPath,
 					const char* h2bFolderPath,
-					GW::SYSTEM::GLog log) {
-	
-		if (allObjectsInLevel.size() > 0.0f)
-		{
-			mod.Mesh_Vert_Index_BuffClear();
-		}
+					LOG log,
+					Level::LOAD_PROGRESS* progress = nullptr) {
 		
 		// What this does:
-		// Parse GameLevel.txt 
+		// Open the compiled GameLevel.lvlb next to GameLevel.txt (or compile it if the text changed)
 		// For each model found in the file...
-			// Create a new Model class on the stack.
-				// Read matrix transform and add to this model.
-				// Load all CPU rendering data for this model from .h2b
-			// Move the newly found Model to our list of total models for the level 
+			// Read its matrix transform.
+			// Reference the CPU rendering data for this model's .h2b from the asset cache
+			// (only the first copy of a .h2b is actually read from disk)
+			// Add the instance to the level's scene store
 
+		LEVEL_PROFILE_SCOPE("LoadLevel");
 		log.LogCategorized("EVENT", "LOADING GAME LEVEL [OBJECT ORIENTED]");
-		log.LogCategorized("MESSAGE", "Begin Reading Game Level Text File.");
+		log.LogCategorized("MESSAGE", "Begin Reading Game Level File.");
 
-		UnloadLevel();// clear previous level data if there is any
-		GW::SYSTEM::GFile file;
-		file.Create();
-		if (-file.OpenTextRead(gameLevelPath)) {
+		// a .lvlb path is loaded as is, a text path uses its .lvlb while the text hash matches
+		std::string levelPath = gameLevelPath;
+		bool compiledOnly = levelPath.size() > 5 && levelPath.compare(levelPath.size() - 5, 5, ".lvlb") == 0;
+		std::string binaryPath = compiledOnly ? levelPath : Level::LevelBinary::PathFor(levelPath);
+		Level::LevelBinary binary;
+		Level::LevelFile file;
+		if (binary.Open(binaryPath.c_str()) && (compiledOnly || binary.IsCurrent(gameLevelPath))) {
+			log.LogCategorized("INFO", (std::string("Compiled Level: ") + binaryPath).c_str());
+		}
+		else if (compiledOnly) {
 			log.LogCategorized(
-				"ERROR", (std::string("Game level not found: ") + gameLevelPath).c_str());
+				"ERROR", (std::string("Compiled game level missing or corrupt: ") + binaryPath).c_str());
 			return false;
 		}
-		char linebuffer[1024];
-		while (+file.ReadLine(linebuffer, 1024, '\n'))
+		else {
+			binary.Close();
+			unsigned long long sourceHash = 0, sourceSize = 0;
+			if (Level::LevelBinary::HashSource(gameLevelPath, sourceHash, sourceSize) == false) {
+				log.LogCategorized(
+					"ERROR", (std::string("Game level not found: ") + gameLevelPath).c_str());
+				return false;
+			}
+			if (file.Read(gameLevelPath) == false) {
+				log.LogCategorized("ERROR", (std::string("Game level malformed: ") + gameLevelPath +
+					" " + file.ErrorString()).c_str());
+				return false;
+			}
+			// the text records are already parsed, a failed write only costs the next load
+			if (Level::LevelBinary::Write(binaryPath.c_str(), file, sourceHash, sourceSize))
+				log.LogCategorized("INFO", (std::string("Compiled Level Written: ") + binaryPath).c_str());
+			else
+				log.LogCategorized("WARNING", (std::string("Could not write compiled level: ") + binaryPath).c_str());
+		}
+		// MESH records in file order, from whichever file was read
+		struct MESH_RECORD {
+			std::string name;
+			std::string modelFile;
+			const Level::MATRIX* transform;
+		};
+		std::vector<MESH_RECORD> meshes;
+		// LIGHT records become the level's point and spot lights
+		std::vector<Level::LIGHT> loadedLights;
+		if (binary.IsOpen()) {
+			const std::string folder = std::string(h2bFolderPath) + "/";
+			for (unsigned i = 0; i < binary.RecordCount(); ++i)
+				if (binary.Type(i) == Level::RECORD_TYPE::MESH)
+					meshes.push_back({ std::string(binary.Name(i)), folder + std::string(binary.Asset(i)), &binary.Transform(i) });
+				else if (binary.Type(i) == Level::RECORD_TYPE::LIGHT)
+					loadedLights.push_back(LoadLight(std::string(binary.Name(i)), binary.Transform(i), log));
+		}
+		else {
+			for (const Level::RECORD& record : file.records)
+				if (record.type == Level::RECORD_TYPE::MESH)
+					meshes.push_back({ record.name, Level::H2BPathFromName(h2bFolderPath, record.name), &record.transform });
+				else if (record.type == Level::RECORD_TYPE::LIGHT)
+					loadedLights.push_back(LoadLight(record.name, record.transform, log));
+		}
+		if (progress != nullptr) {
+			progress->done = 0;
+			progress->total = static_cast<unsigned>(meshes.size());
+		}
+
+		// every distinct .h2b is resolved and parsed once, across the job system's threads if there is one
+		assetCache.ForgetMissing();
+		std::vector<std::string> uniqueFiles;
+		std::vector<unsigned> meshFile(meshes.size());
 		{
-			// having to have this is a bug, need to have Read/ReadLine return failure at EOF
-			if (linebuffer[0] == '\0')
-				break;
-			if (std::strcmp(linebuffer, "MESH") == 0)
-			{
-				Model newModel;
-				file.ReadLine(linebuffer, 1024, '\n');
-				log.LogCategorized("INFO", (std::string("Model Detected: ") + linebuffer).c_str());
-				// create the model file name from this (strip the .001)
-				newModel.SetName(linebuffer);
-				std::string modelFile = linebuffer;
-				modelFile = modelFile.substr(0, modelFile.find_last_of("."));
-				modelFile += ".h2b";
-
-				// now read the transform data as we will need that regardless
-				GW::MATH::GMATRIXF transform;
-				for (int i = 0; i < 4; ++i) {
-					file.ReadLine(linebuffer, 1024, '\n');
-					// read floats
-					std::sscanf(linebuffer + 13, "%f, %f, %f, %f",
-						&transform.data[0 + i * 4], &transform.data[1 + i * 4],
-						&transform.data[2 + i * 4], &transform.data[3 + i * 4]);
-				}
-				std::string loc = "Location: X ";
-				loc += std::to_string(transform.row4.x) + " Y " +
-					std::to_string(transform.row4.y) + " Z " + std::to_string(transform.row4.z);
-				log.LogCategorized("INFO", loc.c_str());
-
-				// Add new model to list of all Models
-				log.LogCategorized("MESSAGE", "Begin Importing .H2B File Data.");
-				modelFile = std::string(h2bFolderPath) + "/" + modelFile;
-				newModel.SetWorldMatrix(transform);
-				// If we find and load it add it to the level
-				if (newModel.LoadModelDataFromDisk(modelFile.c_str())) {
-					// add to our level objects, we use std::move since Model::cpuModel is not copy safe.
-					allObjectsInLevel.push_back(std::move(newModel));
-					log.LogCategorized("INFO", (std::string("H2B Imported: ") + modelFile).c_str());
-				}
-				else {
-					// notify user that a model file is missing but continue loading
-					log.LogCategorized("ERROR",
-						(std::string("H2B Not Found: ") + modelFile).c_str());
-					log.LogCategorized("WARNING", "Loading will continue but model(s) are missing.");
-				}
-				log.LogCategorized("MESSAGE", "Importing of .H2B File Data Complete.");
+			std::unordered_map<std::string, unsigned> fileIndex;
+			for (size_t i = 0; i < meshes.size(); ++i) {
+				auto inserted = fileIndex.emplace(meshes[i].modelFile, static_cast<unsigned>(uniqueFiles.size()));
+				if (inserted.second)
+					uniqueFiles.push_back(meshes[i].modelFile);
+				meshFile[i] = inserted.first->second;
 			}
 		}
+		std::vector<Level::AssetHandle> fileAssets = assetCache.AcquireAll(uniqueFiles, jobs);
+		if (useLevelOfDetail)
+			assetCache.BuildLods(fileAssets, lodOptions, jobs);
+
+		// new instances are collected first so assets shared with the previous level stay cached
+		Level::SceneStore loadedObjects;
+		loadedObjects.Reserve(static_cast<unsigned>(meshes.size()));
+		auto cancelled = [&]() {
+			if (progress == nullptr || progress->cancel == false)
+				return false;
+			// drop the references the partial level took, the current level is untouched
+			for (const Level::INSTANCE& e : loadedObjects.Instances())
+				assetCache.Release(e.asset);
+			for (Level::AssetHandle asset : fileAssets)
+				assetCache.Release(asset);
+			log.LogCategorized("WARNING", (std::string("Game level load cancelled: ") + gameLevelPath).c_str());
+			return true;
+		};
+		for (size_t i = 0; i < meshes.size(); ++i) {
+			if (cancelled())
+				return false;
+			LoadModel(meshes[i].name, meshes[i].modelFile, *meshes[i].transform,
+				fileAssets[meshFile[i]], loadedObjects, log);
+			if (progress != nullptr)
+				++progress->done;
+		}
+		if (cancelled())
+			return false;
+		// each instance holds its own reference now
+		for (Level::AssetHandle asset : fileAssets)
+			assetCache.Release(asset);
+		UnloadLevel();// clear previous level data if there is any
+		// added to the emptied store so the slots keep their generations
+		scene.Reserve(loadedObjects.Size());
+		for (unsigned i = 0; i < loadedObjects.Size(); ++i)
+			scene.Add(loadedObjects.Instance(i).asset, loadedObjects.Instance(i).world, loadedObjects.Name(i));
+		lights.swap(loadedLights);
+		BuildBounds();
+		BuildOccluders();
+		BuildStaticBatches();
+		PrepareInstances();
+
+		Level::ASSET_STATS stats = assetCache.GetStats();
+		log.LogCategorized("INFO", (std::string("Unique Assets: ") + std::to_string(stats.uniqueAssets) +
+			" Instances: " + std::to_string(stats.instances) +
+			" Lights: " + std::to_string(lights.size()) +
+			" Bytes Saved: " + std::to_string(stats.bytesSaved)).c_str());
 		log.LogCategorized("MESSAGE", "Game Level File Reading Complete.");
 		// level loaded into CPU ram
 		log.LogCategorized("EVENT", "GAME LEVEL WAS LOADED TO CPU [OBJECT ORIENTED]");
 		return true;
 	}
+	// one MESH record: an instance referencing its cached .h2b (asset, INVALID_ASSET if the file is missing)
+	template<typename LOG>
+	void LoadModel(const std::string& name, const std::string& modelFile, const Level::MATRIX& transform,
+		Level::AssetHandle asset, Level::SceneStore& loadedObjects, LOG& log) {
+		log.LogCategorized("INFO", (std::string("Model Detected: ") + name).c_str());
+
+		// now read the transform data as we will need that regardless
+		std::string loc = "Location: X ";
+		loc += std::to_string(transform.data[12]) + " Y " +
+			std::to_string(transform.data[13]) + " Z " + std::to_string(transform.data[14]);
+		log.LogCategorized("INFO", loc.c_str());
+
+		log.LogCategorized("MESSAGE", "Begin Importing .H2B File Data.");
+		// If we find and load it add it to the level
+		if (asset != Level::INVALID_ASSET) {
+			loadedObjects.Add(assetCache.AddReference(asset), transform, name);
+			log.LogCategorized("INFO", (std::string("H2B Imported: ") + modelFile).c_str());
+		}
+		else {
+			// notify user that a model file is missing but continue loading
+			log.LogCategorized("ERROR",
+				(std::string("H2B Not Found: ") + modelFile).c_str());
+			log.LogCategorized("WARNING", "Loading will continue but model(s) are missing.");
+		}
+		log.LogCategorized("MESSAGE", "Importing of .H2B File Data Complete.");
+	}
+	// one LIGHT record, the file has no color or range so those are LIGHT_DEFAULTS'
+	template<typename LOG>
+	Level::LIGHT LoadLight(const std::string& name, const Level::MATRIX& transform, LOG& log) {
+		Level::LIGHT light = Level::LightFromRecord(name, transform);
+		log.LogCategorized("INFO", (std::string(light.type == Level::LIGHT_TYPE::SPOT ? "Spot Light Detected: " : "Point Light Detected: ") +
+			name + " Location: X " + std::to_string(light.position.x) + " Y " + std::to_string(light.position.y) +
+			" Z " + std::to_string(light.position.z)).c_str());
+		return light;
+	}
+	// world bounds of every instance and the BVH over them
+	void BuildBounds() {
+		LEVEL_PROFILE_SCOPE("Build bounds");
+		const std::vector<Level::INSTANCE>& instances = scene.Instances();
+		assetBounds.resize(assetCache.Capacity());
+		std::vector<bool> measured(assetCache.Capacity(), false);
+		std::vector<Level::AssetHandle> usedAssets;
+		for (const Level::INSTANCE& instance : instances) {
+			if (!measured[instance.asset]) {
+				usedAssets.push_back(instance.asset);
+				measured[instance.asset] = true;
+			}
+		}
+		// vertex bounds per asset, then every instance's world box (batch_math.h, a vector of instances at a time)
+		Level::ParallelFor(jobs, static_cast<unsigned>(usedAssets.size()), 1, [&](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i)
+				assetBounds[usedAssets[i]] = Level::LocalBounds(assetCache.Get(usedAssets[i]));
+		});
+		const unsigned count = scene.Size();
+		Level::BOUNDS_SOA local, world;
+		Level::MATRICES_SOA matrices;
+		local.Resize(count);
+		world.Resize(count);
+		matrices.Resize(count);
+		Level::ParallelFor(jobs, count, 4096, [&](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i) {
+				local.Set(i, assetBounds[instances[i].asset]);
+				matrices.Set(i, instances[i].world);
+			}
+			Level::TransformBounds(local, matrices, world, begin, end);
+			for (unsigned i = begin; i < end; ++i)
+				scene.SetBounds(i, world.Get(i));
+		});
+		bvh.Build(scene.Bounds());
+	}
+	// occluders among the instances, picked once their bounds are known
+	void BuildOccluders() {
+		LEVEL_PROFILE_SCOPE("Build occluders");
+		occlusion.Clear();
+		if (useOcclusion)
+			occlusion.Build(scene.Instances(), assetCache, scene.Bounds(), occlusionOptions);
+	}
+	// bakes the instances static batching takes, a BVH over the batches culls them
+	void BuildStaticBatches() {
+		LEVEL_PROFILE_SCOPE("Build static batches");
+		staticBatcher.Clear();
+		if (useStaticBatching)
+			staticBatcher.Build(scene.Instances(), assetCache, scene.Bounds(), staticOptions, jobs);
+		std::vector<Level::AABB> batchBounds;
+		for (const Level::STATIC_BATCH& batch : staticBatcher.batches)
+			batchBounds.push_back(batch.bounds);
+		staticBvh.Build(batchBounds);
+	}
+	// after instances moved or went, rebuilds what LoadLevel built from them (the static
+	// batches only if rebake) and has the next frame upload the instances again
+	void InstancesChanged(bool rebake) {
+		bvh.Build(scene.Bounds());
+		BuildOccluders();
+		if (rebake) {
+			ReleaseStaticBatches();
+			BuildStaticBatches();
+			if (gpu != nullptr) {
+				UploadStaticBatches(*gpu);
+				if (vertexFormat == Level::VERTEX_FORMAT::COMPACT)
+					UploadBoundsTable(*gpu);
+			}
+		}
+		visible.clear();
+		uploadedVisible.clear();
+		batchesPrepared = false;
+	}
+	bool IsBatched(unsigned instance) const {
+		return instance < staticBatcher.batched.size() && staticBatcher.batched[instance] != 0;
+	}
+	// groups every instance the static batches do not draw (CPU half of the instanced upload)
+	void PrepareInstances() {
+		LEVEL_PROFILE_SCOPE("Prepare instances");
+		uploadedVisible.clear();
+		visibleInstances.clear();
+		for (unsigned i = 0; i < scene.Size(); ++i)
+			if (!IsBatched(i)) {
+				uploadedVisible.push_back(i);
+				visibleInstances.push_back(scene.Instance(i));
+			}
+		instancedPath.Prepare(visibleInstances, assetCache, jobs);
+		batchesPrepared = true;
+	}
 	// Upload the CPU level to GPU
-	void UploadLevelToGPU(ID3D11Device* creator) /*pass handle to API device if needed*/{
-		// iterate over each model and tell it to draw itself
-		for (auto& e : allObjectsInLevel) {
-			e.UploadModelData2GPU(creator);/*forward handle to API device if needed*/
+	void UploadLevelToGPU(Level::RenderBackend& backend) /*pass handle to API device if needed*/{
+		LEVEL_PROFILE_SCOPE("UploadLevelToGPU");
+		gpu = &backend;
+		const bool compact = vertexFormat == Level::VERTEX_FORMAT::COMPACT;
+		if (compact)
+			CompressAssets();
+		// only assets that are not in the shared geometry yet are placed and uploaded
+		for (const Level::INSTANCE& e : scene.Instances()) {
+			Level::AssetHandle asset = e.asset;
+			if (assetCache.NeedsUpload(asset)) {
+				if (geometry.Add(backend, asset, GeometryData(asset)) == false)
+					PrintLabeledDebugString("ERROR: ", "Level geometry buffer could not be created.");
+				assetCache.MarkUploaded(asset);
+			}
+		}
+		LocateAssets();
+		// the per Model path's pipeline, shared by every instance
+		modelPath.UploadModelData2GPU(backend, compact ? COMPACT_MODEL_PIPELINE : MODEL_PIPELINE);/*forward handle to API device if needed*/
+		UploadMaterialTable(backend);
+		UploadLights(backend);
+		UploadStaticBatches(backend);
+		if (compact)
+			UploadBoundsTable(backend);
+		// group the level's instances (unless LoadLevel already did) and upload their world matrices
+		if (!batchesPrepared)
+			PrepareInstances();
+		instancedPath.Upload(backend, compact ? COMPACT_INSTANCED_PIPELINE : INSTANCED_PIPELINE);
+	}
+	// the static batches' geometry and their constants (identity world, material, bounds),
+	// which never change so they go into one immutable buffer instead of the ring
+	void UploadStaticBatches(Level::RenderBackend& backend) {
+		const std::vector<Level::STATIC_BATCH>& batches = staticBatcher.batches;
+		const bool compact = vertexFormat == Level::VERTEX_FORMAT::COMPACT;
+		staticCompact.assign(compact ? batches.size() : 0, Level::COMPACT_GEOMETRY());
+		Level::ParallelFor(jobs, static_cast<unsigned>(staticCompact.size()), 1, [&](unsigned begin, unsigned end) {
+			for (unsigned b = begin; b < end; ++b)
+				Level::Compress(batches[b].vertices, batches[b].indices, batches[b].bounds, staticCompact[b]);
+		});
+		staticBuffers.assign(batches.size(), ModelAssetBuffers());
+		std::vector<MeshData> constants(batches.size());
+		for (unsigned b = 0; b < batches.size(); ++b) {
+			if (staticGeometry.Add(backend, b, StaticGeometryData(b)) == false)
+				PrintLabeledDebugString("ERROR: ", "Static batch buffer could not be created.");
+			staticBuffers[b].Locate(staticGeometry, b);
+			constants[b].wMatrix = Level::IdentityMatrix();
+			constants[b].materialIndex = firstMaterial[batches[b].asset] + batches[b].materialIndex;
+			constants[b].boundsIndex = static_cast<unsigned>(assetCache.Capacity()) + b;
+		}
+		if (batches.empty())
+			return;
+		staticPipeline = backend.CreatePipeline(compact ? COMPACT_MODEL_PIPELINE : MODEL_PIPELINE);
+		// one CONSTANT_ALIGNMENT slot per batch, bound by range like the ring's
+		std::vector<unsigned char> slots(batches.size() * Level::CONSTANT_ALIGNMENT, 0);
+		for (unsigned b = 0; b < batches.size(); ++b)
+			std::memcpy(&slots[b * Level::CONSTANT_ALIGNMENT], &constants[b], sizeof(MeshData));
+		Level::BUFFER_DESC bufferConstants = { Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::IMMUTABLE,
+			static_cast<unsigned>(slots.size()) };
+		staticConstants = backend.CreateBuffer(bufferConstants, slots.data());
+	}
+	Level::GEOMETRY_DATA StaticGeometryData(unsigned batch) const {
+		const Level::STATIC_BATCH& source = staticBatcher.batches[batch];
+		if (vertexFormat == Level::VERTEX_FORMAT::FULL || staticCompact[batch].shortIndices.empty())
+			return { vertexFormat == Level::VERTEX_FORMAT::FULL ? static_cast<const void*>(source.vertices.data()) : staticCompact[batch].vertices.data(),
+				static_cast<unsigned>(source.vertices.size()), source.indices.data(), static_cast<unsigned>(source.indices.size()), sizeof(unsigned) };
+		return { staticCompact[batch].vertices.data(), static_cast<unsigned>(source.vertices.size()),
+			staticCompact[batch].shortIndices.data(), static_cast<unsigned>(source.indices.size()), sizeof(unsigned short) };
+	}
+
+	// CPU vertices/indices of a cached asset, what the geometry pool uploads
+	Level::GEOMETRY_DATA GeometryData(Level::AssetHandle asset) const {
+		const H2B::Parser& cpuModel = assetCache.Get(asset);
+		if (vertexFormat == Level::VERTEX_FORMAT::FULL)
+			return { cpuModel.vertices.data(), static_cast<unsigned>(cpuModel.vertices.size()),
+				cpuModel.indices.data(), static_cast<unsigned>(cpuModel.indices.size()), sizeof(unsigned) };
+		const Level::COMPACT_GEOMETRY& packed = compactGeometry[asset];
+		if (packed.shortIndices.empty())
+			return { packed.vertices.data(), static_cast<unsigned>(packed.vertices.size()),
+				cpuModel.indices.data(), static_cast<unsigned>(cpuModel.indices.size()), sizeof(unsigned) };
+		return { packed.vertices.data(), static_cast<unsigned>(packed.vertices.size()),
+			packed.shortIndices.data(), static_cast<unsigned>(packed.shortIndices.size()), sizeof(unsigned short) };
+	}
+	// packs every asset that still needs uploading, quantized across its bounds
+	void CompressAssets() {
+		compactGeometry.resize(assetCache.Capacity());
+		std::vector<Level::AssetHandle> toCompress;
+		std::vector<bool> queued(assetCache.Capacity(), false);
+		for (const Level::INSTANCE& e : scene.Instances()) {
+			Level::AssetHandle asset = e.asset;
+			if (assetCache.NeedsUpload(asset) && !queued[asset]) {
+				queued[asset] = true;
+				toCompress.push_back(asset);
+			}
+		}
+		Level::ParallelFor(jobs, static_cast<unsigned>(toCompress.size()), 1, [&](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i)
+				Level::Compress(assetCache.Get(toCompress[i]), assetBounds[toCompress[i]], compactGeometry[toCompress[i]]);
+		});
+	}
+	// refreshes where every asset's geometry is after placing or compacting
+	void LocateAssets() {
+		assetBuffers.assign(assetCache.Capacity(), ModelAssetBuffers());
+		for (Level::AssetHandle asset = 0; asset < assetBuffers.size(); ++asset)
+			if (geometry.Contains(asset))
+				assetBuffers[asset].Locate(geometry, asset);
+	}
+
+	// the attributes of every material of every asset the level uses, they never change after this
+	void UploadMaterialTable(Level::RenderBackend& backend) {
+		backend.ReleaseBuffer(materialTable);
+		materialTable = Level::INVALID_BUFFER;
+		firstMaterial.assign(assetCache.Capacity(), 0);
+		std::vector<bool> added(assetCache.Capacity(), false);
+		std::vector<H2B::ATTRIBUTES> table;
+		for (const Level::INSTANCE& e : scene.Instances()) {
+			Level::AssetHandle asset = e.asset;
+			if (added[asset])
+				continue;
+			added[asset] = true;
+			firstMaterial[asset] = static_cast<unsigned>(table.size());
+			const H2B::Parser& cpuModel = assetCache.Get(asset);
+			for (unsigned m = 0; m < cpuModel.materialCount; ++m)
+				table.push_back(cpuModel.materials[m].attrib);
+		}
+		uploadStats.materialTableBytes = sizeof(H2B::ATTRIBUTES) * table.size();
+		if (table.empty())
+			return;
+		Level::BUFFER_DESC bufferMaterials = { Level::BUFFER_TYPE::STRUCTURED, Level::BUFFER_USAGE::IMMUTABLE,
+			static_cast<unsigned>(sizeof(H2B::ATTRIBUTES) * table.size()), sizeof(H2B::ATTRIBUTES) };
+		materialTable = backend.CreateBuffer(bufferMaterials, table.data());
+	}
+	// the light table, which only changes with SetLights, and the per frame cluster buffers.
+	// the cluster constants exist even without lights so lightCount 0 replaces a previous level's
+	void UploadLights(Level::RenderBackend& backend) {
+		ReleaseLights(backend);
+		Level::BUFFER_DESC bufferConstants = { Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC,
+			sizeof(Level::CLUSTER_CONSTANTS) };
+		clusterConstants = backend.CreateBuffer(bufferConstants, nullptr);
+		if (lights.empty())
+			return;
+		std::vector<Level::LIGHT_CONSTANTS> table;
+		for (const Level::LIGHT& light : lights)
+			table.push_back(Level::LightConstants(light));
+		Level::BUFFER_DESC bufferLights = { Level::BUFFER_TYPE::STRUCTURED, Level::BUFFER_USAGE::IMMUTABLE,
+			static_cast<unsigned>(sizeof(Level::LIGHT_CONSTANTS) * table.size()), sizeof(Level::LIGHT_CONSTANTS) };
+		lightTable = backend.CreateBuffer(bufferLights, table.data());
+	}
+	void ReleaseLights(Level::RenderBackend& backend) {
+		backend.ReleaseBuffer(lightTable);
+		backend.ReleaseBuffer(clusterConstants);
+		backend.ReleaseBuffer(clusterRanges);
+		backend.ReleaseBuffer(clusterLights);
+		lightTable = clusterConstants = clusterRanges = clusterLights = Level::INVALID_BUFFER;
+		clusterRangeCount = clusterLightCapacity = 0;
+		clustersWritten = false;
+	}
+	// a STRUCTURED buffer of stride bytes per element for at least count elements, replaced when it is too small
+	void ReserveDynamic(Level::BufferHandle& buffer, unsigned& capacity, unsigned count, unsigned stride) {
+		if (count <= capacity && buffer != Level::INVALID_BUFFER)
+			return;
+		stateCache.ReleaseBuffer(buffer);
+		Level::BUFFER_DESC desc = { Level::BUFFER_TYPE::STRUCTURED, Level::BUFFER_USAGE::DYNAMIC, stride * count, stride };
+		buffer = stateCache.CreateBuffer(desc, nullptr);
+		capacity = count;
+	}
+	// bins the lights for the camera and uploads the lists, the light list grows to the
+	// next power of two it needs. Binds lightCount 0 when nothing is lit
+	void BinLights() {
+		LEVEL_PROFILE_SCOPE("Bin lights");
+		uploadStats.lightBytes = 0;
+		if (clusterConstants == Level::INVALID_BUFFER)
+			return;
+		const bool lit = useClusteredLights && hasCamera && lightTable != Level::INVALID_BUFFER;
+		if (lit)
+			lightClusters.Bin(lights, viewMatrix, projectionMatrix, jobs);
+		else
+			lightClusters.Clear();
+		const Level::CLUSTER_CONSTANTS constants = lightClusters.Constants();
+		if (!clustersWritten || std::memcmp(&constants, &writtenClusters, sizeof(constants)) != 0) {
+			stateCache.UpdateBuffer(clusterConstants, &constants, sizeof(constants));
+			uploadStats.lightBytes = sizeof(constants);
+			writtenClusters = constants;
+			clustersWritten = true;
+		}
+		stateCache.SetConstantBuffer(Level::CLUSTER_CONSTANTS_SLOT, clusterConstants, Level::STAGE_PIXEL);
+		if (constants.lightCount == 0)
+			return;
+		const std::vector<Level::CLUSTER_RANGE>& ranges = lightClusters.Ranges();
+		const std::vector<unsigned>& indices = lightClusters.Indices();
+		// the grid can change size between frames
+		if (ranges.size() != clusterRangeCount)
+			clusterRangeCount = 0;
+		ReserveDynamic(clusterRanges, clusterRangeCount, static_cast<unsigned>(ranges.size()), sizeof(Level::CLUSTER_RANGE));
+		stateCache.UpdateBuffer(clusterRanges, ranges.data(), static_cast<unsigned>(sizeof(Level::CLUSTER_RANGE) * ranges.size()));
+		unsigned needed = 1024;
+		while (needed < indices.size())
+			needed *= 2;
+		ReserveDynamic(clusterLights, clusterLightCapacity, needed, sizeof(unsigned));
+		if (!indices.empty())
+			stateCache.UpdateBuffer(clusterLights, indices.data(), static_cast<unsigned>(sizeof(unsigned) * indices.size()));
+		stateCache.SetShaderResource(Level::LIGHT_TABLE_SLOT, lightTable, Level::STAGE_PIXEL);
+		stateCache.SetShaderResource(Level::CLUSTER_RANGE_SLOT, clusterRanges, Level::STAGE_PIXEL);
+		stateCache.SetShaderResource(Level::CLUSTER_LIGHT_SLOT, clusterLights, Level::STAGE_PIXEL);
+		uploadStats.lightBytes += sizeof(Level::CLUSTER_RANGE) * ranges.size() + sizeof(unsigned) * indices.size();
+	}
+	// every cached asset's quantization, indexed by Level::AssetHandle like MESH_CONSTANTS::boundsIndex,
+	// followed by the static batches'
+	void UploadBoundsTable(Level::RenderBackend& backend) {
+		backend.ReleaseBuffer(boundsTable);
+		boundsTable = Level::INVALID_BUFFER;
+		std::vector<Level::POSITION_BOUNDS> table(assetCache.Capacity(), Level::POSITION_BOUNDS());
+		for (Level::AssetHandle asset = 0; asset < table.size() && asset < compactGeometry.size(); ++asset)
+			if (assetCache.IsValid(asset))
+				table[asset] = compactGeometry[asset].bounds;
+		for (const Level::COMPACT_GEOMETRY& batch : staticCompact)
+			table.push_back(batch.bounds);
+		if (table.empty())
+			return;
+		Level::BUFFER_DESC bufferBounds = { Level::BUFFER_TYPE::STRUCTURED, Level::BUFFER_USAGE::IMMUTABLE,
+			static_cast<unsigned>(sizeof(Level::POSITION_BOUNDS) * table.size()), sizeof(Level::POSITION_BOUNDS) };
+		boundsTable = backend.CreateBuffer(bufferBounds, table.data());
+	}
+
+	// camera for the next RenderLevel calls (row major, v * view * projection)
+	void SetViewProjection(const Level::MATRIX& view, const Level::MATRIX& projection) {
+		viewProjection = Level::Multiply(view, projection);
+		frustum = Level::ExtractFrustum(viewProjection);
+		viewMatrix = view;
+		projectionMatrix = projection;
+		// the view's rotation is orthonormal, the eye is the translation rotated back
+		const float* v = view.data;
+		cameraPosition = { -(v[12] * v[0] + v[13] * v[1] + v[14] * v[2]), -(v[12] * v[4] + v[13] * v[5] + v[14] * v[6]),
+			-(v[12] * v[8] + v[13] * v[9] + v[14] * v[10]) };
+		projectionScale = projection.data[5];
+		hasCamera = true;
+	}
+	// distance along the view direction to the center of an instance's bounds, 0 without a camera
+	float ViewDepth(unsigned instance) const {
+		if (!hasCamera)
+			return 0.0f;
+		return Level::ViewDepth(scene.Bounds()[instance], viewMatrix);
+	}
+
+	// level of detail of every visible instance from its bounding sphere's size on screen,
+	// all level 0 without a camera or with level of detail off
+	void SelectLods() {
+		LEVEL_PROFILE_SCOPE("Select LODs");
+		lodStats = Level::LOD_STATS();
+		lodChanged = false;
+		const bool select = useLevelOfDetail && hasCamera;
+		const std::vector<Level::AABB>& bounds = scene.Bounds();
+		for (unsigned i : visible) {
+			Level::INSTANCE& instance = scene.Instance(i);
+			const Level::ASSET_LODS& lods = assetCache.Lods(instance.asset);
+			unsigned lod = 0;
+			if (select && lods.count > 1) {
+				float extent[3];
+				for (int a = 0; a < 3; ++a)
+					extent[a] = bounds[i].max[a] - bounds[i].min[a];
+				float radius = 0.5f * std::sqrt(extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]);
+				lod = Level::SelectLod(lods, Level::ScreenRadius(radius, ViewDepth(i), projectionScale), instance.lod, lodSelection);
+			}
+			if (lod != instance.lod) {
+				instance.lod = lod;
+				++lodStats.switches;
+				lodChanged = true;
+			}
+			++lodStats.instances[lod];
+			lodStats.triangles += lods.triangles[lod];
+			lodStats.baseTriangles += lods.triangles[0];
 		}
 	}
 
 	// Draws all objects in the level
-	void RenderLevel(PipelineHandles _drawPipeLine) {
-		// iterate over each model and tell it to draw itself
-		for (auto &e : allObjectsInLevel) {
-			e.DrawModel( _drawPipeLine);/*pass any needed global info.(ex:camera)*/
+	void RenderLevel(Level::RenderBackend& backend) {
+		LEVEL_PROFILE_SCOPE("RenderLevel");
+		stateCache.Begin(backend);
+		stateCache.SetShaderResource(Level::MATERIAL_TABLE_SLOT, materialTable, Level::STAGE_PIXEL);
+		if (boundsTable != Level::INVALID_BUFFER)
+			stateCache.SetShaderResource(Level::POSITION_BOUNDS_SLOT, boundsTable, Level::STAGE_VERTEX);
+		uploadStats.constantBytes = uploadStats.instanceBytes = 0;
+		BinLights();
+		// visible Models in load order so culling never changes the draw order
+		if (useCulling && hasCamera) {
+			LEVEL_PROFILE_SCOPE("Cull");
+			bvh.Query(frustum, visible, cullStats, jobs);
+			std::sort(visible.begin(), visible.end());
+		}
+		else {
+			visible.resize(scene.Size());
+			for (unsigned i = 0; i < visible.size(); ++i)
+				visible[i] = i;
+			cullStats = Level::CULL_STATS();
+			cullStats.instances = cullStats.visible = scene.Size();
+		}
+		occlusionRan = useOcclusion && useCulling && hasCamera && occlusion.OccluderCount() > 0;
+		if (occlusionRan) {
+			LEVEL_PROFILE_SCOPE("Occlusion cull");
+			occlusion.Render(viewProjection, cameraPosition, frustum, jobs);
+			occlusion.Cull(visible, [&](unsigned i) { return scene.Bounds()[i]; }, jobs);
+		}
+		if (!staticBatcher.batches.empty()) {
+			visible.erase(std::remove_if(visible.begin(), visible.end(), [&](unsigned i) { return IsBatched(i); }), visible.end());
+			DrawStaticBatches();
+		}
+		SelectLods();
+
+		if (useInstancing) {
+			// only regroup and upload when the visible set or a level of detail changed
+			if (visible != uploadedVisible || lodChanged) {
+				visibleInstances.resize(visible.size());
+				Level::ParallelFor(jobs, static_cast<unsigned>(visible.size()), 8192, [&](unsigned begin, unsigned end) {
+					for (unsigned i = begin; i < end; ++i)
+						visibleInstances[i] = scene.Instance(visible[i]);
+				});
+				LEVEL_PROFILE_SCOPE("Rebuild instances");
+				instancedPath.Rebuild(backend, visibleInstances, assetCache, jobs);
+				uploadStats.instanceBytes = instancedPath.batcher.InstanceBufferBytes();
+				uploadedVisible = visible;
+				batchesPrepared = visible.size() == scene.Size();
+			}
+			drawConstants.BeginFrame(stateCache, static_cast<unsigned>(instancedPath.batcher.groups.size()));
+			if (useRenderQueue)
+				DrawInstancedQueue();
+			else
+				instancedPath.Draw(backend, assetBuffers, drawConstants, firstMaterial);
+			uploadStats.constantBytes = drawConstants.BytesWritten();
+			return;
+		}
+		if (useRenderQueue) {
+			DrawModelQueue();
+			uploadStats.constantBytes = drawConstants.BytesWritten();
+			return;
+		}
+		drawConstants.BeginFrame(stateCache, static_cast<unsigned>(GetDrawCallCount()));
+		// point the model path at each instance and tell it to draw itself
+		for (unsigned i : visible) {
+			const Level::INSTANCE& instance = scene.Instance(i);
+			modelPath.SetAsset(instance.asset);
+			modelPath.SetWorldMatrix(instance.world);
+			modelPath.DrawModel(backend, assetCache.Get(instance.asset), assetCache.Lods(instance.asset), instance.lod,
+				assetBuffers[instance.asset], drawConstants, firstMaterial[instance.asset]);/*pass any needed global info.(ex:camera)*/
+		}
+		uploadStats.constantBytes = drawConstants.BytesWritten();
+	}
+	// static batches in the frustum in build order (material, then cell), opaque only so they go first
+	void DrawStaticBatches() {
+		LEVEL_PROFILE_SCOPE("Draw static batches");
+		if (useCulling && hasCamera) {
+			staticBvh.Query(frustum, visibleBatches, staticCullStats, jobs);
+			std::sort(visibleBatches.begin(), visibleBatches.end());
+			if (occlusionRan)
+				occlusion.Cull(visibleBatches, [&](unsigned b) { return staticBatcher.batches[b].bounds; }, jobs);
 		}
+		else {
+			visibleBatches.resize(staticBatcher.batches.size());
+			for (unsigned b = 0; b < visibleBatches.size(); ++b)
+				visibleBatches[b] = b;
+			staticCullStats = Level::CULL_STATS();
+			staticCullStats.instances = staticCullStats.visible = static_cast<unsigned>(visibleBatches.size());
+		}
+		stateCache.SetPipeline(staticPipeline);
+		for (unsigned b : visibleBatches) {
+			const ModelAssetBuffers& buffers = staticBuffers[b];
+			const unsigned strides[] = { buffers.vertexStride };
+			const unsigned offsets[] = { 0 };
+			stateCache.SetVertexBuffers(0, 1, &buffers.vertexBuffer, strides, offsets);
+			stateCache.SetIndexBuffer(buffers.microsoftIndexBuffer, buffers.indexFormat, 0);
+			stateCache.SetConstantBufferRange(1, staticConstants, b * Level::CONSTANT_ALIGNMENT, Level::CONSTANT_ALIGNMENT,
+				Level::STAGE_VERTEX_PIXEL);
+			stateCache.DrawIndexed(static_cast<unsigned>(staticBatcher.batches[b].indices.size()), buffers.firstIndex, buffers.baseVertex);
+		}
+	}
+	// every visible Model sub-mesh through the sort, then drawn with redundant binds dropped
+	void DrawModelQueue() {
+		renderQueue.Clear();
+		queuedDraws.clear();
+		for (unsigned i : visible) {
+			const Level::AssetHandle asset = scene.Instance(i).asset;
+			const H2B::Parser& cpuModel = assetCache.Get(asset);
+			const float depth = ViewDepth(i);
+			for (unsigned m = 0; m < cpuModel.meshCount; ++m) {
+				unsigned material = firstMaterial[asset] + cpuModel.meshes[m].materialIndex;
+				unsigned page = assetBuffers[asset].page;
+				unsigned long long key = cpuModel.materials[cpuModel.meshes[m].materialIndex].attrib.d < 1.0f ?
+					Level::SORT_KEY::Translucent(modelPath.pipeline, page, material, depth) :
+					Level::SORT_KEY::Opaque(modelPath.pipeline, page, material, depth);
+				renderQueue.Push(key, static_cast<unsigned>(queuedDraws.size()));
+				queuedDraws.push_back({ i, m });
+			}
+		}
+		renderQueue.Sort();
+		drawConstants.BeginFrame(stateCache, static_cast<unsigned>(renderQueue.Size()));
+		runModels.assign(RecordingRuns(), modelPath);
+		// one ring slot per draw
+		RecordQueue([](unsigned k) { return k; },
+			[&](unsigned run, Level::StateCache& cache, Level::ConstantRing& constants, unsigned k) {
+				DrawQueued(runModels[run], cache, constants, k);
+			},
+			[&](unsigned run, Level::StateCache& cache, Level::ConstantRing& constants, unsigned begin, unsigned end) {
+				for (unsigned k = begin; k < end; ++k)
+					DrawQueued(runModels[run], cache, constants, k);
+			});
+	}
+	// the k-th sorted Model sub-mesh
+	void DrawQueued(Model& model, Level::RenderBackend& backend, Level::ConstantRing& constants, unsigned k) {
+		const QUEUED_DRAW& draw = queuedDraws[renderQueue.Draw(k)];
+		const Level::INSTANCE& instance = scene.Instance(draw.model);
+		model.SetAsset(instance.asset);
+		model.SetWorldMatrix(instance.world);
+		model.SetUpPipeline(backend, assetBuffers[instance.asset]);
+		model.DrawMesh(backend, assetCache.Get(instance.asset), assetBuffers[instance.asset], draw.mesh,
+			assetCache.Lods(instance.asset).Range(instance.lod, draw.mesh), constants, firstMaterial[instance.asset]);
+	}
+	// runs the recorder may split a draw list into
+	unsigned RecordingRuns() const {
+		return useParallelRecording && jobs != nullptr ? jobs->Threads() : 1;
+	}
+	// the sorted draws through stateCache and drawConstants, see Level::ParallelRecorder::Record
+	template<typename SLOTS, typename PRIME, typename RECORD>
+	void RecordQueue(const SLOTS& slotsBefore, const PRIME& prime, const RECORD& record) {
+		const unsigned count = static_cast<unsigned>(renderQueue.Size());
+		if (useParallelRecording)
+			recorder.Record(stateCache, drawConstants, count, jobs, slotsBefore, prime, record);
+		else
+			record(0u, stateCache, drawConstants, 0u, count);
+	}
+	// instance groups through the sort, translucent groups by their farthest visible instance
+	void DrawInstancedQueue() {
+		const std::vector<Level::INSTANCE_GROUP>& groups = instancedPath.batcher.groups;
+		bool translucent = false;
+		for (const Level::INSTANCE_GROUP& group : groups)
+			translucent |= assetCache.Get(group.asset).materials[group.materialIndex].attrib.d < 1.0f;
+		if (translucent) {
+			assetDepth.assign(assetCache.Capacity(), 0.0f);
+			for (unsigned i : visible)
+				assetDepth[scene.Instance(i).asset] = std::max(assetDepth[scene.Instance(i).asset], ViewDepth(i));
+		}
+		renderQueue.Clear();
+		for (unsigned g = 0; g < groups.size(); ++g) {
+			const Level::INSTANCE_GROUP& group = groups[g];
+			unsigned material = firstMaterial[group.asset] + group.materialIndex;
+			unsigned page = assetBuffers[group.asset].page;
+			unsigned long long key = assetCache.Get(group.asset).materials[group.materialIndex].attrib.d < 1.0f ?
+				Level::SORT_KEY::Translucent(instancedPath.pipeline, page, material, assetDepth[group.asset]) :
+				Level::SORT_KEY::Opaque(instancedPath.pipeline, page, material, 0.0f);
+			renderQueue.Push(key, g);
+		}
+		renderQueue.Sort();
+		// a group takes a ring slot when its material differs from the one before it
+		auto materialOf = [&](unsigned k) {
+			const Level::INSTANCE_GROUP& group = groups[renderQueue.Draw(k)];
+			return firstMaterial[group.asset] + group.materialIndex;
+		};
+		materialSlots.assign(renderQueue.Size() + 1, 0);
+		for (unsigned k = 0; k < renderQueue.Size(); ++k)
+			materialSlots[k + 1] = materialSlots[k] + (k == 0 || materialOf(k) != materialOf(k - 1));
+		runMaterials.assign(RecordingRuns(), InstancedDrawPath::BOUND_MATERIAL());
+		RecordQueue([&](unsigned k) { return materialSlots[k]; },
+			[&](unsigned run, Level::StateCache& cache, Level::ConstantRing& constants, unsigned k) {
+				// group k's material is already in the last slot taken up to it
+				runMaterials[run].material = materialOf(k);
+				runMaterials[run].offset = (materialSlots[k + 1] - 1) * Level::CONSTANT_ALIGNMENT;
+				instancedPath.DrawGroup(cache, assetBuffers, constants, firstMaterial, groups[renderQueue.Draw(k)], runMaterials[run]);
+			},
+			[&](unsigned run, Level::StateCache& cache, Level::ConstantRing& constants, unsigned begin, unsigned end) {
+				for (unsigned k = begin; k < end; ++k)
+					instancedPath.DrawGroup(cache, assetBuffers, constants, firstMaterial, groups[renderQueue.Draw(k)], runMaterials[run]);
+			});
 	}
 	// used to wipe CPU & GPU level data between levels
 	bool UnloadLevel() {
-		if (allObjectsInLevel.size() > 0)
+		if (!scene.Empty())
 		{
-			allObjectsInLevel.clear();
+			// every instance goes through its handle, last one first so nothing moves
+			ReleaseStaticBatches();
+			while (!scene.Empty())
+				ReleaseInstance(scene.HandleOf(scene.Size() - 1));
+			if (gpu != nullptr) {
+				// assets kept for the next level slide over the freed ranges, empty pages go
+				geometry.Compact(*gpu, [&](unsigned asset) { return GeometryData(asset); });
+				LocateAssets();
+				instancedPath.Release(*gpu);
+				drawConstants.Release(*gpu);
+				gpu->ReleaseBuffer(materialTable);
+				gpu->ReleaseBuffer(boundsTable);
+				ReleaseLights(*gpu);
+			}
+			materialTable = Level::INVALID_BUFFER;
+			boundsTable = Level::INVALID_BUFFER;
+			lights.clear();
+			lightClusters.Clear();
+			visible.clear();
+			uploadedVisible.clear();
+			lodStats = Level::LOD_STATS();
+			batchesPrepared = false;
+			bvh.Build(std::vector<Level::AABB>());
+			occlusion.Clear();
+			occlusionRan = false;
 			return true;
 		}
 		return false;
 	}
+	// drops a live instance and its asset reference, the last instance using an asset
+	// frees its CPU copy and its geometry range
+	void ReleaseInstance(Level::InstanceHandle handle) {
+		Level::AssetHandle asset = scene.Instance(scene.IndexOf(handle)).asset;
+		if (assetCache.Release(asset)) {
+			geometry.Remove(asset);
+			if (asset < compactGeometry.size())
+				compactGeometry[asset] = Level::COMPACT_GEOMETRY();
+		}
+		scene.Remove(handle);
+	}
+	// the static batches' CPU and GPU data, their pool is only theirs so it goes as a whole
+	void ReleaseStaticBatches() {
+		if (gpu != nullptr) {
+			staticGeometry.Release(*gpu);
+			gpu->ReleaseBuffer(staticConstants);
+		}
+		staticConstants = Level::INVALID_BUFFER;
+		staticBatcher.Clear();
+		staticBuffers.clear();
+		staticCompact.clear();
+		visibleBatches.clear();
+		staticBvh.Build(std::vector<Level::AABB>());
+	}
+	// handle of the first instance the level file placed as name, INVALID_INSTANCE if there is none
+	Level::InstanceHandle FindInstance(const std::string& name) const {
+		for (unsigned i = 0; i < scene.Size(); ++i)
+			if (scene.Name(i) == name)
+				return scene.HandleOf(i);
+		return Level::INVALID_INSTANCE;
+	}
+	// places an instance somewhere else, false once its handle is stale. Its bounds, the BVH
+	// and the occluders follow, the static batches are baked again if it was in one
+	bool MoveInstance(Level::InstanceHandle handle, const Level::MATRIX& world) {
+		if (!scene.Contains(handle))
+			return false;
+		const unsigned index = scene.IndexOf(handle);
+		Level::INSTANCE& instance = scene.Instance(index);
+		instance.world = world;
+		scene.SetBounds(index, Level::TransformBounds(assetBounds[instance.asset], world));
+		InstancesChanged(IsBatched(index));
+		return true;
+	}
+	// takes an instance out of the level, false once its handle is stale. The level's last
+	// instance moves into its index, so everything indexed by instance is built again
+	bool RemoveInstance(Level::InstanceHandle handle) {
+		if (!scene.Contains(handle))
+			return false;
+		ReleaseInstance(handle);
+		InstancesChanged(!staticBatcher.batches.empty());
+		return true;
+	}
+	// threads for loading and per frame work, nullptr runs everything on the calling thread
+	void SetJobSystem(Level::JobSystem* system) {
+		jobs = system;
+	}
+	// layout the level's geometry is uploaded in (FULL by default), only changes while
+	// nothing is uploaded, i.e. before the first UploadLevelToGPU
+	bool SetVertexFormat(Level::VERTEX_FORMAT format) {
+		if (geometry.PageCount() != 0)
+			return format == vertexFormat;
+		vertexFormat = format;
+		geometry = Level::GeometryPool(Level::VertexStride(format),
+			format == Level::VERTEX_FORMAT::COMPACT ? sizeof(unsigned short) : sizeof(unsigned));
+		staticGeometry = Level::GeometryPool(Level::VertexStride(format),
+			format == Level::VERTEX_FORMAT::COMPACT ? sizeof(unsigned short) : sizeof(unsigned));
+		return true;
+	}
+	Level::VERTEX_FORMAT GetVertexFormat() const {
+		return vertexFormat;
+	}
+	// simplified levels of detail (off by default). Levels are built by LoadLevel, so
+	// turn this on before loading, turning it off draws every instance at level 0
+	void SetLevelOfDetail(bool enabled, const Level::LOD_OPTIONS& options = Level::LOD_OPTIONS(),
+		const Level::LOD_SELECTION& selection = Level::LOD_SELECTION()) {
+		useLevelOfDetail = enabled;
+		lodOptions = options;
+		lodSelection = selection;
+	}
+	// bake static instances into batches per material and grid cell (off by default), set before LoadLevel.
+	// batched instances draw their level 0, levels of detail only apply to the rest
+	void SetStaticBatching(bool enabled, const Level::STATIC_BATCH_OPTIONS& options = Level::STATIC_BATCH_OPTIONS()) {
+		useStaticBatching = enabled;
+		staticOptions = options;
+	}
+	// occlusion culling against big walls and floors (off by default). Occluders are picked by
+	// LoadLevel, so turn this on before loading, turning it off skips the test
+	void SetOcclusionCulling(bool enabled, const Level::OCCLUSION_OPTIONS& options = Level::OCCLUSION_OPTIONS()) {
+		useOcclusion = enabled;
+		occlusionOptions = options;
+	}
+	// light the level with its point and spot lights (on by default), binned into clusters of the
+	// camera's frustum every frame
+	void SetClusteredLighting(bool enabled, const Level::CLUSTER_OPTIONS& options = Level::CLUSTER_OPTIONS()) {
+		useClusteredLights = enabled;
+		const Level::CLUSTER_OPTIONS& current = lightClusters.Options();
+		if (options.tilesX != current.tilesX || options.tilesY != current.tilesY || options.slices != current.slices)
+			lightClusters.SetOptions(options);
+	}
+	// replaces the level's lights (by default its LIGHT records), re-uploading the light table
+	// if the level is on the GPU
+	void SetLights(const std::vector<Level::LIGHT>& levelLights) {
+		lights = levelLights;
+		if (gpu != nullptr && clusterConstants != Level::INVALID_BUFFER)
+			UploadLights(*gpu);
+	}
+	const std::vector<Level::LIGHT>& GetLights() const {
+		return lights;
+	}
+	// switch between instanced draws and one draw per Model sub-mesh
+	void SetInstancing(bool enabled) {
+		useInstancing = enabled;
+	}
+	// sort draws and skip redundant binds (on by default), off draws in load order
+	void SetRenderQueue(bool enabled) {
+		useRenderQueue = enabled;
+	}
+	// record long sorted draw lists on the job system's threads (on by default), the
+	// backend gets the same commands either way
+	void SetParallelRecording(bool enabled, const Level::PARALLEL_RECORDING& options = Level::PARALLEL_RECORDING()) {
+		useParallelRecording = enabled;
+		recorder.SetOptions(options);
+	}
+	// test the BVH against the camera each frame (on by default once a camera is set)
+	void SetCulling(bool enabled) {
+		useCulling = enabled;
+	}
+	// draw calls the last RenderLevel issued
+	size_t GetDrawCallCount() const {
+		if (useInstancing)
+			return visibleBatches.size() + instancedPath.batcher.DrawCalls();
+		size_t draws = visibleBatches.size();
+		for (unsigned i : visible)
+			draws += assetCache.Get(scene.Instance(i).asset).meshCount;
+		return draws;
+	}
+	// instances, BVH nodes/bounds tested and instances visible in the last RenderLevel
+	Level::CULL_STATS GetCullStats() const {
+		return cullStats;
+	}
+	// instances per level of detail, level switches and triangles of the last RenderLevel
+	Level::LOD_STATS GetLodStats() const {
+		return lodStats;
+	}
+	// occluders drawn, boxes tested and hidden and what it cost in the last RenderLevel
+	Level::OCCLUSION_STATS GetOcclusionStats() const {
+		Level::OCCLUSION_STATS stats = {};
+		if (occlusionRan)
+			stats = occlusion.Stats();
+		stats.occluders = occlusion.OccluderCount();
+		stats.quads = occlusion.QuadCount();
+		return stats;
+	}
+	// lights binned, list sizes and binning time of the last RenderLevel
+	Level::CLUSTER_STATS GetClusterStats() const {
+		return lightClusters.Stats();
+	}
+	// batches, baked instances and bytes against the assets they came from
+	Level::STATIC_BATCH_STATS GetStaticBatchStats() const {
+		return staticBatcher.Stats(scene.Instances(), assetCache);
+	}
+	// batches tested and in the frustum in the last RenderLevel
+	Level::CULL_STATS GetStaticCullStats() const {
+		return staticCullStats;
+	}
+	// binds the last RenderLevel passed to the backend and the redundant ones it dropped
+	Level::STATE_STATS GetStateStats() const {
+		return stateCache.Stats();
+	}
+	// command lists the last sorted draw list was recorded into
+	Level::RECORDING_STATS GetRecordingStats() const {
+		return recorder.Stats();
+	}
+	// bytes the last RenderLevel uploaded (constants, instance matrices) and the material table size
+	Level::UPLOAD_STATS GetUploadStats() const {
+		return uploadStats;
+	}
+	// shared vertex/index buffers, how full and how fragmented they are
+	Level::GEOMETRY_STATS GetGeometryStats() const {
+		return geometry.GetStats();
+	}
+	// the level's instances, their bounds and names (index i is the BVH's instance i)
+	const Level::SceneStore& GetScene() const {
+		return scene;
+	}
+	// shared asset counters (unique assets, instances, parses, bytes saved)
+	Level::ASSET_STATS GetAssetStats() const {
+		return assetCache.GetStats();
+	}
 	// *THIS APPROACH COMBINES DATA & LOGIC* 
 	// *WITH THIS APPROACH THE CURRENT RENDERER SHOULD BE JUST AN API MANAGER CLASS*
 	// *ALL ACTUAL GPU LOADING AND RENDERING SHOULD BE HANDLED BY THE MODEL CLASS* 
 	// For example: anything that is not a global API object should be encapsulated.
 };
-
+#endif
@@ -42,6 +42,7 @@ int main()
 		win.Register(msgs);
 		if (+d3d11.Create(win, GW::GRAPHICS::DEPTH_BUFFER_SUPPORT))
 		{
+			LEVEL_PROFILE_THREAD("main");
 			Renderer renderer(win, d3d11);
 			while (+win.ProcessWindowEvents())
 			{
@@ -58,14 +59,27 @@ int main()
 					con->ClearDepthStencilView(depth, D3D11_CLEAR_DEPTH, 1, 0);
 					renderer.UpdateCamera();
 					renderer.Render();
-					swap->Present(1, 0);
+					{
+						LEVEL_PROFILE_SCOPE("Present");
+						swap->Present(1, 0);
+					}
 					// release incremented COM reference counts
 					swap->Release();
 					view->Release();
 					depth->Release();
 					con->Release();
 				}
+				LEVEL_PROFILE_FRAME();
+#if defined(LEVEL_ENABLE_PROFILER)
+				// the rolling summary every 10 seconds at 60 Hz
+				if (Level::Profiler::Instance().Stats().frames % 600 == 0)
+					std::cout << Level::Profiler::Instance().FormatSummary() << std::endl;
+#endif
 			}
+#if defined(LEVEL_ENABLE_PROFILER)
+			// the last frames for chrome://tracing or ui.perfetto.dev
+			Level::Profiler::Instance().WriteChromeTrace("profile.json");
+#endif
 		}
 	}
 	return 0; // that's all folks
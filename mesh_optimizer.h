@@ -0,0 +1,506 @@
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+// Offline clean up of .h2b geometry. The OBJ converter writes vertices and
+// triangles in whatever order the modeling tool had them, this reorders them
+// for the GPU and h2b_writer.h stores the result as a regular .h2b:
+//   weld      vertices with identical bytes become one
+//   cache     triangles ordered for the post transform vertex cache (Forsyth)
+//   overdraw  the cache order split into clusters that are drawn outward facing
+//             first, only where that keeps ACMR within a threshold (Sander et al.)
+//   fetch     vertices renumbered in the order the indices first use them
+// Triangles only move inside the index ranges the file's batches and meshes
+// draw, every range keeps its offset, count and material. No step depends on
+// addresses, hashing or threads, the same file always gives the same bytes.
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include "h2bParser.h"
+
+namespace Level {
+
+	struct MESH_OPTIMIZE_OPTIONS {
+		bool weld = true;
+		bool vertexCache = true;
+		// a range's ACMR may grow by this factor for overdraw, 0 skips the pass
+		float overdrawThreshold = 1.05f;
+		bool vertexFetch = true;
+	};
+
+	// FIFO post transform cache, reset for every draw.
+	// ACMR: vertices transformed per triangle (0.5 .. 3), ATVR: per vertex drawn (1 is ideal)
+	struct VERTEX_CACHE_STATS {
+		unsigned triangles;
+		unsigned vertices;		// distinct vertices the draws use
+		unsigned transformed;	// cache misses
+		double acmr;
+		double atvr;
+	};
+
+	// pixels that passed the depth test per covered pixel, rasterized in draw
+	// order from the 6 axis directions (1 means nothing was drawn over)
+	struct OVERDRAW_STATS {
+		unsigned long long covered;
+		unsigned long long shaded;
+		double overdraw;
+	};
+
+	struct MESH_OPTIMIZE_STATS {
+		unsigned verticesIn;
+		unsigned verticesOut;
+		unsigned welded;	// duplicates merged into an identical vertex
+		unsigned unused;	// vertices no index used (besides welded ones), dropped by the fetch pass
+		unsigned clusters;	// overdraw clusters over all ranges
+		VERTEX_CACHE_STATS cacheBefore, cacheAfter;
+	};
+
+	// cache the ACMR/ATVR reports and the overdraw clustering simulate
+	static const unsigned VERTEX_CACHE_SIZE = 16;
+	// LRU cache the Forsyth scores model, bigger than the FIFO it optimizes for
+	static const unsigned FORSYTH_CACHE_SIZE = 32;
+
+	// what the renderer draws: one range per mesh (the batches if there are no meshes)
+	inline std::vector<H2B::BATCH> DrawRanges(const H2B::Parser& model)
+	{
+		std::vector<H2B::BATCH> draws;
+		for (const H2B::MESH& mesh : model.meshes)
+			draws.push_back(mesh.drawInfo);
+		if (draws.empty())
+			draws = model.batches;
+		return draws;
+	}
+
+	// the index buffer cut at every batch/mesh boundary, triangles can move inside
+	// a segment without changing any range. False if a range is not whole triangles.
+	inline bool IndexSegments(const H2B::Parser& model, std::vector<H2B::BATCH>& segments)
+	{
+		const unsigned indexCount = static_cast<unsigned>(model.indices.size());
+		std::vector<unsigned> cuts = { 0, indexCount };
+		auto addRange = [&](const H2B::BATCH& range) {
+			if (range.indexOffset > indexCount || range.indexCount > indexCount - range.indexOffset)
+				return false;
+			cuts.push_back(range.indexOffset);
+			cuts.push_back(range.indexOffset + range.indexCount);
+			return true;
+		};
+		for (const H2B::BATCH& batch : model.batches)
+			if (addRange(batch) == false)
+				return false;
+		for (const H2B::MESH& mesh : model.meshes)
+			if (addRange(mesh.drawInfo) == false)
+				return false;
+		std::sort(cuts.begin(), cuts.end());
+		cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+		segments.clear();
+		for (size_t i = 0; i < cuts.size(); ++i) {
+			if (cuts[i] % 3 != 0)
+				return false;
+			if (i + 1 < cuts.size())
+				segments.push_back({ cuts[i + 1] - cuts[i], cuts[i] });
+		}
+		return true;
+	}
+
+	inline VERTEX_CACHE_STATS AnalyzeVertexCache(const std::vector<unsigned>& indices, const std::vector<H2B::BATCH>& draws,
+		size_t vertexCount, unsigned cacheSize = VERTEX_CACHE_SIZE)
+	{
+		VERTEX_CACHE_STATS stats = {};
+		// a vertex is cached while fewer than cacheSize misses happened since its own
+		std::vector<unsigned long long> missedAt(vertexCount, 0);
+		std::vector<bool> used(vertexCount, false);
+		unsigned long long time = cacheSize;
+		for (const H2B::BATCH& draw : draws) {
+			time += cacheSize;
+			const unsigned end = draw.indexOffset + draw.indexCount - draw.indexCount % 3;
+			for (unsigned i = draw.indexOffset; i < end && i < indices.size(); ++i) {
+				const unsigned vertex = indices[i];
+				if (vertex >= vertexCount)
+					continue;
+				if (missedAt[vertex] == 0 || time - missedAt[vertex] >= cacheSize) {
+					missedAt[vertex] = ++time;
+					++stats.transformed;
+				}
+				if (!used[vertex]) {
+					used[vertex] = true;
+					++stats.vertices;
+				}
+			}
+			stats.triangles += draw.indexCount / 3;
+		}
+		stats.acmr = stats.triangles > 0 ? static_cast<double>(stats.transformed) / stats.triangles : 0.0;
+		stats.atvr = stats.vertices > 0 ? static_cast<double>(stats.transformed) / stats.vertices : 0.0;
+		return stats;
+	}
+
+	inline OVERDRAW_STATS AnalyzeOverdraw(const H2B::Parser& model, unsigned resolution = 256)
+	{
+		OVERDRAW_STATS stats = {};
+		if (model.vertices.empty())
+			return stats;
+		float low[3], high[3];
+		const H2B::VECTOR& first = model.vertices[0].pos;
+		low[0] = high[0] = first.x;
+		low[1] = high[1] = first.y;
+		low[2] = high[2] = first.z;
+		for (const H2B::VERTEX& vertex : model.vertices) {
+			const float p[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+			for (int i = 0; i < 3; ++i) {
+				low[i] = std::min(low[i], p[i]);
+				high[i] = std::max(high[i], p[i]);
+			}
+		}
+		const float extent = std::max({ high[0] - low[0], high[1] - low[1], high[2] - low[2] });
+		if (extent <= 0)
+			return stats;
+		const float scale = resolution / extent;
+		const std::vector<H2B::BATCH> draws = DrawRanges(model);
+		std::vector<float> depth(static_cast<size_t>(resolution) * resolution);
+		for (int axis = 0; axis < 3; ++axis) {
+			const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			for (float side : { 1.0f, -1.0f }) {
+				std::fill(depth.begin(), depth.end(), INFINITY);
+				for (const H2B::BATCH& draw : draws) {
+					for (unsigned t = 0; t + 2 < draw.indexCount; t += 3) {
+						float x[3], y[3], z[3], facing = 0;
+						for (int k = 0; k < 3; ++k) {
+							const H2B::VERTEX& vertex = model.vertices[model.indices[draw.indexOffset + t + k]];
+							const float p[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+							const float n[3] = { vertex.nrm.x, vertex.nrm.y, vertex.nrm.z };
+							x[k] = (p[u] - low[u]) * scale;
+							y[k] = (p[v] - low[v]) * scale;
+							// the viewer is on the +side end of the axis, nearer is smaller
+							z[k] = -side * p[axis];
+							facing += side * n[axis];
+						}
+						// back faces by their vertex normals, whatever the winding
+						if (facing <= 0)
+							continue;
+						float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+						if (area == 0)
+							continue;
+						if (area < 0) {
+							std::swap(x[1], x[2]);
+							std::swap(y[1], y[2]);
+							std::swap(z[1], z[2]);
+							area = -area;
+						}
+						const int minX = std::max(0, static_cast<int>(std::floor(std::min({ x[0], x[1], x[2] }))));
+						const int maxX = std::min(static_cast<int>(resolution) - 1, static_cast<int>(std::max({ x[0], x[1], x[2] })));
+						const int minY = std::max(0, static_cast<int>(std::floor(std::min({ y[0], y[1], y[2] }))));
+						const int maxY = std::min(static_cast<int>(resolution) - 1, static_cast<int>(std::max({ y[0], y[1], y[2] })));
+						for (int py = minY; py <= maxY; ++py) {
+							for (int px = minX; px <= maxX; ++px) {
+								const float cx = px + 0.5f, cy = py + 0.5f;
+								const float w0 = (x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1]);
+								const float w1 = (x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2]);
+								const float w2 = (x[1] - x[0]) * (cy - y[0]) - (y[1] - y[0]) * (cx - x[0]);
+								if (w0 < 0 || w1 < 0 || w2 < 0)
+									continue;
+								const float pixelDepth = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+								float& stored = depth[static_cast<size_t>(py) * resolution + px];
+								if (pixelDepth < stored) {
+									stored = pixelDepth;
+									++stats.shaded;
+								}
+							}
+						}
+					}
+				}
+				for (float d : depth)
+					stats.covered += d != INFINITY ? 1 : 0;
+			}
+		}
+		stats.overdraw = stats.covered > 0 ? static_cast<double>(stats.shaded) / stats.covered : 0.0;
+		return stats;
+	}
+
+	// vertices with the same 36 bytes become the lowest numbered one of them,
+	// the others stay in the vertex buffer unused, returns how many were merged
+	inline unsigned WeldVertices(H2B::Parser& model)
+	{
+		const std::vector<H2B::VERTEX>& vertices = model.vertices;
+		std::vector<unsigned> order(vertices.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+			int compare = std::memcmp(&vertices[a], &vertices[b], sizeof(H2B::VERTEX));
+			return compare < 0 || (compare == 0 && a < b);
+		});
+		std::vector<unsigned> remap(vertices.size());
+		unsigned welded = 0;
+		for (size_t i = 0; i < order.size(); ++i) {
+			if (i > 0 && std::memcmp(&vertices[order[i]], &vertices[order[i - 1]], sizeof(H2B::VERTEX)) == 0) {
+				remap[order[i]] = remap[order[i - 1]];
+				++welded;
+			}
+			else
+				remap[order[i]] = order[i];
+		}
+		for (unsigned& index : model.indices)
+			index = remap[index];
+		return welded;
+	}
+
+	// Forsyth's vertex score: recently used vertices and vertices with few triangles left go first
+	inline float ForsythScore(int cacheSlot, unsigned remaining)
+	{
+		if (remaining == 0)
+			return -1.0f;
+		float score = 0.0f;
+		if (cacheSlot >= 0) {
+			// the last triangle's vertices get a fixed score so no strip direction is preferred
+			if (cacheSlot < 3)
+				score = 0.75f;
+			else
+				score = std::pow(1.0f - (cacheSlot - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+	}
+
+	// reorders the triangles of indices[0, indexCount) for the vertex cache, corners keep their winding
+	inline void OptimizeVertexCache(unsigned* indices, unsigned indexCount)
+	{
+		const unsigned triangles = indexCount / 3;
+		if (triangles < 2)
+			return;
+		const std::vector<unsigned> source(indices, indices + triangles * 3);
+		// dense ids for the segment's vertices
+		std::vector<unsigned> unique(source);
+		std::sort(unique.begin(), unique.end());
+		unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+		const unsigned vertexCount = static_cast<unsigned>(unique.size());
+		std::vector<unsigned> corners(source.size());
+		for (size_t i = 0; i < source.size(); ++i)
+			corners[i] = static_cast<unsigned>(std::lower_bound(unique.begin(), unique.end(), source[i]) - unique.begin());
+
+		// triangles around each vertex, the first remaining[v] of them are not emitted yet
+		std::vector<unsigned> remaining(vertexCount, 0), firstTriangle(vertexCount + 1, 0), adjacency(corners.size());
+		for (unsigned corner : corners)
+			++remaining[corner];
+		for (unsigned v = 0; v < vertexCount; ++v)
+			firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+		std::vector<unsigned> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (unsigned i = 0; i < corners.size(); ++i)
+			adjacency[fill[corners[i]]++] = i / 3;
+
+		std::vector<int> cacheSlot(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount), triangleScore(triangles);
+		std::vector<bool> emitted(triangles, false);
+		for (unsigned v = 0; v < vertexCount; ++v)
+			vertexScore[v] = ForsythScore(-1, remaining[v]);
+		const unsigned NONE = 0xFFFFFFFF;
+		unsigned best = NONE;
+		for (unsigned t = 0; t < triangles; ++t) {
+			triangleScore[t] = vertexScore[corners[t * 3]] + vertexScore[corners[t * 3 + 1]] + vertexScore[corners[t * 3 + 2]];
+			if (best == NONE || triangleScore[t] > triangleScore[best])
+				best = t;
+		}
+
+		std::vector<unsigned> cache, nextCache;
+		unsigned cursor = 0, written = 0;
+		for (unsigned count = 0; count < triangles; ++count) {
+			// nothing in the cache has triangles left, continue with the first one not drawn
+			if (best == NONE) {
+				while (emitted[cursor])
+					++cursor;
+				best = cursor;
+			}
+			emitted[best] = true;
+			const unsigned* corner = &corners[best * 3];
+			for (int k = 0; k < 3; ++k) {
+				indices[written++] = source[best * 3 + k];
+				unsigned* around = &adjacency[firstTriangle[corner[k]]];
+				for (unsigned j = 0; j < remaining[corner[k]]; ++j) {
+					if (around[j] == best) {
+						std::swap(around[j], around[remaining[corner[k]] - 1]);
+						--remaining[corner[k]];
+						break;
+					}
+				}
+			}
+			// the triangle's vertices move to the front of the cache, the rest one back
+			nextCache.clear();
+			for (int k = 0; k < 3; ++k)
+				if (std::find(nextCache.begin(), nextCache.end(), corner[k]) == nextCache.end())
+					nextCache.push_back(corner[k]);
+			const size_t front = nextCache.size();
+			for (unsigned v : cache)
+				if (std::find(nextCache.begin(), nextCache.begin() + front, v) == nextCache.begin() + front)
+					nextCache.push_back(v);
+			for (size_t i = 0; i < nextCache.size(); ++i) {
+				cacheSlot[nextCache[i]] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+				vertexScore[nextCache[i]] = ForsythScore(cacheSlot[nextCache[i]], remaining[nextCache[i]]);
+			}
+			// rescore what the cache touches, the best of it is next
+			best = NONE;
+			for (size_t i = 0; i < nextCache.size(); ++i) {
+				const unsigned v = nextCache[i];
+				for (unsigned j = 0; j < remaining[v]; ++j) {
+					const unsigned t = adjacency[firstTriangle[v] + j];
+					triangleScore[t] = vertexScore[corners[t * 3]] + vertexScore[corners[t * 3 + 1]] + vertexScore[corners[t * 3 + 2]];
+				}
+			}
+			for (size_t i = 0; i < nextCache.size() && i < FORSYTH_CACHE_SIZE; ++i) {
+				const unsigned v = nextCache[i];
+				for (unsigned j = 0; j < remaining[v]; ++j) {
+					const unsigned t = adjacency[firstTriangle[v] + j];
+					if (best == NONE || triangleScore[t] > triangleScore[best] || (triangleScore[t] == triangleScore[best] && t < best))
+						best = t;
+				}
+			}
+			if (nextCache.size() > FORSYTH_CACHE_SIZE)
+				nextCache.resize(FORSYTH_CACHE_SIZE);
+			cache.swap(nextCache);
+		}
+	}
+
+	// Splits cache ordered triangles into clusters and draws the clusters that
+	// face away from the segment's center first, so they hide what is behind
+	// them. A hard cluster starts where a triangle misses all 3 vertices, it is
+	// split further wherever the triangles so far transform at most threshold
+	// times the cluster's ACMR. Returns the number of clusters.
+	inline unsigned OptimizeOverdraw(unsigned* indices, unsigned indexCount, const std::vector<H2B::VERTEX>& vertices, float threshold)
+	{
+		const unsigned triangles = indexCount / 3;
+		if (triangles < 2 || threshold <= 0)
+			return triangles > 0 ? 1 : 0;
+		std::vector<unsigned long long> missedAt(vertices.size(), 0);
+		unsigned long long time = VERTEX_CACHE_SIZE;
+		std::vector<unsigned char> misses(triangles, 0);
+		std::vector<unsigned> hard;
+		for (unsigned t = 0; t < triangles; ++t) {
+			for (int k = 0; k < 3; ++k) {
+				const unsigned vertex = indices[t * 3 + k];
+				if (missedAt[vertex] == 0 || time - missedAt[vertex] >= VERTEX_CACHE_SIZE) {
+					missedAt[vertex] = ++time;
+					++misses[t];
+				}
+			}
+			if (t == 0 || misses[t] == 3)
+				hard.push_back(t);
+		}
+		hard.push_back(triangles);
+		std::vector<unsigned> starts;
+		for (size_t h = 0; h + 1 < hard.size(); ++h) {
+			const unsigned begin = hard[h], end = hard[h + 1];
+			unsigned total = 0;
+			for (unsigned t = begin; t < end; ++t)
+				total += misses[t];
+			const double limit = threshold * total / static_cast<double>(end - begin);
+			unsigned runMisses = 0, runTriangles = 0;
+			starts.push_back(begin);
+			for (unsigned t = begin; t + 1 < end; ++t) {
+				runMisses += misses[t];
+				++runTriangles;
+				if (runMisses <= limit * runTriangles) {
+					starts.push_back(t + 1);
+					runMisses = runTriangles = 0;
+				}
+			}
+		}
+		starts.push_back(triangles);
+		const unsigned clusters = static_cast<unsigned>(starts.size() - 1);
+
+		// area weighted centers and normals, normals turned to agree with the vertex normals
+		std::vector<float> clusterCenter(clusters * 3, 0.0f), clusterNormal(clusters * 3, 0.0f), clusterArea(clusters, 0.0f);
+		double center[3] = { 0, 0, 0 }, totalArea = 0;
+		for (unsigned c = 0; c < clusters; ++c) {
+			for (unsigned t = starts[c]; t < starts[c + 1]; ++t) {
+				const H2B::VERTEX& a = vertices[indices[t * 3]];
+				const H2B::VERTEX& b = vertices[indices[t * 3 + 1]];
+				const H2B::VERTEX& d = vertices[indices[t * 3 + 2]];
+				const float e0[3] = { b.pos.x - a.pos.x, b.pos.y - a.pos.y, b.pos.z - a.pos.z };
+				const float e1[3] = { d.pos.x - a.pos.x, d.pos.y - a.pos.y, d.pos.z - a.pos.z };
+				float normal[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+				const float vertexNormal[3] = { a.nrm.x + b.nrm.x + d.nrm.x, a.nrm.y + b.nrm.y + d.nrm.y, a.nrm.z + b.nrm.z + d.nrm.z };
+				if (normal[0] * vertexNormal[0] + normal[1] * vertexNormal[1] + normal[2] * vertexNormal[2] < 0)
+					for (int i = 0; i < 3; ++i)
+						normal[i] = -normal[i];
+				const float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				const float middle[3] = { (a.pos.x + b.pos.x + d.pos.x) / 3, (a.pos.y + b.pos.y + d.pos.y) / 3, (a.pos.z + b.pos.z + d.pos.z) / 3 };
+				for (int i = 0; i < 3; ++i) {
+					clusterCenter[c * 3 + i] += middle[i] * area;
+					clusterNormal[c * 3 + i] += normal[i];
+					center[i] += middle[i] * area;
+				}
+				clusterArea[c] += area;
+				totalArea += area;
+			}
+		}
+		if (totalArea <= 0)
+			return clusters;
+		std::vector<float> key(clusters, 0.0f);
+		for (unsigned c = 0; c < clusters; ++c) {
+			const float* normal = &clusterNormal[c * 3];
+			const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (clusterArea[c] <= 0 || length <= 0)
+				continue;
+			for (int i = 0; i < 3; ++i)
+				key[c] += (clusterCenter[c * 3 + i] / clusterArea[c] - static_cast<float>(center[i] / totalArea)) * normal[i] / length;
+		}
+		std::vector<unsigned> order(clusters);
+		std::iota(order.begin(), order.end(), 0u);
+		std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return key[a] > key[b]; });
+		const std::vector<unsigned> source(indices, indices + triangles * 3);
+		unsigned written = 0;
+		for (unsigned c : order)
+			for (unsigned i = starts[c] * 3; i < starts[c + 1] * 3; ++i)
+				indices[written++] = source[i];
+		return clusters;
+	}
+
+	// renumbers the vertices in the order the indices first use them and drops
+	// the ones nothing uses, returns how many were dropped
+	inline unsigned OptimizeVertexFetch(H2B::Parser& model)
+	{
+		const unsigned NONE = 0xFFFFFFFF;
+		std::vector<unsigned> remap(model.vertices.size(), NONE);
+		std::vector<H2B::VERTEX> ordered;
+		ordered.reserve(model.vertices.size());
+		for (unsigned& index : model.indices) {
+			if (remap[index] == NONE) {
+				remap[index] = static_cast<unsigned>(ordered.size());
+				ordered.push_back(model.vertices[index]);
+			}
+			index = remap[index];
+		}
+		const unsigned dropped = static_cast<unsigned>(model.vertices.size() - ordered.size());
+		model.vertices.swap(ordered);
+		model.vertexCount = static_cast<unsigned>(model.vertices.size());
+		return dropped;
+	}
+
+	// Runs the enabled passes over a parsed .h2b in place. False (and the model
+	// untouched) if an index or a batch/mesh range is out of bounds.
+	inline bool OptimizeMesh(H2B::Parser& model, const MESH_OPTIMIZE_OPTIONS& options = MESH_OPTIMIZE_OPTIONS(),
+		MESH_OPTIMIZE_STATS* stats = nullptr)
+	{
+		std::vector<H2B::BATCH> segments;
+		if (IndexSegments(model, segments) == false)
+			return false;
+		for (unsigned index : model.indices)
+			if (index >= model.vertices.size())
+				return false;
+		const std::vector<H2B::BATCH> draws = DrawRanges(model);
+		MESH_OPTIMIZE_STATS result = {};
+		result.verticesIn = static_cast<unsigned>(model.vertices.size());
+		result.cacheBefore = AnalyzeVertexCache(model.indices, draws, model.vertices.size());
+		if (options.weld)
+			result.welded = WeldVertices(model);
+		for (const H2B::BATCH& segment : segments) {
+			if (options.vertexCache)
+				OptimizeVertexCache(model.indices.data() + segment.indexOffset, segment.indexCount);
+			if (options.overdrawThreshold > 0)
+				result.clusters += OptimizeOverdraw(model.indices.data() + segment.indexOffset, segment.indexCount,
+					model.vertices, options.overdrawThreshold);
+		}
+		if (options.vertexFetch)
+			result.unused = OptimizeVertexFetch(model) - result.welded;
+		result.verticesOut = static_cast<unsigned>(model.vertices.size());
+		result.cacheAfter = AnalyzeVertexCache(model.indices, draws, model.vertices.size());
+		if (stats != nullptr)
+			*stats = result;
+		return true;
+	}
+}
+#endif
@@ -0,0 +1,392 @@
+#ifndef _MESH_SIMPLIFIER_H_
+#define _MESH_SIMPLIFIER_H_
+// Quadric error simplification (Garland & Heckbert) of a .h2b asset's meshes.
+// Vertices the OBJ converter split at a shared position (hard normals, UV
+// seams) are simplified as one point so those seams never open. Every mesh
+// keeps its own triangles, and the edges along an open border, between two
+// meshes (materials) or along a seam get extra quadrics that hold them in place.
+// An edge collapse moves one point onto a neighbour, so the output only
+// uses input positions and every corner keeps its input vertex's attributes.
+// Simplify may be called again with a lower target and continues from there.
+// Collapses are picked by error, then point ids, so results are deterministic.
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <vector>
+#include "h2bParser.h"
+
+namespace Level {
+
+	// symmetric 4x4 matrix summing squared distances to planes, weight is the area summed in
+	struct QUADRIC {
+		double a[10] = {}; // xx xy xz xw yy yz yw zz zw ww
+		double weight = 0.0;
+	};
+
+	inline void AddPlane(QUADRIC& q, double nx, double ny, double nz, double d, double weight)
+	{
+		q.a[0] += weight * nx * nx; q.a[1] += weight * nx * ny; q.a[2] += weight * nx * nz; q.a[3] += weight * nx * d;
+		q.a[4] += weight * ny * ny; q.a[5] += weight * ny * nz; q.a[6] += weight * ny * d;
+		q.a[7] += weight * nz * nz; q.a[8] += weight * nz * d;
+		q.a[9] += weight * d * d;
+		q.weight += weight;
+	}
+	inline void AddQuadric(QUADRIC& q, const QUADRIC& other)
+	{
+		for (int i = 0; i < 10; ++i)
+			q.a[i] += other.a[i];
+		q.weight += other.weight;
+	}
+	// weighted sum of squared distances from the point to the planes
+	inline double QuadricError(const QUADRIC& q, const float point[3])
+	{
+		const double x = point[0], y = point[1], z = point[2];
+		return q.a[0] * x * x + 2.0 * q.a[1] * x * y + 2.0 * q.a[2] * x * z + 2.0 * q.a[3] * x +
+			q.a[4] * y * y + 2.0 * q.a[5] * y * z + 2.0 * q.a[6] * y +
+			q.a[7] * z * z + 2.0 * q.a[8] * z + q.a[9];
+	}
+
+	class MeshSimplifier
+	{
+		struct TRIANGLE {
+			unsigned point[3];
+			unsigned vertex[3];	// input vertex of each corner, its attributes are kept
+			unsigned mesh;
+		};
+		struct COLLAPSE {
+			double error;	// squared distance
+			unsigned from, to;
+			unsigned fromVersion, toVersion;
+			// priority_queue keeps the largest on top, the cheapest collapse has to be
+			bool operator<(const COLLAPSE& other) const {
+				if (error != other.error)
+					return error > other.error;
+				if (from != other.from)
+					return from > other.from;
+				return to > other.to;
+			}
+		};
+		// border/material edges weigh this much more than the faces they bound, seams less
+		static constexpr double BORDER_WEIGHT = 10.0;
+		static constexpr double SEAM_WEIGHT = 1.0;
+		// a moved triangle's normal may turn by up to about 78 degrees
+		static constexpr double MIN_NORMAL_DOT = 0.2;
+		// the triangles around the moved point may lose or gain this fraction of their area.
+		// thin parts (blades, wires) collapse along themselves without any plane error,
+		// this keeps them from shrinking away
+		static constexpr double MAX_AREA_CHANGE = 0.25;
+
+		const H2B::Parser* model = nullptr;
+		unsigned meshCount = 0;
+		std::vector<float> points;		// xyz per distinct position
+		std::vector<QUADRIC> quadrics;
+		std::vector<unsigned> version;	// bumped when a point's quadric or fan changes
+		std::vector<char> removed;
+		std::vector<std::vector<unsigned>> fans;	// triangles around each point, dead ones dropped lazily
+		std::vector<TRIANGLE> triangles;	// in mesh order
+		std::vector<char> alive;
+		std::priority_queue<COLLAPSE> queue;
+		unsigned liveTriangles = 0;
+		double largestError = 0.0;
+
+		const float* Point(unsigned point) const {
+			return &points[point * 3];
+		}
+		static void Normal(const float* a, const float* b, const float* c, double n[3])
+		{
+			const double e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			const double e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+			n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+			n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+		}
+		static bool Contains(const TRIANGLE& triangle, unsigned point) {
+			return triangle.point[0] == point || triangle.point[1] == point || triangle.point[2] == point;
+		}
+
+		void Push(unsigned from, unsigned to)
+		{
+			QUADRIC q = quadrics[from];
+			AddQuadric(q, quadrics[to]);
+			double error = std::max(0.0, QuadricError(q, Point(to))) / std::max(q.weight, 1e-30);
+			queue.push({ error, from, to, version[from], version[to] });
+		}
+		void DropDead(std::vector<unsigned>& fan) {
+			fan.erase(std::remove_if(fan.begin(), fan.end(), [&](unsigned t) { return alive[t] == 0; }), fan.end());
+		}
+
+		// moves from onto to unless that folds a triangle over or changes the area too much
+		bool Collapse(unsigned from, unsigned to)
+		{
+			DropDead(fans[from]);
+			double areaBefore = 0.0, areaAfter = 0.0;
+			for (unsigned t : fans[from]) {
+				const TRIANGLE& triangle = triangles[t];
+				if (Contains(triangle, to)) {
+					double n[3];
+					Normal(Point(triangle.point[0]), Point(triangle.point[1]), Point(triangle.point[2]), n);
+					areaBefore += std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					continue;
+				}
+				const float* before[3];
+				const float* after[3];
+				for (int c = 0; c < 3; ++c) {
+					before[c] = Point(triangle.point[c]);
+					after[c] = triangle.point[c] == from ? Point(to) : before[c];
+				}
+				double n0[3], n1[3];
+				Normal(before[0], before[1], before[2], n0);
+				Normal(after[0], after[1], after[2], n1);
+				double length0 = std::sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+				double length1 = std::sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+				areaBefore += length0;
+				areaAfter += length1;
+				if (length0 == 0.0)
+					continue;
+				if (length1 == 0.0 || n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] < MIN_NORMAL_DOT * length0 * length1)
+					return false;
+			}
+			if (std::abs(areaAfter - areaBefore) > MAX_AREA_CHANGE * areaBefore)
+				return false;
+			for (unsigned t : fans[from]) {
+				TRIANGLE& triangle = triangles[t];
+				if (Contains(triangle, to)) {
+					alive[t] = 0;
+					--liveTriangles;
+					continue;
+				}
+				for (int c = 0; c < 3; ++c)
+					if (triangle.point[c] == from)
+						triangle.point[c] = to;
+				fans[to].push_back(t);
+			}
+			fans[from].clear();
+			removed[from] = 1;
+			AddQuadric(quadrics[to], quadrics[from]);
+			++version[to];
+			DropDead(fans[to]);
+
+			std::vector<unsigned> neighbours;
+			for (unsigned t : fans[to])
+				for (int c = 0; c < 3; ++c)
+					if (triangles[t].point[c] != to)
+						neighbours.push_back(triangles[t].point[c]);
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			for (unsigned n : neighbours) {
+				Push(to, n);
+				Push(n, to);
+			}
+			return true;
+		}
+
+	public:
+		// ranges[m] is mesh m's index range, false if there is nothing to simplify
+		bool Begin(const H2B::Parser& source, const std::vector<H2B::BATCH>& ranges)
+		{
+			*this = MeshSimplifier();
+			model = &source;
+			meshCount = static_cast<unsigned>(ranges.size());
+			const unsigned vertexCount = static_cast<unsigned>(source.vertices.size());
+
+			// one point per distinct position
+			std::vector<unsigned> order(vertexCount);
+			for (unsigned v = 0; v < vertexCount; ++v)
+				order[v] = v;
+			auto less = [&](unsigned a, unsigned b) {
+				const H2B::VECTOR& pa = source.vertices[a].pos;
+				const H2B::VECTOR& pb = source.vertices[b].pos;
+				if (pa.x != pb.x) return pa.x < pb.x;
+				if (pa.y != pb.y) return pa.y < pb.y;
+				if (pa.z != pb.z) return pa.z < pb.z;
+				return a < b;
+			};
+			std::sort(order.begin(), order.end(), less);
+			std::vector<unsigned> pointOf(vertexCount);
+			for (unsigned i = 0; i < vertexCount; ++i) {
+				const H2B::VECTOR& p = source.vertices[order[i]].pos;
+				const H2B::VECTOR* previous = i == 0 ? nullptr : &source.vertices[order[i - 1]].pos;
+				if (previous == nullptr || p.x != previous->x || p.y != previous->y || p.z != previous->z) {
+					points.push_back(p.x);
+					points.push_back(p.y);
+					points.push_back(p.z);
+				}
+				pointOf[order[i]] = static_cast<unsigned>(points.size() / 3 - 1);
+			}
+			const unsigned pointCount = static_cast<unsigned>(points.size() / 3);
+
+			// triangles collapsed to a line or a point draw nothing and are dropped
+			for (unsigned m = 0; m < meshCount; ++m) {
+				const H2B::BATCH& range = ranges[m];
+				if (static_cast<size_t>(range.indexOffset) + range.indexCount > source.indices.size())
+					return false;
+				for (unsigned i = 0; i + 2 < range.indexCount; i += 3) {
+					TRIANGLE triangle;
+					bool valid = true;
+					for (int c = 0; c < 3; ++c) {
+						unsigned v = source.indices[range.indexOffset + i + c];
+						valid = valid && v < vertexCount;
+						triangle.vertex[c] = v;
+						triangle.point[c] = valid ? pointOf[v] : 0;
+					}
+					triangle.mesh = m;
+					if (valid && triangle.point[0] != triangle.point[1] && triangle.point[1] != triangle.point[2] &&
+						triangle.point[0] != triangle.point[2])
+						triangles.push_back(triangle);
+				}
+			}
+			if (triangles.empty())
+				return false;
+			liveTriangles = static_cast<unsigned>(triangles.size());
+			alive.assign(triangles.size(), 1);
+			quadrics.assign(pointCount, QUADRIC());
+			version.assign(pointCount, 0);
+			removed.assign(pointCount, 0);
+			fans.assign(pointCount, std::vector<unsigned>());
+
+			// face planes weighted by area
+			std::vector<double> faceNormals(triangles.size() * 3, 0.0);
+			for (unsigned t = 0; t < triangles.size(); ++t) {
+				const TRIANGLE& triangle = triangles[t];
+				double* n = &faceNormals[t * 3];
+				Normal(Point(triangle.point[0]), Point(triangle.point[1]), Point(triangle.point[2]), n);
+				double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				for (int c = 0; c < 3; ++c)
+					fans[triangle.point[c]].push_back(t);
+				if (length == 0.0)
+					continue;
+				for (int i = 0; i < 3; ++i)
+					n[i] /= length;
+				const float* p = Point(triangle.point[0]);
+				double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+				for (int c = 0; c < 3; ++c)
+					AddPlane(quadrics[triangle.point[c]], n[0], n[1], n[2], d, length * 0.5);
+			}
+
+			// every triangle side keyed by its points, a key used once is an open border,
+			// by two meshes a material border, by two corners with different vertices a seam
+			struct SIDE {
+				unsigned a, b;		// points, a < b
+				unsigned va, vb;	// the triangle's vertices at a and b
+				unsigned triangle;
+			};
+			std::vector<SIDE> sides;
+			sides.reserve(triangles.size() * 3);
+			for (unsigned t = 0; t < triangles.size(); ++t)
+				for (int c = 0; c < 3; ++c) {
+					const TRIANGLE& triangle = triangles[t];
+					unsigned a = triangle.point[c], b = triangle.point[(c + 1) % 3];
+					unsigned va = triangle.vertex[c], vb = triangle.vertex[(c + 1) % 3];
+					if (a > b) {
+						std::swap(a, b);
+						std::swap(va, vb);
+					}
+					sides.push_back({ a, b, va, vb, t });
+				}
+			std::sort(sides.begin(), sides.end(), [](const SIDE& x, const SIDE& y) {
+				return x.a != y.a ? x.a < y.a : x.b != y.b ? x.b < y.b : x.triangle < y.triangle;
+			});
+			for (size_t first = 0; first < sides.size();) {
+				size_t last = first + 1;
+				while (last < sides.size() && sides[last].a == sides[first].a && sides[last].b == sides[first].b)
+					++last;
+				double weight = last - first == 1 ? BORDER_WEIGHT : 0.0;
+				for (size_t s = first + 1; s < last; ++s) {
+					if (triangles[sides[s].triangle].mesh != triangles[sides[first].triangle].mesh)
+						weight = std::max(weight, BORDER_WEIGHT);
+					else if (sides[s].va != sides[first].va || sides[s].vb != sides[first].vb)
+						weight = std::max(weight, SEAM_WEIGHT);
+				}
+				if (weight > 0.0) {
+					// a plane through the edge at right angles to each face holds it
+					const float* pa = Point(sides[first].a);
+					const float* pb = Point(sides[first].b);
+					const double edge[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+					const double lengthSquared = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+					for (size_t s = first; s < last; ++s) {
+						const double* n = &faceNormals[sides[s].triangle * 3];
+						double m[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+						double length = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+						if (length == 0.0)
+							continue;
+						for (int i = 0; i < 3; ++i)
+							m[i] /= length;
+						double d = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+						AddPlane(quadrics[sides[first].a], m[0], m[1], m[2], d, weight * lengthSquared);
+						AddPlane(quadrics[sides[first].b], m[0], m[1], m[2], d, weight * lengthSquared);
+					}
+				}
+				first = last;
+			}
+			for (size_t first = 0; first < sides.size(); ++first)
+				if (first == 0 || sides[first].a != sides[first - 1].a || sides[first].b != sides[first - 1].b) {
+					Push(sides[first].a, sides[first].b);
+					Push(sides[first].b, sides[first].a);
+				}
+			return true;
+		}
+
+		// collapses until targetTriangles are left or the next collapse would move
+		// the surface by more than maxError (model units), returns the triangles left
+		unsigned Simplify(unsigned targetTriangles, float maxError)
+		{
+			const double maxSquared = static_cast<double>(maxError) * maxError;
+			while (liveTriangles > targetTriangles && !queue.empty()) {
+				COLLAPSE collapse = queue.top();
+				if (removed[collapse.from] || removed[collapse.to] || version[collapse.from] != collapse.fromVersion ||
+					version[collapse.to] != collapse.toVersion) {
+					queue.pop();
+					continue;
+				}
+				if (collapse.error > maxSquared)
+					break;
+				queue.pop();
+				// a rejected collapse is queued again once its neighbourhood changes
+				if (Collapse(collapse.from, collapse.to))
+					largestError = std::max(largestError, collapse.error);
+			}
+			return liveTriangles;
+		}
+
+		unsigned Triangles() const {
+			return liveTriangles;
+		}
+		// largest collapse error so far, model units
+		float Error() const {
+			return static_cast<float>(std::sqrt(largestError));
+		}
+
+		// the current triangles: every distinct (position, input vertex) pair becomes
+		// a vertex in first use order, ranges[m] is where mesh m's indices went
+		void Extract(std::vector<H2B::VERTEX>& vertices, std::vector<unsigned>& indices, std::vector<H2B::BATCH>& ranges) const
+		{
+			vertices.clear();
+			indices.clear();
+			ranges.assign(meshCount, H2B::BATCH{ 0, 0 });
+			std::map<unsigned long long, unsigned> corners;
+			size_t t = 0;
+			for (unsigned m = 0; m < meshCount; ++m) {
+				ranges[m].indexOffset = static_cast<unsigned>(indices.size());
+				for (; t < triangles.size() && triangles[t].mesh == m; ++t) {
+					if (alive[t] == 0)
+						continue;
+					for (int c = 0; c < 3; ++c) {
+						const TRIANGLE& triangle = triangles[t];
+						unsigned long long key = (static_cast<unsigned long long>(triangle.point[c]) << 32) | triangle.vertex[c];
+						auto inserted = corners.emplace(key, static_cast<unsigned>(vertices.size()));
+						if (inserted.second) {
+							H2B::VERTEX vertex = model->vertices[triangle.vertex[c]];
+							const float* p = Point(triangle.point[c]);
+							vertex.pos = { p[0], p[1], p[2] };
+							vertices.push_back(vertex);
+						}
+						indices.push_back(inserted.first->second);
+					}
+				}
+				ranges[m].indexCount = static_cast<unsigned>(indices.size()) - ranges[m].indexOffset;
+			}
+		}
+	};
+}
+#endif
@@ -0,0 +1,797 @@
+#ifndef _OCCLUSION_H_
+#define _OCCLUSION_H_
+// Software occlusion culling for interiors. At load the level's big opaque
+// slab shaped instances (walls, floors, door frames) become occluders. Each
+// such asset is split along its thinnest axis into its two sides, the
+// triangles facing either way. Coplanar occluder instances (a wall of modular
+// pieces) are merged: per side, their triangles are rasterized together onto
+// one grid in the shared plane, gaps narrower than a crack are closed (the
+// mortar between stones, the seams between pieces) while openings like a
+// door's stay open, and the grid's rectangles become one sided world space
+// quads on the side's innermost plane, so a wall occludes as one piece. Every
+// frame the quads in the frustum that face the camera and cover the most of
+// the screen are transformed, clipped against the near plane and rasterized
+// one by one (each a convex polygon, so no diagonal splits it) into a small
+// depth buffer, Simd::LANES pixels at a time, keeping the nearest depth. A max depth mip
+// chain (the hierarchical depth buffer) is built on top, and an instance is
+// hidden when the nearest corner of its box is behind the farthest occluder
+// depth over the 2x2 texels its screen rect covers at the matching level.
+// Only pixels a triangle covers completely are written (inner conservative
+// rasterization), at the farthest depth inside the pixel, so a hidden box is
+// never drawn on screen.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "asset_cache.h"
+#include "culling.h"
+#include "instancing.h"
+#include "job_system.h"
+#include "level_math.h"
+#include "simd.h"
+
+namespace Level {
+
+	struct OCCLUSION_OPTIONS {
+		unsigned width = 256;		// depth buffer, rounded up to a multiple of Simd::LANES
+		unsigned height = 128;
+		float minOccluderSize = 1.0f;	// an occluder's world bounds are at least this big along two axes
+		float maxOccluderThickness = 0.5f;	// an occluder asset's thinnest extent over the smaller of the other two
+		unsigned maxOccluderTriangles = 4096;	// level 0 triangles of an asset that may occlude
+		float crackWidth = 0.05f;		// gaps narrower than this between an occluder's triangles (or pieces) are closed
+		unsigned maxOccluders = 64;		// quads rasterized per frame, the ones covering the most of the screen
+	};
+
+	struct OCCLUSION_STATS {
+		unsigned occluders;			// instances that may occlude (picked at load)
+		unsigned quads;				// their quads after merging coplanar instances
+		unsigned rasterized;		// of those quads, drawn into the depth buffer this frame
+		unsigned polygons;			// occluder quads left after clipping
+		unsigned tested;			// boxes tested against the depth buffer
+		unsigned culled;			// of those, hidden
+		double rasterizeMs;			// occluder selection, rasterization and the mip chain
+		double testMs;				// the box tests
+	};
+
+	class OcclusionCuller
+	{
+		// an occluder asset flattened along its thinnest axis, in object space. Side 0 is what faces -axis,
+		// side 1 what faces +axis: a camera on that side sees those triangles, and any ray to a point of
+		// their core plane that they cover has gone into the asset on the way (but through a crack)
+		struct OCCLUDER_MESH {
+			std::vector<float> triangles[2];	// a side's level 0 triangles, corners along the two axes after axis, 2 floats each
+			float core[2] = {};				// a side's plane along axis, its triangles' corner nearest the other side
+			int axis = 0;					// the slab's thinnest axis
+			float thickness = 0.0f;			// the slab's extent along axis
+			float middle = 0.0f;			// the middle plane along axis
+			float low[2] = {}, high[2] = {};	// the bounds along the other two axes
+			float cell[2] = {};				// its grid's cell along them
+		};
+		// a world space quad of merged occluders, only drawn for a camera in front of it (on normal's side).
+		// bounds is its box grown to the slabs it came from
+		struct OCCLUDER {
+			float corners[4][3];
+			FLOAT3 normal;
+			float offset;		// Dot(normal, a corner)
+			AABB bounds;
+		};
+		// a quad clipped by 5 planes has at most 9 sides
+		static const int MAX_EDGES = 9;
+		// a screen space convex polygon ready to fill, edge i is a[i] * x + b[i] * y + c[i] >= 0
+		struct POLYGON {
+			float a[MAX_EDGES], b[MAX_EDGES], c[MAX_EDGES];
+			int edges;
+			float zx, zy, z0;		// farthest depth inside the pixel at (x, y)
+			int minX, maxX, minY, maxY;	// pixels whose centers may be inside
+		};
+		static const unsigned BAND_ROWS = 16;	// rows one job fills
+		static const int GUARD_BAND = 4;		// x and y are clipped at this many times w
+		static const unsigned LANES_MASK = Simd::LANES - 1;
+		static const size_t MAX_MERGE_CELLS = 1 << 22;	// grid of a plane's merged occluders, bigger planes stay apart
+
+		OCCLUSION_OPTIONS options;
+		std::vector<OCCLUDER_MESH> meshes;	// by asset, empty if the asset never occludes
+		std::vector<unsigned> occluders;	// instance indices
+		std::vector<OCCLUDER> quads;		// the occluders' quads, merged per plane
+		unsigned width = 0, height = 0;
+		// level 0 is the depth buffer, level l starts at levelStart[l] and is levelWidth[l] x levelHeight[l]
+		std::vector<float> depth;
+		std::vector<size_t> levelStart;
+		std::vector<unsigned> levelWidth, levelHeight;
+		MATRIX viewProjection = IdentityMatrix();
+		bool active = false;	// something was rasterized this frame
+		OCCLUSION_STATS stats = {};
+		// per frame scratch
+		std::vector<std::pair<float, unsigned>> candidates;
+		std::vector<POLYGON> polygons;
+		std::vector<char> hidden;
+
+		// corners of a world box on screen, false if the box reaches in front of the near plane
+		bool Project(const AABB& bounds, float rect[4], float& nearest) const
+		{
+			rect[0] = rect[1] = 1e30f;
+			rect[2] = rect[3] = -1e30f;
+			nearest = 1.0f;
+			for (int corner = 0; corner < 8; ++corner) {
+				const float point[3] = { corner & 1 ? bounds.max[0] : bounds.min[0],
+					corner & 2 ? bounds.max[1] : bounds.min[1], corner & 4 ? bounds.max[2] : bounds.min[2] };
+				float out[4];
+				TransformPoint(point, viewProjection, out);
+				if (out[2] < 0.0f || out[3] <= 1e-6f)
+					return false;
+				const float inverse = 1.0f / out[3];
+				const float x = (out[0] * inverse * 0.5f + 0.5f) * width, y = (0.5f - out[1] * inverse * 0.5f) * height;
+				rect[0] = std::min(rect[0], x);
+				rect[1] = std::min(rect[1], y);
+				rect[2] = std::max(rect[2], x);
+				rect[3] = std::max(rect[3], y);
+				nearest = std::min(nearest, out[2] * inverse);
+			}
+			return true;
+		}
+
+		// clips a clip space quad (4 corners, xyzw each) against the near plane and the guard band, appends what is left
+		void Setup(const float* corners)
+		{
+			static const float planes[5][4] = { { 0, 0, 1, 0 }, { 1, 0, 0, GUARD_BAND }, { -1, 0, 0, GUARD_BAND },
+				{ 0, 1, 0, GUARD_BAND }, { 0, -1, 0, GUARD_BAND } };
+			float polygon[2][MAX_EDGES][4];
+			int count = 4, in = 0;
+			std::copy(corners, corners + 16, &polygon[0][0][0]);
+			for (const float* plane : planes) {
+				float distance[MAX_EDGES];
+				bool any = false, all = true;
+				for (int i = 0; i < count; ++i) {
+					const float* p = polygon[in][i];
+					distance[i] = plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3] * p[3];
+					any |= distance[i] >= 0.0f;
+					all &= distance[i] >= 0.0f;
+				}
+				if (!any)
+					return;
+				if (all)
+					continue;
+				int out = 0;
+				for (int i = 0; i < count; ++i) {
+					const int j = (i + 1) % count;
+					const float* p = polygon[in][i];
+					const float* q = polygon[in][j];
+					if (distance[i] >= 0.0f)
+						std::copy(p, p + 4, polygon[1 - in][out++]);
+					if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+						const float t = distance[i] / (distance[i] - distance[j]);
+						for (int k = 0; k < 4; ++k)
+							polygon[1 - in][out][k] = p[k] + (q[k] - p[k]) * t;
+						++out;
+					}
+				}
+				count = out;
+				in = 1 - in;
+			}
+			float screen[MAX_EDGES][3];
+			for (int i = 0; i < count; ++i) {
+				const float* p = polygon[in][i];
+				const float inverse = 1.0f / p[3];
+				screen[i][0] = (p[0] * inverse * 0.5f + 0.5f) * width;
+				screen[i][1] = (0.5f - p[1] * inverse * 0.5f) * height;
+				screen[i][2] = p[2] * inverse;
+			}
+			SetupScreen(screen, count);
+		}
+		void SetupScreen(const float (*p)[3], int count)
+		{
+			// twice the signed area, and the fan triangle the depth plane is taken from (the biggest)
+			float area = 0.0f, fanArea = 0.0f;
+			int fan = 1;
+			for (int i = 0; i < count; ++i) {
+				const int j = (i + 1) % count;
+				area += p[i][0] * p[j][1] - p[j][0] * p[i][1];
+				if (i > 0 && j > 0) {
+					const float part = (p[i][0] - p[0][0]) * (p[j][1] - p[0][1]) - (p[i][1] - p[0][1]) * (p[j][0] - p[0][0]);
+					if (std::fabs(part) > std::fabs(fanArea)) {
+						fanArea = part;
+						fan = i;
+					}
+				}
+			}
+			if (!(std::fabs(area) > 1e-6f) || !(std::fabs(fanArea) > 1e-6f))
+				return;
+			// occluders are drawn from both sides
+			const float sign = area > 0.0f ? 1.0f : -1.0f;
+			POLYGON t;
+			t.edges = 0;
+			for (int i = 0; i < count; ++i) {
+				const float* from = p[i];
+				const float* to = p[(i + 1) % count];
+				const float a = (from[1] - to[1]) * sign, b = (to[0] - from[0]) * sign;
+				if (a == 0.0f && b == 0.0f)
+					continue;
+				t.a[t.edges] = a;
+				t.b[t.edges] = b;
+				// inner conservative: a pixel center passes only when the whole pixel is inside
+				t.c[t.edges] = -(a * from[0] + b * from[1]) - 0.5f * (std::fabs(a) + std::fabs(b));
+				++t.edges;
+			}
+			// the quad is planar, so depth is one plane over it, from barycentrics of the fan triangle
+			const float* v[3] = { p[0], p[fan], p[fan + 1] };
+			float a[3], b[3], c[3];
+			for (int e = 0; e < 3; ++e) {
+				a[e] = v[e][1] - v[(e + 1) % 3][1];
+				b[e] = v[(e + 1) % 3][0] - v[e][0];
+				c[e] = -(a[e] * v[e][0] + b[e] * v[e][1]);
+			}
+			// edge e is the weight of the vertex opposite it
+			const float inverse = 1.0f / fanArea;
+			t.zx = (v[0][2] * a[1] + v[1][2] * a[2] + v[2][2] * a[0]) * inverse;
+			t.zy = (v[0][2] * b[1] + v[1][2] * b[2] + v[2][2] * b[0]) * inverse;
+			t.z0 = (v[0][2] * c[1] + v[1][2] * c[2] + v[2][2] * c[0]) * inverse + 0.5f * (std::fabs(t.zx) + std::fabs(t.zy));
+			float low[2] = { p[0][0], p[0][1] }, high[2] = { p[0][0], p[0][1] };
+			for (int i = 1; i < count; ++i)
+				for (int k = 0; k < 2; ++k) {
+					low[k] = std::min(low[k], p[i][k]);
+					high[k] = std::max(high[k], p[i][k]);
+				}
+			t.minX = std::max(0, static_cast<int>(std::ceil(low[0] - 0.5f)));
+			t.minY = std::max(0, static_cast<int>(std::ceil(low[1] - 0.5f)));
+			t.maxX = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor(high[0] - 0.5f)));
+			t.maxY = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor(high[1] - 0.5f)));
+			if (t.minX <= t.maxX && t.minY <= t.maxY)
+				polygons.push_back(t);
+		}
+
+		// rows [top, bottom) of every polygon, keeping the nearest depth
+		void Fill(int top, int bottom)
+		{
+			using namespace Simd;
+			const FLOATS zero = Set(0.0f), ramp = Ramp();
+			for (const POLYGON& t : polygons) {
+				const int y0 = std::max(t.minY, top), y1 = std::min(t.maxY, bottom - 1);
+				const int x0 = t.minX & ~(LANES - 1);
+				FLOATS a[MAX_EDGES], row[MAX_EDGES];
+				for (int e = 0; e < t.edges; ++e)
+					a[e] = Set(t.a[e]);
+				const FLOATS zx = Set(t.zx);
+				for (int y = y0; y <= y1; ++y) {
+					const float py = y + 0.5f;
+					for (int e = 0; e < t.edges; ++e)
+						row[e] = Set(t.b[e] * py + t.c[e]);
+					const FLOATS rowZ = Set(t.zy * py + t.z0);
+					float* line = &depth[static_cast<size_t>(y) * width];
+					for (int x = x0; x <= t.maxX; x += LANES) {
+						const FLOATS px = Set(x + 0.5f) + ramp;
+						MASK inside = All(true);
+						for (int e = 0; e < t.edges; ++e)
+							inside = And(inside, GreaterEqual(a[e] * px + row[e], zero));
+						if (Bits(inside) == 0)
+							continue;
+						const FLOATS z = zx * px + rowZ, old = Load(line + x);
+						Store(line + x, Select(And(inside, Less(z, old)), z, old));
+					}
+				}
+			}
+		}
+
+		void BuildMips()
+		{
+			for (size_t l = 1; l < levelStart.size(); ++l) {
+				const float* source = &depth[levelStart[l - 1]];
+				float* target = &depth[levelStart[l]];
+				const unsigned sourceWidth = levelWidth[l - 1], sourceHeight = levelHeight[l - 1];
+				for (unsigned y = 0; y < levelHeight[l]; ++y)
+					for (unsigned x = 0; x < levelWidth[l]; ++x) {
+						const unsigned x1 = std::min(2 * x + 1, sourceWidth - 1), y1 = std::min(2 * y + 1, sourceHeight - 1);
+						target[y * levelWidth[l] + x] = std::max(std::max(source[2 * y * sourceWidth + 2 * x], source[2 * y * sourceWidth + x1]),
+							std::max(source[y1 * sourceWidth + 2 * x], source[y1 * sourceWidth + x1]));
+					}
+			}
+		}
+
+		// the asset's occluder mesh, none if it is not a slab or neither side covers a cell of its grid
+		void BuildMesh(const H2B::Parser& model, const ASSET_LODS& lods, OCCLUDER_MESH& out) const
+		{
+			const AABB bounds = LocalBounds(model);
+			float extent[3];
+			int axis = 0;
+			for (int a = 0; a < 3; ++a) {
+				extent[a] = bounds.max[a] - bounds.min[a];
+				if (extent[a] < extent[axis])
+					axis = a;
+			}
+			const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			if (!(extent[u] > 0.0f && extent[v] > 0.0f) || extent[axis] > options.maxOccluderThickness * std::min(extent[u], extent[v]))
+				return;
+
+			// a triangle belongs to the side its normals lean to. The grid's cell is half a crack, coarser
+			// for an asset too big for MAX_MERGE_CELLS of them
+			float size = std::max(0.5f * options.crackWidth, std::sqrt(extent[u] * extent[v] / MAX_MERGE_CELLS));
+			const unsigned gridWidth = static_cast<unsigned>(std::ceil(extent[u] / size)), gridHeight = static_cast<unsigned>(std::ceil(extent[v] / size));
+			const float cell[2] = { extent[u] / gridWidth, extent[v] / gridHeight };
+			std::vector<float> cells[2];
+			out.core[0] = bounds.min[axis];
+			out.core[1] = bounds.max[axis];
+			for (unsigned m = 0; m < model.meshCount; ++m) {
+				const H2B::BATCH& range = lods.Range(0, m);
+				for (unsigned k = 0; k + 2 < range.indexCount; k += 3) {
+					const H2B::VERTEX* corners[3];
+					float lean = 0.0f;
+					for (int c = 0; c < 3; ++c) {
+						corners[c] = &model.vertices[model.indices[range.indexOffset + k + c]];
+						lean += (&corners[c]->nrm.x)[axis];
+					}
+					if (lean == 0.0f)
+						continue;
+					const int side = lean > 0.0f;
+					for (const H2B::VERTEX* corner : corners) {
+						const float* position = &corner->pos.x;
+						out.triangles[side].push_back(position[u]);
+						out.triangles[side].push_back(position[v]);
+						cells[side].push_back((position[u] - bounds.min[u]) / cell[0]);
+						cells[side].push_back((position[v] - bounds.min[v]) / cell[1]);
+						out.core[side] = side ? std::min(out.core[side], position[axis]) : std::max(out.core[side], position[axis]);
+					}
+				}
+			}
+			bool any = false;
+			std::vector<char> solid;
+			for (int side = 0; side < 2; ++side) {
+				Cover(cells[side], gridWidth, gridHeight, solid);
+				if (std::find(solid.begin(), solid.end(), 1) == solid.end())
+					out.triangles[side].clear();
+				any |= !out.triangles[side].empty();
+			}
+			if (!any)
+				return;
+			out.axis = axis;
+			out.thickness = extent[axis];
+			out.middle = (bounds.min[axis] + bounds.max[axis]) * 0.5f;
+			for (int a = 0; a < 2; ++a) {
+				out.low[a] = bounds.min[a == 0 ? u : v];
+				out.high[a] = bounds.max[a == 0 ? u : v];
+				out.cell[a] = cell[a];
+			}
+		}
+
+		// solid[y * width + x] is set for the cells of a width x height grid that the triangles (x, y in cells,
+		// 3 corners each) cover: the ones whose center is inside a triangle, then closed (grown by a cell and
+		// shrunk back), so a gap of up to two cells between triangles is filled while an opening stays open
+		static void Cover(const std::vector<float>& triangles, unsigned width, unsigned height, std::vector<char>& solid)
+		{
+			std::vector<char> covered(static_cast<size_t>(width) * height, 0);
+			for (size_t t = 0; t + 6 <= triangles.size(); t += 6) {
+				const float* p = &triangles[t];
+				const float area = (p[2] - p[0]) * (p[5] - p[1]) - (p[3] - p[1]) * (p[4] - p[0]);
+				if (!(std::fabs(area) > 1e-12f))
+					continue;
+				const float sign = area > 0.0f ? 1.0f : -1.0f;
+				const int minX = std::max(0, static_cast<int>(std::floor(std::min({ p[0], p[2], p[4] }) - 0.5f)));
+				const int maxX = std::min(static_cast<int>(width) - 1, static_cast<int>(std::ceil(std::max({ p[0], p[2], p[4] }) - 0.5f)));
+				const int minY = std::max(0, static_cast<int>(std::floor(std::min({ p[1], p[3], p[5] }) - 0.5f)));
+				const int maxY = std::min(static_cast<int>(height) - 1, static_cast<int>(std::ceil(std::max({ p[1], p[3], p[5] }) - 0.5f)));
+				for (int y = minY; y <= maxY; ++y)
+					for (int x = minX; x <= maxX; ++x) {
+						const float cx = x + 0.5f, cy = y + 0.5f;
+						bool inside = true;
+						for (int e = 0; e < 3 && inside; ++e) {
+							const float* a = p + 2 * e;
+							const float* b = p + 2 * ((e + 1) % 3);
+							inside = sign * ((b[0] - a[0]) * (cy - a[1]) - (b[1] - a[1]) * (cx - a[0])) >= 0.0f;
+						}
+						if (inside)
+							covered[static_cast<size_t>(y) * width + x] = 1;
+					}
+			}
+			// each cell set when all (shrink) or any (grow) of its 3x3 neighbours inside the grid are
+			auto spread = [&](const std::vector<char>& from, std::vector<char>& to, bool all) {
+				to.assign(from.size(), 0);
+				for (unsigned y = 0; y < height; ++y)
+					for (unsigned x = 0; x < width; ++x) {
+						bool set = all;
+						for (unsigned j = y ? y - 1 : 0; j <= y + 1 && j < height; ++j)
+							for (unsigned i = x ? x - 1 : 0; i <= x + 1 && i < width; ++i)
+								set = all ? set && from[static_cast<size_t>(j) * width + i] : set || from[static_cast<size_t>(j) * width + i];
+						to[static_cast<size_t>(y) * width + x] = set;
+					}
+			};
+			std::vector<char> grown;
+			spread(covered, grown, false);
+			spread(grown, solid, true);
+			for (size_t c = 0; c < solid.size(); ++c)
+				solid[c] |= covered[c];
+		}
+
+		// a rectangle's corners in order around it, in cells of its width and height
+		static constexpr float QUAD_CORNERS[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+		// greedy rectangles over a width x height grid of solid cells (cleared as they are taken):
+		// as wide as the row allows, then as many rows as stay solid, emit(x, y, w, h) for each
+		template<typename EMIT>
+		static void Rectangles(std::vector<char>& solid, unsigned width, unsigned height, const EMIT& emit)
+		{
+			for (unsigned y = 0; y < height; ++y)
+				for (unsigned x = 0; x < width; ++x) {
+					if (!solid[static_cast<size_t>(y) * width + x])
+						continue;
+					unsigned w = 1, h = 1;
+					while (x + w < width && solid[static_cast<size_t>(y) * width + x + w])
+						++w;
+					while (y + h < height) {
+						bool full = true;
+						for (unsigned i = x; i < x + w; ++i)
+							full &= solid[static_cast<size_t>(y + h) * width + i] != 0;
+						if (!full)
+							break;
+						++h;
+					}
+					for (unsigned j = y; j < y + h; ++j)
+						std::fill(solid.begin() + static_cast<size_t>(j) * width + x, solid.begin() + static_cast<size_t>(j) * width + x + w, 0);
+					emit(x, y, w, h);
+				}
+		}
+
+		// the occluder instances in world space, merged per plane: instances whose slabs share a plane (their
+		// middle planes within the thinner slab's half thickness of each other) have a side's triangles
+		// projected together onto one grid in it, Cover finds the cells they cover between them and the
+		// grid's rectangles become that side's quads, on the deepest of the sides' core planes. Where pieces
+		// overlap one covers the other's cracks, where they touch Cover closes the seam, so a wall of modular
+		// pieces occludes as one
+		void Merge(const std::vector<INSTANCE>& instances)
+		{
+			struct SLAB {
+				FLOAT3 origin, u, normal;	// the middle plane's corner at the asset's low u, v, the asset's u axis and the plane's normal
+				float offset;				// Dot(normal, origin)
+				float half;					// half the slab's thickness
+				float cell;					// the asset's smaller cell in world units
+				int major;					// axis of the normal's biggest component, which is positive
+				int up;						// the asset's side facing along normal
+			};
+			// object space point at along on the asset's thinnest axis and u, v on the other two
+			auto at = [](const OCCLUDER_MESH& mesh, float along, float u, float v, float point[3]) {
+				point[mesh.axis] = along;
+				point[(mesh.axis + 1) % 3] = u;
+				point[(mesh.axis + 2) % 3] = v;
+			};
+			std::vector<SLAB> slabs(occluders.size());
+			for (size_t k = 0; k < occluders.size(); ++k) {
+				const INSTANCE& instance = instances[occluders[k]];
+				const OCCLUDER_MESH& mesh = meshes[instance.asset];
+				float axes[3][3];
+				for (int a = 0; a < 3; ++a) {
+					const float unit[3] = { a == 0 ? 1.0f : 0.0f, a == 1 ? 1.0f : 0.0f, a == 2 ? 1.0f : 0.0f };
+					TransformNormal(unit, instance.world, axes[a]);
+				}
+				const FLOAT3 thin = { axes[mesh.axis][0], axes[mesh.axis][1], axes[mesh.axis][2] };
+				const float* u = axes[(mesh.axis + 1) % 3];
+				const float* v = axes[(mesh.axis + 2) % 3];
+				SLAB& slab = slabs[k];
+				slab.u = { u[0], u[1], u[2] };
+				slab.normal = Normalize(Cross(slab.u, { v[0], v[1], v[2] }));
+				slab.major = 0;
+				for (int a = 1; a < 3; ++a)
+					if (std::fabs((&slab.normal.x)[a]) > std::fabs((&slab.normal.x)[slab.major]))
+						slab.major = a;
+				if ((&slab.normal.x)[slab.major] < 0.0f)
+					slab.normal = { -slab.normal.x, -slab.normal.y, -slab.normal.z };
+				float corner[3], origin[4];
+				at(mesh, mesh.middle, mesh.low[0], mesh.low[1], corner);
+				TransformPoint(corner, instance.world, origin);
+				slab.origin = { origin[0], origin[1], origin[2] };
+				slab.offset = Dot(slab.normal, slab.origin);
+				slab.half = 0.5f * mesh.thickness * std::fabs(Dot(thin, slab.normal));
+				slab.cell = std::min(std::sqrt(Dot(slab.u, slab.u)) * mesh.cell[0], std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) * mesh.cell[1]);
+				slab.up = Dot(thin, slab.normal) > 0.0f;
+			}
+			// by plane, so a plane's instances are neighbours
+			std::vector<unsigned> order(occluders.size());
+			for (unsigned k = 0; k < order.size(); ++k)
+				order[k] = k;
+			std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+				return slabs[a].major != slabs[b].major ? slabs[a].major < slabs[b].major : slabs[a].offset < slabs[b].offset;
+			});
+			std::vector<char> taken(occluders.size(), 0);
+			std::vector<unsigned> members;
+			std::vector<float> triangles;
+			std::vector<char> solid;
+			// side 1 (facing along normal) or 0 of members, instances of the plane through origin with axes u, v,
+			// covered on one grid, or each on its own when the plane is too big for one
+			auto cover = [&](const unsigned* first, size_t count, int side, const FLOAT3& origin, const FLOAT3& u, const FLOAT3& v,
+				const FLOAT3& normal, float grow, auto& self) -> void {
+				auto project = [&](const INSTANCE& instance, float along, float pu, float pv, float out[3]) {
+					float point[3], world[4];
+					at(meshes[instance.asset], along, pu, pv, point);
+					TransformPoint(point, instance.world, world);
+					const FLOAT3 offset = Subtract({ world[0], world[1], world[2] }, origin);
+					out[0] = Dot(offset, u);
+					out[1] = Dot(offset, v);
+					out[2] = Dot(offset, normal);
+				};
+				float low[2] = { 1e30f, 1e30f }, high[2] = { -1e30f, -1e30f }, cell = 1e30f;
+				float plane = side ? 1e30f : -1e30f;
+				for (size_t m = 0; m < count; ++m) {
+					const INSTANCE& instance = instances[occluders[first[m]]];
+					const OCCLUDER_MESH& mesh = meshes[instance.asset];
+					const int own = side ? slabs[first[m]].up : 1 - slabs[first[m]].up;
+					if (mesh.triangles[own].empty())
+						continue;
+					for (const float* corner : QUAD_CORNERS) {
+						float point[3];
+						project(instance, mesh.core[own], corner[0] ? mesh.high[0] : mesh.low[0], corner[1] ? mesh.high[1] : mesh.low[1], point);
+						for (int a = 0; a < 2; ++a) {
+							low[a] = std::min(low[a], point[a]);
+							high[a] = std::max(high[a], point[a]);
+						}
+						plane = side ? std::min(plane, point[2]) : std::max(plane, point[2]);
+					}
+					cell = std::min(cell, slabs[first[m]].cell);
+				}
+				if (low[0] > high[0])
+					return;
+				// the grid's lines run along the first instance's
+				const float start[2] = { std::floor(low[0] / cell) * cell, std::floor(low[1] / cell) * cell };
+				const float cells[2] = { std::ceil((high[0] - start[0]) / cell), std::ceil((high[1] - start[1]) / cell) };
+				if (!(cell > 0.0f) || !(cells[0] * cells[1] <= static_cast<float>(MAX_MERGE_CELLS))) {
+					if (count > 1)
+						for (size_t m = 0; m < count; ++m)
+							self(first + m, 1, side, origin, u, v, normal, grow, self);
+					return;
+				}
+				const unsigned gridWidth = std::max(1u, static_cast<unsigned>(cells[0])), gridHeight = std::max(1u, static_cast<unsigned>(cells[1]));
+				triangles.clear();
+				for (size_t m = 0; m < count; ++m) {
+					const INSTANCE& instance = instances[occluders[first[m]]];
+					const OCCLUDER_MESH& mesh = meshes[instance.asset];
+					const int own = side ? slabs[first[m]].up : 1 - slabs[first[m]].up;
+					const std::vector<float>& flat = mesh.triangles[own];
+					for (size_t c = 0; c + 2 <= flat.size(); c += 2) {
+						float point[3];
+						project(instance, mesh.core[own], flat[c], flat[c + 1], point);
+						triangles.push_back((point[0] - start[0]) / cell);
+						triangles.push_back((point[1] - start[1]) / cell);
+					}
+				}
+				Cover(triangles, gridWidth, gridHeight, solid);
+				const FLOAT3 corner = { origin.x + normal.x * plane, origin.y + normal.y * plane, origin.z + normal.z * plane };
+				const FLOAT3 facing = side ? normal : FLOAT3{ -normal.x, -normal.y, -normal.z };
+				Rectangles(solid, gridWidth, gridHeight, [&](unsigned x, unsigned y, unsigned w, unsigned h) {
+					AddQuad(corner, u, v, facing, grow + std::fabs(plane), [&](int index, int a) {
+						return start[a] + (a == 0 ? x + QUAD_CORNERS[index][0] * w : y + QUAD_CORNERS[index][1] * h) * cell;
+					});
+				});
+			};
+			for (size_t first = 0; first < order.size(); ++first) {
+				if (taken[order[first]])
+					continue;
+				const SLAB& base = slabs[order[first]];
+				const FLOAT3 u = Normalize(Subtract(base.u, { base.normal.x * Dot(base.u, base.normal),
+					base.normal.y * Dot(base.u, base.normal), base.normal.z * Dot(base.u, base.normal) }));
+				const FLOAT3 v = Cross(base.normal, u);
+				members.clear();
+				float grow = base.half;
+				for (size_t next = first; next < order.size(); ++next) {
+					const unsigned k = order[next];
+					const SLAB& slab = slabs[k];
+					if (slab.major != base.major || slab.offset - base.offset > base.half + slab.half)
+						break;
+					if (taken[k] || Dot(slab.normal, base.normal) < 0.9995f)
+						continue;
+					// the corners of its middle plane have to be inside both slabs
+					const INSTANCE& instance = instances[occluders[k]];
+					const OCCLUDER_MESH& mesh = meshes[instance.asset];
+					float deviation = 0.0f;
+					for (const float* corner : QUAD_CORNERS) {
+						float point[3], world[4];
+						at(mesh, mesh.middle, corner[0] ? mesh.high[0] : mesh.low[0], corner[1] ? mesh.high[1] : mesh.low[1], point);
+						TransformPoint(point, instance.world, world);
+						deviation = std::max(deviation, std::fabs(Dot(Subtract({ world[0], world[1], world[2] }, base.origin), base.normal)));
+					}
+					if (deviation > std::min(base.half, slab.half))
+						continue;
+					taken[k] = 1;
+					members.push_back(k);
+					grow = std::max(grow, slab.half + deviation);
+				}
+				for (int side = 0; side < 2; ++side)
+					cover(members.data(), members.size(), side, base.origin, u, v, base.normal, grow, cover);
+			}
+		}
+		// a quad of the plane through origin facing normal, at(corner, 0/1) is the corner's u/v, grown by grow along normal for its bounds
+		template<typename AT>
+		void AddQuad(const FLOAT3& origin, const FLOAT3& u, const FLOAT3& v, const FLOAT3& normal, float grow, const AT& at)
+		{
+			OCCLUDER quad;
+			quad.bounds = EmptyBounds();
+			for (int corner = 0; corner < 4; ++corner) {
+				const float x = at(corner, 0), y = at(corner, 1);
+				quad.corners[corner][0] = origin.x + u.x * x + v.x * y;
+				quad.corners[corner][1] = origin.y + u.y * x + v.y * y;
+				quad.corners[corner][2] = origin.z + u.z * x + v.z * y;
+				for (int a = 0; a < 3; ++a) {
+					quad.bounds.min[a] = std::min(quad.bounds.min[a], quad.corners[corner][a]);
+					quad.bounds.max[a] = std::max(quad.bounds.max[a], quad.corners[corner][a]);
+				}
+			}
+			for (int a = 0; a < 3; ++a) {
+				quad.bounds.min[a] -= std::fabs((&normal.x)[a]) * grow;
+				quad.bounds.max[a] += std::fabs((&normal.x)[a]) * grow;
+			}
+			quad.normal = normal;
+			quad.offset = Dot(normal, origin);
+			quads.push_back(quad);
+		}
+
+	public:
+		void Clear()
+		{
+			meshes.clear();
+			occluders.clear();
+			quads.clear();
+			active = false;
+			stats = OCCLUSION_STATS();
+		}
+
+		// picks the occluders among instances, worldBounds[i] is instances[i]'s world box
+		void Build(const std::vector<INSTANCE>& instances, const AssetCache& assets, const std::vector<AABB>& worldBounds,
+			const OCCLUSION_OPTIONS& occlusionOptions = OCCLUSION_OPTIONS())
+		{
+			Clear();
+			options = occlusionOptions;
+			width = (std::max(options.width, 1u) + LANES_MASK) & ~LANES_MASK;
+			height = std::max(options.height, 1u);
+			levelStart.clear();
+			levelWidth.clear();
+			levelHeight.clear();
+			size_t size = 0;
+			for (unsigned w = width, h = height;; w = (w + 1) / 2, h = (h + 1) / 2) {
+				levelStart.push_back(size);
+				levelWidth.push_back(w);
+				levelHeight.push_back(h);
+				size += static_cast<size_t>(w) * h;
+				if (w == 1 && h == 1)
+					break;
+			}
+			depth.assign(size, 1.0f);
+
+			meshes.resize(assets.Capacity());
+			std::vector<char> eligible(assets.Capacity(), 0), checked(assets.Capacity(), 0);
+			for (unsigned i = 0; i < instances.size(); ++i) {
+				const AssetHandle asset = instances[i].asset;
+				if (!assets.IsValid(asset))
+					continue;
+				if (!checked[asset]) {
+					checked[asset] = 1;
+					const H2B::Parser& model = assets.Get(asset);
+					bool opaque = true;
+					for (const H2B::MESH& mesh : model.meshes)
+						opaque &= model.materials[mesh.materialIndex].attrib.d >= 1.0f;
+					if (opaque && model.meshCount > 0 && assets.Lods(asset).triangles[0] <= options.maxOccluderTriangles)
+						BuildMesh(model, assets.Lods(asset), meshes[asset]);
+					eligible[asset] = !meshes[asset].triangles[0].empty() || !meshes[asset].triangles[1].empty();
+				}
+				unsigned bigAxes = 0;
+				for (int a = 0; a < 3; ++a)
+					bigAxes += worldBounds[i].max[a] - worldBounds[i].min[a] >= options.minOccluderSize;
+				if (eligible[asset] && bigAxes >= 2)
+					occluders.push_back(i);
+			}
+			Merge(instances);
+			stats.occluders = static_cast<unsigned>(occluders.size());
+			stats.quads = static_cast<unsigned>(quads.size());
+		}
+
+		// draws this frame's occluders for the camera at eye, jobs (optional) fills bands of rows in parallel
+		void Render(const MATRIX& cameraViewProjection, const FLOAT3& eye, const FRUSTUM& frustum, JobSystem* jobs = nullptr)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			viewProjection = cameraViewProjection;
+			stats.rasterized = stats.polygons = stats.tested = stats.culled = 0;
+			stats.testMs = 0.0;
+			std::fill(depth.begin(), depth.end(), 1.0f);
+
+			// the quads in the frustum, biggest on screen first (anything through the near plane is the biggest).
+			// A camera inside the slabs a quad came from sees the back of their faces (culled), the quad would hide too much
+			candidates.clear();
+			for (unsigned q = 0; q < quads.size(); ++q) {
+				const AABB& box = quads[q].bounds;
+				unsigned planeMask = 0x3F;
+				if (TestBounds(frustum, box, planeMask) == CULL_OUTSIDE)
+					continue;
+				if (Dot(quads[q].normal, eye) <= quads[q].offset)
+					continue;
+				if (eye.x >= box.min[0] && eye.x <= box.max[0] && eye.y >= box.min[1] && eye.y <= box.max[1] && eye.z >= box.min[2] && eye.z <= box.max[2])
+					continue;
+				float rect[4], nearest;
+				float area = 1e30f;
+				if (Project(box, rect, nearest))
+					area = (std::min(rect[2], static_cast<float>(width)) - std::max(rect[0], 0.0f)) *
+						(std::min(rect[3], static_cast<float>(height)) - std::max(rect[1], 0.0f));
+				candidates.push_back({ -area, q });
+			}
+			const size_t count = std::min<size_t>(candidates.size(), options.maxOccluders);
+			std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+			polygons.clear();
+			for (size_t c = 0; c < count; ++c) {
+				const OCCLUDER& quad = quads[candidates[c].second];
+				float corners[4][4];
+				for (int corner = 0; corner < 4; ++corner)
+					TransformPoint(quad.corners[corner], viewProjection, corners[corner]);
+				Setup(&corners[0][0]);
+			}
+			stats.rasterized = static_cast<unsigned>(count);
+			stats.polygons = static_cast<unsigned>(polygons.size());
+			active = !polygons.empty();
+			if (active) {
+				const unsigned bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+				ParallelFor(jobs, bands, 1, [&](unsigned begin, unsigned end) {
+					Fill(begin * BAND_ROWS, std::min(end * BAND_ROWS, height));
+				});
+				BuildMips();
+			}
+			stats.rasterizeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		// true unless the box is behind this frame's occluders
+		bool Visible(const AABB& bounds) const
+		{
+			float rect[4], nearest;
+			if (!active || !Project(bounds, rect, nearest))
+				return true;
+			const int x0 = std::max(0, static_cast<int>(std::floor(rect[0]))), y0 = std::max(0, static_cast<int>(std::floor(rect[1])));
+			const int x1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor(rect[2])));
+			const int y1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor(rect[3])));
+			if (x0 > x1 || y0 > y1)
+				return true;
+			// the level where the rect covers at most 2x2 texels
+			unsigned level = 0;
+			while (level + 1 < levelStart.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+				++level;
+			const float* texels = &depth[levelStart[level]];
+			for (int y = y0 >> level; y <= y1 >> level; ++y)
+				for (int x = x0 >> level; x <= x1 >> level; ++x)
+					if (nearest <= texels[y * levelWidth[level] + x])
+						return true;
+			return false;
+		}
+
+		// removes the hidden entries of list (order kept), boundsOf(entry) is the entry's world box
+		template<typename BOUNDS_OF>
+		void Cull(std::vector<unsigned>& list, BOUNDS_OF boundsOf, JobSystem* jobs = nullptr)
+		{
+			if (!active)
+				return;
+			const auto start = std::chrono::steady_clock::now();
+			hidden.assign(list.size(), 0);
+			ParallelFor(jobs, static_cast<unsigned>(list.size()), 256, [&](unsigned begin, unsigned end) {
+				for (unsigned i = begin; i < end; ++i)
+					hidden[i] = !Visible(boundsOf(list[i]));
+			});
+			size_t kept = 0;
+			for (size_t i = 0; i < list.size(); ++i)
+				if (!hidden[i])
+					list[kept++] = list[i];
+			stats.tested += static_cast<unsigned>(list.size());
+			stats.culled += static_cast<unsigned>(list.size() - kept);
+			list.resize(kept);
+			stats.testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		const OCCLUSION_STATS& Stats() const {
+			return stats;
+		}
+		unsigned OccluderCount() const {
+			return static_cast<unsigned>(occluders.size());
+		}
+		unsigned QuadCount() const {
+			return static_cast<unsigned>(quads.size());
+		}
+		// level 0 of this frame's depth buffer, Width() x Height(), 1 where nothing was drawn
+		const float* DepthBuffer() const {
+			return depth.data();
+		}
+		unsigned Width() const {
+			return width;
+		}
+		unsigned Height() const {
+			return height;
+		}
+	};
+}
+#endif
@@ -0,0 +1,401 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+// Frame profiler. LEVEL_PROFILE_SCOPE("name") times the rest of the enclosing
+// block, LEVEL_PROFILE_COUNT("name", n) adds n to a per frame counter and
+// LEVEL_PROFILE_FRAME() closes the frame. Every thread writes into a ring of
+// its own, the only shared write is publishing the ring's count, so timing a
+// scope never takes a lock. EndFrame (one thread, once a frame) drains the
+// rings into per frame totals, a rolling window for average/p95/p99 and the
+// last traceFrames frames, which WriteChromeTrace exports as Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev).
+// The macros only exist when LEVEL_ENABLE_PROFILER is defined (CMake option
+// of the same name), otherwise they compile to nothing. Enabled, a scope is
+// two steady_clock reads and a 32 byte write, Level_Benchmark profiler
+// measures it: about 90 ns per scope on the machine it was written on, where a
+// single steady_clock read was 44 ns, and 60 ns per event for EndFrame.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Level {
+
+	struct PROFILE_EVENT {
+		const char* name;			// a string literal, kept by pointer
+		unsigned long long start;	// ns since the profiler started
+		unsigned long long end;		// equal to start for counters
+		unsigned long long value;	// counters only
+		bool counter;
+	};
+
+	// rolling window numbers of one scope (times in ms, per frame totals over every thread)
+	struct SCOPE_SUMMARY {
+		std::string name;
+		double calls;		// average per frame
+		double average, p95, p99, max;
+	};
+	struct COUNTER_SUMMARY {
+		std::string name;
+		double average;		// per frame
+		unsigned long long max;
+	};
+
+	struct PROFILER_STATS {
+		unsigned long long frames;		// EndFrame calls
+		unsigned long long events;		// scopes and counters collected
+		unsigned long long dropped;		// overwritten before EndFrame could collect them
+		unsigned threads;				// threads that recorded anything
+	};
+
+	class Profiler
+	{
+		// written by its thread only, read by EndFrame
+		struct THREAD_EVENTS {
+			static constexpr unsigned CAPACITY = 1u << 15;	// per thread between two EndFrames
+			std::vector<PROFILE_EVENT> events = std::vector<PROFILE_EVENT>(CAPACITY);
+			std::atomic<unsigned long long> written{ 0 };
+			unsigned long long read = 0;	// EndFrame's cursor
+			unsigned id = 0;
+			std::string name;
+		};
+		// one collected event and the thread it came from
+		struct TRACE_EVENT {
+			PROFILE_EVENT event;
+			unsigned thread;
+		};
+		struct FRAME {
+			unsigned long long index, start, end;
+			unsigned thread;	// the one that called EndFrame
+			std::vector<TRACE_EVENT> events;
+			std::map<std::string, unsigned long long> counters;
+		};
+		// last frames of one scope or counter, a ring of summaryFrames values
+		struct HISTORY {
+			std::vector<unsigned long long> values;	// ns for scopes
+			std::vector<unsigned> calls;
+			unsigned long long lastFrame = 0;		// frames it is missing from count as 0
+		};
+
+		const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+		mutable std::mutex threadsLock;	// registering a thread, EndFrame walking the list
+		std::vector<std::unique_ptr<THREAD_EVENTS>> threads;
+		mutable std::mutex historyLock;	// EndFrame against Summary/WriteChromeTrace
+		std::deque<FRAME> trace;
+		std::map<std::string, HISTORY> scopes, counters;
+		unsigned traceFrames = 300;
+		unsigned summaryFrames = 120;
+		unsigned long long frameStart = 0;
+		PROFILER_STATS stats = {};
+
+		Profiler() = default;
+
+		THREAD_EVENTS& Current()
+		{
+			static thread_local THREAD_EVENTS* current = nullptr;
+			if (current == nullptr) {
+				std::lock_guard<std::mutex> guard(threadsLock);
+				threads.emplace_back(new THREAD_EVENTS());
+				current = threads.back().get();
+				current->id = static_cast<unsigned>(threads.size());
+				current->name = current->id == 1 ? "main" : "thread " + std::to_string(current->id);
+			}
+			return *current;
+		}
+		void Push(const PROFILE_EVENT& event)
+		{
+			THREAD_EVENTS& thread = Current();
+			unsigned long long slot = thread.written.load(std::memory_order_relaxed);
+			thread.events[slot & (THREAD_EVENTS::CAPACITY - 1)] = event;
+			thread.written.store(slot + 1, std::memory_order_release);
+		}
+		// adds value as frame's entry in history, zero filling the frames it was absent from
+		void Remember(HISTORY& history, unsigned long long frame, unsigned long long value, unsigned calls)
+		{
+			if (history.values.size() != summaryFrames) {
+				history.values.assign(summaryFrames, 0);
+				history.calls.assign(summaryFrames, 0);
+			}
+			unsigned long long first = std::max(history.lastFrame + 1, frame >= summaryFrames ? frame - summaryFrames + 1 : 0);
+			for (unsigned long long f = first; f < frame; ++f) {
+				history.values[f % summaryFrames] = 0;
+				history.calls[f % summaryFrames] = 0;
+			}
+			history.values[frame % summaryFrames] = value;
+			history.calls[frame % summaryFrames] = calls;
+			history.lastFrame = frame;
+		}
+		static void AppendEscaped(std::string& out, const std::string& text)
+		{
+			for (char c : text) {
+				if (c == '"' || c == '\\')
+					out.push_back('\\');
+				if (static_cast<unsigned char>(c) >= 0x20)
+					out.push_back(c);
+			}
+		}
+
+	public:
+		static Profiler& Instance()
+		{
+			static Profiler profiler;
+			return profiler;
+		}
+
+		unsigned long long Now() const
+		{
+			return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - origin).count());
+		}
+		void Record(const char* name, unsigned long long start, unsigned long long end)
+		{
+			Push({ name, start, end, 0, false });
+		}
+		void Count(const char* name, unsigned long long value)
+		{
+			unsigned long long now = Now();
+			Push({ name, now, now, value, true });
+		}
+		// the calling thread's track name in the trace
+		void SetThreadName(const std::string& name)
+		{
+			THREAD_EVENTS& thread = Current();
+			std::lock_guard<std::mutex> guard(threadsLock);
+			thread.name = name;
+		}
+		// frames WriteChromeTrace keeps and frames the summary averages over, clears both
+		void SetWindow(unsigned keepTraceFrames, unsigned keepSummaryFrames)
+		{
+			std::lock_guard<std::mutex> guard(historyLock);
+			traceFrames = keepTraceFrames;
+			summaryFrames = std::max(1u, keepSummaryFrames);
+			trace.clear();
+			scopes.clear();
+			counters.clear();
+		}
+
+		// collects every thread's events since the last call as one frame
+		void EndFrame()
+		{
+			FRAME frame;
+			frame.end = Now();
+			frame.start = frameStart;
+			frame.thread = Current().id;
+			frameStart = frame.end;
+			{
+				std::lock_guard<std::mutex> guard(threadsLock);
+				for (const std::unique_ptr<THREAD_EVENTS>& thread : threads) {
+					unsigned long long written = thread->written.load(std::memory_order_acquire);
+					if (written - thread->read > THREAD_EVENTS::CAPACITY) {
+						stats.dropped += written - thread->read - THREAD_EVENTS::CAPACITY;
+						thread->read = written - THREAD_EVENTS::CAPACITY;
+					}
+					size_t first = frame.events.size();
+					for (unsigned long long i = thread->read; i < written; ++i)
+						frame.events.push_back({ thread->events[i & (THREAD_EVENTS::CAPACITY - 1)], thread->id });
+					// slots the thread wrapped around to while they were copied are not trustworthy
+					unsigned long long now = thread->written.load(std::memory_order_acquire);
+					if (now - thread->read > THREAD_EVENTS::CAPACITY) {
+						unsigned long long torn = std::min(written - thread->read, now - thread->read - THREAD_EVENTS::CAPACITY);
+						frame.events.erase(frame.events.begin() + first, frame.events.begin() + first + static_cast<size_t>(torn));
+						stats.dropped += torn;
+					}
+					thread->read = written;
+				}
+				stats.threads = 0;
+				for (const std::unique_ptr<THREAD_EVENTS>& thread : threads)
+					stats.threads += thread->written.load(std::memory_order_relaxed) > 0;
+			}
+
+			std::lock_guard<std::mutex> guard(historyLock);
+			frame.index = ++stats.frames;
+			stats.events += frame.events.size();
+			// summed by literal first, the few distinct names are merged by text after
+			std::unordered_map<const char*, std::pair<unsigned long long, unsigned>> byName;
+			std::unordered_map<const char*, unsigned long long> counted;
+			for (const TRACE_EVENT& e : frame.events) {
+				if (e.event.counter) {
+					counted[e.event.name] += e.event.value;
+					continue;
+				}
+				std::pair<unsigned long long, unsigned>& total = byName[e.event.name];
+				total.first += e.event.end - e.event.start;
+				++total.second;
+			}
+			std::map<std::string, std::pair<unsigned long long, unsigned>> totals;
+			for (const auto& name : byName) {
+				std::pair<unsigned long long, unsigned>& total = totals[name.first];
+				total.first += name.second.first;
+				total.second += name.second.second;
+			}
+			for (const auto& counter : counted)
+				frame.counters[counter.first] += counter.second;
+			totals["Frame"] = { frame.end - frame.start, 1 };
+			for (const auto& total : totals)
+				Remember(scopes[total.first], frame.index, total.second.first, total.second.second);
+			for (const auto& counter : frame.counters)
+				Remember(counters[counter.first], frame.index, counter.second, 1);
+			if (traceFrames > 0) {
+				trace.push_back(std::move(frame));
+				while (trace.size() > traceFrames)
+					trace.pop_front();
+			}
+		}
+
+		// every scope seen in the last summaryFrames frames, slowest average first
+		std::vector<SCOPE_SUMMARY> Summary() const
+		{
+			std::lock_guard<std::mutex> guard(historyLock);
+			std::vector<SCOPE_SUMMARY> result;
+			const unsigned long long frames = std::min<unsigned long long>(stats.frames, summaryFrames);
+			for (const auto& scope : scopes) {
+				if (frames == 0 || scope.second.lastFrame + summaryFrames <= stats.frames)
+					continue;
+				std::vector<unsigned long long> values;
+				unsigned long long calls = 0;
+				for (unsigned long long f = stats.frames + 1 - frames; f <= stats.frames; ++f) {
+					bool present = f <= scope.second.lastFrame;
+					values.push_back(present ? scope.second.values[f % summaryFrames] : 0);
+					calls += present ? scope.second.calls[f % summaryFrames] : 0;
+				}
+				std::sort(values.begin(), values.end());
+				double sum = 0;
+				for (unsigned long long v : values)
+					sum += static_cast<double>(v);
+				auto percentile = [&](double p) {
+					return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))] / 1e6;
+				};
+				result.push_back({ scope.first, static_cast<double>(calls) / frames, sum / frames / 1e6,
+					percentile(0.95), percentile(0.99), values.back() / 1e6 });
+			}
+			std::sort(result.begin(), result.end(), [](const SCOPE_SUMMARY& a, const SCOPE_SUMMARY& b) {
+				return a.average > b.average;
+			});
+			return result;
+		}
+		std::vector<COUNTER_SUMMARY> CounterSummary() const
+		{
+			std::lock_guard<std::mutex> guard(historyLock);
+			std::vector<COUNTER_SUMMARY> result;
+			const unsigned long long frames = std::min<unsigned long long>(stats.frames, summaryFrames);
+			for (const auto& counter : counters) {
+				if (frames == 0 || counter.second.lastFrame + summaryFrames <= stats.frames)
+					continue;
+				COUNTER_SUMMARY summary = { counter.first, 0.0, 0 };
+				for (unsigned long long f = stats.frames + 1 - frames; f <= counter.second.lastFrame; ++f) {
+					summary.average += static_cast<double>(counter.second.values[f % summaryFrames]) / frames;
+					summary.max = std::max(summary.max, counter.second.values[f % summaryFrames]);
+				}
+				result.push_back(summary);
+			}
+			return result;
+		}
+		// the summary as a table, for logs and consoles
+		std::string FormatSummary() const
+		{
+			std::string text;
+			char line[160];
+			std::snprintf(line, sizeof(line), "%-28s %8s %9s %9s %9s %9s\n", "scope (ms/frame)", "calls", "average", "p95", "p99", "max");
+			text += line;
+			for (const SCOPE_SUMMARY& scope : Summary()) {
+				std::snprintf(line, sizeof(line), "%-28s %8.1f %9.3f %9.3f %9.3f %9.3f\n", scope.name.c_str(),
+					scope.calls, scope.average, scope.p95, scope.p99, scope.max);
+				text += line;
+			}
+			for (const COUNTER_SUMMARY& counter : CounterSummary()) {
+				std::snprintf(line, sizeof(line), "%-28s %8s %9.1f %29llu\n", counter.name.c_str(), "", counter.average, counter.max);
+				text += line;
+			}
+			return text;
+		}
+
+		// the kept frames in Chrome's trace event format, false if the file can not be written
+		bool WriteChromeTrace(const char* path) const
+		{
+			std::string json = "{\"traceEvents\":[\n";
+			char number[96];
+			auto microseconds = [&](unsigned long long ns) {
+				std::snprintf(number, sizeof(number), "%.3f", ns / 1000.0);
+				return std::string(number);
+			};
+			{
+				std::lock_guard<std::mutex> guard(threadsLock);
+				for (const std::unique_ptr<THREAD_EVENTS>& thread : threads) {
+					json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread->id) + ",\"args\":{\"name\":\"";
+					AppendEscaped(json, thread->name);
+					json += "\"}},\n";
+				}
+			}
+			std::lock_guard<std::mutex> guard(historyLock);
+			for (const FRAME& frame : trace) {
+				json += "{\"name\":\"Frame " + std::to_string(frame.index) + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" +
+					std::to_string(frame.thread) + ",\"ts\":" + microseconds(frame.start) + ",\"dur\":" +
+					microseconds(frame.end - frame.start) + "},\n";
+				for (const TRACE_EVENT& e : frame.events) {
+					if (e.event.counter)
+						continue;
+					json += "{\"name\":\"";
+					AppendEscaped(json, e.event.name);
+					json += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(e.thread) + ",\"ts\":" +
+						microseconds(e.event.start) + ",\"dur\":" + microseconds(e.event.end - e.event.start) + "},\n";
+				}
+				for (const auto& counter : frame.counters) {
+					json += "{\"name\":\"";
+					AppendEscaped(json, counter.first);
+					json += "\",\"ph\":\"C\",\"pid\":1,\"ts\":" + microseconds(frame.end) + ",\"args\":{\"value\":" +
+						std::to_string(counter.second) + "}},\n";
+				}
+			}
+			// the metadata above always leaves a trailing comma
+			json.resize(json.size() - 2);
+			json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+			FILE* file = std::fopen(path, "wb");
+			if (file == nullptr)
+				return false;
+			bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+			return std::fclose(file) == 0 && written;
+		}
+
+		PROFILER_STATS Stats() const
+		{
+			std::lock_guard<std::mutex> guard(historyLock);
+			return stats;
+		}
+	};
+
+	// times its own lifetime, what LEVEL_PROFILE_SCOPE declares
+	class ScopedTimer
+	{
+		const char* name;
+		unsigned long long start;
+	public:
+		explicit ScopedTimer(const char* scopeName) : name(scopeName), start(Profiler::Instance().Now()) {}
+		~ScopedTimer() {
+			Profiler& profiler = Profiler::Instance();
+			profiler.Record(name, start, profiler.Now());
+		}
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+	};
+}
+
+#define LEVEL_PROFILE_JOIN2(a, b) a##b
+#define LEVEL_PROFILE_JOIN(a, b) LEVEL_PROFILE_JOIN2(a, b)
+#if defined(LEVEL_ENABLE_PROFILER)
+#define LEVEL_PROFILE_SCOPE(name) Level::ScopedTimer LEVEL_PROFILE_JOIN(levelProfileScope, __LINE__)(name)
+#define LEVEL_PROFILE_COUNT(name, value) Level::Profiler::Instance().Count(name, static_cast<unsigned long long>(value))
+#define LEVEL_PROFILE_THREAD(name) Level::Profiler::Instance().SetThreadName(name)
+#define LEVEL_PROFILE_FRAME() Level::Profiler::Instance().EndFrame()
+#else
+#define LEVEL_PROFILE_SCOPE(name) ((void)0)
+#define LEVEL_PROFILE_COUNT(name, value) ((void)0)
+#define LEVEL_PROFILE_THREAD(name) ((void)0)
+#define LEVEL_PROFILE_FRAME() ((void)0)
+#endif
+#endif
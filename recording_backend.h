@@ -0,0 +1,359 @@
+#ifndef _RECORDING_BACKEND_H_
+#define _RECORDING_BACKEND_H_
+// Headless Level::RenderBackend that records every call into a compact byte
+// stream instead of talking to a GPU. Used to measure the CPU cost of building
+// a frame and to diff the command stream between changes.
+//
+// Stream layout: one opcode byte followed by that command's fixed size payload.
+// Buffer contents are not stored, uploads record their size and a hash.
+// Command lists are recording backends of their own whose streams are
+// appended to this one's when they are executed.
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "level_hash.h"
+#include "render_backend.h"
+
+namespace Level {
+
+	struct RECORDING_COUNTERS {
+		unsigned commands;
+		unsigned draws;				// DrawIndexed + DrawIndexedInstanced
+		unsigned instances;			// instances submitted (1 per DrawIndexed)
+		unsigned long long indices;	// indices submitted, times instances
+		unsigned stateChanges;		// pipeline/vertex/index/constant buffer/shader resource binds
+		unsigned bufferUpdates;		// UpdateBuffer + UpdateBufferRange
+		unsigned long long bytesUploaded; // UpdateBuffer + CreateBuffer initial data
+		unsigned buffersCreated;
+		unsigned buffersReleased;
+		unsigned pipelinesCreated;
+	};
+
+	class RecordingBackend : public RenderBackend
+	{
+	public:
+		enum OPCODE : unsigned char {
+			CREATE_BUFFER = 1, RELEASE_BUFFER, CREATE_PIPELINE, SET_PIPELINE, SET_VERTEX_BUFFERS,
+			SET_INDEX_BUFFER, SET_CONSTANT_BUFFER, UPDATE_BUFFER, DRAW_INDEXED, DRAW_INDEXED_INSTANCED,
+			SET_CONSTANT_BUFFER_RANGE, SET_SHADER_RESOURCE, UPDATE_BUFFER_RANGE
+		};
+
+	private:
+		std::vector<unsigned char> stream;
+		RECORDING_COUNTERS counters = {};
+		std::vector<BUFFER_DESC> buffers;		// index = handle - 1
+		std::vector<bool> bufferAlive;
+		std::vector<BufferHandle> freeBuffers;
+		std::vector<unsigned long long> pipelines; // description hash, index = handle - 1
+		std::vector<std::unique_ptr<RecordingBackend>> lists, freeLists;
+
+		template<typename T>
+		void Write(const T& value) {
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			stream.insert(stream.end(), bytes, bytes + sizeof(T));
+		}
+		void Begin(OPCODE op) {
+			stream.push_back(op);
+			++counters.commands;
+		}
+		template<typename T>
+		static T Read(const unsigned char*& at) {
+			T value;
+			std::memcpy(&value, at, sizeof(T));
+			at += sizeof(T);
+			return value;
+		}
+
+	public:
+		BufferHandle CreateBuffer(const BUFFER_DESC& desc, const void* initialData) override
+		{
+			BufferHandle handle;
+			if (freeBuffers.empty()) {
+				buffers.push_back(desc);
+				bufferAlive.push_back(true);
+				handle = static_cast<BufferHandle>(buffers.size());
+			}
+			else {
+				handle = freeBuffers.back();
+				freeBuffers.pop_back();
+				buffers[handle - 1] = desc;
+				bufferAlive[handle - 1] = true;
+			}
+			Begin(CREATE_BUFFER);
+			Write(handle);
+			Write(static_cast<unsigned char>(desc.type));
+			Write(static_cast<unsigned char>(desc.usage));
+			Write(desc.byteWidth);
+			Write(initialData != nullptr ? HashBytes(initialData, desc.byteWidth) : 0ull);
+			++counters.buffersCreated;
+			if (initialData != nullptr)
+				counters.bytesUploaded += desc.byteWidth;
+			return handle;
+		}
+		void ReleaseBuffer(BufferHandle buffer) override
+		{
+			if (buffer == INVALID_BUFFER || buffer > buffers.size() || !bufferAlive[buffer - 1])
+				return;
+			bufferAlive[buffer - 1] = false;
+			freeBuffers.push_back(buffer);
+			Begin(RELEASE_BUFFER);
+			Write(buffer);
+			++counters.buffersReleased;
+		}
+		PipelineHandle CreatePipeline(const PIPELINE_DESC& desc) override
+		{
+			unsigned long long key = HashString(desc.vertexShaderPath ? desc.vertexShaderPath : "");
+			key = HashString(desc.pixelShaderPath ? desc.pixelShaderPath : "", key);
+			key = HashBytes(&desc.instanced, sizeof(desc.instanced), key);
+			// only hashed when set so FULL vertex pipelines keep their keys
+			if (desc.compactVertices)
+				key = HashBytes(&desc.compactVertices, sizeof(desc.compactVertices), key);
+			for (size_t i = 0; i < pipelines.size(); ++i)
+				if (pipelines[i] == key)
+					return static_cast<PipelineHandle>(i + 1);
+			pipelines.push_back(key);
+			PipelineHandle handle = static_cast<PipelineHandle>(pipelines.size());
+			Begin(CREATE_PIPELINE);
+			Write(handle);
+			Write(key);
+			++counters.pipelinesCreated;
+			return handle;
+		}
+
+		void SetPipeline(PipelineHandle pipeline) override
+		{
+			Begin(SET_PIPELINE);
+			Write(pipeline);
+			++counters.stateChanges;
+		}
+		void SetVertexBuffers(unsigned startSlot, unsigned count, const BufferHandle* vertexBuffers,
+			const unsigned* strides, const unsigned* offsets) override
+		{
+			Begin(SET_VERTEX_BUFFERS);
+			Write(static_cast<unsigned char>(startSlot));
+			Write(static_cast<unsigned char>(count));
+			for (unsigned i = 0; i < count; ++i) {
+				Write(vertexBuffers[i]);
+				Write(strides[i]);
+				Write(offsets[i]);
+			}
+			++counters.stateChanges;
+		}
+		void SetIndexBuffer(BufferHandle buffer, INDEX_FORMAT format, unsigned offset) override
+		{
+			Begin(SET_INDEX_BUFFER);
+			Write(buffer);
+			Write(static_cast<unsigned char>(format));
+			Write(offset);
+			++counters.stateChanges;
+		}
+		void SetConstantBuffer(unsigned slot, BufferHandle buffer, unsigned stages) override
+		{
+			Begin(SET_CONSTANT_BUFFER);
+			Write(static_cast<unsigned char>(slot));
+			Write(static_cast<unsigned char>(stages));
+			Write(buffer);
+			++counters.stateChanges;
+		}
+		void SetConstantBufferRange(unsigned slot, BufferHandle buffer, unsigned byteOffset, unsigned byteCount,
+			unsigned stages) override
+		{
+			Begin(SET_CONSTANT_BUFFER_RANGE);
+			Write(static_cast<unsigned char>(slot));
+			Write(static_cast<unsigned char>(stages));
+			Write(buffer);
+			Write(byteOffset);
+			Write(byteCount);
+			++counters.stateChanges;
+		}
+		void SetShaderResource(unsigned slot, BufferHandle buffer, unsigned stages) override
+		{
+			Begin(SET_SHADER_RESOURCE);
+			Write(static_cast<unsigned char>(slot));
+			Write(static_cast<unsigned char>(stages));
+			Write(buffer);
+			++counters.stateChanges;
+		}
+		void UpdateBufferRange(BufferHandle buffer, unsigned byteOffset, const void* data, unsigned byteCount,
+			bool discard) override
+		{
+			Begin(UPDATE_BUFFER_RANGE);
+			Write(buffer);
+			Write(static_cast<unsigned char>(discard));
+			Write(byteOffset);
+			Write(byteCount);
+			Write(HashBytes(data, byteCount));
+			++counters.bufferUpdates;
+			counters.bytesUploaded += byteCount;
+		}
+		void UpdateBuffer(BufferHandle buffer, const void* data, unsigned byteCount) override
+		{
+			Begin(UPDATE_BUFFER);
+			Write(buffer);
+			Write(byteCount);
+			Write(HashBytes(data, byteCount));
+			++counters.bufferUpdates;
+			counters.bytesUploaded += byteCount;
+		}
+		void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override
+		{
+			Begin(DRAW_INDEXED);
+			Write(indexCount);
+			Write(startIndex);
+			Write(baseVertex);
+			++counters.draws;
+			++counters.instances;
+			counters.indices += indexCount;
+		}
+		void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount,
+			unsigned startIndex, int baseVertex, unsigned startInstance) override
+		{
+			Begin(DRAW_INDEXED_INSTANCED);
+			Write(indexCount);
+			Write(instanceCount);
+			Write(startIndex);
+			Write(baseVertex);
+			Write(startInstance);
+			++counters.draws;
+			counters.instances += instanceCount;
+			counters.indices += static_cast<unsigned long long>(indexCount) * instanceCount;
+		}
+
+		RenderBackend* OpenCommandList() override
+		{
+			if (freeLists.empty())
+				lists.emplace_back(new RecordingBackend());
+			else {
+				lists.push_back(std::move(freeLists.back()));
+				freeLists.pop_back();
+			}
+			return lists.back().get();
+		}
+		void ExecuteCommandList(RenderBackend* list) override
+		{
+			for (size_t i = 0; i < lists.size(); ++i) {
+				if (lists[i].get() != list)
+					continue;
+				RecordingBackend& recorded = *lists[i];
+				stream.insert(stream.end(), recorded.stream.begin(), recorded.stream.end());
+				const RECORDING_COUNTERS& added = recorded.counters;
+				counters.commands += added.commands;
+				counters.draws += added.draws;
+				counters.instances += added.instances;
+				counters.indices += added.indices;
+				counters.stateChanges += added.stateChanges;
+				counters.bufferUpdates += added.bufferUpdates;
+				counters.bytesUploaded += added.bytesUploaded;
+				recorded.ResetFrame();
+				freeLists.push_back(std::move(lists[i]));
+				lists.erase(lists.begin() + i);
+				return;
+			}
+		}
+
+		// start a new frame: clears the stream and counters, resources stay alive
+		void ResetFrame()
+		{
+			stream.clear();
+			counters = RECORDING_COUNTERS();
+		}
+		const std::vector<unsigned char>& Stream() const {
+			return stream;
+		}
+		const RECORDING_COUNTERS& Counters() const {
+			return counters;
+		}
+		unsigned long long StreamHash() const {
+			return HashBytes(stream.data(), stream.size());
+		}
+
+		// one line of text per command, for diffing two recordings
+		std::vector<std::string> Disassemble() const
+		{
+			std::vector<std::string> lines;
+			char line[256];
+			const unsigned char* at = stream.data();
+			const unsigned char* end = at + stream.size();
+			while (at < end) {
+				OPCODE op = static_cast<OPCODE>(*at++);
+				switch (op) {
+				case CREATE_BUFFER: {
+					unsigned handle = Read<unsigned>(at);
+					unsigned type = Read<unsigned char>(at), usage = Read<unsigned char>(at);
+					unsigned bytes = Read<unsigned>(at);
+					unsigned long long hash = Read<unsigned long long>(at);
+					std::snprintf(line, sizeof(line), "CreateBuffer #%u type %u usage %u bytes %u data %016llx", handle, type, usage, bytes, hash);
+					break; }
+				case RELEASE_BUFFER:
+					std::snprintf(line, sizeof(line), "ReleaseBuffer #%u", Read<unsigned>(at));
+					break;
+				case CREATE_PIPELINE: {
+					unsigned handle = Read<unsigned>(at);
+					unsigned long long key = Read<unsigned long long>(at);
+					std::snprintf(line, sizeof(line), "CreatePipeline #%u key %016llx", handle, key);
+					break; }
+				case SET_PIPELINE:
+					std::snprintf(line, sizeof(line), "SetPipeline #%u", Read<unsigned>(at));
+					break;
+				case SET_VERTEX_BUFFERS: {
+					unsigned slot = Read<unsigned char>(at), count = Read<unsigned char>(at);
+					int length = std::snprintf(line, sizeof(line), "SetVertexBuffers slot %u", slot);
+					for (unsigned i = 0; i < count; ++i) {
+						unsigned buffer = Read<unsigned>(at), stride = Read<unsigned>(at), offset = Read<unsigned>(at);
+						if (length < static_cast<int>(sizeof(line)))
+							length += std::snprintf(line + length, sizeof(line) - length, " #%u/%u/%u", buffer, stride, offset);
+					}
+					break; }
+				case SET_INDEX_BUFFER: {
+					unsigned buffer = Read<unsigned>(at), format = Read<unsigned char>(at), offset = Read<unsigned>(at);
+					std::snprintf(line, sizeof(line), "SetIndexBuffer #%u format %u offset %u", buffer, format, offset);
+					break; }
+				case SET_CONSTANT_BUFFER: {
+					unsigned slot = Read<unsigned char>(at), stages = Read<unsigned char>(at), buffer = Read<unsigned>(at);
+					std::snprintf(line, sizeof(line), "SetConstantBuffer b%u stages %u #%u", slot, stages, buffer);
+					break; }
+				case UPDATE_BUFFER: {
+					unsigned buffer = Read<unsigned>(at), bytes = Read<unsigned>(at);
+					unsigned long long hash = Read<unsigned long long>(at);
+					std::snprintf(line, sizeof(line), "UpdateBuffer #%u bytes %u data %016llx", buffer, bytes, hash);
+					break; }
+				case SET_CONSTANT_BUFFER_RANGE: {
+					unsigned slot = Read<unsigned char>(at), stages = Read<unsigned char>(at), buffer = Read<unsigned>(at);
+					unsigned offset = Read<unsigned>(at), bytes = Read<unsigned>(at);
+					std::snprintf(line, sizeof(line), "SetConstantBufferRange b%u stages %u #%u offset %u bytes %u", slot, stages, buffer, offset, bytes);
+					break; }
+				case SET_SHADER_RESOURCE: {
+					unsigned slot = Read<unsigned char>(at), stages = Read<unsigned char>(at), buffer = Read<unsigned>(at);
+					std::snprintf(line, sizeof(line), "SetShaderResource t%u stages %u #%u", slot, stages, buffer);
+					break; }
+				case UPDATE_BUFFER_RANGE: {
+					unsigned buffer = Read<unsigned>(at), discard = Read<unsigned char>(at);
+					unsigned offset = Read<unsigned>(at), bytes = Read<unsigned>(at);
+					unsigned long long hash = Read<unsigned long long>(at);
+					std::snprintf(line, sizeof(line), "UpdateBufferRange #%u offset %u bytes %u data %016llx%s", buffer, offset, bytes, hash,
+						discard ? " discard" : "");
+					break; }
+				case DRAW_INDEXED: {
+					unsigned count = Read<unsigned>(at), start = Read<unsigned>(at);
+					int base = Read<int>(at);
+					std::snprintf(line, sizeof(line), "DrawIndexed %u start %u base %d", count, start, base);
+					break; }
+				case DRAW_INDEXED_INSTANCED: {
+					unsigned count = Read<unsigned>(at), instances = Read<unsigned>(at), start = Read<unsigned>(at);
+					int base = Read<int>(at);
+					unsigned first = Read<unsigned>(at);
+					std::snprintf(line, sizeof(line), "DrawIndexedInstanced %u x%u start %u base %d first %u", count, instances, start, base, first);
+					break; }
+				default:
+					lines.push_back("<corrupt stream>");
+					return lines;
+				}
+				lines.push_back(line);
+			}
+			return lines;
+		}
+	};
+}
+#endif
@@ -0,0 +1,96 @@
+#ifndef _RENDER_BACKEND_H_
+#define _RENDER_BACKEND_H_
+// Thin interface between the level code and the graphics API.
+// Model/Level_Objects only create buffers, bind state, update constants and
+// draw through this, so the same frame can go to D3D11 (d3d11_backend.h) or
+// be recorded headless (recording_backend.h) for profiling and diffing.
+// Draws can also be recorded on other threads into command lists that are
+// played back on this backend's thread, see command_list.h.
+
+namespace Level {
+
+	// 0 is never a valid handle
+	typedef unsigned BufferHandle;
+	typedef unsigned PipelineHandle;
+	static const BufferHandle INVALID_BUFFER = 0;
+	static const PipelineHandle INVALID_PIPELINE = 0;
+
+	// STRUCTURED is read by shaders as a StructuredBuffer<T> (a t register)
+	enum class BUFFER_TYPE { VERTEX, INDEX, CONSTANT, STRUCTURED };
+	// IMMUTABLE: initial data only, DEFAULT: UpdateSubresource, DYNAMIC: Map/WRITE_DISCARD
+	enum class BUFFER_USAGE { IMMUTABLE, DEFAULT, DYNAMIC };
+	enum class INDEX_FORMAT { UINT16, UINT32 };
+
+	// shader stages a constant buffer is bound to
+	enum SHADER_STAGE { STAGE_VERTEX = 1, STAGE_PIXEL = 2, STAGE_VERTEX_PIXEL = 3 };
+
+	// offsets and sizes of constant buffer ranges are multiples of this (16 constants)
+	static const unsigned CONSTANT_ALIGNMENT = 256;
+
+	struct BUFFER_DESC {
+		BUFFER_TYPE type;
+		BUFFER_USAGE usage;
+		unsigned byteWidth;
+		unsigned structureStride = 0;	// STRUCTURED only, bytes per element
+	};
+
+	// shaders + matching input layout, always triangle lists
+	struct PIPELINE_DESC {
+		const char* vertexShaderPath;
+		const char* pixelShaderPath;
+		bool instanced; // USE_INSTANCING vertex shader, world matrix rows in slot 1
+		bool compactVertices; // USE_COMPACT_VERTICES, Level::COMPACT_VERTEX in slot 0 (vertex_format.h)
+	};
+
+	class RenderBackend
+	{
+	public:
+		virtual ~RenderBackend() {}
+
+		// initialData may be nullptr for DEFAULT/DYNAMIC buffers
+		virtual BufferHandle CreateBuffer(const BUFFER_DESC& desc, const void* initialData) = 0;
+		virtual void ReleaseBuffer(BufferHandle buffer) = 0;
+		// identical descriptions return the same handle
+		virtual PipelineHandle CreatePipeline(const PIPELINE_DESC& desc) = 0;
+
+		virtual void SetPipeline(PipelineHandle pipeline) = 0;
+		virtual void SetVertexBuffers(unsigned startSlot, unsigned count, const BufferHandle* buffers,
+			const unsigned* strides, const unsigned* offsets) = 0;
+		virtual void SetIndexBuffer(BufferHandle buffer, INDEX_FORMAT format, unsigned offset) = 0;
+		virtual void SetConstantBuffer(unsigned slot, BufferHandle buffer, unsigned stages) = 0;
+		// binds byteCount bytes of a constant buffer starting at byteOffset, both CONSTANT_ALIGNMENT multiples
+		virtual void SetConstantBufferRange(unsigned slot, BufferHandle buffer, unsigned byteOffset, unsigned byteCount,
+			unsigned stages) = 0;
+		// STRUCTURED buffer to a t register
+		virtual void SetShaderResource(unsigned slot, BufferHandle buffer, unsigned stages) = 0;
+
+		// replaces the whole buffer (byteCount <= its byteWidth)
+		virtual void UpdateBuffer(BufferHandle buffer, const void* data, unsigned byteCount) = 0;
+		// DYNAMIC and DEFAULT buffers: writes part of the buffer without touching the rest.
+		// for DYNAMIC ones discard lets the old contents go (first write of a frame),
+		// otherwise the range must not overlap data a draw already used this frame.
+		// DEFAULT buffers ignore discard, the driver keeps earlier draws' data intact
+		virtual void UpdateBufferRange(BufferHandle buffer, unsigned byteOffset, const void* data, unsigned byteCount,
+			bool discard) = 0;
+
+		virtual void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) = 0;
+		virtual void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount,
+			unsigned startIndex, int baseVertex, unsigned startInstance) = 0;
+
+		// Command lists: OpenCommandList hands out a backend that one other thread records
+		// binds, updates and draws into (never resources), ExecuteCommandList plays it here
+		// and takes it back. Both are called on this backend's thread. nullptr means the
+		// backend has no lists of its own and Level::CommandList is recorded instead.
+		virtual RenderBackend* OpenCommandList() {
+			return nullptr;
+		}
+		virtual void ExecuteCommandList(RenderBackend* /*list*/) {}
+		// true if a list starts from what was bound here when it was opened and executing
+		// it leaves this backend's binds as they were (D3D11 deferred contexts), false if
+		// lists simply continue one another, like the recording backend's streams
+		virtual bool ListsAreIndependent() const {
+			return false;
+		}
+	};
+}
+#endif
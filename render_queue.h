@@ -0,0 +1,347 @@
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+// Sorted submission of the level's draws.
+// Every visible sub-mesh is pushed with a 64 bit key and the index of its
+// draw, the keys are radix sorted and the draws submitted in key order.
+// Opaque draws are grouped by state and go front to back within a state for
+// early Z, translucent ones (ATTRIBUTES::d < 1) come after them back to front.
+// StateCache sits between the submission and the backend and drops binds of
+// state that is already bound.
+#include <cstring>
+#include <vector>
+#include "render_backend.h"
+
+namespace Level {
+
+	// Key layout, most significant bit first
+	//   opaque:       0 | pipeline:7 | geometry:16 | material:16 | depth:24 (near first)
+	//   translucent:  1 | depth:24 (far first) | pipeline:7 | geometry:16 | material:16
+	// geometry is the asset (vertex/index buffers) and material the sub-mesh
+	// material of that asset, so geometry ranks above material: in this renderer
+	// a material is only constant data while geometry is two buffer binds.
+	namespace SORT_KEY {
+		static const unsigned PIPELINE_BITS = 7, GEOMETRY_BITS = 16, MATERIAL_BITS = 16, DEPTH_BITS = 24;
+		static const unsigned long long TRANSLUCENT = 1ull << 63;
+
+		// view space depth (distance along the view direction) to 24 ordered bits.
+		// a non negative float's bit pattern sorts like its value, the top 24 of its
+		// 31 bits keep 16 bits of mantissa. behind the camera clamps to 0
+		inline unsigned long long Depth(float viewDepth)
+		{
+			if (!(viewDepth > 0.0f))
+				return 0;
+			unsigned bits;
+			std::memcpy(&bits, &viewDepth, sizeof(bits));
+			return (bits >> 7) & ((1u << DEPTH_BITS) - 1);
+		}
+		inline unsigned long long State(unsigned pipeline, unsigned geometry, unsigned material)
+		{
+			return (static_cast<unsigned long long>(pipeline & ((1u << PIPELINE_BITS) - 1)) << (GEOMETRY_BITS + MATERIAL_BITS)) |
+				(static_cast<unsigned long long>(geometry & ((1u << GEOMETRY_BITS) - 1)) << MATERIAL_BITS) |
+				(material & ((1u << MATERIAL_BITS) - 1));
+		}
+		inline unsigned long long Opaque(unsigned pipeline, unsigned geometry, unsigned material, float viewDepth)
+		{
+			return (State(pipeline, geometry, material) << DEPTH_BITS) | Depth(viewDepth);
+		}
+		inline unsigned long long Translucent(unsigned pipeline, unsigned geometry, unsigned material, float viewDepth)
+		{
+			const unsigned long long farFirst = ((1ull << DEPTH_BITS) - 1) - Depth(viewDepth);
+			return TRANSLUCENT | (farFirst << (PIPELINE_BITS + GEOMETRY_BITS + MATERIAL_BITS)) |
+				State(pipeline, geometry, material);
+		}
+		inline bool IsTranslucent(unsigned long long key) {
+			return (key & TRANSLUCENT) != 0;
+		}
+	}
+
+	class RenderQueue
+	{
+		std::vector<unsigned long long> keys, sortedKeys;
+		std::vector<unsigned> draws, sortedDraws;
+		std::vector<unsigned> histogram;
+
+	public:
+		void Clear()
+		{
+			keys.clear();
+			draws.clear();
+		}
+		// draw is whatever index the caller uses to find the draw again
+		void Push(unsigned long long key, unsigned draw)
+		{
+			keys.push_back(key);
+			draws.push_back(draw);
+		}
+
+		// LSD radix sort, 8 bits per pass. stable, so equal keys keep push order,
+		// and passes where every key has the same byte are skipped
+		void Sort()
+		{
+			const size_t count = keys.size();
+			if (count < 2)
+				return;
+			sortedKeys.resize(count);
+			sortedDraws.resize(count);
+			histogram.assign(8 * 256, 0);
+			for (unsigned long long key : keys)
+				for (unsigned pass = 0; pass < 8; ++pass)
+					++histogram[pass * 256 + ((key >> (pass * 8)) & 0xFF)];
+			for (unsigned pass = 0; pass < 8; ++pass) {
+				unsigned* counts = &histogram[pass * 256];
+				if (counts[(keys[0] >> (pass * 8)) & 0xFF] == count)
+					continue;
+				unsigned offset = 0;
+				for (unsigned bucket = 0; bucket < 256; ++bucket) {
+					unsigned bucketCount = counts[bucket];
+					counts[bucket] = offset;
+					offset += bucketCount;
+				}
+				for (size_t i = 0; i < count; ++i) {
+					unsigned at = counts[(keys[i] >> (pass * 8)) & 0xFF]++;
+					sortedKeys[at] = keys[i];
+					sortedDraws[at] = draws[i];
+				}
+				keys.swap(sortedKeys);
+				draws.swap(sortedDraws);
+			}
+		}
+
+		size_t Size() const {
+			return keys.size();
+		}
+		unsigned long long Key(size_t i) const {
+			return keys[i];
+		}
+		unsigned Draw(size_t i) const {
+			return draws[i];
+		}
+	};
+
+	struct STATE_STATS {
+		unsigned issued;	// binds passed on to the backend
+		unsigned skipped;	// binds of state that was already bound
+	};
+
+	// RenderBackend that forwards to another one, minus redundant binds.
+	// Begin forgets what is bound since code outside the cache may have changed it,
+	// releasing a buffer does too because its handle can be handed out again.
+	// A copy plus Continue records a command list from the bound state onward.
+	class StateCache : public RenderBackend
+	{
+		static const unsigned VERTEX_SLOTS = 2, CONSTANT_SLOTS = 4, RESOURCE_SLOTS = 8;
+		struct VERTEX_BINDING {
+			BufferHandle buffer;
+			unsigned stride, offset;
+		};
+		struct CONSTANT_BINDING {
+			BufferHandle buffer;
+			unsigned stages;
+			unsigned byteOffset, byteCount;	// 0, 0 for the whole buffer
+		};
+		struct RESOURCE_BINDING {
+			BufferHandle buffer;
+			unsigned stages;
+		};
+
+		RenderBackend* target = nullptr;
+		bool pipelineKnown = false;
+		PipelineHandle pipeline = INVALID_PIPELINE;
+		bool vertexKnown[VERTEX_SLOTS] = {};
+		VERTEX_BINDING vertex[VERTEX_SLOTS] = {};
+		bool indexKnown = false;
+		BufferHandle indexBuffer = INVALID_BUFFER;
+		INDEX_FORMAT indexFormat = INDEX_FORMAT::UINT32;
+		unsigned indexOffset = 0;
+		bool constantKnown[CONSTANT_SLOTS] = {};
+		CONSTANT_BINDING constant[CONSTANT_SLOTS] = {};
+		bool resourceKnown[RESOURCE_SLOTS] = {};
+		RESOURCE_BINDING resource[RESOURCE_SLOTS] = {};
+		STATE_STATS stats = {};
+
+		// true if the binding is already there, otherwise remembers it
+		bool Bound(unsigned slot, const CONSTANT_BINDING& binding)
+		{
+			if (slot >= CONSTANT_SLOTS)
+				return false;
+			const CONSTANT_BINDING& bound = constant[slot];
+			if (constantKnown[slot] && bound.buffer == binding.buffer && bound.stages == binding.stages &&
+				bound.byteOffset == binding.byteOffset && bound.byteCount == binding.byteCount) {
+				++stats.skipped;
+				return true;
+			}
+			constantKnown[slot] = true;
+			constant[slot] = binding;
+			++stats.issued;
+			return false;
+		}
+
+	public:
+		void Begin(RenderBackend& backend)
+		{
+			target = &backend;
+			Invalidate();
+			stats = STATE_STATS();
+		}
+		void Invalidate()
+		{
+			pipelineKnown = indexKnown = false;
+			for (bool& known : vertexKnown)
+				known = false;
+			for (bool& known : constantKnown)
+				known = false;
+			for (bool& known : resourceKnown)
+				known = false;
+		}
+		STATE_STATS Stats() const {
+			return stats;
+		}
+		RenderBackend* Target() const {
+			return target;
+		}
+
+		// keeps what is known to be bound but sends the binds from now on to backend, a list
+		// that continues where this cache's backend is. rebind first binds all of it again
+		// for a list that starts from some other state. stats start over
+		void Continue(RenderBackend& backend, bool rebind)
+		{
+			target = &backend;
+			if (rebind) {
+				if (pipelineKnown)
+					target->SetPipeline(pipeline);
+				for (unsigned slot = 0; slot < VERTEX_SLOTS; ++slot)
+					if (vertexKnown[slot])
+						target->SetVertexBuffers(slot, 1, &vertex[slot].buffer, &vertex[slot].stride, &vertex[slot].offset);
+				if (indexKnown)
+					target->SetIndexBuffer(indexBuffer, indexFormat, indexOffset);
+				for (unsigned slot = 0; slot < CONSTANT_SLOTS; ++slot) {
+					const CONSTANT_BINDING& bound = constant[slot];
+					if (constantKnown[slot] && bound.byteCount == 0)
+						target->SetConstantBuffer(slot, bound.buffer, bound.stages);
+					else if (constantKnown[slot])
+						target->SetConstantBufferRange(slot, bound.buffer, bound.byteOffset, bound.byteCount, bound.stages);
+				}
+				for (unsigned slot = 0; slot < RESOURCE_SLOTS; ++slot)
+					if (resourceKnown[slot])
+						target->SetShaderResource(slot, resource[slot].buffer, resource[slot].stages);
+			}
+			stats = STATE_STATS();
+		}
+		// after a list recorded through run (a Continue'd copy) was executed on this cache's
+		// backend: its binds count as this cache's, and unless the backend restores its own
+		// state after a list (takeBinds false) what run left bound is bound here now
+		void Join(const StateCache& run, bool takeBinds)
+		{
+			RenderBackend* backend = target;
+			STATE_STATS total = stats;
+			if (takeBinds)
+				*this = run;
+			target = backend;
+			stats.issued = total.issued + run.stats.issued;
+			stats.skipped = total.skipped + run.stats.skipped;
+		}
+
+		BufferHandle CreateBuffer(const BUFFER_DESC& desc, const void* initialData) override {
+			return target->CreateBuffer(desc, initialData);
+		}
+		void ReleaseBuffer(BufferHandle buffer) override
+		{
+			Invalidate();
+			target->ReleaseBuffer(buffer);
+		}
+		PipelineHandle CreatePipeline(const PIPELINE_DESC& desc) override {
+			return target->CreatePipeline(desc);
+		}
+
+		void SetPipeline(PipelineHandle newPipeline) override
+		{
+			if (pipelineKnown && pipeline == newPipeline) {
+				++stats.skipped;
+				return;
+			}
+			pipelineKnown = true;
+			pipeline = newPipeline;
+			++stats.issued;
+			target->SetPipeline(newPipeline);
+		}
+		void SetVertexBuffers(unsigned startSlot, unsigned count, const BufferHandle* buffers,
+			const unsigned* strides, const unsigned* offsets) override
+		{
+			bool same = startSlot + count <= VERTEX_SLOTS;
+			for (unsigned i = 0; same && i < count; ++i) {
+				const VERTEX_BINDING& bound = vertex[startSlot + i];
+				same = vertexKnown[startSlot + i] && bound.buffer == buffers[i] &&
+					bound.stride == strides[i] && bound.offset == offsets[i];
+			}
+			if (same) {
+				++stats.skipped;
+				return;
+			}
+			for (unsigned i = 0; i < count && startSlot + i < VERTEX_SLOTS; ++i) {
+				vertexKnown[startSlot + i] = true;
+				vertex[startSlot + i] = { buffers[i], strides[i], offsets[i] };
+			}
+			++stats.issued;
+			target->SetVertexBuffers(startSlot, count, buffers, strides, offsets);
+		}
+		void SetIndexBuffer(BufferHandle buffer, INDEX_FORMAT format, unsigned offset) override
+		{
+			if (indexKnown && indexBuffer == buffer && indexFormat == format && indexOffset == offset) {
+				++stats.skipped;
+				return;
+			}
+			indexKnown = true;
+			indexBuffer = buffer;
+			indexFormat = format;
+			indexOffset = offset;
+			++stats.issued;
+			target->SetIndexBuffer(buffer, format, offset);
+		}
+		void SetConstantBuffer(unsigned slot, BufferHandle buffer, unsigned stages) override
+		{
+			if (slot >= CONSTANT_SLOTS)
+				++stats.issued;
+			else if (Bound(slot, { buffer, stages, 0, 0 }))
+				return;
+			target->SetConstantBuffer(slot, buffer, stages);
+		}
+		void SetConstantBufferRange(unsigned slot, BufferHandle buffer, unsigned byteOffset, unsigned byteCount,
+			unsigned stages) override
+		{
+			if (slot >= CONSTANT_SLOTS)
+				++stats.issued;
+			else if (Bound(slot, { buffer, stages, byteOffset, byteCount }))
+				return;
+			target->SetConstantBufferRange(slot, buffer, byteOffset, byteCount, stages);
+		}
+		void SetShaderResource(unsigned slot, BufferHandle buffer, unsigned stages) override
+		{
+			if (slot < RESOURCE_SLOTS && resourceKnown[slot] && resource[slot].buffer == buffer && resource[slot].stages == stages) {
+				++stats.skipped;
+				return;
+			}
+			if (slot < RESOURCE_SLOTS) {
+				resourceKnown[slot] = true;
+				resource[slot] = { buffer, stages };
+			}
+			++stats.issued;
+			target->SetShaderResource(slot, buffer, stages);
+		}
+
+		void UpdateBuffer(BufferHandle buffer, const void* data, unsigned byteCount) override {
+			target->UpdateBuffer(buffer, data, byteCount);
+		}
+		void UpdateBufferRange(BufferHandle buffer, unsigned byteOffset, const void* data, unsigned byteCount,
+			bool discard) override {
+			target->UpdateBufferRange(buffer, byteOffset, data, byteCount, discard);
+		}
+		void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override {
+			target->DrawIndexed(indexCount, startIndex, baseVertex);
+		}
+		void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount,
+			unsigned startIndex, int baseVertex, unsigned startInstance) override {
+			target->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+		}
+	};
+}
+#endif
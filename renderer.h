@@ -1,12 +1,46 @@
-#include <d3dcompiler.h>	// required for compiling shaders on the fly, consider pre-compiling instead
+#include <memory>
 #include "load_object_oriented.h"
-#pragma comment(lib, "d3dcompiler.lib") 
+#include "level_streaming.h"
+#include "d3d11_backend.h"
+
+// Pipeline/State Objects
+struct PipelineHandles
+{
+	ID3D11DeviceContext* context;
+	ID3D11RenderTargetView* targetView;
+	ID3D11DepthStencilView* depthStencil;
+};
+
+// Uniform/ShaderVariable Buffer
+struct SceneData
+{
+	GW::MATH::GVECTORF sunAmbient, cameraPos;
+	GW::MATH::GVECTORF lightDirc, lightColor;// lighting info
+	GW::MATH::GMATRIXF vMatrix, pMatrix; // viewing info
+};
 
 // Creation, Rendering & Cleanup
 class Renderer
 {
-	// Class that holds all level objects
-	Level_Objects level_obj;
+	// Loading, culling and batching are spread over these threads, declared before
+	// the levels so it is destroyed after them
+	Level::JobSystem jobs;
+	// Class that holds all level objects, replaced by levelStreamer when a new level is ready
+	std::unique_ptr<Level_Objects> level_obj;
+	// loads the selected level in the background while the current one keeps rendering
+	Level::LevelStreamer levelStreamer;
+	int loadingPercent = -1;			// last progress printed
+	// FULL uploads the .h2b vertices as they are, COMPACT packs them into 16 bytes (vertex_format.h)
+	Level::VERTEX_FORMAT vertexFormat = Level::VERTEX_FORMAT::FULL;
+	// simplified levels of detail built at load and picked by screen size (level_of_detail.h)
+	bool levelOfDetail = true;
+	// bake static instances into per material chunks (static_batching.h), the instanced path
+	// already draws these levels in fewer calls so it stays off
+	bool staticBatching = false;
+	// skip instances hidden behind the level's walls and floors (occlusion.h)
+	bool occlusionCulling = true;
+	// light the level with its LIGHT records, binned per frame into screen/depth clusters (clustered_lights.h)
+	bool clusteredLighting = true;
 	Model models;
 	SceneData _sceneData;			  // struct accessors
 
@@ -23,8 +57,11 @@ class Renderer
 	GW::MATH::GMATRIXF world;		  // world matrix
 	GW::MATH::GMATRIXF rotatedWorld;  // rotate world
 
+	// every buffer/pipeline/draw of the level goes through here
+	std::unique_ptr<D3D11Backend> backend;
+
 	// scene buffer
-	Microsoft::WRL::ComPtr<ID3D11Buffer> sceneDataBuffer;
+	Level::BufferHandle sceneDataBuffer = Level::INVALID_BUFFER;
 
 	// timer
 	std::chrono::high_resolution_clock::time_point lastTime;
@@ -48,19 +85,41 @@ public:
 		d3d = _d3d;
 		
 		gInput.Create(win);
+
+		ID3D11Device* creator;
+		ID3D11DeviceContext* context;
+		d3d.GetDevice((void**)&creator);
+		d3d.GetImmediateContext((void**)&context);
+		backend.reset(new D3D11Backend(creator, context));
+		// free temporary handles (the backend keeps its own references)
+		context->Release();
+		creator->Release();
 		
 		// COMMENT OUT IF YOU WANT LEVEL 1 TO NOT POPULATE FIRST
 		GW::SYSTEM::GLog gLog;
 		gLog.Create("errorLog.txt");
 		gLog.EnableConsoleLogging(true); // shows all loaded items
-		level_obj.LoadLevel("../GameLevel.txt","../Models", gLog.Relinquish());
+		level_obj.reset(new Level_Objects());
+		level_obj->SetJobSystem(&jobs);
+		level_obj->SetVertexFormat(vertexFormat);
+		level_obj->SetLevelOfDetail(levelOfDetail);
+		level_obj->SetStaticBatching(staticBatching);
+		level_obj->SetOcclusionCulling(occlusionCulling);
+		level_obj->SetClusteredLighting(clusteredLighting);
+		levelStreamer.SetJobSystem(&jobs);
+		levelStreamer.SetVertexFormat(vertexFormat);
+		levelStreamer.SetLevelOfDetail(levelOfDetail);
+		levelStreamer.SetStaticBatching(staticBatching);
+		levelStreamer.SetOcclusionCulling(occlusionCulling);
+		levelStreamer.SetClusteredLighting(clusteredLighting);
+		level_obj->LoadLevel("../GameLevel.txt","../Models", gLog.Relinquish());
 		
 		// UNCOMMENT IF YOU WANT LEVEL 2 TO POPULATE FIRST
 		//GW::SYSTEM::GLog gLog2;
 		//
 		//gLog2.Create("errorLog2.txt");
 		//gLog2.EnableConsoleLogging(true); // shows all loaded items
-		//level_obj.LoadLevel("../GameLevel2.txt", "../Models2", gLog2.Relinquish());
+		//level_obj->LoadLevel("../GameLevel2.txt", "../Models2", gLog2.Relinquish());
 		
 
 		IntializeGraphics();
@@ -70,11 +129,7 @@ private:
 	//constructor helper functions
 	void IntializeGraphics()
 	{
-		ID3D11Device* creator;
-		d3d.GetDevice((void**)&creator);
-
-
-		level_obj.UploadLevelToGPU(creator);
+		level_obj->UploadLevelToGPU(*backend);
 
 		ViewMatrixBuilder();
 
@@ -82,42 +137,48 @@ private:
 
 		LightVecBuilder();
 		
-		CreateSceneBuffer(creator);
-
-		// free temporary handle
-		creator->Release();
+		CreateSceneBuffer();
 	}
 
 
 public:
 	void Render()
 	{
-		// Select level but the level needs to be rendered prior to switching
+		LEVEL_PROFILE_SCOPE("Render");
+		// Select level, a requested level loads in the background and is swapped in here once ready
 		SelectLevel();
 
 		PipelineHandles curHandles = GetCurrentPipelineHandles();
 
 		SetRenderTargets(curHandles);
 				
-		D3D11_MAPPED_SUBRESOURCE sceneMap = { 0 };
-		curHandles.context->Map(sceneDataBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &sceneMap);
-		memcpy(sceneMap.pData, &_sceneData, sizeof(_sceneData));
-		curHandles.context->Unmap(sceneDataBuffer.Get(), 0);
-
-		// easier way to map and unmap information ^^^ proof above works as well ^^^
-		//curHandles.context->UpdateSubresource(sceneDataBuffer.Get(), 0, nullptr, &_sceneData, 0, 0);
+		// dynamic buffer, the backend maps it with WRITE_DISCARD
+		backend->UpdateBuffer(sceneDataBuffer, &_sceneData, sizeof(_sceneData));
 
+		backend->SetConstantBuffer(0, sceneDataBuffer, Level::STAGE_VERTEX_PIXEL);
 
-		curHandles.context->VSSetConstantBuffers(0, 1, sceneDataBuffer.GetAddressOf());
-		curHandles.context->PSSetConstantBuffers(0, 1, sceneDataBuffer.GetAddressOf());
-
-		level_obj.RenderLevel(curHandles);
+		// only Models inside the camera's frustum get submitted
+		level_obj->SetViewProjection(ToLevelMatrix(_sceneData.vMatrix), ToLevelMatrix(_sceneData.pMatrix));
+		level_obj->RenderLevel(*backend);
+		LEVEL_PROFILE_COUNT("draws", level_obj->GetDrawCallCount());
+		LEVEL_PROFILE_COUNT("state binds", level_obj->GetStateStats().issued);
+		LEVEL_PROFILE_COUNT("bytes uploaded", sizeof(_sceneData) + level_obj->GetUploadStats().constantBytes +
+			level_obj->GetUploadStats().instanceBytes + level_obj->GetUploadStats().lightBytes);
+		LEVEL_PROFILE_COUNT("light list entries", level_obj->GetClusterStats().entries);
 
 		ReleasePipelineHandles(curHandles);
 	}
 
 private:
 
+	// GMATRIXF and Level::MATRIX share the row major float[16] layout
+	static Level::MATRIX ToLevelMatrix(const GW::MATH::GMATRIXF& matrix)
+	{
+		Level::MATRIX result;
+		memcpy(result.data, &matrix, sizeof(result.data));
+		return result;
+	}
+
 	PipelineHandles GetCurrentPipelineHandles()
 	{
 		PipelineHandles retval;
@@ -126,14 +187,9 @@ private:
 		d3d.GetDepthStencilView((void**)&retval.depthStencil);
 		return retval;
 	}
-	void CreateSceneBuffer(ID3D11Device* creator) {
-		D3D11_BUFFER_DESC bufferScene;
-		bufferScene.Usage = D3D11_USAGE_DYNAMIC;
-		bufferScene.ByteWidth = sizeof(_sceneData);
-		bufferScene.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		bufferScene.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		bufferScene.MiscFlags = 0;
-		creator->CreateBuffer(&bufferScene, nullptr, sceneDataBuffer.GetAddressOf());
+	void CreateSceneBuffer() {
+		Level::BUFFER_DESC bufferScene = { Level::BUFFER_TYPE::CONSTANT, Level::BUFFER_USAGE::DYNAMIC, sizeof(_sceneData) };
+		sceneDataBuffer = backend->CreateBuffer(bufferScene, nullptr);
 	}
 
 	void ReleasePipelineHandles(PipelineHandles toRelease)
@@ -152,12 +208,16 @@ private:
 public:
 	~Renderer()
 	{
-		// ComPtr will auto release so nothing to do here yet 
+		// GPU level data has to go before the backend that owns it
+		levelStreamer.Flush();
+		level_obj->UnloadLevel();
+		SceneBuffClear();
 	}
 
 	// reset scene
 	void SceneBuffClear() {
-		sceneDataBuffer.ReleaseAndGetAddressOf();
+		backend->ReleaseBuffer(sceneDataBuffer);
+		sceneDataBuffer = Level::INVALID_BUFFER;
 	}
 
 	// helper functions for world
@@ -166,7 +226,7 @@ public:
 		world = GW::MATH::GIdentityMatrixF;
 		// rotatedWorld is reset to idenetity
 		rotatedWorld = world;
-		models._meshData.wMatrix = world;
+		memcpy(&models._meshData.wMatrix, &world, sizeof(Level::MATRIX));
 	}
 
 	// helper functions for view
@@ -209,7 +269,8 @@ public:
 		_sceneData.pMatrix = projection;
 	}
 
-	// helper functions for lighting
+	// helper functions for lighting, the sun. The level's own point and spot lights are
+	// binned and uploaded by Level_Objects::RenderLevel
 	void LightVecBuilder() {
 		_lightColor = { 0.9f,0.9f,1.0f,1.0f };
 		_lightDir = { -1.0f, -1.0f, 2.0f, 0.0f };
@@ -226,6 +287,7 @@ public:
 	
 	// camera controls
 	void UpdateCamera() {
+		LEVEL_PROFILE_SCOPE("UpdateCamera");
 
 		std::chrono::high_resolution_clock::time_point _now = std::chrono::high_resolution_clock::now();
 		deltaTime = std::chrono::duration_cast<std::chrono::microseconds> (_now - lastTime).count() / 1000000.0f;
@@ -332,40 +394,47 @@ public:
 	}
 
 	void SelectLevel() {
-		
-		GW::SYSTEM::GLog _glog;
 
 		gInput.GetState(G_KEY_NUMPAD_1, _NumPad1);
 		gInput.GetState(G_KEY_NUMPAD_2, _NumPad2);
-		_glog.Create("errorLog.txt");
-		_glog.EnableConsoleLogging(true); // shows all loaded items
-		
-		// once you click the num_pad_1 give it 3 secs to clear everything and render new level
-		if (_NumPad1 > 0.0f)
-		{
-			if (isLevelSwaped)
-			{
-				isLevelSwaped = !isLevelSwaped;
-				level_obj.LoadLevel("../GameLevel.txt", "../Models", _glog.Relinquish());	
-			}
-			SceneBuffClear();
 
-			IntializeGraphics();
-		}
-		
-		// once you click the num_pad_2 give it 3 secs to clear everything and render new level
-		if (_NumPad2 > 0.0f)
+		// num_pad_1/2 start loading the other level, the current one keeps rendering meanwhile.
+		// pressing the key of the level already shown resets the camera
+		if (_NumPad1 > 0.0f || _NumPad2 > 0.0f)
 		{
-			if (!isLevelSwaped)
+			bool wantLevel2 = _NumPad2 > 0.0f;
+			if (wantLevel2 != isLevelSwaped)
 			{
-				isLevelSwaped = !isLevelSwaped;
-				level_obj.LoadLevel("../GameLevel2.txt", "../Models2", _glog.Relinquish());
+				isLevelSwaped = wantLevel2;
+				GW::SYSTEM::GLog _glog;
+				_glog.Create(wantLevel2 ? "errorLog2.txt" : "errorLog.txt");
+				_glog.EnableConsoleLogging(true); // shows all loaded items
+				if (wantLevel2)
+					levelStreamer.Request("../GameLevel2.txt", "../Models2", _glog.Relinquish());
+				else
+					levelStreamer.Request("../GameLevel.txt", "../Models", _glog.Relinquish());
+				loadingPercent = -1;
 			}
-			SceneBuffClear();
-
-			IntializeGraphics();
+			else if (!levelStreamer.Loading())
+				ResetCamera();
 		}
 
+		if (levelStreamer.Loading()) {
+			int percent = static_cast<int>(levelStreamer.Progress() * 100.0f);
+			if (percent / 25 != loadingPercent / 25) {
+				PrintLabeledDebugString("Loading level: ", (std::to_string(percent) + "% " + levelStreamer.PendingPath()).c_str());
+				loadingPercent = percent;
+			}
+		}
+		// frame boundary, the old level is freed once the GPU can no longer be using it
+		if (levelStreamer.BeginFrame(*backend, level_obj))
+			ResetCamera();
+	}
 
+	// camera and light back to where a freshly loaded level starts
+	void ResetCamera() {
+		ViewMatrixBuilder();
+		ProjectionMatrixBuilder();
+		LightVecBuilder();
 	}
 };
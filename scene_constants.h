@@ -0,0 +1,95 @@
+#ifndef _SCENE_CONSTANTS_H_
+#define _SCENE_CONSTANTS_H_
+// Gateware free copies of the shaders' constant buffers (same layout as the
+// cbuffers in Shaders/*.hlsl) for the headless tools and software backend.
+#include "h2bParser.h"
+#include "level_math.h"
+
+namespace Level {
+
+	// cbuffer SceneData : register(b0), the renderer's SceneData
+	struct SCENE_CONSTANTS {
+		float sunAmbient[4], cameraPos[4];
+		float lightDirc[4], lightColor[4];
+		MATRIX vMatrix, pMatrix;
+	};
+
+	// cbuffer MeshData : register(b1), load_object_oriented.h's MeshData.
+	// every draw gets its own CONSTANT_ALIGNMENT slot of the level's constant ring
+	struct MESH_CONSTANTS {
+		MATRIX wMatrix;
+		unsigned materialIndex;	// into the material table
+		unsigned boundsIndex;	// into the position bounds table, COMPACT vertices only
+		unsigned padding[2];
+	};
+
+	// StructuredBuffer<ATTRIBUTES> materialTable : register(t0), every material of the level
+	static const unsigned MATERIAL_TABLE_SLOT = 0;
+
+	// StructuredBuffer<POSITION_BOUNDS> positionBounds : register(t1), per asset,
+	// a COMPACT vertex's position is offset + unorm16 steps * scale (vertex_format.h)
+	struct POSITION_BOUNDS {
+		float scale[3];
+		float padding0;
+		float offset[3];
+		float padding1;
+	};
+	static const unsigned POSITION_BOUNDS_SLOT = 1;
+
+	// cbuffer ClusterData : register(b2), the froxel grid the lights were binned
+	// into this frame (clustered_lights.h). A pixel at view depth z is in slice
+	// log(z) * sliceScale + sliceBias, lightCount 0 turns the level's lights off
+	struct CLUSTER_CONSTANTS {
+		unsigned clusterCount[3];	// across, up, deep
+		unsigned lightCount;
+		float sliceScale, sliceBias;
+		float padding[2];
+	};
+	static const unsigned CLUSTER_CONSTANTS_SLOT = 2;
+
+	// StructuredBuffer<LIGHT> lights : register(t2), the level's point and spot lights.
+	// spot falloff is saturate(cos(angle to direction) * spotScale + spotOffset)^2, 1 for point lights
+	struct LIGHT_CONSTANTS {
+		float position[3];
+		float range;
+		float direction[3];
+		float spotScale;
+		float color[3];
+		float spotOffset;
+	};
+	static const unsigned LIGHT_TABLE_SLOT = 2;
+
+	// StructuredBuffer<uint2> clusterRanges : register(t3), per cluster where its lights
+	// start in clusterLights (t4) and how many there are
+	struct CLUSTER_RANGE {
+		unsigned offset, count;
+	};
+	static const unsigned CLUSTER_RANGE_SLOT = 3;
+	static const unsigned CLUSTER_LIGHT_SLOT = 4;
+
+	// the camera and sun Renderer starts with (ViewMatrixBuilder,
+	// ProjectionMatrixBuilder and LightVecBuilder)
+	inline SCENE_CONSTANTS DefaultScene(float aspectRatio)
+	{
+		SCENE_CONSTANTS scene = {};
+		FLOAT3 camera = { 1.25f, 7.5f, -5.0f };
+		scene.cameraPos[0] = camera.x;
+		scene.cameraPos[1] = camera.y;
+		scene.cameraPos[2] = camera.z;
+		scene.vMatrix = LookAtLH(camera, { 0.15f, 0.75f, 0.0f }, { 0.0f, 1.0f, 0.0f });
+		scene.pMatrix = PerspectiveLH(65.0f * 3.14159265f / 180.0f, aspectRatio, 0.1f, 100.0f);
+
+		FLOAT3 light = Normalize({ -1.0f, -1.0f, 2.0f });
+		const float lightColor[4] = { 0.9f, 0.9f, 1.0f, 1.0f };
+		const float sunAmbient[4] = { 0.25f, 0.25f, 0.35f, 0.0f };
+		scene.lightDirc[0] = light.x;
+		scene.lightDirc[1] = light.y;
+		scene.lightDirc[2] = light.z;
+		for (int i = 0; i < 4; ++i) {
+			scene.lightColor[i] = lightColor[i];
+			scene.sunAmbient[i] = sunAmbient[i];
+		}
+		return scene;
+	}
+}
+#endif
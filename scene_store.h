@@ -0,0 +1,158 @@
+#ifndef _SCENE_STORE_H_
+#define _SCENE_STORE_H_
+// The level's placed instances in dense arrays: the INSTANCE records the
+// batchers read (asset handle, world matrix, level of detail), their world
+// bounds and, apart from both, their names. Code outside the store holds an
+// InstanceHandle, a slot index plus the slot's generation, so a handle to a
+// removed instance stops resolving even after its slot is reused. Add and
+// Remove are O(1): a removal moves the last instance into the hole, which
+// keeps the arrays dense but changes that instance's index (never its handle).
+// Materials stay per asset (the level's firstMaterial table), every instance
+// of an asset uses the same range.
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "asset_cache.h"
+#include "culling.h"
+#include "instancing.h"
+#include "level_file.h"
+
+namespace Level {
+
+	// heap bytes behind a string, 0 while it fits in the string's own buffer
+	inline size_t StringHeapBytes(const std::string& text)
+	{
+		const char* inside = reinterpret_cast<const char*>(&text);
+		const bool local = !std::less<const char*>()(text.data(), inside) && std::less<const char*>()(text.data(), inside + sizeof(text));
+		return local ? 0 : text.capacity() + 1;
+	}
+
+	// slot in the low 32 bits, its generation in the high 32
+	typedef unsigned long long InstanceHandle;
+	static const InstanceHandle INVALID_INSTANCE = 0xFFFFFFFFFFFFFFFFull;
+
+	class SceneStore
+	{
+		struct SLOT {
+			unsigned index;			// into the dense arrays while alive, the next free slot otherwise
+			unsigned generation;	// bumped on every Remove
+		};
+		static const unsigned NO_SLOT = 0xFFFFFFFF;
+
+		// dense, instances[i], bounds[i], names[i] and slotOf[i] are instance i
+		std::vector<INSTANCE> instances;
+		std::vector<AABB> bounds;
+		std::vector<std::string> names;
+		std::vector<unsigned> slotOf;
+		std::vector<SLOT> slots;
+		unsigned freeSlot = NO_SLOT;
+
+	public:
+		void Reserve(unsigned count)
+		{
+			instances.reserve(count);
+			bounds.reserve(count);
+			names.reserve(count);
+			slotOf.reserve(count);
+			slots.reserve(count);
+		}
+		// the bounds start empty until SetBounds
+		InstanceHandle Add(AssetHandle asset, const MATRIX& world, std::string name = std::string())
+		{
+			unsigned slot = freeSlot;
+			if (slot != NO_SLOT)
+				freeSlot = slots[slot].index;
+			else {
+				slot = static_cast<unsigned>(slots.size());
+				slots.push_back({ 0, 0 });
+			}
+			slots[slot].index = Size();
+			INSTANCE instance;
+			instance.asset = asset;
+			instance.world = world;
+			instances.push_back(instance);
+			bounds.push_back(EmptyBounds());
+			names.push_back(std::move(name));
+			slotOf.push_back(slot);
+			return (static_cast<InstanceHandle>(slots[slot].generation) << 32) | slot;
+		}
+		// false if the handle is stale
+		bool Remove(InstanceHandle handle)
+		{
+			const unsigned index = IndexOf(handle);
+			if (index == NO_SLOT)
+				return false;
+			const unsigned last = Size() - 1;
+			if (index != last) {
+				instances[index] = instances[last];
+				bounds[index] = bounds[last];
+				names[index] = std::move(names[last]);
+				slotOf[index] = slotOf[last];
+				slots[slotOf[index]].index = index;
+			}
+			instances.pop_back();
+			bounds.pop_back();
+			names.pop_back();
+			slotOf.pop_back();
+			const unsigned slot = static_cast<unsigned>(handle);
+			++slots[slot].generation;
+			slots[slot].index = freeSlot;
+			freeSlot = slot;
+			return true;
+		}
+
+		// dense index of a live instance, 0xFFFFFFFF for a stale or invalid handle
+		unsigned IndexOf(InstanceHandle handle) const
+		{
+			const unsigned slot = static_cast<unsigned>(handle);
+			if (slot >= slots.size() || slots[slot].generation != static_cast<unsigned>(handle >> 32))
+				return NO_SLOT;
+			return slots[slot].index;
+		}
+		bool Contains(InstanceHandle handle) const {
+			return IndexOf(handle) != NO_SLOT;
+		}
+		InstanceHandle HandleOf(unsigned index) const {
+			return (static_cast<InstanceHandle>(slots[slotOf[index]].generation) << 32) | slotOf[index];
+		}
+		unsigned Size() const {
+			return static_cast<unsigned>(instances.size());
+		}
+		bool Empty() const {
+			return instances.empty();
+		}
+
+		const std::vector<INSTANCE>& Instances() const {
+			return instances;
+		}
+		INSTANCE& Instance(unsigned index) {
+			return instances[index];
+		}
+		const INSTANCE& Instance(unsigned index) const {
+			return instances[index];
+		}
+		// world space boxes, the input of the level's BVH
+		const std::vector<AABB>& Bounds() const {
+			return bounds;
+		}
+		// distinct indices may be set from several threads at once
+		void SetBounds(unsigned index, const AABB& box) {
+			bounds[index] = box;
+		}
+		const std::string& Name(unsigned index) const {
+			return names[index];
+		}
+
+		// bytes the arrays (and names longer than the strings' own buffer) hold
+		size_t MemoryBytes() const
+		{
+			size_t bytes = sizeof(INSTANCE) * instances.capacity() + sizeof(AABB) * bounds.capacity() +
+				sizeof(std::string) * names.capacity() + sizeof(unsigned) * slotOf.capacity() + sizeof(SLOT) * slots.capacity();
+			for (const std::string& name : names)
+				bytes += StringHeapBytes(name);
+			return bytes;
+		}
+	};
+}
+#endif
@@ -0,0 +1,182 @@
+#ifndef _SHADER_CACHE_H_
+#define _SHADER_CACHE_H_
+// Compile-once shader bytecode cache.
+// Bytecode is keyed by a hash of (source, entry point, profile, flags, defines),
+// kept in memory and persisted to disk so a warm start never calls the compiler.
+// The compiler is passed in, D3DCompile on windows or a stub in the headless tools.
+//
+// On disk every entry is "<directory>/<key as 16 hex digits>.cso":
+//   char magic[4] "LSC1" | unsigned version | u64 key | u64 byteCount | u64 checksum | bytecode
+// Files whose header, key, size or checksum don't match are treated as stale and rebuilt.
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "level_hash.h"
+
+namespace Level {
+
+	struct SHADER_SOURCE {
+		std::string source;
+		std::string entryPoint;
+		std::string profile;
+		unsigned flags;
+		std::vector<std::pair<std::string, std::string>> defines;
+	};
+
+	struct SHADER_CACHE_STATS {
+		unsigned memoryHits;	// served from this run's cache
+		unsigned diskHits;		// loaded from a persisted .cso
+		unsigned compiles;		// calls into the compiler
+		unsigned failures;		// compiles that failed
+		unsigned staleFiles;	// persisted files rejected (corrupt/mismatched)
+		unsigned diskWrites;
+	};
+
+	class ShaderCache
+	{
+	public:
+		// fills bytecode (or errors) and returns false on failure
+		typedef std::function<bool(const SHADER_SOURCE&, std::vector<unsigned char>& bytecode, std::string& errors)> Compiler;
+
+		static const unsigned FORMAT_VERSION = 1;
+		static constexpr size_t HEADER_SIZE = 32;
+
+	private:
+		std::string directory;
+		Compiler compiler;
+		std::unordered_map<unsigned long long, std::vector<unsigned char>> memory;
+		SHADER_CACHE_STATS stats = {};
+
+		std::string EntryPath(unsigned long long key) const
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "%016llx.cso", key);
+			return directory + "/" + name;
+		}
+
+		bool LoadEntry(unsigned long long key, std::vector<unsigned char>& bytecode)
+		{
+			std::ifstream file(EntryPath(key), std::ios_base::in | std::ios_base::binary);
+			if (file.is_open() == false)
+				return false;
+			char header[HEADER_SIZE];
+			unsigned version = 0;
+			unsigned long long storedKey = 0, byteCount = 0, checksum = 0;
+			bool valid = static_cast<bool>(file.read(header, HEADER_SIZE));
+			if (valid) {
+				std::memcpy(&version, header + 4, 4);
+				std::memcpy(&storedKey, header + 8, 8);
+				std::memcpy(&byteCount, header + 16, 8);
+				std::memcpy(&checksum, header + 24, 8);
+				valid = std::memcmp(header, "LSC1", 4) == 0 && version == FORMAT_VERSION &&
+					storedKey == key && byteCount > 0 && byteCount < (1ull << 30);
+			}
+			if (valid) {
+				bytecode.resize(static_cast<size_t>(byteCount));
+				valid = static_cast<bool>(file.read(reinterpret_cast<char*>(bytecode.data()), bytecode.size())) &&
+					file.peek() == std::char_traits<char>::eof() &&
+					HashBytes(bytecode.data(), bytecode.size()) == checksum;
+			}
+			if (!valid) {
+				++stats.staleFiles;
+				bytecode.clear();
+			}
+			return valid;
+		}
+
+		void StoreEntry(unsigned long long key, const std::vector<unsigned char>& bytecode)
+		{
+			if (directory.empty())
+				return;
+			std::error_code error;
+			std::filesystem::create_directories(directory, error);
+			// write then rename so a crash never leaves a half written entry behind
+			std::string path = EntryPath(key);
+			std::string temporary = path + ".tmp";
+			{
+				std::ofstream file(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+				if (file.is_open() == false)
+					return;
+				unsigned version = FORMAT_VERSION;
+				unsigned long long byteCount = bytecode.size();
+				unsigned long long checksum = HashBytes(bytecode.data(), bytecode.size());
+				file.write("LSC1", 4);
+				file.write(reinterpret_cast<const char*>(&version), 4);
+				file.write(reinterpret_cast<const char*>(&key), 8);
+				file.write(reinterpret_cast<const char*>(&byteCount), 8);
+				file.write(reinterpret_cast<const char*>(&checksum), 8);
+				file.write(reinterpret_cast<const char*>(bytecode.data()), bytecode.size());
+				if (!file)
+					return;
+			}
+			std::filesystem::rename(temporary, path, error);
+			if (error)
+				std::filesystem::remove(temporary, error);
+			else
+				++stats.diskWrites;
+		}
+
+	public:
+		// an empty directory keeps the cache in memory only
+		ShaderCache(std::string cacheDirectory, Compiler shaderCompiler)
+			: directory(std::move(cacheDirectory)), compiler(std::move(shaderCompiler)) {}
+
+		static unsigned long long Key(const SHADER_SOURCE& shader)
+		{
+			unsigned long long hash = HashString(shader.source);
+			hash = HashString(shader.entryPoint, hash);
+			hash = HashString(shader.profile, hash);
+			hash = HashBytes(&shader.flags, sizeof(shader.flags), hash);
+			for (const auto& define : shader.defines) {
+				hash = HashString(define.first, hash);
+				hash = HashString(define.second, hash);
+			}
+			return hash;
+		}
+
+		// Bytecode for this shader, compiling only if neither memory nor disk has it.
+		// Returns nullptr (and the compiler's message in errors) if compilation fails.
+		const std::vector<unsigned char>* GetBytecode(const SHADER_SOURCE& shader, std::string* errors = nullptr)
+		{
+			unsigned long long key = Key(shader);
+			auto found = memory.find(key);
+			if (found != memory.end()) {
+				++stats.memoryHits;
+				return &found->second;
+			}
+			std::vector<unsigned char> bytecode;
+			if (!directory.empty() && LoadEntry(key, bytecode)) {
+				++stats.diskHits;
+				return &(memory[key] = std::move(bytecode));
+			}
+			std::string message;
+			++stats.compiles;
+			if (compiler(shader, bytecode, message) == false || bytecode.empty()) {
+				++stats.failures;
+				if (errors != nullptr)
+					*errors = message;
+				return nullptr;
+			}
+			StoreEntry(key, bytecode);
+			return &(memory[key] = std::move(bytecode));
+		}
+
+		// drops the in memory copies (the persisted files stay)
+		void ClearMemory() {
+			memory.clear();
+		}
+		const std::string& Directory() const {
+			return directory;
+		}
+		SHADER_CACHE_STATS GetStats() const {
+			return stats;
+		}
+	};
+}
+#endif
@@ -0,0 +1,89 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+// Just enough of a float vector for the software rasterizer's inner loop and
+// the batch_math.h kernels: AVX (8 lanes) when the compiler targets it
+// (LEVEL_ENABLE_AVX, AVX2 builds too), SSE2 (4 lanes) on every x64 build and
+// a portable 4 lane fallback with the same interface elsewhere.
+// There is no fused multiply-add, a*b + c rounds twice like the scalar code.
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LEVEL_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEVEL_SIMD_SSE
+#endif
+
+namespace Level {
+
+	namespace Simd {
+#if defined(LEVEL_SIMD_AVX)
+		static const int LANES = 8;
+		struct FLOATS { __m256 v; };
+		typedef FLOATS MASK;
+		inline FLOATS Set(float f) { return { _mm256_set1_ps(f) }; }
+		inline FLOATS Ramp() { return { _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7) }; }
+		inline FLOATS Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+		inline void Store(float* p, FLOATS a) { _mm256_storeu_ps(p, a.v); }
+		inline FLOATS operator+(FLOATS a, FLOATS b) { return { _mm256_add_ps(a.v, b.v) }; }
+		inline FLOATS operator*(FLOATS a, FLOATS b) { return { _mm256_mul_ps(a.v, b.v) }; }
+		inline FLOATS operator-(FLOATS a, FLOATS b) { return { _mm256_sub_ps(a.v, b.v) }; }
+		inline FLOATS Abs(FLOATS a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+		inline MASK Greater(FLOATS a, FLOATS b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+		inline MASK Equal(FLOATS a, FLOATS b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+		inline MASK Less(FLOATS a, FLOATS b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+		inline MASK GreaterEqual(FLOATS a, FLOATS b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+		inline MASK And(MASK a, MASK b) { return { _mm256_and_ps(a.v, b.v) }; }
+		inline MASK Or(MASK a, MASK b) { return { _mm256_or_ps(a.v, b.v) }; }
+		inline MASK All(bool set) { return { _mm256_castsi256_ps(_mm256_set1_epi32(set ? -1 : 0)) }; }
+		inline FLOATS Select(MASK m, FLOATS a, FLOATS b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+		inline int Bits(MASK m) { return _mm256_movemask_ps(m.v); }
+#elif defined(LEVEL_SIMD_SSE)
+		static const int LANES = 4;
+		struct FLOATS { __m128 v; };
+		typedef FLOATS MASK;
+		inline FLOATS Set(float f) { return { _mm_set1_ps(f) }; }
+		inline FLOATS Ramp() { return { _mm_setr_ps(0, 1, 2, 3) }; }
+		inline FLOATS Load(const float* p) { return { _mm_loadu_ps(p) }; }
+		inline void Store(float* p, FLOATS a) { _mm_storeu_ps(p, a.v); }
+		inline FLOATS operator+(FLOATS a, FLOATS b) { return { _mm_add_ps(a.v, b.v) }; }
+		inline FLOATS operator*(FLOATS a, FLOATS b) { return { _mm_mul_ps(a.v, b.v) }; }
+		inline FLOATS operator-(FLOATS a, FLOATS b) { return { _mm_sub_ps(a.v, b.v) }; }
+		inline FLOATS Abs(FLOATS a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+		inline MASK Greater(FLOATS a, FLOATS b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+		inline MASK Equal(FLOATS a, FLOATS b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+		inline MASK Less(FLOATS a, FLOATS b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+		inline MASK GreaterEqual(FLOATS a, FLOATS b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+		inline MASK And(MASK a, MASK b) { return { _mm_and_ps(a.v, b.v) }; }
+		inline MASK Or(MASK a, MASK b) { return { _mm_or_ps(a.v, b.v) }; }
+		inline MASK All(bool set) { return { _mm_castsi128_ps(_mm_set1_epi32(set ? -1 : 0)) }; }
+		inline FLOATS Select(MASK m, FLOATS a, FLOATS b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+		inline int Bits(MASK m) { return _mm_movemask_ps(m.v); }
+#else
+		// portable fallback with the same interface
+		static const int LANES = 4;
+		struct FLOATS { float v[LANES]; };
+		struct MASK { bool v[LANES]; };
+		inline FLOATS Set(float f) { return { { f, f, f, f } }; }
+		inline FLOATS Ramp() { return { { 0, 1, 2, 3 } }; }
+		inline FLOATS Load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+		inline void Store(float* p, FLOATS a) { std::memcpy(p, a.v, sizeof(a.v)); }
+		inline FLOATS operator+(FLOATS a, FLOATS b) { for (int i = 0; i < LANES; ++i) a.v[i] += b.v[i]; return a; }
+		inline FLOATS operator*(FLOATS a, FLOATS b) { for (int i = 0; i < LANES; ++i) a.v[i] *= b.v[i]; return a; }
+		inline FLOATS operator-(FLOATS a, FLOATS b) { for (int i = 0; i < LANES; ++i) a.v[i] -= b.v[i]; return a; }
+		inline FLOATS Abs(FLOATS a) { for (int i = 0; i < LANES; ++i) a.v[i] = std::fabs(a.v[i]); return a; }
+		inline MASK Greater(FLOATS a, FLOATS b) { MASK m; for (int i = 0; i < LANES; ++i) m.v[i] = a.v[i] > b.v[i]; return m; }
+		inline MASK Equal(FLOATS a, FLOATS b) { MASK m; for (int i = 0; i < LANES; ++i) m.v[i] = a.v[i] == b.v[i]; return m; }
+		inline MASK Less(FLOATS a, FLOATS b) { MASK m; for (int i = 0; i < LANES; ++i) m.v[i] = a.v[i] < b.v[i]; return m; }
+		inline MASK GreaterEqual(FLOATS a, FLOATS b) { MASK m; for (int i = 0; i < LANES; ++i) m.v[i] = a.v[i] >= b.v[i]; return m; }
+		inline MASK And(MASK a, MASK b) { for (int i = 0; i < LANES; ++i) a.v[i] = a.v[i] && b.v[i]; return a; }
+		inline MASK Or(MASK a, MASK b) { for (int i = 0; i < LANES; ++i) a.v[i] = a.v[i] || b.v[i]; return a; }
+		inline MASK All(bool set) { return { { set, set, set, set } }; }
+		inline FLOATS Select(MASK m, FLOATS a, FLOATS b) { for (int i = 0; i < LANES; ++i) a.v[i] = m.v[i] ? a.v[i] : b.v[i]; return a; }
+		inline int Bits(MASK m) { int bits = 0; for (int i = 0; i < LANES; ++i) bits |= m.v[i] << i; return bits; }
+#endif
+	}
+}
+#endif
@@ -0,0 +1,706 @@
+#ifndef _SOFTWARE_BACKEND_H_
+#define _SOFTWARE_BACKEND_H_
+// Level::RenderBackend that renders on the CPU, for golden images and frame
+// timings on machines without a GPU.
+//
+// It implements the one pipeline the level uses (Shaders/VertexShader.hlsl and
+// PixelShader.hlsl, with or without USE_INSTANCING and USE_COMPACT_VERTICES) and
+// reads the same vertex, index, instance and constant buffers, material table,
+// position bounds and clustered lights the D3D11 backend would get.
+// Draws are transformed, clipped against the near plane, back face culled
+// (D3D11 defaults: clockwise front faces) and binned into TILE x TILE tiles as
+// they are submitted. EndFrame rasterizes the tiles in parallel: edge
+// functions and the depth test run Simd::LANES pixels at a time (AVX or SSE2),
+// the nearest triangle per pixel is kept and each visible pixel is shaded once.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "render_backend.h"
+#include "scene_constants.h"
+#include "clustered_lights.h"
+#include "vertex_format.h"
+#include "image_compare.h"
+#include "simd.h"
+
+namespace Level {
+
+	struct SOFTWARE_STATS {
+		unsigned draws;
+		unsigned long long trianglesIn;		// per instance
+		unsigned long long trianglesCulled;	// outside the frustum, back facing or between pixel centers
+		unsigned long long trianglesClipped;	// crossed the near plane
+		unsigned long long trianglesBinned;
+		unsigned long long binEntries;		// triangle/tile pairs
+		unsigned long long pixelsShaded;
+	};
+
+	class SoftwareBackend : public RenderBackend
+	{
+	public:
+		static const int TILE = 64; // multiple of Simd::LANES
+		static constexpr unsigned NO_TRIANGLE = 0xFFFFFFFF;
+
+	private:
+		struct BUFFER {
+			BUFFER_DESC desc;
+			std::vector<unsigned char> bytes;
+			bool alive;
+			unsigned long long version;	// changes with every write
+		};
+		struct PIPELINE {
+			std::string vertexShaderPath, pixelShaderPath;
+			bool instanced;
+			bool compact;
+		};
+		// constants a draw was issued with, triangles point back at it
+		struct DRAW_STATE {
+			SCENE_CONSTANTS scene;
+			MESH_CONSTANTS mesh;
+			H2B::ATTRIBUTES material;	// materialTable[mesh.materialIndex]
+			unsigned lighting;			// into lightings, NO_LIGHTING without point and spot lights
+		};
+		// copies of the cluster constants (b2), light table (t2), cluster ranges (t3) and
+		// light lists (t4), shared by the draws until one of them changes
+		struct LIGHTING {
+			CLUSTER_CONSTANTS clusters;
+			std::vector<LIGHT_CONSTANTS> lights;
+			std::vector<CLUSTER_RANGE> ranges;
+			std::vector<unsigned> indices;
+			unsigned long long versions[4];
+		};
+		static constexpr unsigned NO_LIGHTING = 0xFFFFFFFF;
+		// vertex shader output
+		struct CLIP_VERTEX {
+			float position[4];
+			float world[3];
+			float normal[3];
+		};
+		// screen space setup, edge k is opposite vertex k: e = a*x + b*y + c
+		struct TRIANGLE {
+			float a[3], b[3], c[3];
+			bool topLeft[3];
+			float zx, zy, zc;		// depth plane
+			float invArea;
+			float invW[3];
+			float world[3][3];		// divided by w for perspective correct interpolation
+			float normal[3][3];
+			unsigned draw;
+			int minX, minY, maxX, maxY;
+		};
+
+		unsigned width, height, tilesX, tilesY;
+		unsigned threads;
+		IMAGE color;
+		unsigned char clearColor[3] = { 0, 0, 0 };
+
+		std::vector<BUFFER> buffers;			// index = handle - 1
+		std::vector<BufferHandle> freeBuffers;
+		std::vector<PIPELINE> pipelines;		// index = handle - 1
+
+		// bound state
+		PipelineHandle pipeline = INVALID_PIPELINE;
+		BufferHandle vertexBuffers[2] = { INVALID_BUFFER, INVALID_BUFFER };
+		unsigned vertexStrides[2] = { 0, 0 }, vertexOffsets[2] = { 0, 0 };
+		BufferHandle indexBuffer = INVALID_BUFFER;
+		INDEX_FORMAT indexFormat = INDEX_FORMAT::UINT32;
+		unsigned indexOffset = 0;
+		BufferHandle constantBuffers[3] = { INVALID_BUFFER, INVALID_BUFFER, INVALID_BUFFER };
+		unsigned constantOffsets[3] = { 0, 0, 0 };
+		BufferHandle materialTable = INVALID_BUFFER;
+		BufferHandle boundsTable = INVALID_BUFFER;
+		BufferHandle lightTable = INVALID_BUFFER, clusterRanges = INVALID_BUFFER, clusterLights = INVALID_BUFFER;
+		unsigned long long writes = 0;		// source of BUFFER::version
+
+		// this frame
+		std::vector<DRAW_STATE> draws;
+		std::vector<LIGHTING> lightings;
+		std::vector<TRIANGLE> triangles;
+		std::vector<std::vector<unsigned>> bins; // triangle indices per tile, in submission order
+		std::vector<CLIP_VERTEX> transformed;	// scratch for one draw
+		std::vector<unsigned> indices;
+		SOFTWARE_STATS stats = {};
+
+		const BUFFER* Get(BufferHandle buffer) const {
+			return (buffer != INVALID_BUFFER && buffer <= buffers.size() && buffers[buffer - 1].alive) ? &buffers[buffer - 1] : nullptr;
+		}
+
+		static void Lerp(const CLIP_VERTEX& from, const CLIP_VERTEX& to, float t, CLIP_VERTEX& out)
+		{
+			for (int i = 0; i < 4; ++i)
+				out.position[i] = from.position[i] + (to.position[i] - from.position[i]) * t;
+			for (int i = 0; i < 3; ++i) {
+				out.world[i] = from.world[i] + (to.world[i] - from.world[i]) * t;
+				out.normal[i] = from.normal[i] + (to.normal[i] - from.normal[i]) * t;
+			}
+		}
+
+		void SetupTriangle(const CLIP_VERTEX& v0, const CLIP_VERTEX& v1, const CLIP_VERTEX& v2, unsigned draw)
+		{
+			const CLIP_VERTEX* v[3] = { &v0, &v1, &v2 };
+			TRIANGLE t;
+			float x[3], y[3], z[3];
+			for (int k = 0; k < 3; ++k) {
+				t.invW[k] = 1.0f / v[k]->position[3];
+				x[k] = (v[k]->position[0] * t.invW[k] * 0.5f + 0.5f) * width;
+				y[k] = (0.5f - v[k]->position[1] * t.invW[k] * 0.5f) * height;
+				z[k] = v[k]->position[2] * t.invW[k];
+				for (int i = 0; i < 3; ++i) {
+					t.world[k][i] = v[k]->world[i] * t.invW[k];
+					t.normal[k][i] = v[k]->normal[i] * t.invW[k];
+				}
+			}
+			// positive when clockwise on screen (y down), the D3D11 front face
+			float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (!(area > 0)) {
+				++stats.trianglesCulled;
+				return;
+			}
+			// pixels whose centers fall inside the bounds
+			t.minX = std::max(0, static_cast<int>(std::ceil(std::min({ x[0], x[1], x[2] }) - 0.5f)));
+			t.minY = std::max(0, static_cast<int>(std::ceil(std::min({ y[0], y[1], y[2] }) - 0.5f)));
+			t.maxX = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor(std::max({ x[0], x[1], x[2] }) - 0.5f)));
+			t.maxY = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor(std::max({ y[0], y[1], y[2] }) - 0.5f)));
+			if (t.minX > t.maxX || t.minY > t.maxY) {
+				++stats.trianglesCulled;
+				return;
+			}
+			for (int k = 0; k < 3; ++k) {
+				int from = (k + 1) % 3, to = (k + 2) % 3;
+				t.a[k] = -(y[to] - y[from]);
+				t.b[k] = x[to] - x[from];
+				t.c[k] = -(t.a[k] * x[from] + t.b[k] * y[from]);
+				// left edges go up, top edges go right
+				t.topLeft[k] = t.a[k] > 0 || (t.a[k] == 0 && t.b[k] > 0);
+			}
+			t.invArea = 1.0f / area;
+			// depth as a plane through vertex 0: from c (about x * y in size) a small far triangle's
+			// depth came out off by more than the distance to the walls in front of it
+			t.zx = (t.a[1] * (z[1] - z[0]) + t.a[2] * (z[2] - z[0])) * t.invArea;
+			t.zy = (t.b[1] * (z[1] - z[0]) + t.b[2] * (z[2] - z[0])) * t.invArea;
+			t.zc = z[0] - t.zx * x[0] - t.zy * y[0];
+			t.draw = draw;
+
+			unsigned index = static_cast<unsigned>(triangles.size());
+			triangles.push_back(t);
+			++stats.trianglesBinned;
+			for (int ty = t.minY / TILE; ty <= t.maxY / TILE; ++ty)
+				for (int tx = t.minX / TILE; tx <= t.maxX / TILE; ++tx) {
+					bins[ty * tilesX + tx].push_back(index);
+					++stats.binEntries;
+				}
+		}
+
+		// trivial reject, near plane clip (z >= 0), then setup
+		void ClipTriangle(const CLIP_VERTEX& v0, const CLIP_VERTEX& v1, const CLIP_VERTEX& v2, unsigned draw)
+		{
+			const CLIP_VERTEX* v[3] = { &v0, &v1, &v2 };
+			unsigned outside[6] = { 0, 0, 0, 0, 0, 0 };
+			for (int k = 0; k < 3; ++k) {
+				const float* p = v[k]->position;
+				outside[0] += p[0] < -p[3];
+				outside[1] += p[0] > p[3];
+				outside[2] += p[1] < -p[3];
+				outside[3] += p[1] > p[3];
+				outside[4] += p[2] < 0;
+				outside[5] += p[2] > p[3];
+			}
+			for (unsigned count : outside)
+				if (count == 3) {
+					++stats.trianglesCulled;
+					return;
+				}
+			if (outside[4] == 0) {
+				SetupTriangle(v0, v1, v2, draw);
+				return;
+			}
+			// Sutherland-Hodgman against the near plane, at most 4 vertices come out
+			++stats.trianglesClipped;
+			CLIP_VERTEX polygon[4];
+			int count = 0;
+			for (int k = 0; k < 3; ++k) {
+				const CLIP_VERTEX& from = *v[k];
+				const CLIP_VERTEX& to = *v[(k + 1) % 3];
+				bool fromInside = from.position[2] >= 0, toInside = to.position[2] >= 0;
+				if (fromInside)
+					polygon[count++] = from;
+				if (fromInside != toInside)
+					Lerp(from, to, from.position[2] / (from.position[2] - to.position[2]), polygon[count++]);
+			}
+			for (int k = 1; k + 1 < count; ++k)
+				SetupTriangle(polygon[0], polygon[k], polygon[k + 1], draw);
+		}
+
+		// Shaders/VertexShader.hlsl, bounds is nullptr for FULL vertices
+		static void ShadeVertex(const unsigned char* vertex, const POSITION_BOUNDS* bounds, const MATRIX& world,
+			const MATRIX& viewProjection, CLIP_VERTEX& out)
+		{
+			float position[3], normal[3], worldOut[4];
+			if (bounds != nullptr) {
+				COMPACT_VERTEX compact;
+				float uv[2];
+				std::memcpy(&compact, vertex, sizeof(compact));
+				DecompressVertex(compact, *bounds, position, uv, normal);
+			}
+			else {
+				std::memcpy(position, vertex, sizeof(position));
+				std::memcpy(normal, vertex + 24, sizeof(normal));
+			}
+			TransformPoint(position, world, worldOut);
+			for (int c = 0; c < 4; ++c)
+				out.position[c] = worldOut[0] * viewProjection.data[c] + worldOut[1] * viewProjection.data[4 + c] +
+					worldOut[2] * viewProjection.data[8 + c] + worldOut[3] * viewProjection.data[12 + c];
+			std::memcpy(out.world, worldOut, sizeof(out.world));
+			TransformNormal(normal, world, out.normal);
+			float length = std::sqrt(out.normal[0] * out.normal[0] + out.normal[1] * out.normal[1] + out.normal[2] * out.normal[2]);
+			if (length > 0)
+				for (float& n : out.normal)
+					n /= length;
+		}
+
+		// the bound lights as a LIGHTING, a new copy only when a buffer was written or rebound since the last one
+		unsigned CurrentLighting()
+		{
+			const BUFFER* constants = Get(constantBuffers[2]);
+			const BUFFER* table = Get(lightTable);
+			const BUFFER* rangeData = Get(clusterRanges);
+			const BUFFER* lists = Get(clusterLights);
+			CLUSTER_CONSTANTS clusters;
+			if (!constants || constantOffsets[2] + sizeof(CLUSTER_CONSTANTS) > constants->bytes.size())
+				return NO_LIGHTING;
+			std::memcpy(&clusters, constants->bytes.data() + constantOffsets[2], sizeof(CLUSTER_CONSTANTS));
+			const unsigned long long count = static_cast<unsigned long long>(clusters.clusterCount[0]) * clusters.clusterCount[1] * clusters.clusterCount[2];
+			if (clusters.lightCount == 0 || count == 0 || !table || !rangeData || !lists || rangeData->bytes.size() < count * sizeof(CLUSTER_RANGE))
+				return NO_LIGHTING;
+			const unsigned long long versions[4] = { constants->version, table->version, rangeData->version, lists->version };
+			if (!lightings.empty() && std::memcmp(lightings.back().versions, versions, sizeof(versions)) == 0)
+				return static_cast<unsigned>(lightings.size() - 1);
+			LIGHTING lighting;
+			lighting.clusters = clusters;
+			std::memcpy(lighting.versions, versions, sizeof(versions));
+			lighting.lights.resize(table->bytes.size() / sizeof(LIGHT_CONSTANTS));
+			std::memcpy(lighting.lights.data(), table->bytes.data(), lighting.lights.size() * sizeof(LIGHT_CONSTANTS));
+			lighting.ranges.resize(static_cast<size_t>(count));
+			std::memcpy(lighting.ranges.data(), rangeData->bytes.data(), lighting.ranges.size() * sizeof(CLUSTER_RANGE));
+			lighting.indices.resize(lists->bytes.size() / sizeof(unsigned));
+			std::memcpy(lighting.indices.data(), lists->bytes.data(), lighting.indices.size() * sizeof(unsigned));
+			// reads past a buffer get nothing, like D3D11's out of bounds structured buffer reads
+			for (CLUSTER_RANGE& range : lighting.ranges) {
+				range.offset = std::min<unsigned>(range.offset, static_cast<unsigned>(lighting.indices.size()));
+				range.count = std::min<unsigned>(range.count, static_cast<unsigned>(lighting.indices.size()) - range.offset);
+			}
+			for (unsigned& index : lighting.indices)
+				index = index < lighting.lights.size() ? index : NO_LIGHTING;
+			lightings.push_back(std::move(lighting));
+			return static_cast<unsigned>(lightings.size() - 1);
+		}
+
+		void Draw(unsigned indexCount, unsigned instanceCount, unsigned startIndex, int baseVertex, unsigned startInstance)
+		{
+			const BUFFER* vertices = Get(vertexBuffers[0]);
+			const BUFFER* indexData = Get(indexBuffer);
+			const BUFFER* scene = Get(constantBuffers[0]);
+			const BUFFER* mesh = Get(constantBuffers[1]);
+			const BUFFER* materials = Get(materialTable);
+			if (pipeline == INVALID_PIPELINE || !vertices || !indexData || !scene || !mesh || !materials ||
+				vertexStrides[0] < (pipelines[pipeline - 1].compact ? sizeof(COMPACT_VERTEX) : sizeof(H2B::VERTEX)) ||
+				constantOffsets[0] + sizeof(SCENE_CONSTANTS) > scene->bytes.size() ||
+				constantOffsets[1] + sizeof(MESH_CONSTANTS) > mesh->bytes.size())
+				return;
+			MESH_CONSTANTS meshConstants;
+			std::memcpy(&meshConstants, mesh->bytes.data() + constantOffsets[1], sizeof(MESH_CONSTANTS));
+			if ((static_cast<size_t>(meshConstants.materialIndex) + 1) * sizeof(H2B::ATTRIBUTES) > materials->bytes.size())
+				return;
+			bool instanced = pipelines[pipeline - 1].instanced;
+			const BUFFER* instances = instanced ? Get(vertexBuffers[1]) : nullptr;
+			if (instanced && (!instances || vertexStrides[1] < sizeof(MATRIX)))
+				return;
+			POSITION_BOUNDS bounds;
+			if (pipelines[pipeline - 1].compact) {
+				const BUFFER* table = Get(boundsTable);
+				if (!table || (static_cast<size_t>(meshConstants.boundsIndex) + 1) * sizeof(POSITION_BOUNDS) > table->bytes.size())
+					return;
+				std::memcpy(&bounds, table->bytes.data() + static_cast<size_t>(meshConstants.boundsIndex) * sizeof(POSITION_BOUNDS),
+					sizeof(POSITION_BOUNDS));
+			}
+
+			// fetch the index range once, skipping the draw if it reads past a buffer
+			unsigned indexSize = indexFormat == INDEX_FORMAT::UINT16 ? 2 : 4;
+			size_t firstByte = indexOffset + static_cast<size_t>(startIndex) * indexSize;
+			if (firstByte + static_cast<size_t>(indexCount) * indexSize > indexData->bytes.size())
+				return;
+			size_t vertexCount = (vertices->bytes.size() - std::min<size_t>(vertexOffsets[0], vertices->bytes.size())) / vertexStrides[0];
+			indices.resize(indexCount);
+			long long lowest = 0, highest = -1;
+			for (unsigned i = 0; i < indexCount; ++i) {
+				unsigned value = 0;
+				std::memcpy(&value, indexData->bytes.data() + firstByte + static_cast<size_t>(i) * indexSize, indexSize);
+				long long vertex = static_cast<long long>(value) + baseVertex;
+				if (vertex < 0 || vertex >= static_cast<long long>(vertexCount))
+					return;
+				indices[i] = static_cast<unsigned>(vertex);
+				lowest = i == 0 ? vertex : std::min(lowest, vertex);
+				highest = std::max(highest, vertex);
+			}
+			if (indexCount < 3)
+				return;
+			if (instanced && vertexOffsets[1] + (static_cast<size_t>(startInstance) + instanceCount) * vertexStrides[1] > instances->bytes.size())
+				return;
+
+			unsigned draw = static_cast<unsigned>(draws.size());
+			draws.emplace_back();
+			std::memcpy(&draws.back().scene, scene->bytes.data() + constantOffsets[0], sizeof(SCENE_CONSTANTS));
+			draws.back().mesh = meshConstants;
+			std::memcpy(&draws.back().material, materials->bytes.data() +
+				static_cast<size_t>(meshConstants.materialIndex) * sizeof(H2B::ATTRIBUTES), sizeof(H2B::ATTRIBUTES));
+			draws.back().lighting = CurrentLighting();
+			MATRIX viewProjection = Multiply(draws.back().scene.vMatrix, draws.back().scene.pMatrix);
+			++stats.draws;
+
+			transformed.resize(static_cast<size_t>(highest - lowest + 1));
+			const unsigned char* vertexData = vertices->bytes.data() + vertexOffsets[0];
+			for (unsigned instance = 0; instance < instanceCount; ++instance) {
+				MATRIX world = draws[draw].mesh.wMatrix;
+				if (instanced)
+					std::memcpy(&world, instances->bytes.data() + vertexOffsets[1] +
+						(static_cast<size_t>(startInstance) + instance) * vertexStrides[1], sizeof(MATRIX));
+				for (long long v = lowest; v <= highest; ++v)
+					ShadeVertex(vertexData + v * vertexStrides[0], pipelines[pipeline - 1].compact ? &bounds : nullptr,
+						world, viewProjection, transformed[v - lowest]);
+				for (unsigned i = 0; i + 2 < indexCount; i += 3) {
+					++stats.trianglesIn;
+					ClipTriangle(transformed[indices[i] - lowest], transformed[indices[i + 1] - lowest],
+						transformed[indices[i + 2] - lowest], draw);
+				}
+			}
+		}
+
+		// per worker tile memory
+		struct TILE_SCRATCH {
+			float depth[TILE * TILE];
+			unsigned triangle[TILE * TILE];
+		};
+
+		void RasterTile(unsigned tile, TILE_SCRATCH& scratch, unsigned long long& shaded)
+		{
+			using namespace Simd;
+			int tileX = static_cast<int>(tile % tilesX) * TILE, tileY = static_cast<int>(tile / tilesX) * TILE;
+			std::fill(scratch.depth, scratch.depth + TILE * TILE, 1.0f);
+			std::fill(scratch.triangle, scratch.triangle + TILE * TILE, NO_TRIANGLE);
+
+			const FLOATS ramp = Ramp(), zero = Set(0);
+			for (unsigned index : bins[tile]) {
+				const TRIANGLE& t = triangles[index];
+				int x0 = std::max(t.minX, tileX), x1 = std::min(t.maxX, tileX + TILE - 1);
+				int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, tileY + TILE - 1);
+				// start on a lane boundary so a row never runs past the tile
+				x0 = tileX + ((x0 - tileX) & ~(LANES - 1));
+				FLOATS a[3], b[3], c[3];
+				MASK topLeft[3];
+				for (int k = 0; k < 3; ++k) {
+					a[k] = Set(t.a[k]);
+					b[k] = Set(t.b[k]);
+					c[k] = Set(t.c[k]);
+					topLeft[k] = All(t.topLeft[k]);
+				}
+				FLOATS zx = Set(t.zx), zy = Set(t.zy), zc = Set(t.zc);
+				for (int y = y0; y <= y1; ++y) {
+					FLOATS fy = Set(y + 0.5f);
+					FLOATS rowC[3] = { b[0] * fy + c[0], b[1] * fy + c[1], b[2] * fy + c[2] };
+					FLOATS rowZ = zy * fy + zc;
+					float* depthRow = scratch.depth + (y - tileY) * TILE - tileX;
+					unsigned* triangleRow = scratch.triangle + (y - tileY) * TILE - tileX;
+					for (int x = x0; x <= x1; x += LANES) {
+						FLOATS fx = Set(x + 0.5f) + ramp;
+						MASK inside = All(true);
+						for (int k = 0; k < 3; ++k) {
+							FLOATS e = a[k] * fx + rowC[k];
+							inside = And(inside, Or(Greater(e, zero), And(Equal(e, zero), topLeft[k])));
+						}
+						if (Bits(inside) == 0)
+							continue;
+						FLOATS z = zx * fx + rowZ;
+						FLOATS stored = Load(depthRow + x);
+						MASK pass = And(inside, Less(z, stored));
+						int bits = Bits(pass);
+						if (bits == 0)
+							continue;
+						Store(depthRow + x, Select(pass, z, stored));
+						for (int lane = 0; lane < LANES; ++lane)
+							if (bits & (1 << lane))
+								triangleRow[x + lane] = index;
+					}
+				}
+			}
+
+			// resolve: shade the visible triangle of each pixel once
+			int endX = std::min(tileX + TILE, static_cast<int>(width)), endY = std::min(tileY + TILE, static_cast<int>(height));
+			unsigned char* pixels = color.rgb.data();
+			for (int y = tileY; y < endY; ++y)
+				for (int x = tileX; x < endX; ++x) {
+					unsigned char* out = pixels + (static_cast<size_t>(y) * width + x) * 3;
+					unsigned index = scratch.triangle[(y - tileY) * TILE + (x - tileX)];
+					if (index == NO_TRIANGLE) {
+						out[0] = clearColor[0];
+						out[1] = clearColor[1];
+						out[2] = clearColor[2];
+						continue;
+					}
+					ShadePixel(triangles[index], x + 0.5f, y + 0.5f, out);
+					++shaded;
+				}
+		}
+
+		// Shaders/PixelShader.hlsl
+		void ShadePixel(const TRIANGLE& t, float x, float y, unsigned char* out) const
+		{
+			float weight[3];
+			for (int k = 0; k < 3; ++k)
+				weight[k] = (t.a[k] * x + t.b[k] * y + t.c[k]) * t.invArea;
+			float w = 1.0f / (weight[0] * t.invW[0] + weight[1] * t.invW[1] + weight[2] * t.invW[2]);
+			FLOAT3 world, normal;
+			float* worldOut = &world.x;
+			float* normalOut = &normal.x;
+			for (int i = 0; i < 3; ++i) {
+				worldOut[i] = (weight[0] * t.world[0][i] + weight[1] * t.world[1][i] + weight[2] * t.world[2][i]) * w;
+				normalOut[i] = (weight[0] * t.normal[0][i] + weight[1] * t.normal[1][i] + weight[2] * t.normal[2][i]) * w;
+			}
+			const SCENE_CONSTANTS& scene = draws[t.draw].scene;
+			const H2B::ATTRIBUTES& material = draws[t.draw].material;
+			auto saturate = [](float value) { return value < 0 ? 0.0f : (value > 1 ? 1.0f : value); };
+
+			FLOAT3 norm = Normalize(normal);
+			float direct = saturate(-(norm.x * scene.lightDirc[0] + norm.y * scene.lightDirc[1] + norm.z * scene.lightDirc[2]));
+			// the point and spot lights of the pixel's cluster
+			float lit[3] = { 0.0f, 0.0f, 0.0f };
+			if (draws[t.draw].lighting != NO_LIGHTING) {
+				const LIGHTING& lighting = lightings[draws[t.draw].lighting];
+				const CLUSTER_RANGE& range = lighting.ranges[ClusterOf(lighting.clusters, &world.x, scene.vMatrix, scene.pMatrix)];
+				for (unsigned i = 0; i < range.count; ++i) {
+					const unsigned index = lighting.indices[range.offset + i];
+					if (index == NO_LIGHTING)
+						continue;
+					const LIGHT_CONSTANTS& light = lighting.lights[index];
+					FLOAT3 toLight = { light.position[0] - world.x, light.position[1] - world.y, light.position[2] - world.z };
+					float distanceSquared = Dot(toLight, toLight);
+					float inverse = 1.0f / std::sqrt(std::max(distanceSquared, 0.000001f));
+					FLOAT3 lightDir = { toLight.x * inverse, toLight.y * inverse, toLight.z * inverse };
+					float falloff = saturate(1 - distanceSquared / (light.range * light.range));
+					float spot = saturate(-(lightDir.x * light.direction[0] + lightDir.y * light.direction[1] + lightDir.z * light.direction[2]) *
+						light.spotScale + light.spotOffset);
+					float strength = saturate(Dot(norm, lightDir)) * falloff * falloff * spot * spot;
+					for (int c = 0; c < 3; ++c)
+						lit[c] += strength * light.color[c];
+				}
+			}
+			FLOAT3 viewDir = Normalize({ scene.cameraPos[0] - world.x, scene.cameraPos[1] - world.y, scene.cameraPos[2] - world.z });
+			const float* Kd = &material.Kd.x;
+			const float* Ks = &material.Ks.x;
+			// pow is most of the shading cost, skip it when it can't contribute
+			float specular = 0;
+			float facing = saturate(Dot(norm, viewDir));
+			if (facing > 0 && (Ks[0] != 0 || Ks[1] != 0 || Ks[2] != 0)) {
+				float specPower = (material.Ns > 0) ? material.Ns + 0.000001f : 90;
+				specular = std::pow(facing, specPower);
+			}
+			const float* Ka = &material.Ka.x;
+			const float* Ke = &material.Ke.x;
+			for (int i = 0; i < 3; ++i) {
+				float indirect = saturate(Ka[i] * scene.sunAmbient[i]);
+				float result = saturate(direct * scene.lightColor[i] + lit[i] + indirect) * Kd[i] + specular * Ks[i] + Ke[i];
+				out[i] = static_cast<unsigned char>(saturate(result) * 255.0f + 0.5f);
+			}
+		}
+
+	public:
+		// threadCount 0 uses every hardware thread
+		SoftwareBackend(unsigned frameWidth, unsigned frameHeight, unsigned threadCount = 0)
+		{
+			Resize(frameWidth, frameHeight);
+			SetThreads(threadCount);
+		}
+
+		void Resize(unsigned frameWidth, unsigned frameHeight)
+		{
+			width = frameWidth;
+			height = frameHeight;
+			tilesX = (width + TILE - 1) / TILE;
+			tilesY = (height + TILE - 1) / TILE;
+			color.width = width;
+			color.height = height;
+			color.rgb.assign(static_cast<size_t>(width) * height * 3, 0);
+			bins.assign(static_cast<size_t>(tilesX) * tilesY, std::vector<unsigned>());
+		}
+		void SetThreads(unsigned threadCount)
+		{
+			threads = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+		}
+		unsigned Threads() const {
+			return threads;
+		}
+
+		BufferHandle CreateBuffer(const BUFFER_DESC& desc, const void* initialData) override
+		{
+			BUFFER buffer;
+			buffer.desc = desc;
+			buffer.alive = true;
+			buffer.version = ++writes;
+			buffer.bytes.assign(desc.byteWidth, 0);
+			if (initialData != nullptr)
+				std::memcpy(buffer.bytes.data(), initialData, desc.byteWidth);
+			if (freeBuffers.empty()) {
+				buffers.push_back(std::move(buffer));
+				return static_cast<BufferHandle>(buffers.size());
+			}
+			BufferHandle handle = freeBuffers.back();
+			freeBuffers.pop_back();
+			buffers[handle - 1] = std::move(buffer);
+			return handle;
+		}
+		void ReleaseBuffer(BufferHandle buffer) override
+		{
+			if (Get(buffer) == nullptr)
+				return;
+			buffers[buffer - 1].alive = false;
+			std::vector<unsigned char>().swap(buffers[buffer - 1].bytes);
+			freeBuffers.push_back(buffer);
+		}
+		// the shader paths are only used to tell pipelines apart, the shaders themselves are built in
+		PipelineHandle CreatePipeline(const PIPELINE_DESC& desc) override
+		{
+			PIPELINE state = { desc.vertexShaderPath ? desc.vertexShaderPath : "", desc.pixelShaderPath ? desc.pixelShaderPath : "",
+				desc.instanced, desc.compactVertices };
+			for (size_t i = 0; i < pipelines.size(); ++i)
+				if (pipelines[i].vertexShaderPath == state.vertexShaderPath && pipelines[i].pixelShaderPath == state.pixelShaderPath &&
+					pipelines[i].instanced == state.instanced && pipelines[i].compact == state.compact)
+					return static_cast<PipelineHandle>(i + 1);
+			pipelines.push_back(state);
+			return static_cast<PipelineHandle>(pipelines.size());
+		}
+
+		void SetPipeline(PipelineHandle handle) override
+		{
+			pipeline = handle <= pipelines.size() ? handle : INVALID_PIPELINE;
+		}
+		void SetVertexBuffers(unsigned startSlot, unsigned count, const BufferHandle* buffs,
+			const unsigned* strides, const unsigned* offsets) override
+		{
+			for (unsigned i = 0; i < count; ++i)
+				if (startSlot + i < 2) {
+					vertexBuffers[startSlot + i] = buffs[i];
+					vertexStrides[startSlot + i] = strides[i];
+					vertexOffsets[startSlot + i] = offsets[i];
+				}
+		}
+		void SetIndexBuffer(BufferHandle buffer, INDEX_FORMAT format, unsigned offset) override
+		{
+			indexBuffer = buffer;
+			indexFormat = format;
+			indexOffset = offset;
+		}
+		void SetConstantBuffer(unsigned slot, BufferHandle buffer, unsigned) override
+		{
+			if (slot < 3) {
+				constantBuffers[slot] = buffer;
+				constantOffsets[slot] = 0;
+			}
+		}
+		void SetConstantBufferRange(unsigned slot, BufferHandle buffer, unsigned byteOffset, unsigned, unsigned) override
+		{
+			if (slot < 3) {
+				constantBuffers[slot] = buffer;
+				constantOffsets[slot] = byteOffset;
+			}
+		}
+		// the material table (t0), position bounds (t1) and clustered lights (t2 to t4)
+		void SetShaderResource(unsigned slot, BufferHandle buffer, unsigned) override
+		{
+			if (slot == MATERIAL_TABLE_SLOT)
+				materialTable = buffer;
+			else if (slot == POSITION_BOUNDS_SLOT)
+				boundsTable = buffer;
+			else if (slot == LIGHT_TABLE_SLOT)
+				lightTable = buffer;
+			else if (slot == CLUSTER_RANGE_SLOT)
+				clusterRanges = buffer;
+			else if (slot == CLUSTER_LIGHT_SLOT)
+				clusterLights = buffer;
+		}
+		void UpdateBuffer(BufferHandle buffer, const void* data, unsigned byteCount) override
+		{
+			UpdateBufferRange(buffer, 0, data, byteCount, true);
+		}
+		// the frame is drawn from the buffer contents at each draw, discarding changes nothing
+		void UpdateBufferRange(BufferHandle buffer, unsigned byteOffset, const void* data, unsigned byteCount, bool) override
+		{
+			if (Get(buffer) == nullptr)
+				return;
+			std::vector<unsigned char>& bytes = buffers[buffer - 1].bytes;
+			buffers[buffer - 1].version = ++writes;
+			if (byteOffset < bytes.size())
+				std::memcpy(bytes.data() + byteOffset, data, std::min<size_t>(byteCount, bytes.size() - byteOffset));
+		}
+
+		void DrawIndexed(unsigned indexCount, unsigned startIndex, int baseVertex) override
+		{
+			Draw(indexCount, 1, startIndex, baseVertex, 0);
+		}
+		void DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount,
+			unsigned startIndex, int baseVertex, unsigned startInstance) override
+		{
+			Draw(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+		}
+
+		// starts a frame cleared to rgb (0..1), the clear happens while resolving tiles
+		void BeginFrame(const float clearRGB[3])
+		{
+			for (int i = 0; i < 3; ++i)
+				clearColor[i] = static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, clearRGB[i])) * 255.0f + 0.5f);
+			draws.clear();
+			lightings.clear();
+			triangles.clear();
+			for (std::vector<unsigned>& bin : bins)
+				bin.clear();
+			stats = SOFTWARE_STATS();
+		}
+
+		// rasterizes and shades every tile, the image is ready afterwards
+		void EndFrame()
+		{
+			unsigned tileCount = tilesX * tilesY;
+			std::atomic<unsigned> next(0);
+			std::atomic<unsigned long long> shaded(0);
+			auto work = [&]() {
+				std::unique_ptr<TILE_SCRATCH> scratch(new TILE_SCRATCH);
+				unsigned long long count = 0;
+				for (unsigned tile = next++; tile < tileCount; tile = next++)
+					RasterTile(tile, *scratch, count);
+				shaded += count;
+			};
+			std::vector<std::thread> workers;
+			for (unsigned i = 1; i < std::min(threads, tileCount); ++i)
+				workers.emplace_back(work);
+			work();
+			for (std::thread& worker : workers)
+				worker.join();
+			stats.pixelsShaded = shaded;
+		}
+
+		const IMAGE& Image() const {
+			return color;
+		}
+		const SOFTWARE_STATS& Stats() const {
+			return stats;
+		}
+		// bytes of a live buffer, nullptr for released or unknown handles
+		const std::vector<unsigned char>* Contents(BufferHandle buffer) const {
+			const BUFFER* found = Get(buffer);
+			return found != nullptr ? &found->bytes : nullptr;
+		}
+	};
+}
+#endif
@@ -0,0 +1,261 @@
+#ifndef _STATIC_BATCHING_H_
+#define _STATIC_BATCHING_H_
+// Build step that bakes the level's static instances into combined meshes.
+// Every sub-mesh of an eligible instance is moved to world space and appended
+// to the batch of its material in the grid cell its instance's bounds center
+// falls into. A section of the level then draws one DrawIndexed per material
+// and cell, with constants that never change. The cells keep each batch small
+// enough for the frustum to cull it. The baked vertices are a copy per
+// instance, Stats() reports what that costs against sharing the assets.
+// Assets with translucent materials are left to the sorted dynamic path.
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "h2bParser.h"
+#include "asset_cache.h"
+#include "culling.h"
+#include "instancing.h"
+#include "job_system.h"
+#include "level_math.h"
+
+namespace Level {
+
+	// which sub-meshes may share a batch
+	enum class BATCH_MERGE {
+		ASSET_MATERIAL,	// the same material of the same asset
+		MATERIAL,		// materials with identical attributes and texture names, from any asset
+	};
+
+	struct STATIC_BATCH_OPTIONS {
+		float chunkSize = 16.0f;		// edge of the world space grid cells, 0 or less makes one cell
+		unsigned maxVertices = 65536;	// a batch that would grow past this starts another (keeps 16 bit indices)
+		unsigned maxInstanceTriangles = 4096;	// instances of bigger assets stay on the instanced path
+		BATCH_MERGE merge = BATCH_MERGE::MATERIAL;
+	};
+
+	// one combined mesh: world space vertices of one material in one cell
+	struct STATIC_BATCH {
+		AssetHandle asset;		// owner of the material, the first sub-mesh's asset
+		unsigned materialIndex;	// in that asset
+		unsigned subMeshes;		// sub-mesh draws this one replaces
+		AABB bounds;
+		std::vector<H2B::VERTEX> vertices;
+		std::vector<unsigned> indices;
+	};
+
+	struct STATIC_BATCH_STATS {
+		unsigned batches;
+		unsigned instances;			// instances baked into batches
+		unsigned subMeshes;			// their sub-mesh draws
+		size_t bakedBytes;			// vertex + index bytes of every batch
+		size_t sourceBytes;			// what the baked assets hold once (level 0 ranges)
+	};
+
+	class StaticBatcher
+	{
+		// a sub-mesh's level 0 triangles over only the vertices they use
+		struct SUB_MESH {
+			std::vector<unsigned> vertices;	// asset vertex per local vertex
+			std::vector<unsigned> indices;	// local
+		};
+		struct ITEM {
+			unsigned material;	// merge group
+			int cell[3];
+			unsigned instance, mesh;
+		};
+
+		static void Gather(const H2B::Parser& model, const H2B::BATCH& range, SUB_MESH& out)
+		{
+			std::vector<unsigned> local(model.vertices.size(), 0xFFFFFFFF);
+			for (unsigned i = 0; i < range.indexCount; ++i) {
+				unsigned vertex = model.indices[range.indexOffset + i];
+				if (local[vertex] == 0xFFFFFFFF) {
+					local[vertex] = static_cast<unsigned>(out.vertices.size());
+					out.vertices.push_back(vertex);
+				}
+				out.indices.push_back(local[vertex]);
+			}
+		}
+		// the material's attributes and texture names, equal for materials that draw the same
+		static std::string Signature(const H2B::MATERIAL& material)
+		{
+			std::string signature(reinterpret_cast<const char*>(&material.attrib), sizeof(H2B::ATTRIBUTES));
+			for (int j = 0; j < 10; ++j) {
+				const char* text = *((&material.name) + j);
+				// the name is the only string that does not change how it looks
+				if (j > 0 && text != nullptr)
+					signature += text;
+				signature.push_back('\0');
+			}
+			return signature;
+		}
+
+	public:
+		std::vector<STATIC_BATCH> batches;
+		// per instance, 1 if it is drawn by a batch
+		std::vector<char> batched;
+
+		void Clear()
+		{
+			batches.clear();
+			batched.clear();
+		}
+
+		// worldBounds[i] is instances[i]'s world box (the BVH's input), jobs (optional) bakes batches in parallel
+		void Build(const std::vector<INSTANCE>& instances, const AssetCache& assets, const std::vector<AABB>& worldBounds,
+			const STATIC_BATCH_OPTIONS& options = STATIC_BATCH_OPTIONS(), JobSystem* jobs = nullptr)
+		{
+			Clear();
+			batched.assign(instances.size(), 0);
+
+			// merge group of every material of every eligible asset
+			std::vector<std::vector<unsigned>> groupOf(assets.Capacity());
+			std::vector<char> eligible(assets.Capacity(), 0);
+			std::vector<std::pair<AssetHandle, unsigned>> groupMaterial;
+			std::map<std::string, unsigned> signatures;
+			for (const INSTANCE& instance : instances) {
+				AssetHandle asset = instance.asset;
+				if (!assets.IsValid(asset) || !groupOf[asset].empty())
+					continue;
+				const H2B::Parser& model = assets.Get(asset);
+				bool opaque = true;
+				for (const H2B::MESH& mesh : model.meshes)
+					opaque &= model.materials[mesh.materialIndex].attrib.d >= 1.0f;
+				eligible[asset] = opaque && model.meshCount > 0 && assets.Lods(asset).triangles[0] <= options.maxInstanceTriangles;
+				groupOf[asset].resize(model.materialCount);
+				for (unsigned m = 0; m < model.materialCount; ++m) {
+					unsigned next = static_cast<unsigned>(groupMaterial.size());
+					if (options.merge == BATCH_MERGE::MATERIAL)
+						groupOf[asset][m] = signatures.emplace(Signature(model.materials[m]), next).first->second;
+					else
+						groupOf[asset][m] = next;
+					if (groupOf[asset][m] == next)
+						groupMaterial.push_back({ asset, m });
+				}
+			}
+
+			// sub-meshes sorted by material, then cell, then load order
+			std::vector<ITEM> items;
+			for (unsigned i = 0; i < instances.size(); ++i) {
+				AssetHandle asset = instances[i].asset;
+				if (!assets.IsValid(asset) || !eligible[asset])
+					continue;
+				batched[i] = 1;
+				int cell[3] = { 0, 0, 0 };
+				for (int a = 0; a < 3 && options.chunkSize > 0.0f; ++a)
+					cell[a] = static_cast<int>(std::floor((worldBounds[i].min[a] + worldBounds[i].max[a]) * 0.5f / options.chunkSize));
+				const H2B::Parser& model = assets.Get(asset);
+				for (unsigned m = 0; m < model.meshCount; ++m)
+					items.push_back({ groupOf[asset][model.meshes[m].materialIndex], { cell[0], cell[1], cell[2] }, i, m });
+			}
+			std::stable_sort(items.begin(), items.end(), [](const ITEM& a, const ITEM& b) {
+				return std::tie(a.material, a.cell[0], a.cell[1], a.cell[2]) < std::tie(b.material, b.cell[0], b.cell[1], b.cell[2]);
+			});
+
+			// level 0 sub-meshes of the baked assets, gathered once
+			std::vector<std::vector<SUB_MESH>> subMeshes(assets.Capacity());
+			std::vector<AssetHandle> used;
+			for (AssetHandle asset = 0; asset < eligible.size(); ++asset)
+				if (eligible[asset])
+					used.push_back(asset);
+			ParallelFor(jobs, static_cast<unsigned>(used.size()), 1, [&](unsigned begin, unsigned end) {
+				for (unsigned u = begin; u < end; ++u) {
+					const H2B::Parser& model = assets.Get(used[u]);
+					subMeshes[used[u]].resize(model.meshCount);
+					for (unsigned m = 0; m < model.meshCount; ++m)
+						Gather(model, assets.Lods(used[u]).Range(0, m), subMeshes[used[u]][m]);
+				}
+			});
+
+			// a batch per run of items with the same material and cell, split at maxVertices
+			struct RUN {
+				size_t first, last;
+			};
+			std::vector<RUN> runs;
+			for (size_t first = 0; first < items.size();) {
+				size_t last = first;
+				unsigned vertices = 0;
+				while (last < items.size() && items[last].material == items[first].material &&
+					std::equal(items[last].cell, items[last].cell + 3, items[first].cell)) {
+					const ITEM& item = items[last];
+					unsigned count = static_cast<unsigned>(subMeshes[instances[item.instance].asset][item.mesh].vertices.size());
+					if (last > first && vertices + count > options.maxVertices)
+						break;
+					vertices += count;
+					++last;
+				}
+				runs.push_back({ first, last });
+				first = last;
+			}
+			batches.resize(runs.size());
+			ParallelFor(jobs, static_cast<unsigned>(runs.size()), 1, [&](unsigned begin, unsigned end) {
+				for (unsigned r = begin; r < end; ++r) {
+					STATIC_BATCH& batch = batches[r];
+					batch.asset = groupMaterial[items[runs[r].first].material].first;
+					batch.materialIndex = groupMaterial[items[runs[r].first].material].second;
+					batch.subMeshes = static_cast<unsigned>(runs[r].last - runs[r].first);
+					batch.bounds = EmptyBounds();
+					for (size_t k = runs[r].first; k < runs[r].last; ++k) {
+						const INSTANCE& instance = instances[items[k].instance];
+						const H2B::Parser& model = assets.Get(instance.asset);
+						const SUB_MESH& subMesh = subMeshes[instance.asset][items[k].mesh];
+						const unsigned base = static_cast<unsigned>(batch.vertices.size());
+						for (unsigned vertex : subMesh.vertices) {
+							const H2B::VERTEX& source = model.vertices[vertex];
+							const float position[3] = { source.pos.x, source.pos.y, source.pos.z };
+							const float normal[3] = { source.nrm.x, source.nrm.y, source.nrm.z };
+							float world[4], worldNormal[3];
+							TransformPoint(position, instance.world, world);
+							TransformNormal(normal, instance.world, worldNormal);
+							float length = std::sqrt(worldNormal[0] * worldNormal[0] + worldNormal[1] * worldNormal[1] + worldNormal[2] * worldNormal[2]);
+							if (length > 0.0f)
+								for (float& n : worldNormal)
+									n /= length;
+							H2B::VERTEX baked = source;
+							baked.pos = { world[0], world[1], world[2] };
+							baked.nrm = { worldNormal[0], worldNormal[1], worldNormal[2] };
+							batch.vertices.push_back(baked);
+							for (int a = 0; a < 3; ++a) {
+								batch.bounds.min[a] = std::min(batch.bounds.min[a], world[a]);
+								batch.bounds.max[a] = std::max(batch.bounds.max[a], world[a]);
+							}
+						}
+						for (unsigned index : subMesh.indices)
+							batch.indices.push_back(base + index);
+					}
+				}
+			});
+		}
+
+		STATIC_BATCH_STATS Stats(const std::vector<INSTANCE>& instances, const AssetCache& assets) const
+		{
+			STATIC_BATCH_STATS stats = {};
+			stats.batches = static_cast<unsigned>(batches.size());
+			for (const STATIC_BATCH& batch : batches) {
+				stats.subMeshes += batch.subMeshes;
+				stats.bakedBytes += sizeof(H2B::VERTEX) * batch.vertices.size() + sizeof(unsigned) * batch.indices.size();
+			}
+			std::vector<char> counted(assets.Capacity(), 0);
+			for (unsigned i = 0; i < batched.size() && i < instances.size(); ++i) {
+				if (!batched[i])
+					continue;
+				++stats.instances;
+				if (counted[instances[i].asset])
+					continue;
+				counted[instances[i].asset] = 1;
+				const H2B::Parser& model = assets.Get(instances[i].asset);
+				for (unsigned m = 0; m < model.meshCount; ++m) {
+					SUB_MESH subMesh;
+					Gather(model, assets.Lods(instances[i].asset).Range(0, m), subMesh);
+					stats.sourceBytes += sizeof(H2B::VERTEX) * subMesh.vertices.size() + sizeof(unsigned) * subMesh.indices.size();
+				}
+			}
+			return stats;
+		}
+	};
+}
+#endif
@@ -0,0 +1,210 @@
+#ifndef _VERTEX_FORMAT_H_
+#define _VERTEX_FORMAT_H_
+// Runtime vertex layouts for the level's geometry.
+// FULL is H2B::VERTEX as the .h2b stores it (36 bytes). COMPACT packs the
+// same vertex into 16 bytes:
+//   position  4 x unorm16, xyz across the asset's bounds (w unused)
+//   uv        2 x half (the .h2b's w is always 0 and dropped)
+//   normal    2 x snorm16, octahedral
+// The vertex shader scales positions back with the asset's POSITION_BOUNDS
+// (t1, see scene_constants.h). Assets with at most 65536 vertices also get
+// 16 bit indices, DrawIndexed's base vertex keeps them local to the asset.
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "h2bParser.h"
+#include "culling.h"
+#include "scene_constants.h"
+
+namespace Level {
+
+	enum class VERTEX_FORMAT { FULL, COMPACT };
+
+	struct COMPACT_VERTEX {
+		unsigned short position[4];
+		unsigned short uv[2];
+		short normal[2];
+	};
+
+	inline unsigned VertexStride(VERTEX_FORMAT format) {
+		return format == VERTEX_FORMAT::COMPACT ? sizeof(COMPACT_VERTEX) : sizeof(H2B::VERTEX);
+	}
+	// indices of an asset fit 16 bits once they are relative to its first vertex
+	inline bool FitsShortIndices(const H2B::Parser& model) {
+		return model.vertices.size() <= 65536;
+	}
+
+	// IEEE half, round to nearest even, out of range values become infinity
+	inline unsigned short FloatToHalf(float value)
+	{
+		unsigned bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		unsigned sign = (bits >> 16) & 0x8000, exponent = (bits >> 23) & 0xFF, mantissa = bits & 0x7FFFFF;
+		if (exponent == 0xFF)
+			return static_cast<unsigned short>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+		int halfExponent = static_cast<int>(exponent) - 127 + 15;
+		if (halfExponent >= 31)
+			return static_cast<unsigned short>(sign | 0x7C00);
+		if (halfExponent <= 0) {
+			// subnormal half (or zero), the implicit bit becomes explicit
+			if (halfExponent < -10)
+				return static_cast<unsigned short>(sign);
+			mantissa |= 0x800000;
+			unsigned shift = static_cast<unsigned>(14 - halfExponent);
+			unsigned half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1), midpoint = 1u << (shift - 1);
+			if (rest > midpoint || (rest == midpoint && (half & 1)))
+				++half;
+			return static_cast<unsigned short>(sign | half);
+		}
+		unsigned half = (static_cast<unsigned>(halfExponent) << 10) | (mantissa >> 13), rest = mantissa & 0x1FFF;
+		// a carry out of the mantissa correctly rounds up into the exponent
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			++half;
+		return static_cast<unsigned short>(sign | half);
+	}
+	inline float HalfToFloat(unsigned short half)
+	{
+		unsigned sign = (half & 0x8000u) << 16, exponent = (half >> 10) & 0x1F, mantissa = half & 0x3FF;
+		float value;
+		if (exponent == 0)
+			value = std::ldexp(static_cast<float>(mantissa), -24);
+		else if (exponent == 31)
+			value = mantissa ? NAN : INFINITY;
+		else
+			value = std::ldexp(static_cast<float>(mantissa | 0x400), static_cast<int>(exponent) - 25);
+		unsigned bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		bits |= sign;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// unit normal to the octahedron unfolded onto [-1, 1]^2
+	inline void OctahedralEncode(const float normal[3], short out[2])
+	{
+		float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+		float x = length > 0 ? normal[0] / length : 0.0f, y = length > 0 ? normal[1] / length : 0.0f;
+		if (length > 0 && normal[2] < 0) {
+			float foldedX = (1.0f - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+			float foldedY = (1.0f - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		out[0] = static_cast<short>(std::lround(std::max(-1.0f, std::min(1.0f, x)) * 32767.0f));
+		out[1] = static_cast<short>(std::lround(std::max(-1.0f, std::min(1.0f, y)) * 32767.0f));
+	}
+	// what the vertex shader does with the R16G16_SNORM pair
+	inline void OctahedralDecode(const short encoded[2], float normal[3])
+	{
+		float x = std::max(encoded[0] / 32767.0f, -1.0f), y = std::max(encoded[1] / 32767.0f, -1.0f);
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		float t = std::max(-z, 0.0f);
+		x += x >= 0 ? -t : t;
+		y += y >= 0 ? -t : t;
+		float length = std::sqrt(x * x + y * y + z * z);
+		normal[0] = x / length;
+		normal[1] = y / length;
+		normal[2] = z / length;
+	}
+
+	// positions are stored as unorm16 steps across the asset's bounds
+	inline POSITION_BOUNDS QuantizationBounds(const AABB& bounds)
+	{
+		POSITION_BOUNDS quantization = {};
+		for (int i = 0; i < 3; ++i) {
+			float extent = bounds.max[i] > bounds.min[i] ? bounds.max[i] - bounds.min[i] : 0.0f;
+			quantization.offset[i] = bounds.max[i] >= bounds.min[i] ? bounds.min[i] : 0.0f;
+			quantization.scale[i] = extent / 65535.0f;
+		}
+		return quantization;
+	}
+
+	inline COMPACT_VERTEX CompressVertex(const H2B::VERTEX& vertex, const POSITION_BOUNDS& bounds)
+	{
+		COMPACT_VERTEX compact = {};
+		const float position[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+		for (int i = 0; i < 3; ++i) {
+			float step = bounds.scale[i] > 0 ? (position[i] - bounds.offset[i]) / bounds.scale[i] : 0.0f;
+			compact.position[i] = static_cast<unsigned short>(std::lround(std::max(0.0f, std::min(65535.0f, step))));
+		}
+		compact.uv[0] = FloatToHalf(vertex.uvw.x);
+		compact.uv[1] = FloatToHalf(vertex.uvw.y);
+		const float normal[3] = { vertex.nrm.x, vertex.nrm.y, vertex.nrm.z };
+		OctahedralEncode(normal, compact.normal);
+		return compact;
+	}
+	// the position, uv and normal the shader sees
+	inline void DecompressVertex(const COMPACT_VERTEX& compact, const POSITION_BOUNDS& bounds,
+		float position[3], float uv[2], float normal[3])
+	{
+		for (int i = 0; i < 3; ++i)
+			position[i] = bounds.offset[i] + compact.position[i] * bounds.scale[i];
+		uv[0] = HalfToFloat(compact.uv[0]);
+		uv[1] = HalfToFloat(compact.uv[1]);
+		OctahedralDecode(compact.normal, normal);
+	}
+
+	// an asset's geometry in the COMPACT layout
+	struct COMPACT_GEOMETRY {
+		POSITION_BOUNDS bounds;
+		std::vector<COMPACT_VERTEX> vertices;
+		std::vector<unsigned short> shortIndices;	// empty if the asset needs 32 bit indices
+	};
+	inline void Compress(const std::vector<H2B::VERTEX>& vertices, const std::vector<unsigned>& indices, const AABB& bounds,
+		COMPACT_GEOMETRY& out)
+	{
+		out.bounds = QuantizationBounds(bounds);
+		out.vertices.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+			out.vertices[i] = CompressVertex(vertices[i], out.bounds);
+		out.shortIndices.clear();
+		if (vertices.size() <= 65536)
+			out.shortIndices.assign(indices.begin(), indices.end());
+	}
+	inline void Compress(const H2B::Parser& model, const AABB& bounds, COMPACT_GEOMETRY& out)
+	{
+		Compress(model.vertices, model.indices, bounds, out);
+	}
+
+	// angle between two directions, atan2 stays exact for small angles where acos of a float dot product does not
+	inline float AngleDegrees(const float a[3], const float b[3])
+	{
+		float cross[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+		float sine = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+		float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		return std::atan2(sine, cosine) * 57.2957795f;
+	}
+
+	// largest difference between an asset and its COMPACT copy
+	struct VERTEX_ERROR {
+		float position;		// model space units
+		float relative;		// position error / largest bounds extent
+		float normalDegrees;
+		float uv;
+	};
+	inline VERTEX_ERROR MeasureError(const H2B::Parser& model, const COMPACT_GEOMETRY& compact)
+	{
+		VERTEX_ERROR error = {};
+		float extent = 0;
+		for (int i = 0; i < 3; ++i)
+			extent = std::max(extent, compact.bounds.scale[i] * 65535.0f);
+		for (size_t v = 0; v < model.vertices.size() && v < compact.vertices.size(); ++v) {
+			const H2B::VERTEX& vertex = model.vertices[v];
+			float position[3], uv[2], normal[3];
+			DecompressVertex(compact.vertices[v], compact.bounds, position, uv, normal);
+			const float original[3] = { vertex.pos.x, vertex.pos.y, vertex.pos.z };
+			float distance = 0;
+			for (int i = 0; i < 3; ++i)
+				distance += (position[i] - original[i]) * (position[i] - original[i]);
+			error.position = std::max(error.position, std::sqrt(distance));
+			error.uv = std::max({ error.uv, std::fabs(uv[0] - vertex.uvw.x), std::fabs(uv[1] - vertex.uvw.y) });
+			const float originalNormal[3] = { vertex.nrm.x, vertex.nrm.y, vertex.nrm.z };
+			if (originalNormal[0] != 0 || originalNormal[1] != 0 || originalNormal[2] != 0)
+				error.normalDegrees = std::max(error.normalDegrees, AngleDegrees(originalNormal, normal));
+		}
+		error.relative = extent > 0 ? error.position / extent : 0.0f;
+		return error;
+	}
+}
+#endif